@@ -0,0 +1,46 @@
+############################################################################
+# FindZstd.cmake
+# Copyright (C) 2019  Belledonne Communications, Grenoble France
+#
+############################################################################
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+#
+############################################################################
+#
+# Find the zstd compression library
+#
+# This module defines:
+#  ZSTD_FOUND        = true if zstd was found
+#  ZSTD_INCLUDE_DIRS = include dirs to be used when using the zstd library
+#  ZSTD_LIBRARIES    = full path to the zstd library
+
+find_path(ZSTD_INCLUDE_DIRS
+	NAMES zstd.h
+	PATH_SUFFIXES include
+)
+
+find_library(ZSTD_LIBRARIES
+	NAMES zstd zstd_static
+	PATH_SUFFIXES lib
+)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(Zstd
+	DEFAULT_MSG
+	ZSTD_INCLUDE_DIRS ZSTD_LIBRARIES
+)
+
+mark_as_advanced(ZSTD_INCLUDE_DIRS ZSTD_LIBRARIES)
@@ -26,6 +26,7 @@
 #include <functional>
 #include <string>
 #include <mutex>
+#include <type_traits>
 
 namespace lime {
 
@@ -61,6 +62,47 @@ namespace lime {
 			   when returned by a get_peerDeviceStatus: this device is not in localStorage */
 	};
 
+	/** @brief A non owning view on a contiguous sequence of elements, mostly bytes: the subset of C++20 std::span used by lime
+	 *
+	 * It is given a pointer and a size, or any container providing data() and size(). The viewed buffer must outlive the span.
+	 * Use span<const uint8_t> for input buffers and span<uint8_t> for output buffers provided by the caller.
+	 */
+	template <typename T>
+	class span {
+		private:
+			T *m_data;
+			size_t m_size;
+		public:
+			using element_type = T; /**< type of the elements */
+			using value_type = typename std::remove_cv<T>::type; /**< type of the elements, without const */
+			using iterator = T *; /**< a span is iterated with pointers */
+
+			/// an empty span
+			constexpr span() noexcept : m_data{nullptr}, m_size{0} {}
+			/// a view on size elements starting at data
+			constexpr span(T *data, const size_t size) noexcept : m_data{data}, m_size{size} {}
+			/// a view on all the elements of a contiguous container(std::vector, std::array, std::string...)
+			template <typename Container, typename = typename std::enable_if<std::is_convertible<decltype(std::declval<Container &>().data()), T *>::value>::type>
+			constexpr span(Container &container) noexcept : m_data{container.data()}, m_size{container.size()} {}
+			/// a view on all the elements of a const container, only for spans on const elements: as std::span, it can view a temporary given as function argument
+			template <typename Container, typename = typename std::enable_if<std::is_const<T>::value && std::is_convertible<decltype(std::declval<const Container &>().data()), T *>::value>::type>
+			constexpr span(const Container &container) noexcept : m_data{container.data()}, m_size{container.size()} {}
+			/// a span on const elements is built from a span on mutable ones
+			template <typename U, typename = typename std::enable_if<std::is_convertible<U *, T *>::value>::type>
+			constexpr span(const span<U> &other) noexcept : m_data{other.data()}, m_size{other.size()} {}
+
+			constexpr T *data(void) const noexcept {return m_data;} /**< first element */
+			constexpr size_t size(void) const noexcept {return m_size;} /**< elements count */
+			constexpr bool empty(void) const noexcept {return m_size == 0;} /**< true if the span holds no element */
+			constexpr iterator begin(void) const noexcept {return m_data;} /**< iterator on the first element */
+			constexpr iterator end(void) const noexcept {return m_data + m_size;} /**< iterator past the last element */
+			constexpr T &operator[](const size_t index) const noexcept {return m_data[index];} /**< element at index, no bound check */
+			/// view on count elements starting at offset, no bound check
+			constexpr span<T> subspan(const size_t offset, const size_t count) const noexcept {return span<T>{m_data + offset, count};}
+			/// view on the elements starting at offset, no bound check
+			constexpr span<T> subspan(const size_t offset) const noexcept {return span<T>{m_data + offset, m_size - offset};}
+	};
+
 	/** @brief The encrypt function input/output data structure
 	 *
 	 * give a recipient GRUU and get it back with the header which must be sent to recipient with the cipher text
@@ -81,6 +123,57 @@ namespace lime {
 		RecipientData(const std::string &deviceId) : deviceId{deviceId}, peerStatus{lime::PeerDeviceStatus::unknown}, DRmessage{} {};
 	};
 
+	/** @brief Encryption or decryption by chunks of a cipherMessage too large to be held in memory
+	 *
+	 * Given by LimeManager::encrypt_stream and LimeManager::decrypt_stream. The message is given to update in pieces of any size,
+	 * the output available so far is appended to the given buffer so the memory used does not depend on the message size.
+	 * Once all the message is given, finish flushes the last part of the output.
+	 *
+	 * When decrypting, each chunk is authenticated before its plaintext is given away but the message may still be truncated until finish succeeds:
+	 * the output shall not be considered complete before that.
+	 */
+	class CipherStream {
+		public:
+			/**
+			 * @brief Process the next part of the message
+			 *
+			 * @param[in]	input		the next part of the message to encrypt or decrypt
+			 * @param[in]	inputSize	size of the input, any size is accepted
+			 * @param[out]	output		the output produced so far is appended to this buffer
+			 *
+			 * @return false if a chunk failed authentication or the stream is already finished, the stream is then unusable
+			 */
+			virtual bool update(const uint8_t *input, const size_t inputSize, std::vector<uint8_t> &output) = 0;
+			/**
+			 * @brief Process the end of the message, no more input is accepted afterward
+			 *
+			 * @param[out]	output		the last part of the output is appended to this buffer
+			 *
+			 * @return false if the last chunk failed authentication (the message was truncated or modified) or the stream is already finished
+			 */
+			virtual bool finish(std::vector<uint8_t> &output) = 0;
+			virtual ~CipherStream() = default;
+	};
+
+	/** Implementations of the crypto primitives(random number generator, key exchange, signature, HMAC-SHA512 and AES256-GCM) */
+	enum class CryptoBackend : uint8_t {
+		bctoolbox=0x01, /**< bctoolbox, always available */
+		openssl=0x02 /**< OpenSSL libcrypto, available when lime is built with ENABLE_OPENSSL_BACKEND */
+	};
+
+	/** Authenticated encryption scheme used to encrypt the messages, the values assigned are used in localStorage so do not modify them */
+	enum class AEADAlgorithm : uint8_t {
+		aes256gcm=0x00, /**< AES256-GCM, the default one and the only one understood by lime versions not aware of this setting */
+		chacha20poly1305=0x01 /**< ChaCha20-Poly1305 (RFC 8439), faster than AES256-GCM on CPU without AES instructions */
+	};
+
+	/** Compression applied to the payload before its encryption, the values assigned are used in the messages so do not modify them */
+	enum class CompressionAlgorithm : uint8_t {
+		none=0x00, /**< payloads are not compressed, the default */
+		zlib=0x01, /**< zlib deflate, available when lime is built with ENABLE_ZLIB_COMPRESSION */
+		zstd=0x02 /**< Zstandard, available when lime is built with ENABLE_ZSTD_COMPRESSION */
+	};
+
 	/** what a Lime callback could possibly say */
 	enum class CallbackReturn : uint8_t {
 		success, /**< operation completed successfully */
@@ -95,6 +188,16 @@ namespace lime {
 	 */
 	using limeCallback = std::function<void(const lime::CallbackReturn status, const std::string message)>;
 
+	/** @brief Callback used to stream the encryption output
+	 *
+	 *	When given to encrypt, it is called once for each recipient as soon as its Double Ratchet message is produced and the matching session saved in local storage,
+	 *	the recipients with a ready session are given away before the key bundles of the others are requested to the X3DH server.
+	 *	The cipherMessage (if any) is always complete before the first call.
+	 *	It is called without holding the Lime internal lock but from within the encrypt processing: it shall not keep the given reference, copy or move what it needs.
+	 *  @param[in]	recipient	the recipient data: device Id, peer device status and the Double Ratchet message to route to this device
+	 */
+	using limeRecipientCallback = std::function<void(const lime::RecipientData &recipient)>;
+
 	/* X3DH server communication : these functions prototypes are used to post data and get response from/to the X3DH server */
 	/**
 	 * @brief Get the response from server. The external service providing secure communication to the X3DH server shall forward to lime library the server's response
@@ -219,6 +322,76 @@ namespace lime {
 			 * 						default is optimized upload size mode.
 			 */
 			void encrypt(const std::string &localDeviceId, std::shared_ptr<const std::string> recipientUserId, std::shared_ptr<std::vector<RecipientData>> recipients, std::shared_ptr<const std::vector<uint8_t>> plainMessage, std::shared_ptr<std::vector<uint8_t>> cipherMessage, const limeCallback &callback, lime::EncryptionPolicy encryptionPolicy=lime::EncryptionPolicy::optimizeUploadSize);
+			/**
+			 * @brief Encrypt a buffer (text or file) for a given list of recipient devices, streaming the result for each recipient as soon as it is ready
+			 *
+			 * Same as the other encrypt form but each recipient Double Ratchet message is given to the recipientCallback as soon as it is produced
+			 * so the caller can start routing them before the encryption to the whole recipient list is completed.
+			 * Recipients for which the encryption failed (no key bundle on the X3DH server) are not given to the recipientCallback.
+			 * When all recipients are processed, the recipients vector holds the complete output as with the other encrypt form and the callback is called.
+			 *
+			 * When some recipients need a key bundle from the X3DH server, the encryption progresses in two phases sharing the same cipherMessage:
+			 * the recipients with a ready session are encrypted and given to the recipientCallback right away, the others are when their key bundles arrive.
+			 * The cipherMessage is thus complete before the first recipientCallback call and is not modified afterward.
+			 * If the key bundles fetch fails, the callback reports a failure but the recipients already given away are valid and their DR messages can be routed.
+			 *
+			 * @param[in]		localDeviceId		used to identify which local acount to use and also as the identified source of the message, shall be the GRUU
+			 * @param[in]		recipientUserId		the Id of intended recipient, shall be a sip:uri of user or conference, is used as associated data to ensure no-one can mess with intended recipient
+			 * @param[in,out]	recipients		a list of RecipientData, see the other form of encrypt for details
+			 * @param[in]		plainMessage		a buffer holding the message to encrypt, can be text or data.
+			 * @param[out]		cipherMessage		points to the buffer to store the encrypted message which must be routed to all recipients(if one is produced, depends on encryption policy)
+			 * @param[in]		recipientCallback	called for each recipient as soon as its Double Ratchet message is ready, see ::limeRecipientCallback
+			 * @param[in]		callback		called once the encryption to all recipients is completed, giving the exit status and an error message in case of failure.
+			 * @param[in]		encryptionPolicy	select how to manage the encryption: direct use of Double Ratchet message or encrypt in the cipher message and use the DR message to share the cipher message key
+			 * 						default is optimized upload size mode.
+			 */
+			void encrypt(const std::string &localDeviceId, std::shared_ptr<const std::string> recipientUserId, std::shared_ptr<std::vector<RecipientData>> recipients, std::shared_ptr<const std::vector<uint8_t>> plainMessage, std::shared_ptr<std::vector<uint8_t>> cipherMessage, const limeRecipientCallback &recipientCallback, const limeCallback &callback, lime::EncryptionPolicy encryptionPolicy=lime::EncryptionPolicy::optimizeUploadSize);
+			/**
+			 * @brief Encrypt a buffer (text or file) for a given list of recipient devices, borrowing the caller buffers
+			 *
+			 * Same as the first encrypt form but the parameters are not shared pointers: no buffer is allocated or copied to hold them
+			 * while the encryption is processed, they are accessed in place and the cipherMessage is written in the caller buffer.
+			 * The caller guarantees they stay valid and are not modified until the callback is called, which may be after this function
+			 * returns when a key bundle is fetched from the X3DH server.
+			 *
+			 * The cipherMessage buffer must be at least cipherMessageMaximumSize(plainMessage.size()) bytes long as the encryption mode is selected
+			 * during the encryption. When it is not, the callback is called with a failure right away and cipherMessageSize is set to the size needed.
+			 *
+			 * @param[in]		localDeviceId	used to identify which local acount to use and also as the identified source of the message, shall be the GRUU
+			 * @param[in]		recipientUserId	the Id of intended recipient, see the first encrypt form
+			 * @param[in,out]	recipients	view on the caller list of RecipientData, see the first encrypt form
+			 * @param[in]		plainMessage	view on the caller buffer holding the message to encrypt, can be text or data.
+			 * @param[out]		cipherMessage	the caller buffer to store the encrypted message which must be routed to all recipients(if one is produced, depends on encryption policy)
+			 * @param[out]		cipherMessageSize	the size of the cipherMessage written in the caller buffer, 0 when none is produced. Set before the callback is called
+			 * @param[in]		callback	called once the encryption to all recipients is completed, giving the exit status and an error message in case of failure.
+			 * @param[in]		encryptionPolicy	select how to manage the encryption, see the first encrypt form
+			 */
+			void encrypt(const std::string &localDeviceId, const std::string &recipientUserId, lime::span<RecipientData> recipients, lime::span<const uint8_t> plainMessage, lime::span<uint8_t> cipherMessage, size_t &cipherMessageSize, const limeCallback &callback, lime::EncryptionPolicy encryptionPolicy=lime::EncryptionPolicy::optimizeUploadSize);
+			/**
+			 * @brief Encrypt a buffer (text or file) for a given list of recipient devices, borrowing the caller buffers and streaming the output per recipient
+			 *
+			 * Same as the previous form, the recipientCallback is called for each recipient as soon as its Double Ratchet message is ready
+			 * as described in the shared pointer form taking a recipientCallback.
+			 *
+			 * @param[in]		localDeviceId	used to identify which local acount to use and also as the identified source of the message, shall be the GRUU
+			 * @param[in]		recipientUserId	the Id of intended recipient, see the first encrypt form
+			 * @param[in,out]	recipients	view on the caller list of RecipientData, see the first encrypt form
+			 * @param[in]		plainMessage	view on the caller buffer holding the message to encrypt, can be text or data.
+			 * @param[out]		cipherMessage	the caller buffer to store the encrypted message, see the previous form
+			 * @param[out]		cipherMessageSize	the size of the cipherMessage written in the caller buffer, set before the first recipientCallback call
+			 * @param[in]		recipientCallback	called for each recipient as soon as its Double Ratchet message is ready, see ::limeRecipientCallback
+			 * @param[in]		callback	called once the encryption to all recipients is completed, giving the exit status and an error message in case of failure.
+			 * @param[in]		encryptionPolicy	select how to manage the encryption, see the first encrypt form
+			 */
+			void encrypt(const std::string &localDeviceId, const std::string &recipientUserId, lime::span<RecipientData> recipients, lime::span<const uint8_t> plainMessage, lime::span<uint8_t> cipherMessage, size_t &cipherMessageSize, const limeRecipientCallback &recipientCallback, const limeCallback &callback, lime::EncryptionPolicy encryptionPolicy=lime::EncryptionPolicy::optimizeUploadSize);
+			/**
+			 * @brief Compute the size of the cipherMessage buffer given to encrypt
+			 *
+			 * @param[in]	plainMessageSize	size of the plain message to be encrypted
+			 *
+			 * @return the size of the largest cipherMessage produced by the encryption of a plain message of this size
+			 */
+			static size_t cipherMessageMaximumSize(const size_t plainMessageSize) noexcept;
 
 			/**
 			 * @brief Decrypt the given message
@@ -241,6 +414,60 @@ namespace lime {
 			 * convenience form to be called when no cipher message is received
 			 */
 			lime::PeerDeviceStatus decrypt(const std::string &localDeviceId, const std::string &recipientUserId, const std::string &senderDeviceId, const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &plainMessage);
+			/**
+			 * @brief Decrypt the given message in a buffer provided by the caller
+			 *
+			 * Same as the other decrypt forms but the input messages are views on the caller buffers and the plaintext is written in
+			 * the caller buffer: a buffer kept from one message to the next spares the allocation of the output.
+			 * A plainMessage buffer the size of the cipherMessage, or of the DRmessage when there is no cipherMessage, is large enough unless
+			 * the sender compressed the payload. When the plaintext does not fit, fail is returned and plainMessageSize is set to the size needed:
+			 * this is checked before the message key is consumed so the message can be decrypted again with a large enough buffer.
+			 *
+			 * @param[in]		localDeviceId	used to identify which local acount to use and also as the recipient device ID of the message, shall be the GRUU
+			 * @param[in]		recipientUserId	the Id of intended recipient, see decrypt
+			 * @param[in]		senderDeviceId	Identify sender Device, see decrypt
+			 * @param[in]		DRmessage	Double Ratchet message targeted to current device
+			 * @param[in]		cipherMessage	when present (depends on encryption policy) holds a common part of the encrypted message, empty otherwise
+			 * @param[out]		plainMessage	the output buffer
+			 * @param[out]		plainMessageSize	the size of the plaintext written in plainMessage
+			 *
+			 * @return	fail if we cannot decrypt the message, the sender device status otherwise, see decrypt
+			 */
+			lime::PeerDeviceStatus decrypt(const std::string &localDeviceId, const std::string &recipientUserId, const std::string &senderDeviceId, lime::span<const uint8_t> DRmessage, lime::span<const uint8_t> cipherMessage, lime::span<uint8_t> plainMessage, size_t &plainMessageSize);
+
+			/**
+			 * @brief Encrypt by chunks a message (large file) too large to be held in memory for a given list of recipient devices
+			 *
+			 * if specified localDeviceId is not found in local Storage, throw an exception
+			 *
+			 * The payload is always in the cipherMessage, produced by the returned stream: the message is given to it in pieces and the cipherMessage
+			 * comes out the same way so the memory used does not depend on the message size. The cipherMessage does not depend on the encryption
+			 * to the recipients, it can be produced and uploaded while the DR messages are not ready yet.
+			 * The DR messages holding the cipherMessage key are produced as in encrypt, see it for details on recipients and callback.
+			 *
+			 * @param[in]		localDeviceId	used to identify which local acount to use and also as the identified source of the message, shall be the GRUU
+			 * @param[in]		recipientUserId	the Id of intended recipient, shall be a sip:uri of user or conference, is used as associated data to ensure no-one can mess with intended recipient
+			 * @param[in,out]	recipients	a list of RecipientData, see encrypt
+			 * @param[in]		callback	called once the DR messages of all recipients are produced, giving the exit status and an error message in case of failure.
+			 *
+			 * @return the stream producing the cipherMessage, its finish shall be called once all the message is given to it
+			 */
+			std::shared_ptr<lime::CipherStream> encrypt_stream(const std::string &localDeviceId, std::shared_ptr<const std::string> recipientUserId, std::shared_ptr<std::vector<RecipientData>> recipients, const limeCallback &callback);
+
+			/**
+			 * @brief Decrypt the Double Ratchet message of a message encrypted by encrypt_stream
+			 *
+			 * if specified localDeviceId is not found in local Storage, throw an exception
+			 *
+			 * @param[in]		localDeviceId	used to identify which local acount to use and also as the recipient device ID of the message, shall be the GRUU
+			 * @param[in]		recipientUserId	the Id of intended recipient, see decrypt
+			 * @param[in]		senderDeviceId	Identify sender Device, see decrypt
+			 * @param[in]		DRmessage	Double Ratchet message targeted to current device
+			 * @param[out]		cipherStream	on success, the stream decrypting the cipherMessage: give it the cipherMessage in pieces, the plaintext comes out the same way
+			 *
+			 * @return	fail if we cannot decrypt the DR message, otherwise the sender device status as in decrypt
+			 */
+			lime::PeerDeviceStatus decrypt_stream(const std::string &localDeviceId, const std::string &recipientUserId, const std::string &senderDeviceId, const std::vector<uint8_t> &DRmessage, std::shared_ptr<lime::CipherStream> &cipherStream);
 
 			/**
 			 * @brief Update: shall be called regularly, once a day at least, performs checks, updates and cleaning operations
@@ -248,7 +475,8 @@ namespace lime {
 			 * this interval is over, it just does nothing.
 			 *
 			 *  - check if we shall update a new SPk to X3DH server(SPk lifetime is set in lime::settings)
-			 *  - check if we need to upload OPks to X3DH server
+			 *  - check if we need to upload OPks to X3DH server. When the observed OPk consumption exceeds OPkServerLowLimit per update period,
+			 *    the limit and the batch size are raised to match it and the server is checked again as soon as the local OPk count estimation falls under it
 			 *  - remove old SPks, clean double ratchet sessions (remove staled, clean their stored keys for skipped messages)
 			 *
 			 * @param[in]	localDeviceId		Identify the local user acount to use, it must be unique and is also used as Id on the X3DH key server, it shall be the GRUU
@@ -395,6 +623,33 @@ namespace lime {
 			 */
 			std::string get_x3dhServerUrl(const std::string &localDeviceId);
 
+			/**
+			 * @brief Set the AEAD scheme this identified user requests for the sessions it initiates from now on
+			 *
+			 * The scheme is selected at session creation by the initiator and advertised in the messages header, the peer adopts it
+			 * when it creates its side of the session. Existing sessions keep the scheme they were created with (AES256-GCM for
+			 * sessions created before this setting existed).
+			 * The cipherMessage, shared by all recipients of a message, uses ChaCha20-Poly1305 only when all their sessions do.
+			 * Peers must run a lime version aware of this setting to decrypt messages not using AES256-GCM.
+			 *
+			 * @param[in]	localDeviceId		Identify the local user account, it must be unique and is also be used as Id on the X3DH key server, it shall be the GRUU
+			 * @param[in]	algorithm		The AEAD scheme to use in new sessions
+			 *
+			 * Throw an exception if the user is unknow or inactive
+			 */
+			void set_AEADAlgorithm(const std::string &localDeviceId, const lime::AEADAlgorithm algorithm);
+
+			/**
+			 * @brief Get the AEAD scheme this identified user requests for the sessions it initiates
+			 *
+			 * @param[in]	localDeviceId		Identify the local user account, it must be unique and is also be used as Id on the X3DH key server, it shall be the GRUU
+			 *
+			 * @return The AEAD scheme used in new sessions
+			 *
+			 * Throw an exception if the user is unknow or inactive
+			 */
+			lime::AEADAlgorithm get_AEADAlgorithm(const std::string &localDeviceId);
+
 			LimeManager() = delete; // no manager without Database and http provider
 			LimeManager(const LimeManager&) = delete; // no copy constructor
 			LimeManager operator=(const LimeManager &) = delete; // nor copy operator
@@ -414,5 +669,54 @@ namespace lime {
 
 			~LimeManager() = default;
 	};
+
+	/**
+	 * @brief Select the implementation used by all crypto primitives
+	 *
+	 * When built with several backends, the default one is picked at first use according to the CPU features.
+	 * Select it before any other call to the library: contexts already in use keep their implementation.
+	 *
+	 * @param[in]	backend	the backend to use from now on
+	 *
+	 * @return false if the requested backend is not available in this build, the current one is then kept
+	 */
+	bool set_cryptoBackend(const lime::CryptoBackend backend);
+
+	/**
+	 * @return the backend currently used by the crypto primitives
+	 */
+	lime::CryptoBackend get_cryptoBackend(void);
+
+	/**
+	 * @return all the crypto backends available in this build
+	 */
+	std::vector<lime::CryptoBackend> available_cryptoBackends(void);
+
+	/**
+	 * @brief Select the compression applied to the payloads before their encryption
+	 *
+	 * Payloads of at least settings::payloadCompressionThreshold bytes are compressed when it makes them shorter,
+	 * the Double Ratchet message header advertises it and the recipient decompresses the payload after its decryption.
+	 *
+	 * Compression is negotiated per peer device: each Double Ratchet message advertises the algorithms its sender can decompress
+	 * and a session records what its peer advertised in the last message decrypted with it. A payload is compressed only
+	 * when the sessions of all its recipients advertised the selected algorithm, so devices running an older lime version or
+	 * built without this algorithm, and devices we never got a message from, always get uncompressed payloads.
+	 *
+	 * @param[in]	algorithm	the compression algorithm to use from now on, none to disable compression
+	 *
+	 * @return false if the requested algorithm is not available in this build, the current one is then kept
+	 */
+	bool set_compressionAlgorithm(const lime::CompressionAlgorithm algorithm);
+
+	/**
+	 * @return the compression algorithm currently applied to the payloads
+	 */
+	lime::CompressionAlgorithm get_compressionAlgorithm(void);
+
+	/**
+	 * @return all the compression algorithms available in this build
+	 */
+	std::vector<lime::CompressionAlgorithm> available_compressionAlgorithms(void);
 } //namespace lime
 #endif /* lime_hpp */
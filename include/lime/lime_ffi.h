@@ -294,13 +294,14 @@ int lime_ffi_encrypt(lime_manager_t manager, const char *localDeviceId,
  * @param[in]		DRmessageSize		DRmessage buffer size
  * @param[in]		cipherMessage		when present (depends on encryption policy) holds a common part of the encrypted message. Set to NULL if not present in the incoming message.
  * @param[in]		cipherMessageSize	cipherMessage buffer size(set to 0 if no cipherMessage is present in the incoming message)
- * @param[out]		plainMessage		the output buffer: its size shall be MAX(cipherMessageSize, DRmessageSize)
- * @param[in,out]	plainMessageSize	plainMessage buffer size, updated with the actual size of the data written
- *
- * @warning The plainMessage buffer must be large enough to store the decrypted message or we face the possibility to not ever be able to decrypt the message.(internal successful decryption will remove the ability to decrypt the same message again). To avoid problem the size of the plain message shall be  MAX(cipherMessageSize, DRmessageSize) as:
- * - The decrypted message is the same size of the encrypted one.
- * - The encrypted message(not alone but we can afford the temporary usage of few dozens bytes) is stored either in cipherMessage or DRmessage depends on encrypter's choice
- * - By allocating MAX(cipherMessageSize, DRmessageSize) bytes to the plainMessage buffer we ensure it can hold the decrypted message
+ * @param[out]		plainMessage		the output buffer: its size should be MAX(cipherMessageSize, DRmessageSize)
+ * @param[in,out]	plainMessageSize	plainMessage buffer size, updated with the actual size of the data written.
+ * 						When the buffer is too small, fail is returned and it is updated with the size needed, it is left untouched on other failures.
+ *
+ * @note A plainMessage buffer of MAX(cipherMessageSize, DRmessageSize) bytes holds the decrypted message unless the sender compressed it:
+ * - The decrypted message is not larger than the encrypted one, stored either in cipherMessage or DRmessage depending on encrypter's choice
+ * - A compressed message may be larger once decompressed. Its size is checked before the decryption is committed: when the buffer is too small,
+ *   fail is returned and the message is not consumed, it can be decrypted again with a larger buffer.
  *
  * @return	fail if we cannot decrypt the message, unknown when it is the first message we ever receive from the sender device, untrusted for known but untrusted sender device, or trusted if it is
  */
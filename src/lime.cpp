@@ -23,7 +23,9 @@
 #include "bctoolbox/exception.hh"
 #include "lime_double_ratchet.hpp"
 #include "lime_double_ratchet_protocol.hpp"
+#include "lime_secure_memory.hpp"
 #include <mutex>
+#include <algorithm> // std::remove
 
 using namespace::std;
 
@@ -45,16 +47,21 @@ namespace lime {
 	 * @param[in]		url				URL of the X3DH key server used to publish our keys(retrieved from DB)
 	 * @param[in]		X3DH_post_data			A function used to communicate with the X3DH server
 	 * @param[in]		Uid				the DB internal Id for this user, speed up DB operations by holding it in DB
+	 * @param[in]		AEAD				AEAD scheme used by the sessions initiated by this user(retrieved from DB)
 	 *
 	 */
 	template <typename Curve>
-	Lime<Curve>::Lime(std::shared_ptr<lime::Db> localStorage, const std::string &deviceId, const std::string &url, const limeX3DHServerPostData &X3DH_post_data, const long int Uid)
+	Lime<Curve>::Lime(std::shared_ptr<lime::Db> localStorage, const std::string &deviceId, const std::string &url, const limeX3DHServerPostData &X3DH_post_data, const long int Uid, const lime::AEADAlgorithm AEAD)
 	: m_RNG{make_RNG()}, m_selfDeviceId{deviceId},
-	m_Ik{}, m_Ik_loaded(false),
+	m_Ik{}, m_Ik_X{}, m_Ik_loaded(false),
 	m_localStorage(localStorage), m_db_Uid{Uid},
-	m_X3DH_post_data{X3DH_post_data}, m_X3DH_Server_URL{url},
-	m_DR_sessions_cache{}, m_ongoing_encryption{nullptr}, m_encryption_queue{}
-	{ }
+	m_X3DH_post_data{X3DH_post_data}, m_X3DH_Server_URL{url}, m_AEAD{AEAD},
+	m_DR_sessions_cache{}, m_noBundle_cache{}, m_renewal_requested{}, m_peerIk_X_cache{},
+	m_OPk_consumption{}, m_OPk_serverCount{0}, m_OPk_serverCount_known{false}, m_OPk_lastCheck{}, m_OPk_serverLowLimit{0}, m_OPk_batchSize{0},
+	m_ongoing_encryption{nullptr}, m_encryption_queue{}
+	{
+		noBundle_cache_load();
+	}
 
 
 	/**
@@ -71,10 +78,12 @@ namespace lime {
 	template <typename Curve>
 	Lime<Curve>::Lime(std::shared_ptr<lime::Db> localStorage, const std::string &deviceId, const std::string &url, const limeX3DHServerPostData &X3DH_post_data)
 	: m_RNG{make_RNG()}, m_selfDeviceId{deviceId},
-	m_Ik{}, m_Ik_loaded(false),
+	m_Ik{}, m_Ik_X{}, m_Ik_loaded(false),
 	m_localStorage(localStorage), m_db_Uid{0},
-	m_X3DH_post_data{X3DH_post_data}, m_X3DH_Server_URL{url},
-	m_DR_sessions_cache{}, m_ongoing_encryption{nullptr}, m_encryption_queue{}
+	m_X3DH_post_data{X3DH_post_data}, m_X3DH_Server_URL{url}, m_AEAD{lime::AEADAlgorithm::aes256gcm},
+	m_DR_sessions_cache{}, m_noBundle_cache{}, m_renewal_requested{}, m_peerIk_X_cache{},
+	m_OPk_consumption{}, m_OPk_serverCount{0}, m_OPk_serverCount_known{false}, m_OPk_lastCheck{}, m_OPk_serverLowLimit{0}, m_OPk_batchSize{0},
+	m_ongoing_encryption{nullptr}, m_encryption_queue{}
 	{
 		create_user();
 	}
@@ -124,6 +133,9 @@ namespace lime {
 	template <typename Curve>
 	void Lime<Curve>::delete_peerDevice(const std::string &peerDeviceId) {
 		m_DR_sessions_cache.erase(peerDeviceId); // remove session from cache if any
+		noBundle_cache_erase(peerDeviceId); // and forget it had no key bundle
+		m_renewal_requested.erase(peerDeviceId);
+		m_peerIk_X_cache.clear(); // the cache is indexed by local storage Id we do not have here, the peer device Id may be reused for an other device
 	}
 
 	template <typename Curve>
@@ -151,6 +163,10 @@ namespace lime {
 		// OPk server low limit cannot be zero, it must be at least one as we test the userData on this to check the server request was a getSelfOPks
 		// and republish the user if not found
 		auto userData = make_shared<callbackUserData<Curve>>(this->shared_from_this(), callback, std::max(OPkServerLowLimit,static_cast<uint16_t>(1)), OPkBatchSize);
+		// keep the parameters so the check can be anticipated if the OPk consumption outpaces the periodic update
+		m_OPk_serverLowLimit = OPkServerLowLimit;
+		m_OPk_batchSize = OPkBatchSize;
+		m_OPk_lastCheck = std::chrono::steady_clock::now();
 		std::vector<uint8_t> X3DHmessage{};
 		x3dh_protocol::buildMessage_getSelfOPks<Curve>(X3DHmessage);
 		postToX3DHServer(userData, X3DHmessage); // in the response from server, if more OPks are needed, it will generate and post them before calling the callback
@@ -164,20 +180,61 @@ namespace lime {
 	}
 
 	template <typename Curve>
-	void Lime<Curve>::encrypt(std::shared_ptr<const std::string> recipientUserId, std::shared_ptr<std::vector<RecipientData>> recipients, std::shared_ptr<const std::vector<uint8_t>> plainMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<std::vector<uint8_t>> cipherMessage, const limeCallback &callback) {
+	void Lime<Curve>::encrypt(std::shared_ptr<const std::string> recipientUserId, std::shared_ptr<std::vector<RecipientData>> recipients, std::shared_ptr<const std::vector<uint8_t>> plainMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<std::vector<uint8_t>> cipherMessage, const limeCallback &callback, const limeRecipientCallback &recipientCallback) {
 		LIME_LOGI<<"encrypt from "<<m_selfDeviceId<<" to "<<recipients->size()<<" recipients";
+		// create a new callbackUserData, store in all shared_ptr to input/output values needed to process this encryption, it may be queued or wait for the X3DH server response
+		auto userData = make_shared<callbackUserData<Curve>>(this->shared_from_this(), callback, recipientUserId, recipients, plainMessage, cipherMessage, encryptionPolicy, recipientCallback);
+		process_encrypt(userData);
+	}
+
+	template <typename Curve>
+	void Lime<Curve>::encrypt(const std::string &recipientUserId, lime::span<RecipientData> recipients, lime::span<const uint8_t> plainMessage, const lime::EncryptionPolicy encryptionPolicy, lime::span<uint8_t> cipherMessage, size_t &cipherMessageSize, const limeCallback &callback, const limeRecipientCallback &recipientCallback) {
+		LIME_LOGI<<"encrypt from "<<m_selfDeviceId<<" to "<<recipients.size()<<" recipients";
+		// the encryption mode is known only once the sessions are loaded: the caller buffer must fit the largest cipherMessage
+		cipherMessageSize = LimeManager::cipherMessageMaximumSize(plainMessage.size());
+		if (cipherMessage.size() < cipherMessageSize) {
+			if (callback) callback(lime::CallbackReturn::fail, std::string("cipherMessage buffer is too small, ").append(std::to_string(cipherMessageSize)).append(" bytes are needed"));
+			return;
+		}
+		cipherMessageSize = 0;
+		// the request only holds views on the caller buffers, the caller keeps them alive until the callback is called
+		auto userData = make_shared<callbackUserData<Curve>>(this->shared_from_this(), callback, recipientUserId, recipients, plainMessage, cipherMessage, cipherMessageSize, encryptionPolicy, recipientCallback);
+		process_encrypt(userData);
+	}
+
+	/**
+	 * @brief Process an encryption request
+	 *
+	 * If all the recipients have an active DR session, encrypt and call the callback.
+	 * Otherwise fetch the missing key bundles from the X3DH server(or queue the request if a fetch is already ongoing),
+	 * the request is processed again when the bundles arrive.
+	 *
+	 * When a recipient callback is given, the recipients with a ready session are encrypted and given away right away,
+	 * the others are encrypted when their bundles arrive, both passes producing DR messages matching the same cipherMessage.
+	 * The recipient callback is called for the recipients encrypted by a pass once the mutex is released, as the final callback.
+	 *
+	 * @param[in,out]	userData	the encryption request: parameters given to encrypt and state of the partial encryption if any
+	 */
+	template <typename Curve>
+	void Lime<Curve>::process_encrypt(std::shared_ptr<callbackUserData<Curve>> userData) {
+		auto &recipients = userData->recipients;
 		/* Check if we have all the Double Ratchet sessions ready or shall we go for an X3DH */
 
 		/* Create the appropriate recipient infos and fill it with sessions found in cache */
-		// internal_recipients is a vector duplicating the recipients one in the same order (ignoring the one with peerStatus set to fail)
+		// internal_recipients is a vector duplicating the recipients one in the same order (ignoring the one with peerStatus set to fail or already encrypted)
 		// This allows fast copying of relevant information back to recipients when encryption is completed
 		std::vector<RecipientInfos<Curve>> internal_recipients{};
 
+		// index in recipients of the ones encrypted by this pass, given to the recipientCallback once the mutex is released
+		std::vector<size_t> streamed_recipients{};
+
 		std::unique_lock<std::mutex> lock(m_mutex);
-		for (const auto &recipient : *recipients) {
+		for (size_t j=0; j<recipients.size(); j++) {
+			const auto &recipient = recipients[j];
 			// if the input recipient peerStatus is fail we must ignore it
 			// most likely: we're in a call after a key bundle fetch and this peer device does not have keys on the X3DH server
-			if (recipient.peerStatus != lime::PeerDeviceStatus::fail) {
+			// ignore also the one encrypted by a previous pass of this request
+			if (recipient.peerStatus != lime::PeerDeviceStatus::fail && !userData->encryptedRecipients[j]) {
 				auto sessionElem = m_DR_sessions_cache.find(recipient.deviceId);
 				if (sessionElem != m_DR_sessions_cache.end()) { // session is in cache
 					if (sessionElem->second->isActive()) { // the session in cache is active
@@ -196,58 +253,193 @@ namespace lime {
 		std::vector<std::string> missing_devices{};
 		cache_DR_sessions(internal_recipients, missing_devices);
 
+		/* Do not ask the X3DH server again for devices it recently had no key bundle for: fail them right now */
+		if (missing_devices.size()>0 && !m_noBundle_cache.empty()) {
+			std::vector<RecipientInfos<Curve>> kept_recipients{};
+			kept_recipients.reserve(internal_recipients.size());
+			size_t i=0;
+			for (size_t j=0; j<recipients.size(); j++) {
+				auto &recipient = recipients[j];
+				if (recipient.peerStatus != lime::PeerDeviceStatus::fail && !userData->encryptedRecipients[j]) {
+					if (internal_recipients[i].DRSession == nullptr && noBundle_cache_find(recipient.deviceId)) {
+						LIME_LOGI<<"Skip key bundle request for "<<recipient.deviceId<<" : X3DH server recently had none";
+						recipient.peerStatus = lime::PeerDeviceStatus::fail; // it is then ignored as internal_recipients won't hold it anymore
+						missing_devices.erase(std::remove(missing_devices.begin(), missing_devices.end(), recipient.deviceId), missing_devices.end());
+					} else {
+						kept_recipients.push_back(std::move(internal_recipients[i]));
+					}
+					i++;
+				}
+			}
+			internal_recipients = std::move(kept_recipients);
+		}
+
 		/* If we are still missing session we must ask the X3DH server for key bundles */
 		if (missing_devices.size()>0) {
-			// create a new callbackUserData, it shall be then deleted in callback, store in all shared_ptr to input/output values needed to call this encrypt function
-			auto userData = make_shared<callbackUserData<Curve>>(this->shared_from_this(), callback, recipientUserId, recipients, plainMessage, cipherMessage, encryptionPolicy);
-			if (m_ongoing_encryption == nullptr) { // no ongoing asynchronous encryption process it
-				m_ongoing_encryption = userData;
-			} else { // some one else is expecting X3DH server response, enqueue this request
+			if (m_ongoing_encryption != nullptr) { // some one else is expecting X3DH server response, enqueue this request
 				m_encryption_queue.push(userData);
 				return;
 			}
+
+			// partial progress: do not make the recipients with a ready session wait for the others key bundles
+			// only when the request is not already split, otherwise we would encrypt again to the same recipients
+			if (userData->recipientCallback && userData->encryptionContext == nullptr && internal_recipients.size() > missing_devices.size()) {
+				// the encryption mode is selected on the complete set of recipients so it is the same for both passes
+				// the missing sessions are about to be created using our AEAD scheme, the cipherMessage uses ChaCha20-Poly1305 only if all sessions do
+				bool chacha = std::all_of(internal_recipients.cbegin(), internal_recipients.cend(), [this](const RecipientInfos<Curve> &recipient) {
+						return (recipient.DRSession == nullptr ? m_AEAD : recipient.DRSession->AEAD()) == lime::AEADAlgorithm::chacha20poly1305;});
+				// the missing sessions peers did not advertise any compression capability yet: the payload is not compressed
+				userData->encryptionContext = std::unique_ptr<EncryptionContext>(new EncryptionContext(internal_recipients.size(), userData->plainMessage, *(userData->recipientUserId), m_selfDeviceId, userData->cipherMessage, userData->encryptionPolicy, chacha?lime::AEADAlgorithm::chacha20poly1305:lime::AEADAlgorithm::aes256gcm, recipientsCompressionAlgorithm(internal_recipients)));
+
+				std::vector<RecipientInfos<Curve>> ready_recipients{};
+				size_t i=0;
+				for (size_t j=0; j<recipients.size(); j++) {
+					if (recipients[j].peerStatus != lime::PeerDeviceStatus::fail && !userData->encryptedRecipients[j]) {
+						if (internal_recipients[i].DRSession != nullptr) {
+							ready_recipients.emplace_back(internal_recipients[i].deviceId, internal_recipients[i].DRSession);
+							ready_recipients.back().peerStatus = internal_recipients[i].peerStatus;
+							streamed_recipients.push_back(j);
+						}
+						i++;
+					}
+				}
+
+				encryptMessage(*(userData->encryptionContext), ready_recipients, userData->plainMessage, m_localStorage, nullptr);
+
+				for (i=0; i<ready_recipients.size(); i++) {
+					auto &recipient = recipients[streamed_recipients[i]];
+					recipient.DRmessage = std::move(ready_recipients[i].DRmessage);
+					recipient.peerStatus = ready_recipients[i].peerStatus;
+					userData->encryptedRecipients[streamed_recipients[i]] = true;
+				}
+			}
+
+			// no ongoing asynchronous encryption process it
+			m_ongoing_encryption = userData;
 			// retrieve bundles from X3DH server, when they arrive, it will run the X3DH initiation and create the DR sessions
 			std::vector<uint8_t> X3DHmessage{};
 			x3dh_protocol::buildMessage_getPeerBundles<Curve>(X3DHmessage, missing_devices);
 			lock.unlock(); // unlock before calling external callbacks
+			for (const auto j : streamed_recipients) userData->recipientCallback(recipients[j]);
 			postToX3DHServer(userData, X3DHmessage);
 			return;
 		}
 
-		// We have everyone: encrypt
-		encryptMessage(internal_recipients, *plainMessage, *recipientUserId, m_selfDeviceId, *cipherMessage, encryptionPolicy, m_localStorage);
+		// We have everyone: encrypt, the recipientCallback (if any) is called once the mutex is released
+		if (userData->encryptionContext == nullptr) {
+			encryptMessage(internal_recipients, userData->plainMessage, *(userData->recipientUserId), m_selfDeviceId, userData->cipherMessage, userData->encryptionPolicy, m_localStorage);
+		} else { // second pass of a partial encryption or streamed cipherMessage: use the context already built so the cipherMessage is shared
+			encryptMessage(*(userData->encryptionContext), internal_recipients, userData->plainMessage, m_localStorage, nullptr);
+		}
 
-		// move DR messages to the input/output structure, ignoring again the input with peerStatus set to fail
+		// move DR messages to the input/output structure, ignoring again the input with peerStatus set to fail or encrypted by a previous pass
 		// so the index on the internal_recipients still matches the way we created it from recipients
 		size_t i=0;
 		auto callbackStatus = lime::CallbackReturn::fail;
 		std::string callbackMessage{"All recipients failed to provide a key bundle"};
-		for (auto &recipient : *recipients) {
+		for (size_t j=0; j<recipients.size(); j++) {
+			auto &recipient = recipients[j];
 			if (recipient.peerStatus != lime::PeerDeviceStatus::fail) {
-				recipient.DRmessage = std::move(internal_recipients[i].DRmessage);
-				recipient.peerStatus = internal_recipients[i].peerStatus;
-				i++;
+				if (!userData->encryptedRecipients[j]) {
+					recipient.DRmessage = std::move(internal_recipients[i].DRmessage);
+					recipient.peerStatus = internal_recipients[i].peerStatus;
+					userData->encryptedRecipients[j] = true;
+					if (userData->recipientCallback) streamed_recipients.push_back(j);
+					i++;
+				}
 				callbackStatus = lime::CallbackReturn::success; // we must have at least one recipient with a successful encryption to return success
 				callbackMessage.clear();
 			}
 		}
+		userData->encryptionContext = nullptr; // we're done with it, wipe the random seed now
+
+		// proactive session renewal: fetch in background a key bundle for the peer devices whose sending chain is getting long
+		// the new session is swapped in when it arrives so no encryption waits for the X3DH server when the current one reaches maxSendingChain
+		std::vector<std::string> renewal_devices{};
+		for (const auto &recipient : internal_recipients) {
+			if (recipient.DRSession->needsRenewal() && m_renewal_requested.count(recipient.deviceId) == 0) {
+				m_renewal_requested.insert(recipient.deviceId);
+				renewal_devices.push_back(recipient.deviceId);
+			}
+		}
 
 		lock.unlock(); // unlock before calling external callbacks
-		if (callback) callback(callbackStatus, callbackMessage);
+		for (const auto j : streamed_recipients) userData->recipientCallback(recipients[j]);
+		if (userData->callback) userData->callback(callbackStatus, callbackMessage);
+		if (!renewal_devices.empty()) {
+			LIME_LOGI<<"Renew sessions from "<<m_selfDeviceId<<" to "<<renewal_devices.size()<<" devices";
+			// this request holds no encryption: no callback, the response just swaps the sessions in cache
+			auto renewalUserData = make_shared<callbackUserData<Curve>>(this->shared_from_this(), nullptr);
+			renewalUserData->renewalDevices = renewal_devices; // their renewal flag is cleared when the request ends, whatever its outcome
+			std::vector<uint8_t> X3DHmessage{};
+			x3dh_protocol::buildMessage_getPeerBundles<Curve>(X3DHmessage, renewal_devices);
+			postToX3DHServer(renewalUserData, X3DHmessage);
+		}
 		lock.lock();
 
 		// is there no one in an asynchronous encryption process and do we have something in encryption queue to process
 		if (m_ongoing_encryption == nullptr && !m_encryption_queue.empty()) { // may happend when an encryption was queued but session was created by a previously queued encryption request
-			auto userData = m_encryption_queue.front();
+			auto queuedUserData = m_encryption_queue.front();
 			m_encryption_queue.pop(); // remove it from queue and do it
 			lock.unlock(); // unlock before recursive call
-			encrypt(userData->recipientUserId, userData->recipients, userData->plainMessage, userData->encryptionPolicy, userData->cipherMessage, userData->callback);
+			process_encrypt(queuedUserData);
 		}
 	}
 
 	template <typename Curve>
-	lime::PeerDeviceStatus Lime<Curve>::decrypt(const std::string &recipientUserId, const std::string &senderDeviceId, const std::vector<uint8_t> &DRmessage, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plainMessage) {
-		std::lock_guard<std::mutex> lock(m_mutex);
+	std::shared_ptr<lime::CipherStream> Lime<Curve>::encrypt_stream(std::shared_ptr<const std::string> recipientUserId, std::shared_ptr<std::vector<RecipientData>> recipients, const limeCallback &callback) {
+		LIME_LOGI<<"encrypt stream from "<<m_selfDeviceId<<" to "<<recipients->size()<<" recipients";
+		// the payload is never in the DR messages: no plaintext, no cipherMessage buffer, the encryption policy is not used
+		auto userData = make_shared<callbackUserData<Curve>>(this->shared_from_this(), callback, recipientUserId, recipients, nullptr, nullptr, lime::EncryptionPolicy::cipherMessage, nullptr);
+		// recipients unable to use our AEAD scheme cannot decrypt a stream either: use it for the cipherMessage whatever their sessions use
+		userData->encryptionContext = std::unique_ptr<EncryptionContext>(new EncryptionContext(*recipientUserId, m_selfDeviceId, m_AEAD));
+		auto cipherStream = make_shared<CipherMessageStream>(userData->encryptionContext->randomSeed, m_selfDeviceId, *recipientUserId, m_AEAD, true);
+		process_encrypt(userData);
+		return cipherStream;
+	}
+
+	template <typename Curve>
+	lime::PeerDeviceStatus Lime<Curve>::decrypt(const std::string &recipientUserId, const std::string &senderDeviceId, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, std::vector<uint8_t> &plainMessage) {
+		return process_decrypt(recipientUserId, senderDeviceId, DRmessage, [&](std::vector<std::shared_ptr<DR<Curve>>> &DRSessions, bool &) {
+			return decryptMessage<Curve>(senderDeviceId, m_selfDeviceId, recipientUserId, DRSessions, DRmessage, cipherMessage, plainMessage);
+		});
+	}
+
+	template <typename Curve>
+	lime::PeerDeviceStatus Lime<Curve>::decrypt(const std::string &recipientUserId, const std::string &senderDeviceId, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, lime::span<uint8_t> plainMessage, size_t &plainMessageSize) {
+		plainMessageSize = 0;
+		return process_decrypt(recipientUserId, senderDeviceId, DRmessage, [&](std::vector<std::shared_ptr<DR<Curve>>> &DRSessions, bool &rejected) {
+			auto DRSession = decryptMessage<Curve>(senderDeviceId, m_selfDeviceId, recipientUserId, DRSessions, DRmessage, cipherMessage, plainMessage, plainMessageSize);
+			rejected = (plainMessageSize > plainMessage.size()); // a session deciphered it but the caller buffer cannot take it, no need to try the others
+			return DRSession;
+		});
+	}
+
+	template <typename Curve>
+	lime::PeerDeviceStatus Lime<Curve>::decrypt_stream(const std::string &recipientUserId, const std::string &senderDeviceId, const lime::span<const uint8_t> DRmessage, std::shared_ptr<lime::CipherStream> &cipherStream) {
+		std::shared_ptr<CipherMessageStream> stream{nullptr};
+		auto status = process_decrypt(recipientUserId, senderDeviceId, DRmessage, [&](std::vector<std::shared_ptr<DR<Curve>>> &DRSessions, bool &) {
+			return decryptMessage<Curve>(senderDeviceId, m_selfDeviceId, recipientUserId, DRSessions, DRmessage, stream);
+		});
+		cipherStream = std::move(stream);
+		return status;
+	}
+
+	/**
+	 * @brief Decrypt a message: try the session in cache, then the ones in local storage and at last create one from the X3DH init message if any
+	 *
+	 * @param[in]	recipientUserId	the Id of intended recipient
+	 * @param[in]	senderDeviceId	the device Id (GRUU) of the message sender
+	 * @param[in]	DRmessage	the Double Ratchet message targeted to current device
+	 * @param[in]	decrypt		performs the decryption with the given sessions, returns the one which succeeded or nullptr.
+	 *				It sets its second argument when a session deciphered the message but it was rejected: no other session is tried
+	 *
+	 * @return	fail if we cannot decrypt the message, the sender device status otherwise
+	 */
+	template <typename Curve>
+	template <typename decryptFunction>
+	lime::PeerDeviceStatus Lime<Curve>::process_decrypt(const std::string &recipientUserId, const std::string &senderDeviceId, const lime::span<const uint8_t> DRmessage, const decryptFunction &decrypt) {
+		std::unique_lock<std::mutex> lock(m_mutex);
 		// before trying to decrypt, we must check if the sender device is known in the local Storage and if we trust it
 		// a successful decryption will insert it in local storage so we must check first if it is there in order to detect new devices
 		// Note: a device could already be trusted in DB even before the first message (if we established trust before sending the first message)
@@ -257,14 +449,17 @@ namespace lime {
 
 		LIME_LOGI<<"decrypt from "<<senderDeviceId<<" to "<<recipientUserId;
 		// do we have any session (loaded or not) matching that senderDeviceId ?
+		bool rejected = false; // a session deciphered the message but it was rejected: stop there, before any attempt to create a session from the X3DH init
 		auto sessionElem = m_DR_sessions_cache.find(senderDeviceId);
 		auto db_sessionIdInCache = 0; // this would be the db_sessionId of the session stored in cache if there is one, no session has the Id 0
 		if (sessionElem != m_DR_sessions_cache.end()) { // session is in cache, it is the active one, just give it a try
 			db_sessionIdInCache = sessionElem->second->dbSessionId();
 			std::vector<std::shared_ptr<DR<Curve>>> cached_DRSessions{1, sessionElem->second}; // copy the session pointer into a vector as the decrypt function ask for it
-			if (decryptMessage<Curve>(senderDeviceId, m_selfDeviceId, recipientUserId, cached_DRSessions, DRmessage, cipherMessage, plainMessage) != nullptr) {
+			if (decrypt(cached_DRSessions, rejected) != nullptr) {
 				// we manage to decrypt the message with the current active session loaded in cache
 				return senderDeviceStatus;
+			} else if (rejected) { // the active session deciphered it but the message was rejected: it is not consumed, keep the session in cache
+				return lime::PeerDeviceStatus::fail;
 			} else { // remove session from cache
 				// session in local storage is not modified, so it's still the active one, it will change status to stale when an other active session will be created
 				m_DR_sessions_cache.erase(sessionElem);
@@ -276,22 +471,28 @@ namespace lime {
 		// load in DRSessions all the session found in cache for this peer device, except the one with id db_sessionIdInCache(is ignored if 0) as we already tried it
 		get_DRSessions(senderDeviceId, db_sessionIdInCache, DRSessions);
 		LIME_LOGI<<"decrypt from "<<senderDeviceId<<" to "<<recipientUserId<<" : found "<<DRSessions.size()<<" sessions in DB";
-		auto usedDRSession = decryptMessage<Curve>(senderDeviceId, m_selfDeviceId, recipientUserId, DRSessions, DRmessage, cipherMessage, plainMessage);
+		auto usedDRSession = decrypt(DRSessions, rejected);
 		if (usedDRSession != nullptr) { // we manage to decrypt with a session
 			m_DR_sessions_cache[senderDeviceId] = std::move(usedDRSession); // store it in cache
 			return senderDeviceStatus;
 		}
+		if (rejected) {
+			LIME_LOGW<<"Fail to decrypt: message from "<<senderDeviceId<<" deciphered but rejected, it is not consumed";
+			return lime::PeerDeviceStatus::fail;
+		}
 
 		// No luck yet, is this message holds a X3DH header - if no we must give up
-		std::vector<uint8_t> X3DH_initMessage{};
+		lime::span<const uint8_t> X3DH_initMessage{}; // points into DRmessage
 		if (!double_ratchet_protocol::parseMessage_get_X3DHinit<Curve>(DRmessage, X3DH_initMessage)) {
 			LIME_LOGE<<"Fail to decrypt: No DR session found and no X3DH init message";
 			return lime::PeerDeviceStatus::fail;
 		}
 
 		// parse the X3DH init message, get keys from localStorage, compute the shared secrets, create DR_Session and return a shared pointer to it
+		uint32_t OPk_id = 0; // our OPk used by the peer to create this session, if any
 		try {
-			std::shared_ptr<DR<Curve>> DRSession{X3DH_init_receiver_session(X3DH_initMessage, senderDeviceId)}; // would just throw an exception in case of failure
+			std::shared_ptr<DR<Curve>> DRSession{X3DH_init_receiver_session(X3DH_initMessage, senderDeviceId, OPk_id)}; // would just throw an exception in case of failure
+			noBundle_cache_erase(senderDeviceId); // this device has keys, whatever the X3DH server said before
 			DRSessions.clear();
 			DRSessions.push_back(DRSession);
 		} catch (BctbxException const &e) {
@@ -299,9 +500,18 @@ namespace lime {
 			return lime::PeerDeviceStatus::fail;
 		}
 
-		if (decryptMessage<Curve>(senderDeviceId, m_selfDeviceId, recipientUserId, DRSessions, DRmessage, cipherMessage, plainMessage) != 0) {
+		if (decrypt(DRSessions, rejected) != 0) {
 			// we manage to decrypt the message with this session, set it in cache
 			m_DR_sessions_cache[senderDeviceId] = std::move(DRSessions.front());
+			// the X3DH init may have consumed one of our OPks: account it in the consumption rate and check in background the server still holds enough of them if we consume faster than expected
+			if (OPk_id != 0) {
+				OPk_consumption_record(OPk_id);
+			}
+			if (OPk_replenishNeeded()) {
+				lock.unlock();
+				LIME_LOGI<<"OPk consumption of user "<<m_selfDeviceId<<" is faster than expected, check OPk count on server";
+				update_OPk(nullptr, m_OPk_serverLowLimit, m_OPk_batchSize);
+			}
 			return senderDeviceStatus;
 		}
 		LIME_LOGE<<"Fail to decrypt: Newly created DR session failed to decrypt the message";
@@ -313,6 +523,11 @@ namespace lime {
 		return m_X3DH_Server_URL;
 	}
 
+	template <typename Curve>
+	lime::AEADAlgorithm Lime<Curve>::get_AEADAlgorithm() {
+		return m_AEAD;
+	}
+
 	/* instantiate Lime for C255 and C448 */
 #ifdef EC25519_ENABLED
 	/* These extern templates are defined in lime_localStorage.cpp */
@@ -323,19 +538,31 @@ namespace lime {
 	extern template void Lime<C255>::X3DH_generate_OPks(std::vector<X<C255, lime::Xtype::publicKey>> &publicOPks, std::vector<uint32_t> &OPk_ids, const uint16_t OPk_number, const bool load);
 	extern template void Lime<C255>::cache_DR_sessions(std::vector<RecipientInfos<C255>> &internal_recipients, std::vector<std::string> &missing_devices);
 	extern template void Lime<C255>::get_DRSessions(const std::string &senderDeviceId, const long int ignoreThisDBSessionId, std::vector<std::shared_ptr<DR<C255>>> &DRSessions);
+	extern template void Lime<C255>::noBundle_cache_load();
+	extern template void Lime<C255>::noBundle_cache_insert(const std::string &peerDeviceId);
+	extern template void Lime<C255>::noBundle_cache_erase(const std::string &peerDeviceId);
+	extern template bool Lime<C255>::noBundle_cache_find(const std::string &peerDeviceId);
 	extern template void Lime<C255>::X3DH_get_SPk(uint32_t SPk_id, Xpair<C255> &SPk);
 	extern template bool Lime<C255>::is_currentSPk_valid(void);
 	extern template void Lime<C255>::X3DH_get_OPk(uint32_t OPk_id, Xpair<C255> &SPk);
 	extern template void Lime<C255>::X3DH_updateOPkStatus(const std::vector<uint32_t> &OPkIds);
+	extern template void Lime<C255>::X3DH_get_activeOPkIds(std::vector<uint32_t> &OPkIds);
 	extern template void Lime<C255>::set_x3dhServerUrl(const std::string &x3dhServerUrl);
+	extern template void Lime<C255>::set_AEADAlgorithm(const lime::AEADAlgorithm algorithm);
 	extern template void Lime<C255>::stale_sessions(const std::string &peerDeviceId);
 	/* These extern templates are defined in lime_x3dh.cpp*/
-	extern template void Lime<C255>::X3DH_init_sender_session(const std::vector<X3DH_peerBundle<C255>> &peerBundle);
-	extern template std::shared_ptr<DR<C255>> Lime<C255>::X3DH_init_receiver_session(const std::vector<uint8_t> X3DH_initMessage, const std::string &peerDeviceId);
+	extern template void Lime<C255>::X3DH_init_sender_session(const std::vector<X3DH_peerBundle<C255>> &peerBundle, const bool renewal);
+	extern template std::shared_ptr<DR<C255>> Lime<C255>::X3DH_init_receiver_session(const lime::span<const uint8_t> X3DH_initMessage, const std::string &peerDeviceId, uint32_t &OPk_id);
+	extern template bool Lime<C255>::peerIk_X_cache_find(const long int peerDid, const DSA<C255, lime::DSAtype::publicKey> &peerIk, X<C255, lime::Xtype::publicKey> &peerIk_X);
+	extern template void Lime<C255>::peerIk_X_cache_insert(const long int peerDid, const DSA<C255, lime::DSAtype::publicKey> &peerIk, const X<C255, lime::Xtype::publicKey> &peerIk_X);
 	/* These extern templates are defined in lime_x3dh_protocol.cpp*/
 	extern template void Lime<C255>::postToX3DHServer(std::shared_ptr<callbackUserData<C255>> userData, const std::vector<uint8_t> &message);
 	extern template void Lime<C255>::process_response(std::shared_ptr<callbackUserData<C255>> userData, int responseCode, const std::vector<uint8_t> &responseBody) noexcept;
 	extern template void Lime<C255>::cleanUserData(std::shared_ptr<callbackUserData<C255>> userData);
+	extern template void Lime<C255>::OPk_consumption_record(const uint32_t OPkId);
+	extern template size_t Lime<C255>::OPk_expectedConsumption(void);
+	extern template uint16_t Lime<C255>::OPk_replenishCount(const size_t serverCount, const uint16_t OPkServerLowLimit, const uint16_t OPkBatchSize);
+	extern template bool Lime<C255>::OPk_replenishNeeded(void);
 
 	template class Lime<C255>;
 #endif
@@ -349,19 +576,31 @@ namespace lime {
 	extern template void Lime<C448>::X3DH_generate_OPks(std::vector<X<C448, lime::Xtype::publicKey>> &publicOPks, std::vector<uint32_t> &OPk_ids, const uint16_t OPk_number, const bool load);
 	extern template void Lime<C448>::cache_DR_sessions(std::vector<RecipientInfos<C448>> &internal_recipients, std::vector<std::string> &missing_devices);
 	extern template void Lime<C448>::get_DRSessions(const std::string &senderDeviceId, const long int ignoreThisDBSessionId, std::vector<std::shared_ptr<DR<C448>>> &DRSessions);
+	extern template void Lime<C448>::noBundle_cache_load();
+	extern template void Lime<C448>::noBundle_cache_insert(const std::string &peerDeviceId);
+	extern template void Lime<C448>::noBundle_cache_erase(const std::string &peerDeviceId);
+	extern template bool Lime<C448>::noBundle_cache_find(const std::string &peerDeviceId);
 	extern template void Lime<C448>::X3DH_get_SPk(uint32_t SPk_id, Xpair<C448> &SPk);
 	extern template bool Lime<C448>::is_currentSPk_valid(void);
 	extern template void Lime<C448>::X3DH_get_OPk(uint32_t OPk_id, Xpair<C448> &SPk);
 	extern template void Lime<C448>::X3DH_updateOPkStatus(const std::vector<uint32_t> &OPkIds);
+	extern template void Lime<C448>::X3DH_get_activeOPkIds(std::vector<uint32_t> &OPkIds);
 	extern template void Lime<C448>::set_x3dhServerUrl(const std::string &x3dhServerUrl);
+	extern template void Lime<C448>::set_AEADAlgorithm(const lime::AEADAlgorithm algorithm);
 	extern template void Lime<C448>::stale_sessions(const std::string &peerDeviceId);
 	/* These extern templates are defined in lime_x3dh.cpp*/
-	extern template void Lime<C448>::X3DH_init_sender_session(const std::vector<X3DH_peerBundle<C448>> &peerBundle);
-	extern template std::shared_ptr<DR<C448>> Lime<C448>::X3DH_init_receiver_session(const std::vector<uint8_t> X3DH_initMessage, const std::string &peerDeviceId);
+	extern template void Lime<C448>::X3DH_init_sender_session(const std::vector<X3DH_peerBundle<C448>> &peerBundle, const bool renewal);
+	extern template std::shared_ptr<DR<C448>> Lime<C448>::X3DH_init_receiver_session(const lime::span<const uint8_t> X3DH_initMessage, const std::string &peerDeviceId, uint32_t &OPk_id);
+	extern template bool Lime<C448>::peerIk_X_cache_find(const long int peerDid, const DSA<C448, lime::DSAtype::publicKey> &peerIk, X<C448, lime::Xtype::publicKey> &peerIk_X);
+	extern template void Lime<C448>::peerIk_X_cache_insert(const long int peerDid, const DSA<C448, lime::DSAtype::publicKey> &peerIk, const X<C448, lime::Xtype::publicKey> &peerIk_X);
 	/* These extern templates are defined in lime_x3dh_protocol.cpp*/
 	extern template void Lime<C448>::postToX3DHServer(std::shared_ptr<callbackUserData<C448>> userData, const std::vector<uint8_t> &message);
 	extern template void Lime<C448>::process_response(std::shared_ptr<callbackUserData<C448>> userData, int responseCode, const std::vector<uint8_t> &responseBody) noexcept;
 	extern template void Lime<C448>::cleanUserData(std::shared_ptr<callbackUserData<C448>> userData);
+	extern template void Lime<C448>::OPk_consumption_record(const uint32_t OPkId);
+	extern template size_t Lime<C448>::OPk_expectedConsumption(void);
+	extern template uint16_t Lime<C448>::OPk_replenishCount(const size_t serverCount, const uint16_t OPkServerLowLimit, const uint16_t OPkBatchSize);
+	extern template bool Lime<C448>::OPk_replenishNeeded(void);
 
 	template class Lime<C448>;
 #endif
@@ -407,7 +646,7 @@ namespace lime {
 #ifdef EC25519_ENABLED
 			{
 				/* constructor will insert user in Db, if already present, raise an exception*/
-				auto lime_ptr = std::make_shared<Lime<C255>>(localStorage, deviceId, url, X3DH_post_data);
+				auto lime_ptr = make_secure_shared<Lime<C255>>(localStorage, deviceId, url, X3DH_post_data);
 				lime_ptr->publish_user(callback, OPkInitialBatchSize);
 				return lime_ptr;
 			}
@@ -417,7 +656,7 @@ namespace lime {
 			case lime::CurveId::c448 :
 #ifdef EC448_ENABLED
 			{
-				auto lime_ptr = std::make_shared<Lime<C448>>(localStorage, deviceId, url, X3DH_post_data);
+				auto lime_ptr = make_secure_shared<Lime<C448>>(localStorage, deviceId, url, X3DH_post_data);
 				lime_ptr->publish_user(callback, OPkInitialBatchSize);
 				return lime_ptr;
 			}
@@ -451,8 +690,9 @@ namespace lime {
 		auto curve = CurveId::unset;
 		long int Uid=0;
 		std::string x3dh_server_url;
+		auto AEAD = lime::AEADAlgorithm::aes256gcm;
 
-		localStorage->load_LimeUser(deviceId, Uid, curve, x3dh_server_url, allStatus); // this one will throw an exception if user is not found, just let it rise
+		localStorage->load_LimeUser(deviceId, Uid, curve, x3dh_server_url, AEAD, allStatus); // this one will throw an exception if user is not found, just let it rise
 		LIME_LOGI<<"Load Lime user "<<deviceId;
 
 		/* check the curve id retrieved from DB is instanciable and return an exception if not */
@@ -471,13 +711,13 @@ namespace lime {
 		switch (curve) {
 			case lime::CurveId::c25519 :
 #ifdef EC25519_ENABLED
-				return std::make_shared<Lime<C255>>(localStorage, deviceId, x3dh_server_url, X3DH_post_data, Uid);
+				return make_secure_shared<Lime<C255>>(localStorage, deviceId, x3dh_server_url, X3DH_post_data, Uid, AEAD);
 #endif
 			break;
 
 			case lime::CurveId::c448 :
 #ifdef EC448_ENABLED
-				return std::make_shared<Lime<C448>>(localStorage, deviceId, x3dh_server_url, X3DH_post_data, Uid);
+				return make_secure_shared<Lime<C448>>(localStorage, deviceId, x3dh_server_url, X3DH_post_data, Uid, AEAD);
 #endif
 			break;
 
@@ -0,0 +1,168 @@
+/*
+	lime_compression.cpp
+	@author Johan Pascal
+	@copyright 	Copyright (C) 2019  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lime_log.hpp"
+#include "lime/lime.hpp"
+#include "lime_compression.hpp"
+#include "lime_settings.hpp"
+
+#ifdef LIME_ZLIB_ENABLED
+#include <zlib.h>
+#endif
+#ifdef LIME_ZSTD_ENABLED
+#include <zstd.h>
+#endif
+#include <algorithm>
+#include <atomic>
+
+namespace lime {
+
+/***** Compression algorithm selection ********/
+static std::atomic<CompressionAlgorithm> &selected_compressionAlgorithm(void) {
+	static std::atomic<CompressionAlgorithm> algorithm{CompressionAlgorithm::none}; // peers not aware of compression cannot read compressed payloads: it must be requested
+	return algorithm;
+}
+
+std::vector<CompressionAlgorithm> available_compressionAlgorithms(void) {
+	std::vector<CompressionAlgorithm> algorithms{CompressionAlgorithm::none};
+#ifdef LIME_ZLIB_ENABLED
+	algorithms.push_back(CompressionAlgorithm::zlib);
+#endif
+#ifdef LIME_ZSTD_ENABLED
+	algorithms.push_back(CompressionAlgorithm::zstd);
+#endif
+	return algorithms;
+}
+
+bool set_compressionAlgorithm(const CompressionAlgorithm algorithm) {
+	auto algorithms = available_compressionAlgorithms();
+	if (std::find(algorithms.cbegin(), algorithms.cend(), algorithm) == algorithms.cend()) {
+		return false;
+	}
+	selected_compressionAlgorithm().store(algorithm);
+	return true;
+}
+
+CompressionAlgorithm get_compressionAlgorithm(void) {
+	return selected_compressionAlgorithm().load(std::memory_order_relaxed);
+}
+
+/***** Payload compression ********/
+/* compressed payload header: algorithm<1 byte> || payload size<4 bytes, big endian> */
+constexpr size_t compressedHeaderSize = 5;
+
+bool compressPayload(const CompressionAlgorithm algorithm, const lime::span<const uint8_t> plaintext, std::vector<uint8_t> &compressed) {
+	if (algorithm == CompressionAlgorithm::none || plaintext.size() < lime::settings::payloadCompressionThreshold || plaintext.size() > lime::settings::payloadDecompressionMaxSize) {
+		return false;
+	}
+
+	size_t compressedSize = 0;
+	switch (algorithm) {
+#ifdef LIME_ZLIB_ENABLED
+		case CompressionAlgorithm::zlib: {
+			uLongf destSize = compressBound(static_cast<uLong>(plaintext.size()));
+			compressed.resize(compressedHeaderSize + destSize);
+			if (compress2(compressed.data()+compressedHeaderSize, &destSize, plaintext.data(), static_cast<uLong>(plaintext.size()), lime::settings::zlibCompressionLevel) != Z_OK) {
+				LIME_LOGW<<"zlib failed to compress a "<<plaintext.size()<<" bytes payload, send it uncompressed";
+				return false;
+			}
+			compressedSize = destSize;
+		}
+		break;
+#endif
+#ifdef LIME_ZSTD_ENABLED
+		case CompressionAlgorithm::zstd: {
+			compressed.resize(compressedHeaderSize + ZSTD_compressBound(plaintext.size()));
+			auto ret = ZSTD_compress(compressed.data()+compressedHeaderSize, compressed.size()-compressedHeaderSize, plaintext.data(), plaintext.size(), lime::settings::zstdCompressionLevel);
+			if (ZSTD_isError(ret)) {
+				LIME_LOGW<<"zstd failed to compress a "<<plaintext.size()<<" bytes payload: "<<ZSTD_getErrorName(ret)<<", send it uncompressed";
+				return false;
+			}
+			compressedSize = ret;
+		}
+		break;
+#endif
+		default:
+			return false;
+	}
+
+	// not worth it if it does not save anything
+	if (compressedHeaderSize + compressedSize >= plaintext.size()) {
+		return false;
+	}
+	compressed.resize(compressedHeaderSize + compressedSize);
+	compressed[0] = static_cast<uint8_t>(algorithm);
+	compressed[1] = static_cast<uint8_t>((plaintext.size()>>24)&0xFF);
+	compressed[2] = static_cast<uint8_t>((plaintext.size()>>16)&0xFF);
+	compressed[3] = static_cast<uint8_t>((plaintext.size()>>8)&0xFF);
+	compressed[4] = static_cast<uint8_t>(plaintext.size()&0xFF);
+	return true;
+}
+
+bool decompressedPayloadSize(const lime::span<const uint8_t> compressed, size_t &plaintextSize) {
+	if (compressed.size() < compressedHeaderSize) {
+		LIME_LOGW<<"Compressed payload is too short";
+		return false;
+	}
+	auto algorithms = available_compressionAlgorithms();
+	if (compressed[0] == static_cast<uint8_t>(CompressionAlgorithm::none) || std::find(algorithms.cbegin(), algorithms.cend(), static_cast<CompressionAlgorithm>(compressed[0])) == algorithms.cend()) {
+		LIME_LOGW<<"Payload is compressed with an algorithm("<<static_cast<int>(compressed[0])<<") not available in this build";
+		return false;
+	}
+	plaintextSize = static_cast<size_t>(compressed[1])<<24 | static_cast<size_t>(compressed[2])<<16 | static_cast<size_t>(compressed[3])<<8 | static_cast<size_t>(compressed[4]);
+	if (plaintextSize > lime::settings::payloadDecompressionMaxSize) {
+		LIME_LOGW<<"Compressed payload announces "<<plaintextSize<<" bytes, over the "<<lime::settings::payloadDecompressionMaxSize<<" bytes limit";
+		return false;
+	}
+	return true;
+}
+
+bool decompressPayload(const lime::span<const uint8_t> compressed, lime::span<uint8_t> plaintext) {
+	size_t plaintextSize = 0;
+	if (!decompressedPayloadSize(compressed, plaintextSize) || plaintextSize != plaintext.size()) {
+		return false;
+	}
+
+	switch (static_cast<CompressionAlgorithm>(compressed[0])) {
+#ifdef LIME_ZLIB_ENABLED
+		case CompressionAlgorithm::zlib: {
+			uLongf destSize = static_cast<uLongf>(plaintextSize);
+			if (uncompress(plaintext.data(), &destSize, compressed.data()+compressedHeaderSize, static_cast<uLong>(compressed.size()-compressedHeaderSize)) != Z_OK || destSize != plaintextSize) {
+				LIME_LOGW<<"zlib failed to decompress payload";
+				return false;
+			}
+		}
+		return true;
+#endif
+#ifdef LIME_ZSTD_ENABLED
+		case CompressionAlgorithm::zstd: {
+			auto ret = ZSTD_decompress(plaintext.data(), plaintext.size(), compressed.data()+compressedHeaderSize, compressed.size()-compressedHeaderSize);
+			if (ZSTD_isError(ret) || ret != plaintextSize) {
+				LIME_LOGW<<"zstd failed to decompress payload";
+				return false;
+			}
+		}
+		return true;
+#endif
+		default: // decompressedPayloadSize already checked the algorithm is available
+			return false;
+	}
+}
+
+} // namespace lime
@@ -0,0 +1,65 @@
+/*
+	lime_compression.hpp
+	@author Johan Pascal
+	@copyright 	Copyright (C) 2019  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef lime_compression_hpp
+#define lime_compression_hpp
+
+#include <vector>
+#include <cstdint>
+#include "lime/lime.hpp"
+
+namespace lime {
+	/**
+	 * @brief Compress a payload before its encryption
+	 *
+	 * The compressed payload is: algorithm<1 byte> || payload size<4 bytes, big endian> || compressed payload
+	 *
+	 * @param[in]	algorithm	the compression algorithm, all the recipients of the payload must be able to decompress it
+	 * @param[in]	plaintext	the payload to compress
+	 * @param[out]	compressed	the compressed payload, meaningful only when the function returns true
+	 *
+	 * @return true if the payload was compressed, false when the algorithm is none or not available, the payload is shorter than
+	 * settings::payloadCompressionThreshold or compressing it does not make it shorter
+	 */
+	bool compressPayload(const CompressionAlgorithm algorithm, const lime::span<const uint8_t> plaintext, std::vector<uint8_t> &compressed);
+
+	/**
+	 * @brief Decompress a payload compressed by compressPayload
+	 *
+	 * @param[in]	compressed	the compressed payload
+	 * @param[out]	plaintext	the buffer to store the decompressed payload, its size must be the one given by decompressedPayloadSize
+	 *
+	 * @return false if the compressed payload header is not accepted by decompressedPayloadSize, the plaintext buffer size does not match
+	 * the announced size or the compressed payload is corrupted. The plaintext buffer content is then meaningless.
+	 */
+	bool decompressPayload(const lime::span<const uint8_t> compressed, lime::span<uint8_t> plaintext);
+
+	/**
+	 * @brief Get the size of a payload compressed by compressPayload once decompressed, without decompressing it
+	 *
+	 * @param[in]	compressed	the compressed payload
+	 * @param[out]	plaintextSize	the size announced in the compressed payload header
+	 *
+	 * @return false if the compressed payload is too short to hold its header, its compression algorithm is not available
+	 * in this build or the announced size is over settings::payloadDecompressionMaxSize: it cannot be decompressed
+	 */
+	bool decompressedPayloadSize(const lime::span<const uint8_t> compressed, size_t &plaintextSize);
+} // namespace lime
+
+#endif //lime_compression_hpp
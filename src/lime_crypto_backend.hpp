@@ -0,0 +1,142 @@
+/*
+	lime_crypto_backend.hpp
+	@author Johan Pascal
+	@copyright 	Copyright (C) 2019  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef lime_crypto_backend_hpp
+#define lime_crypto_backend_hpp
+
+#include "lime_crypto_primitives.hpp"
+#include "lime_settings.hpp"
+
+namespace lime {
+/*************************************************************************************************/
+/********************** Contexts pool ************************************************************/
+/*************************************************************************************************/
+/**
+ * @brief A per thread pool of crypto contexts
+ *
+ * Creating a crypto context allocates it and its keys buffers, the ratchet and X3DH steps need a fresh one at each call.
+ * Contexts released by their user are wiped of any key material and kept for the next request on the releasing thread,
+ * up to settings::cryptoContextPoolSize per thread and context type.
+ *
+ * @tparam	Context	the context type, it must provide a wipe() method zeroing all the keys it holds
+ */
+template <typename Context>
+class contextPool {
+	private:
+		std::vector<std::unique_ptr<Context>> m_available; // wiped contexts ready to be used again
+
+		contextPool() : m_available{} {
+			m_available.reserve(lime::settings::cryptoContextPoolSize);
+		}
+		~contextPool() {
+			destroyed() = true;
+		}
+
+		/* set when this thread pool is destroyed at thread exit, contexts released after that are just deleted */
+		static bool &destroyed(void) {
+			static thread_local bool poolDestroyed = false; // trivially destructible: still valid after the pool destruction
+			return poolDestroyed;
+		}
+		static contextPool<Context> &instance(void) {
+			static thread_local contextPool<Context> pool{};
+			return pool;
+		}
+		static void release(Context *context) noexcept {
+			context->wipe();
+			if (!destroyed()) {
+				auto &pool = instance();
+				if (pool.m_available.size() < lime::settings::cryptoContextPoolSize) {
+					pool.m_available.emplace_back(context);
+					return;
+				}
+			}
+			delete context;
+		}
+
+	public:
+		/**
+		 * @brief get a context from this thread pool, create one if the pool is empty
+		 * @return a context holding no key, it goes back to the pool of the thread releasing the last reference on it
+		 */
+		static std::shared_ptr<Context> get(void) {
+			std::unique_ptr<Context> context{};
+			if (!destroyed()) {
+				auto &pool = instance();
+				if (!pool.m_available.empty()) {
+					context = std::move(pool.m_available.back());
+					pool.m_available.pop_back();
+				}
+			}
+			if (context == nullptr) {
+				context = std::unique_ptr<Context>(new Context());
+			}
+			return std::shared_ptr<Context>(context.release(), release);
+		}
+};
+
+#ifdef LIME_OPENSSL_BACKEND
+/*************************************************************************************************/
+/********************** OpenSSL backend **********************************************************/
+/*************************************************************************************************/
+/**
+ * OpenSSL libcrypto implementation of the crypto primitives, implemented in lime_crypto_openssl.cpp
+ * The generic factories and functions declared in lime_crypto_primitives.hpp forward to these when the OpenSSL backend is selected.
+ */
+namespace openssl_backend {
+	std::shared_ptr<RNG> make_RNG();
+
+	template <typename Curve>
+	std::shared_ptr<keyExchange<Curve>> make_keyExchange();
+
+	template <typename Curve>
+	std::shared_ptr<Signature<Curve>> make_Signature();
+
+	void HMAC_SHA512(const uint8_t *const key, const size_t keySize, const uint8_t *const input, const size_t inputSize, uint8_t *hash, size_t hashSize);
+
+	void AES256GCM_encrypt(const uint8_t *const key, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const plain, const size_t plainSize, const uint8_t *const AD, const size_t ADSize,
+		uint8_t *tag, const size_t tagSize, uint8_t *cipher);
+
+	bool AES256GCM_decrypt(const uint8_t *const key, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const cipher, const size_t cipherSize, const uint8_t *const AD, const size_t ADSize,
+		const uint8_t *const tag, const size_t tagSize, uint8_t *plain);
+
+	void CHACHA20POLY1305_encrypt(const uint8_t *const key, const uint8_t *const nonce,
+		const uint8_t *const plain, const size_t plainSize, const uint8_t *const AD, const size_t ADSize,
+		uint8_t *tag, uint8_t *cipher);
+
+	bool CHACHA20POLY1305_decrypt(const uint8_t *const key, const uint8_t *const nonce,
+		const uint8_t *const cipher, const size_t cipherSize, const uint8_t *const AD, const size_t ADSize,
+		const uint8_t *const tag, uint8_t *plain);
+
+#ifdef EC25519_ENABLED
+	extern template std::shared_ptr<keyExchange<C255>> make_keyExchange();
+	extern template std::shared_ptr<Signature<C255>> make_Signature();
+#endif // EC25519_ENABLED
+
+#ifdef EC448_ENABLED
+	extern template std::shared_ptr<keyExchange<C448>> make_keyExchange();
+	extern template std::shared_ptr<Signature<C448>> make_Signature();
+#endif // EC448_ENABLED
+} // namespace openssl_backend
+#endif // LIME_OPENSSL_BACKEND
+
+} // namespace lime
+
+#endif //lime_crypto_backend_hpp
@@ -0,0 +1,607 @@
+/*
+	lime_crypto_openssl.cpp
+	@author Johan Pascal
+	@copyright 	Copyright (C) 2019  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lime_crypto_backend.hpp"
+#include "bctoolbox/exception.hh"
+
+#include <climits>
+#include <openssl/bn.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+namespace lime {
+namespace openssl_backend {
+
+/***** Random Number Generator ********/
+/**
+ * @brief A wrapper around the OpenSSL private Random Number Generator, implements the RNG interface
+ */
+class openssl_RNG : public RNG {
+	public:
+
+		void randomize(sBuffer<lime::settings::DRrandomSeedSize> &buffer) override {
+			randomize(buffer.data(), buffer.size());
+		};
+
+		uint32_t randomize() override {
+			uint32_t ret;
+			randomize(reinterpret_cast<uint8_t *>(&ret), sizeof(ret));
+			// we are on 31 bits: keep the uint32_t MSb set to 0 (see RNG interface definition)
+			return (ret & 0x7FFFFFFF);
+		};
+
+		void randomize(uint8_t *buffer, const size_t size) override {
+			size_t done = 0;
+			while (done < size) {
+				int chunk = static_cast<int>(std::min(size - done, static_cast<size_t>(INT_MAX)));
+				if (RAND_priv_bytes(buffer + done, chunk) != 1) {
+					throw BCTBX_EXCEPTION << "OpenSSL RNG failure";
+				}
+				done += chunk;
+			}
+		}
+}; // class openssl_RNG
+
+std::shared_ptr<RNG> make_RNG() {
+	return std::make_shared<openssl_RNG>();
+}
+
+/***** Curves parameters ********************/
+/**
+ * @brief OpenSSL keys identifiers and Edwards to Montgomery keys conversion for a curve
+ */
+template <typename Curve>
+struct openssl_curve {
+	/* if this template is instanciated the static_assert will fail but will give us an error message with faulty Curve type */
+	static_assert(sizeof(Curve) != sizeof(Curve), "You must specialize openssl_curve for your type");
+};
+
+/**
+ * @brief Convert an EdDSA public key into a key exchange one using the Edwards to Montgomery birational map
+ *
+ * The field prime and the Edwards y coordinate are little endian, the u coordinate is computed by:
+ * - Curve 25519: u = (1+y)/(1-y)
+ * - Curve 448: u = y^2(1-dy^2)/(1-y^2), d = -39081
+ *
+ * @param[in]	p		field prime, big endian hexadecimal string
+ * @param[in]	d		Edwards curve d parameter when the 448 map is used, 0 for the 25519 map
+ * @param[in]	ed		EdDSA public key, the x coordinate sign is in the MSb of its last byte
+ * @param[in]	edSize		EdDSA public key size
+ * @param[out]	x		key exchange public key
+ * @param[in]	xSize		key exchange public key size
+ */
+static void EdwardsToMontgomery(const char *p, const long d, const uint8_t *ed, const size_t edSize, uint8_t *x, const size_t xSize) {
+	std::vector<uint8_t> yBuffer(ed, ed+xSize);
+	if (edSize == xSize) { // 25519: the sign bit shares the last byte
+		yBuffer.back() &= 0x7F;
+	}
+	BN_CTX *ctx = BN_CTX_new();
+	BIGNUM *prime = nullptr;
+	if (ctx == nullptr || BN_hex2bn(&prime, p) == 0) {
+		BN_CTX_free(ctx);
+		throw BCTBX_EXCEPTION << "OpenSSL EdDSA to ECDH public key conversion failure";
+	}
+	BN_CTX_start(ctx);
+	BIGNUM *y = BN_CTX_get(ctx);
+	BIGNUM *n = BN_CTX_get(ctx);
+	BIGNUM *den = BN_CTX_get(ctx);
+	BIGNUM *one = BN_CTX_get(ctx);
+	bool ok = (BN_lebin2bn(yBuffer.data(), static_cast<int>(yBuffer.size()), y) != nullptr)
+		&& BN_one(one);
+	if (d == 0) {
+		ok = ok && BN_mod_add(n, one, y, prime, ctx) // 1+y
+			&& BN_mod_sub(den, one, y, prime, ctx); // 1-y
+	} else {
+		BIGNUM *y2 = BN_CTX_get(ctx);
+		BIGNUM *dy2 = BN_CTX_get(ctx);
+		ok = ok && BN_mod_sqr(y2, y, prime, ctx) // y^2
+			&& BN_copy(dy2, y2) && BN_mul_word(dy2, static_cast<BN_ULONG>(-d)) && BN_mod_add(dy2, one, dy2, prime, ctx) // 1-dy^2 with d<0
+			&& BN_mod_mul(n, y2, dy2, prime, ctx) // y^2(1-dy^2)
+			&& BN_mod_sub(den, one, y2, prime, ctx); // 1-y^2
+	}
+	ok = ok && (BN_mod_inverse(den, den, prime, ctx) != nullptr)
+		&& BN_mod_mul(n, n, den, prime, ctx)
+		&& (BN_bn2lebinpad(n, x, static_cast<int>(xSize)) == static_cast<int>(xSize));
+	BN_CTX_end(ctx);
+	BN_clear_free(prime);
+	BN_CTX_free(ctx);
+	if (!ok) {
+		throw BCTBX_EXCEPTION << "OpenSSL EdDSA to ECDH public key conversion failure";
+	}
+}
+
+/**
+ * @brief Hash an EdDSA private key with the signature scheme hash function, the first bytes of the digest are the key exchange private key
+ */
+static void EdDSAPrivateHash(const EVP_MD *md, const uint8_t *ed, const size_t edSize, uint8_t *x, const size_t xSize) {
+	std::array<uint8_t, 2*57> digest; // large enough for SHA512 and the 114 bytes SHAKE256 output used by Ed448
+	EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+	bool ok = (ctx != nullptr) && EVP_DigestInit_ex(ctx, md, nullptr) && EVP_DigestUpdate(ctx, ed, edSize);
+	if (EVP_MD_flags(md) & EVP_MD_FLAG_XOF) {
+		ok = ok && EVP_DigestFinalXOF(ctx, digest.data(), digest.size());
+	} else {
+		ok = ok && EVP_DigestFinal_ex(ctx, digest.data(), nullptr);
+	}
+	EVP_MD_CTX_free(ctx);
+	if (ok) {
+		std::copy_n(digest.cbegin(), xSize, x);
+	}
+	cleanBuffer(digest.data(), digest.size());
+	if (!ok) {
+		throw BCTBX_EXCEPTION << "OpenSSL EdDSA to ECDH private key conversion failure";
+	}
+}
+
+#ifdef EC25519_ENABLED
+template <> struct openssl_curve<C255> {
+	static constexpr int XId = EVP_PKEY_X25519;
+	static constexpr int DSAId = EVP_PKEY_ED25519;
+	static void publicKeyConversion(const DSA<C255, lime::DSAtype::publicKey> &ed, X<C255, lime::Xtype::publicKey> &x) {
+		EdwardsToMontgomery("7FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFED", 0, ed.data(), ed.size(), x.data(), x.size());
+	}
+	static void privateKeyConversion(const DSA<C255, lime::DSAtype::privateKey> &ed, X<C255, lime::Xtype::privateKey> &x) {
+		EdDSAPrivateHash(EVP_sha512(), ed.data(), ed.size(), x.data(), x.size());
+	}
+};
+#endif // EC25519_ENABLED
+
+#ifdef EC448_ENABLED
+template <> struct openssl_curve<C448> {
+	static constexpr int XId = EVP_PKEY_X448;
+	static constexpr int DSAId = EVP_PKEY_ED448;
+	static void publicKeyConversion(const DSA<C448, lime::DSAtype::publicKey> &ed, X<C448, lime::Xtype::publicKey> &x) {
+		EdwardsToMontgomery("FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF", -39081, ed.data(), ed.size(), x.data(), x.size());
+	}
+	static void privateKeyConversion(const DSA<C448, lime::DSAtype::privateKey> &ed, X<C448, lime::Xtype::privateKey> &x) {
+		EdDSAPrivateHash(EVP_shake256(), ed.data(), ed.size(), x.data(), x.size());
+	}
+};
+#endif // EC448_ENABLED
+
+/**
+ * @brief Create an OpenSSL key from a raw private key, OpenSSL derives the matching public key on creation
+ */
+static EVP_PKEY *newPrivateKey(const int id, const uint8_t *key, const size_t keySize) {
+	auto pkey = EVP_PKEY_new_raw_private_key(id, nullptr, key, keySize);
+	if (pkey == nullptr) {
+		throw BCTBX_EXCEPTION << "OpenSSL invalid private key";
+	}
+	return pkey;
+}
+
+static EVP_PKEY *newPublicKey(const int id, const uint8_t *key, const size_t keySize) {
+	auto pkey = EVP_PKEY_new_raw_public_key(id, nullptr, key, keySize);
+	if (pkey == nullptr) {
+		throw BCTBX_EXCEPTION << "OpenSSL invalid public key";
+	}
+	return pkey;
+}
+
+/***** Signature  ********************/
+/**
+ * @brief a wrapper around OpenSSL signature algorithms, implements the Signature interface
+ *
+ * Provides EdDSA on curves 25519 and 448
+ */
+template <typename Curve>
+class openssl_EDDSA : public Signature<Curve> {
+	private :
+		DSA<Curve, lime::DSAtype::privateKey> m_secret;
+		DSA<Curve, lime::DSAtype::publicKey> m_public;
+		bool m_hasSecret, m_hasPublic;
+		EVP_PKEY *m_secretKey; // OpenSSL key built from m_secret, created when needed
+		EVP_PKEY *m_publicKey; // OpenSSL key built from m_public, created when needed
+		EVP_MD_CTX *m_mdContext;
+
+		void freeKeys(void) {
+			EVP_PKEY_free(m_secretKey);
+			m_secretKey = nullptr;
+			EVP_PKEY_free(m_publicKey);
+			m_publicKey = nullptr;
+		}
+		EVP_PKEY *secretKey(void) {
+			if (!m_hasSecret) {
+				throw BCTBX_EXCEPTION << "invalid EdDSA secret key";
+			}
+			if (m_secretKey == nullptr) {
+				m_secretKey = newPrivateKey(openssl_curve<Curve>::DSAId, m_secret.data(), m_secret.size());
+			}
+			return m_secretKey;
+		}
+		EVP_PKEY *publicKey(void) {
+			if (!m_hasPublic) {
+				throw BCTBX_EXCEPTION << "invalid EdDSA public key";
+			}
+			if (m_publicKey == nullptr) {
+				m_publicKey = newPublicKey(openssl_curve<Curve>::DSAId, m_public.data(), m_public.size());
+			}
+			return m_publicKey;
+		}
+		void sign(const uint8_t *message, const size_t messageSize, DSA<Curve, lime::DSAtype::signature> &signature) {
+			auto sigSize = signature.size();
+			EVP_MD_CTX_reset(m_mdContext);
+			if (EVP_DigestSignInit(m_mdContext, nullptr, nullptr, nullptr, secretKey()) != 1
+				|| EVP_DigestSign(m_mdContext, signature.data(), &sigSize, message, messageSize) != 1) {
+				throw BCTBX_EXCEPTION << "OpenSSL EdDSA signature failure";
+			}
+		}
+		bool verify(const uint8_t *message, const size_t messageSize, const DSA<Curve, lime::DSAtype::signature> &signature) {
+			EVP_MD_CTX_reset(m_mdContext);
+			if (EVP_DigestVerifyInit(m_mdContext, nullptr, nullptr, nullptr, publicKey()) != 1) {
+				throw BCTBX_EXCEPTION << "OpenSSL EdDSA verify failure";
+			}
+			return (EVP_DigestVerify(m_mdContext, signature.data(), signature.size(), message, messageSize) == 1);
+		}
+
+	public :
+		/* accessors */
+		void get_secret(DSA<Curve, lime::DSAtype::privateKey> &secretKey) override {
+			if (!m_hasSecret) {
+				throw BCTBX_EXCEPTION << "invalid EdDSA secret key";
+			}
+			secretKey = m_secret;
+		}
+		void get_public(DSA<Curve, lime::DSAtype::publicKey> &publicKey) override {
+			if (!m_hasPublic) {
+				throw BCTBX_EXCEPTION << "invalid EdDSA public key";
+			}
+			publicKey = m_public;
+		}
+
+		/* Setting keys */
+		void set_secret(const DSA<Curve, lime::DSAtype::privateKey> &secretKey) override {
+			EVP_PKEY_free(m_secretKey);
+			m_secretKey = nullptr;
+			m_secret = secretKey;
+			m_hasSecret = true;
+		}
+
+		void set_public(const DSA<Curve, lime::DSAtype::publicKey> &publicKey) override {
+			EVP_PKEY_free(m_publicKey);
+			m_publicKey = nullptr;
+			m_public = publicKey;
+			m_hasPublic = true;
+		}
+
+		void createKeyPair(std::shared_ptr<lime::RNG> rng) override {
+			// Generate a random secret key
+			DSA<Curve, lime::DSAtype::privateKey> secret;
+			rng->randomize(secret.data(), secret.size());
+			// set it in the context
+			set_secret(secret);
+			// and generate the public value
+			derivePublic();
+		}
+
+		void derivePublic(void) override {
+			auto publicSize = m_public.size();
+			if (EVP_PKEY_get_raw_public_key(secretKey(), m_public.data(), &publicSize) != 1) {
+				throw BCTBX_EXCEPTION << "OpenSSL EdDSA public key derivation failure";
+			}
+			EVP_PKEY_free(m_publicKey);
+			m_publicKey = nullptr;
+			m_hasPublic = true;
+		}
+
+		void sign(const std::vector<uint8_t> &message, DSA<Curve, lime::DSAtype::signature> &signature) override {
+			sign(message.data(), message.size(), signature);
+		}
+
+		void sign(const X<Curve, lime::Xtype::publicKey> &message, DSA<Curve, lime::DSAtype::signature> &signature) override {
+			sign(message.data(), message.ssize(), signature);
+		}
+
+		bool verify(const std::vector<uint8_t> &message, const DSA<Curve, lime::DSAtype::signature> &signature) override {
+			return verify(message.data(), message.size(), signature);
+		}
+
+		bool verify(const X<Curve, lime::Xtype::publicKey> &message, const DSA<Curve, lime::DSAtype::signature> &signature) override {
+			return verify(message.data(), message.ssize(), signature);
+		}
+
+		/**
+		 * @brief zero all keys held by the context before it is reused
+		 */
+		void wipe(void) {
+			freeKeys();
+			cleanBuffer(m_secret.data(), m_secret.size());
+			cleanBuffer(m_public.data(), m_public.size());
+			m_hasSecret = false;
+			m_hasPublic = false;
+		}
+
+		openssl_EDDSA() : m_secret{}, m_public{}, m_hasSecret{false}, m_hasPublic{false}, m_secretKey{nullptr}, m_publicKey{nullptr} {
+			m_mdContext = EVP_MD_CTX_new();
+			if (m_mdContext == nullptr) {
+				throw BCTBX_EXCEPTION << "OpenSSL EdDSA context creation failure";
+			}
+		}
+		~openssl_EDDSA(){
+			freeKeys();
+			EVP_MD_CTX_free(m_mdContext);
+			m_mdContext = nullptr;
+		}
+}; // class openssl_EDDSA
+
+/***** Key Exchange ******************/
+/**
+ * @brief a wrapper around OpenSSL key exchange algorithms, implements the keyExchange interface
+ *
+ * Provides X25519 and X448
+ */
+template <typename Curve>
+class openssl_ECDH : public keyExchange<Curve> {
+	private :
+		X<Curve, lime::Xtype::privateKey> m_secret;
+		X<Curve, lime::Xtype::publicKey> m_selfPublic;
+		X<Curve, lime::Xtype::publicKey> m_peerPublic;
+		X<Curve, lime::Xtype::sharedSecret> m_sharedSecret;
+		bool m_hasSecret, m_hasSelfPublic, m_hasPeerPublic, m_hasSharedSecret;
+		EVP_PKEY *m_secretKey; // OpenSSL key built from m_secret, created when needed and kept as its creation computes the public key
+
+		EVP_PKEY *secretKey(void) {
+			if (!m_hasSecret) {
+				throw BCTBX_EXCEPTION << "invalid ECDH secret key";
+			}
+			if (m_secretKey == nullptr) {
+				m_secretKey = newPrivateKey(openssl_curve<Curve>::XId, m_secret.data(), m_secret.size());
+			}
+			return m_secretKey;
+		}
+	public :
+		/* accessors */
+		void get_secret(X<Curve, lime::Xtype::privateKey> &secret) override {
+			if (!m_hasSecret) {
+				throw BCTBX_EXCEPTION << "invalid ECDH secret key";
+			}
+			secret = m_secret;
+		}
+		void get_selfPublic(X<Curve, lime::Xtype::publicKey> &selfPublic) override {
+			if (!m_hasSelfPublic) {
+				throw BCTBX_EXCEPTION << "invalid ECDH self public key";
+			}
+			selfPublic = m_selfPublic;
+		}
+		void get_peerPublic(X<Curve, lime::Xtype::publicKey> &peerPublic) override {
+			if (!m_hasPeerPublic) {
+				throw BCTBX_EXCEPTION << "invalid ECDH peer public key";
+			}
+			peerPublic = m_peerPublic;
+		}
+		void get_sharedSecret(X<Curve, lime::Xtype::sharedSecret> &sharedSecret) override {
+			if (!m_hasSharedSecret) {
+				throw BCTBX_EXCEPTION << "invalid ECDH shared secret";
+			}
+			sharedSecret = m_sharedSecret;
+		}
+
+		/* Setting keys, accept Signature keys */
+		void set_secret(const X<Curve, lime::Xtype::privateKey> &secret) override {
+			EVP_PKEY_free(m_secretKey);
+			m_secretKey = nullptr;
+			m_secret = secret;
+			m_hasSecret = true;
+		}
+
+		void set_secret(const DSA<Curve, lime::DSAtype::privateKey> &secret) override {
+			EVP_PKEY_free(m_secretKey);
+			m_secretKey = nullptr;
+			openssl_curve<Curve>::privateKeyConversion(secret, m_secret);
+			m_hasSecret = true;
+		}
+
+		void set_selfPublic(const X<Curve, lime::Xtype::publicKey> &selfPublic) override {
+			m_selfPublic = selfPublic;
+			m_hasSelfPublic = true;
+		}
+
+		void set_selfPublic(const DSA<Curve, lime::DSAtype::publicKey> &selfPublic) override {
+			openssl_curve<Curve>::publicKeyConversion(selfPublic, m_selfPublic);
+			m_hasSelfPublic = true;
+		}
+
+		void set_peerPublic(const X<Curve, lime::Xtype::publicKey> &peerPublic) override {
+			m_peerPublic = peerPublic;
+			m_hasPeerPublic = true;
+		}
+
+		void set_peerPublic(const DSA<Curve, lime::DSAtype::publicKey> &peerPublic) override {
+			openssl_curve<Curve>::publicKeyConversion(peerPublic, m_peerPublic);
+			m_hasPeerPublic = true;
+		}
+
+		void createKeyPair(std::shared_ptr<lime::RNG> rng) override {
+			// Generate a random secret key
+			X<Curve, lime::Xtype::privateKey> secret;
+			rng->randomize(secret.data(), secret.size());
+			// set it in the context
+			set_secret(secret);
+			// and generate the public value
+			deriveSelfPublic();
+		}
+
+		void deriveSelfPublic(void) override {
+			auto publicSize = m_selfPublic.size();
+			if (EVP_PKEY_get_raw_public_key(secretKey(), m_selfPublic.data(), &publicSize) != 1) {
+				throw BCTBX_EXCEPTION << "OpenSSL ECDH public key derivation failure";
+			}
+			m_hasSelfPublic = true;
+		}
+
+		void computeSharedSecret(void) override {
+			if (!m_hasPeerPublic) {
+				throw BCTBX_EXCEPTION << "invalid ECDH peer public key";
+			}
+			auto peerKey = newPublicKey(openssl_curve<Curve>::XId, m_peerPublic.data(), m_peerPublic.size());
+			auto ctx = EVP_PKEY_CTX_new(secretKey(), nullptr);
+			auto sharedSecretSize = m_sharedSecret.size();
+			bool ok = (ctx != nullptr)
+				&& (EVP_PKEY_derive_init(ctx) == 1)
+				&& (EVP_PKEY_derive_set_peer(ctx, peerKey) == 1)
+				&& (EVP_PKEY_derive(ctx, m_sharedSecret.data(), &sharedSecretSize) == 1);
+			EVP_PKEY_CTX_free(ctx);
+			EVP_PKEY_free(peerKey);
+			if (!ok) {
+				throw BCTBX_EXCEPTION << "OpenSSL ECDH shared secret computation failure";
+			}
+			m_hasSharedSecret = true;
+		}
+
+		/**
+		 * @brief zero all keys held by the context before it is reused
+		 */
+		void wipe(void) {
+			EVP_PKEY_free(m_secretKey);
+			m_secretKey = nullptr;
+			cleanBuffer(m_secret.data(), m_secret.size());
+			cleanBuffer(m_selfPublic.data(), m_selfPublic.size());
+			cleanBuffer(m_peerPublic.data(), m_peerPublic.size());
+			cleanBuffer(m_sharedSecret.data(), m_sharedSecret.size());
+			m_hasSecret = m_hasSelfPublic = m_hasPeerPublic = m_hasSharedSecret = false;
+		}
+
+		openssl_ECDH() : m_secret{}, m_selfPublic{}, m_peerPublic{}, m_sharedSecret{},
+			m_hasSecret{false}, m_hasSelfPublic{false}, m_hasPeerPublic{false}, m_hasSharedSecret{false}, m_secretKey{nullptr} {}
+		~openssl_ECDH(){
+			EVP_PKEY_free(m_secretKey);
+			m_secretKey = nullptr;
+		}
+}; // class openssl_ECDH
+
+/* Factory functions */
+template <typename Curve>
+std::shared_ptr<keyExchange<Curve>> make_keyExchange() {
+	return contextPool<openssl_ECDH<Curve>>::get();
+}
+
+template <typename Curve>
+std::shared_ptr<Signature<Curve>> make_Signature() {
+	return contextPool<openssl_EDDSA<Curve>>::get();
+}
+
+/***** HMAC SHA512 ******************/
+void HMAC_SHA512(const uint8_t *const key, const size_t keySize, const uint8_t *const input, const size_t inputSize, uint8_t *hash, size_t hashSize) {
+	std::array<uint8_t, SHA512::ssize()> fullHash;
+	static const uint8_t emptyKey = 0; // OpenSSL rejects a null key pointer even with a zero size
+	if (::HMAC(EVP_sha512(), (key != nullptr)?key:&emptyKey, static_cast<int>(keySize), input, inputSize, fullHash.data(), nullptr) == nullptr) {
+		throw BCTBX_EXCEPTION << "OpenSSL HMAC-SHA512 failure";
+	}
+	std::copy_n(fullHash.cbegin(), std::min(SHA512::ssize(), hashSize), hash);
+	cleanBuffer(fullHash.data(), fullHash.size());
+}
+
+/***** AEAD: AES256-GCM and ChaCha20-Poly1305 ******************/
+/**
+ * @brief get the AEAD cipher context of the calling thread, created at first call and then reused
+ */
+static EVP_CIPHER_CTX *AEAD_context(void) {
+	static thread_local std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> context{EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free};
+	if (context == nullptr) {
+		throw BCTBX_EXCEPTION << "OpenSSL AEAD context creation failure";
+	}
+	return context.get();
+}
+
+/**
+ * @brief Set cipher, key and IV in the calling thread AEAD context then process the additional data
+ */
+static void AEAD_start(EVP_CIPHER_CTX *ctx, const EVP_CIPHER *type, const int encrypt, const uint8_t *const key, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const AD, const size_t ADSize, const size_t dataSize) {
+	int len = 0;
+	if (IVSize == 0 || IVSize > INT_MAX || ADSize > INT_MAX || dataSize > INT_MAX
+		|| EVP_CipherInit_ex(ctx, type, nullptr, nullptr, nullptr, encrypt) != 1
+		|| EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, static_cast<int>(IVSize), nullptr) != 1
+		|| EVP_CipherInit_ex(ctx, nullptr, nullptr, key, IV, encrypt) != 1
+		|| (ADSize > 0 && EVP_CipherUpdate(ctx, nullptr, &len, AD, static_cast<int>(ADSize)) != 1)) {
+		throw BCTBX_EXCEPTION << "OpenSSL AEAD initialisation failure";
+	}
+}
+
+static void AEAD_encrypt(const EVP_CIPHER *type, const uint8_t *const key, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const plain, const size_t plainSize, const uint8_t *const AD, const size_t ADSize,
+		uint8_t *tag, const size_t tagSize, uint8_t *cipher) {
+	auto ctx = AEAD_context();
+	AEAD_start(ctx, type, 1, key, IV, IVSize, AD, ADSize, plainSize);
+	int len = 0;
+	if ((plainSize > 0 && EVP_EncryptUpdate(ctx, cipher, &len, plain, static_cast<int>(plainSize)) != 1)
+		|| EVP_EncryptFinal_ex(ctx, cipher + len, &len) != 1
+		|| EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, static_cast<int>(tagSize), tag) != 1) {
+		throw BCTBX_EXCEPTION << "OpenSSL AEAD encryption failure";
+	}
+}
+
+static bool AEAD_decrypt(const EVP_CIPHER *type, const uint8_t *const key, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const cipher, const size_t cipherSize, const uint8_t *const AD, const size_t ADSize,
+		const uint8_t *const tag, const size_t tagSize, uint8_t *plain) {
+	auto ctx = AEAD_context();
+	AEAD_start(ctx, type, 0, key, IV, IVSize, AD, ADSize, cipherSize);
+	int len = 0;
+	if ((cipherSize > 0 && EVP_DecryptUpdate(ctx, plain, &len, cipher, static_cast<int>(cipherSize)) != 1)
+		|| EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, static_cast<int>(tagSize), const_cast<uint8_t *>(tag)) != 1) {
+		throw BCTBX_EXCEPTION << "OpenSSL AEAD decryption failure";
+	}
+	if (EVP_DecryptFinal_ex(ctx, plain + len, &len) != 1) { // authentication failed: do not leak the unauthenticated plain text
+		cleanBuffer(plain, cipherSize);
+		return false;
+	}
+	return true;
+}
+
+void AES256GCM_encrypt(const uint8_t *const key, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const plain, const size_t plainSize, const uint8_t *const AD, const size_t ADSize,
+		uint8_t *tag, const size_t tagSize, uint8_t *cipher) {
+	AEAD_encrypt(EVP_aes_256_gcm(), key, IV, IVSize, plain, plainSize, AD, ADSize, tag, tagSize, cipher);
+}
+
+bool AES256GCM_decrypt(const uint8_t *const key, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const cipher, const size_t cipherSize, const uint8_t *const AD, const size_t ADSize,
+		const uint8_t *const tag, const size_t tagSize, uint8_t *plain) {
+	return AEAD_decrypt(EVP_aes_256_gcm(), key, IV, IVSize, cipher, cipherSize, AD, ADSize, tag, tagSize, plain);
+}
+
+void CHACHA20POLY1305_encrypt(const uint8_t *const key, const uint8_t *const nonce,
+		const uint8_t *const plain, const size_t plainSize, const uint8_t *const AD, const size_t ADSize,
+		uint8_t *tag, uint8_t *cipher) {
+	AEAD_encrypt(EVP_chacha20_poly1305(), key, nonce, CHACHA20POLY1305::nonceSize(), plain, plainSize, AD, ADSize, tag, CHACHA20POLY1305::tagSize(), cipher);
+}
+
+bool CHACHA20POLY1305_decrypt(const uint8_t *const key, const uint8_t *const nonce,
+		const uint8_t *const cipher, const size_t cipherSize, const uint8_t *const AD, const size_t ADSize,
+		const uint8_t *const tag, uint8_t *plain) {
+	return AEAD_decrypt(EVP_chacha20_poly1305(), key, nonce, CHACHA20POLY1305::nonceSize(), cipher, cipherSize, AD, ADSize, tag, CHACHA20POLY1305::tagSize(), plain);
+}
+
+/* template instanciations for Curve 25519 and Curve 448 */
+#ifdef EC25519_ENABLED
+	template class openssl_ECDH<C255>;
+	template class openssl_EDDSA<C255>;
+	template std::shared_ptr<keyExchange<C255>> make_keyExchange();
+	template std::shared_ptr<Signature<C255>> make_Signature();
+#endif //EC25519_ENABLED
+
+#ifdef EC448_ENABLED
+	template class openssl_ECDH<C448>;
+	template class openssl_EDDSA<C448>;
+	template std::shared_ptr<keyExchange<C448>> make_keyExchange();
+	template std::shared_ptr<Signature<C448>> make_Signature();
+#endif //EC448_ENABLED
+
+} // namespace openssl_backend
+} // namespace lime
@@ -17,11 +17,28 @@
 	along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "lime/lime.hpp"
 #include "lime_crypto_primitives.hpp"
+#include "lime_crypto_backend.hpp"
+#include "lime_settings.hpp"
+#include "lime_secure_memory.hpp"
 #include "bctoolbox/crypto.h"
 #include "bctoolbox/crypto.hh"
 #include "bctoolbox/exception.hh"
 
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#include <immintrin.h> // AES-NI and PCLMULQDQ intrinsics
+#endif
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <thread>
+#ifndef _WIN32
+#include <pthread.h> // pthread_atfork
+#endif
+
 namespace lime {
 
 /* template instanciations for Curves 25519 and 448, done  */
@@ -47,6 +64,52 @@ namespace lime {
 	template class DSApair<C448>;
 #endif
 
+/***** Crypto backend selection ********/
+/**
+ * @brief pick the default crypto backend according to the build options and the CPU features
+ *
+ * OpenSSL is preferred when available unless running on an x86 CPU lacking AES-NI or PCLMULQDQ:
+ * its AES-GCM and key exchange code paths are then no faster than the bctoolbox ones.
+ */
+static CryptoBackend default_cryptoBackend(void) {
+#ifdef LIME_OPENSSL_BACKEND
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	if (!__builtin_cpu_supports("aes") || !__builtin_cpu_supports("pclmul")) {
+		return CryptoBackend::bctoolbox;
+	}
+#endif
+	return CryptoBackend::openssl;
+#else
+	return CryptoBackend::bctoolbox;
+#endif
+}
+
+static std::atomic<CryptoBackend> &selected_cryptoBackend(void) {
+	static std::atomic<CryptoBackend> backend{default_cryptoBackend()};
+	return backend;
+}
+
+std::vector<CryptoBackend> available_cryptoBackends(void) {
+	std::vector<CryptoBackend> backends{CryptoBackend::bctoolbox};
+#ifdef LIME_OPENSSL_BACKEND
+	backends.push_back(CryptoBackend::openssl);
+#endif
+	return backends;
+}
+
+bool set_cryptoBackend(const CryptoBackend backend) {
+	auto backends = available_cryptoBackends();
+	if (std::find(backends.cbegin(), backends.cend(), backend) == backends.cend()) {
+		return false;
+	}
+	selected_cryptoBackend().store(backend);
+	return true;
+}
+
+CryptoBackend get_cryptoBackend(void) {
+	return selected_cryptoBackend().load(std::memory_order_relaxed);
+}
+
 /***** Random Number Generator ********/
 /**
  * @brief A wrapper around the bctoolbox Random Number Generator, implements the RNG interface
@@ -74,8 +137,94 @@ class bctbx_RNG : public RNG {
 
 /* Factory function */
 std::shared_ptr<RNG> make_RNG() {
+#ifdef LIME_OPENSSL_BACKEND
+	if (get_cryptoBackend() == CryptoBackend::openssl) {
+		return openssl_backend::make_RNG();
+	}
+#endif
 	return std::make_shared<bctbx_RNG>();
 }
+
+/**
+ * @brief count the fork of this process: a buffered RNG copied in a child process must not serve the random the parent serves too
+ */
+static std::atomic<uint32_t> &forkGeneration(void) {
+	static std::atomic<uint32_t> generation{0};
+#ifndef _WIN32
+	static std::once_flag registered;
+	std::call_once(registered, []{pthread_atfork(nullptr, nullptr, []{forkGeneration().fetch_add(1);});});
+#endif
+	return generation;
+}
+
+/**
+ * @brief A buffered RNG, implements the RNG interface
+ *
+ * Random bytes are drawn from an RNG of the selected backend in blocks of settings::RNGbufferSize bytes and served from
+ * this buffer: key Ids, seeds and private keys do not pay the DRBG call overhead each. Served bytes are wiped from the buffer,
+ * large requests bypass it.
+ * When the process forks, the child drops the buffer and the underlying RNG and creates a new one.
+ * It must not be shared between threads, use thread_RNG to get the one of the calling thread.
+ */
+class buffered_RNG : public RNG {
+	private:
+		std::shared_ptr<RNG> m_source; // the RNG filling the buffer
+		sBuffer<lime::settings::RNGbufferSize> m_buffer;
+		size_t m_available; // the unused random bytes are the last m_available ones of m_buffer
+		uint32_t m_forkGeneration; // forkGeneration value when m_source was created
+
+		void read(uint8_t *buffer, const size_t size) {
+			auto generation = forkGeneration().load();
+			if (generation != m_forkGeneration) { // we are in a child process: do not use the random of the parent
+				cleanBuffer(m_buffer.data(), m_buffer.size());
+				m_available = 0;
+				m_source = make_RNG();
+				m_forkGeneration = generation;
+			}
+
+			if (size > lime::settings::RNGbufferSize/4) { // no point buffering large requests
+				m_source->randomize(buffer, size);
+				return;
+			}
+			if (size > m_available) {
+				m_source->randomize(m_buffer.data(), m_buffer.size());
+				m_available = m_buffer.size();
+			}
+			auto random = m_buffer.data() + m_buffer.size() - m_available;
+			std::memcpy(buffer, random, size);
+			cleanBuffer(random, size);
+			m_available -= size;
+		}
+
+	public:
+		buffered_RNG() : m_source{make_RNG()}, m_buffer{}, m_available{0}, m_forkGeneration{forkGeneration().load()} {}
+
+		void randomize(sBuffer<lime::settings::DRrandomSeedSize> &buffer) override {
+			read(buffer.data(), buffer.size());
+		};
+
+		uint32_t randomize() override {
+			uint32_t ret;
+			read(reinterpret_cast<uint8_t *>(&ret), sizeof(ret));
+			// we are on 31 bits: keep the uint32_t MSb set to 0 (see RNG interface definition)
+			return (ret & 0x7FFFFFFF);
+		};
+
+		void randomize(uint8_t *buffer, const size_t size) override {
+			read(buffer, size);
+		}
+}; // class buffered_RNG
+
+std::shared_ptr<RNG> thread_RNG() {
+	static thread_local std::shared_ptr<RNG> rng{};
+	static thread_local CryptoBackend rngBackend{};
+	auto backend = get_cryptoBackend();
+	if (rng == nullptr || rngBackend != backend) { // created at first call or when the backend changed
+		rng = make_secure_shared<buffered_RNG>(); // the buffer holds future key material: keep it in the secure arena
+		rngBackend = backend;
+	}
+	return rng;
+}
 /***** Signature  ********************/
 /* bctbx_EdDSA specialized constructor */
 template <typename Curve>
@@ -99,6 +248,20 @@ bctbx_EDDSAContext_t *bctbx_EDDSAInit(void) {
 	}
 #endif // EC448_ENABLED
 
+/**
+ * @brief zero the keys held by a bctoolbox EdDSA context, buffers are kept allocated so the context can be reused
+ *
+ * @param[in,out]	context	the EdDSA context to wipe
+ */
+static void bctbx_EDDSAWipe(bctbx_EDDSAContext_t *context) {
+	if (context->secretKey != nullptr) {
+		cleanBuffer(context->secretKey, context->secretLength);
+	}
+	if (context->publicKey != nullptr) {
+		cleanBuffer(context->publicKey, context->pointCoordinateLength);
+	}
+}
+
 /**
  * @brief a wrapper around bctoolbox signature algorithms, implements the Signature interface
  *
@@ -110,27 +273,23 @@ class bctbx_EDDSA : public Signature<Curve> {
 		bctbx_EDDSAContext_t *m_context; // the EDDSA context
 	public :
 		/* accessors */
-		const DSA<Curve, lime::DSAtype::privateKey> get_secret(void) override {
+		void get_secret(DSA<Curve, lime::DSAtype::privateKey> &secretKey) override {
 			if (m_context->secretKey == nullptr) {
 				throw BCTBX_EXCEPTION << "invalid EdDSA secret key";
 			}
 			if (DSA<Curve, lime::DSAtype::privateKey>::ssize() != m_context->secretLength) {
 				throw BCTBX_EXCEPTION << "Invalid buffer to store EdDSA secret key";
 			}
-			DSA<Curve, lime::DSAtype::privateKey> s;
-			std::copy_n(m_context->secretKey, s.ssize(), s.data());
-			return s;
+			std::copy_n(m_context->secretKey, secretKey.ssize(), secretKey.data());
 		}
-		const DSA<Curve, lime::DSAtype::publicKey> get_public(void) override {
+		void get_public(DSA<Curve, lime::DSAtype::publicKey> &publicKey) override {
 			if (m_context->publicKey == nullptr) {
 				throw BCTBX_EXCEPTION << "invalid EdDSA public key";
 			}
 			if (DSA<Curve, lime::DSAtype::publicKey>::ssize() != m_context->pointCoordinateLength) {
 				throw BCTBX_EXCEPTION << "Invalid buffer to store EdDSA public key";
 			}
-			DSA<Curve, lime::DSAtype::publicKey> p;
-			std::copy_n(m_context->publicKey, p.ssize(), p.data());
-			return p;
+			std::copy_n(m_context->publicKey, publicKey.ssize(), publicKey.data());
 		}
 
 		/* Setting keys */
@@ -174,6 +333,13 @@ class bctbx_EDDSA : public Signature<Curve> {
 			return (bctbx_EDDSA_verify(m_context, message.data(), message.ssize(), nullptr, 0, signature.data(), signature.ssize()) == BCTBX_VERIFY_SUCCESS);
 		}
 
+		/**
+		 * @brief zero all keys held by the context before it is reused
+		 */
+		void wipe(void) {
+			bctbx_EDDSAWipe(m_context);
+		}
+
 		bctbx_EDDSA() {
 			m_context = bctbx_EDDSAInit<Curve>();
 		}
@@ -217,51 +383,51 @@ template <typename Curve>
 class bctbx_ECDH : public keyExchange<Curve> {
 	private :
 		bctbx_ECDHContext_t *m_context; // the ECDH context
+		bctbx_EDDSAContext_t *m_conversionContext; // EdDSA context used to convert keys from signature format, created at first use
+
+		bctbx_EDDSAContext_t *conversionContext(void) {
+			if (m_conversionContext == nullptr) {
+				m_conversionContext = bctbx_EDDSAInit<Curve>();
+			}
+			return m_conversionContext;
+		}
 	public :
 		/* accessors */
-		const X<Curve, lime::Xtype::privateKey> get_secret(void) override {
+		void get_secret(X<Curve, lime::Xtype::privateKey> &secret) override {
 			if (m_context->secret == nullptr) {
 				throw BCTBX_EXCEPTION << "invalid ECDH secret key";
 			}
 			if (X<Curve, lime::Xtype::privateKey>::ssize() != m_context->secretLength) {
 				throw BCTBX_EXCEPTION << "Invalid buffer to store ECDH secret key";
 			}
-			X<Curve, lime::Xtype::privateKey> s;
-			std::copy_n(m_context->secret, s.ssize(), s.data());
-			return s;
+			std::copy_n(m_context->secret, secret.ssize(), secret.data());
 		}
-		const X<Curve, lime::Xtype::publicKey> get_selfPublic(void) override {
+		void get_selfPublic(X<Curve, lime::Xtype::publicKey> &selfPublic) override {
 			if (m_context->selfPublic == nullptr) {
 				throw BCTBX_EXCEPTION << "invalid ECDH self public key";
 			}
 			if (X<Curve, lime::Xtype::publicKey>::ssize() != m_context->pointCoordinateLength) {
 				throw BCTBX_EXCEPTION << "Invalid buffer to store ECDH self public key";
 			}
-			X<Curve, lime::Xtype::publicKey> p;
-			std::copy_n(m_context->selfPublic, p.ssize(), p.data());
-			return p;
+			std::copy_n(m_context->selfPublic, selfPublic.ssize(), selfPublic.data());
 		}
-		const X<Curve, lime::Xtype::publicKey> get_peerPublic(void) override {
+		void get_peerPublic(X<Curve, lime::Xtype::publicKey> &peerPublic) override {
 			if (m_context->peerPublic == nullptr) {
 				throw BCTBX_EXCEPTION << "invalid ECDH peer public key";
 			}
 			if (X<Curve, lime::Xtype::publicKey>::ssize() != m_context->pointCoordinateLength) {
 				throw BCTBX_EXCEPTION << "Invalid buffer to store ECDH peer public key";
 			}
-			X<Curve, lime::Xtype::publicKey> p;
-			std::copy_n(m_context->peerPublic, p.ssize(), p.data());
-			return p;
+			std::copy_n(m_context->peerPublic, peerPublic.ssize(), peerPublic.data());
 		}
-		const X<Curve, lime::Xtype::sharedSecret> get_sharedSecret(void) override {
+		void get_sharedSecret(X<Curve, lime::Xtype::sharedSecret> &sharedSecret) override {
 			if (m_context->sharedSecret == nullptr) {
 				throw BCTBX_EXCEPTION << "invalid ECDH shared secret";
 			}
 			if (X<Curve, lime::Xtype::sharedSecret>::ssize() != m_context->pointCoordinateLength) {
 				throw BCTBX_EXCEPTION << "Invalid buffer to store ECDH output";
 			}
-			X<Curve, lime::Xtype::sharedSecret> s;
-			std::copy_n(m_context->sharedSecret, s.ssize(), s.data());
-			return s;
+			std::copy_n(m_context->sharedSecret, sharedSecret.ssize(), sharedSecret.data());
 		}
 
 
@@ -271,15 +437,15 @@ class bctbx_ECDH : public keyExchange<Curve> {
 		}
 
 		void set_secret(const DSA<Curve, lime::DSAtype::privateKey> &secret) override {
-			// we must create a temporary bctbx_EDDSA context and set the given key in
-			auto tmp_context = bctbx_EDDSAInit<Curve>();
+			// set the given key in our EdDSA conversion context
+			auto tmp_context = conversionContext();
 			bctbx_EDDSA_setSecretKey(tmp_context, secret.data(), secret.ssize());
 
 			// Convert
 			bctbx_EDDSA_ECDH_privateKeyConversion(tmp_context, m_context);
 
 			// Cleaning
-			bctbx_DestroyEDDSAContext(tmp_context);
+			bctbx_EDDSAWipe(tmp_context);
 		}
 
 		void set_selfPublic(const X<Curve, lime::Xtype::publicKey> &selfPublic) override {
@@ -287,15 +453,15 @@ class bctbx_ECDH : public keyExchange<Curve> {
 		}
 
 		void set_selfPublic(const DSA<Curve, lime::DSAtype::publicKey> &selfPublic) override {
-			// we must create a temporary bctbx_EDDSA context and set the given key in
-			auto tmp_context = bctbx_EDDSAInit<Curve>();
+			// set the given key in our EdDSA conversion context
+			auto tmp_context = conversionContext();
 			bctbx_EDDSA_setPublicKey(tmp_context, selfPublic.data(), selfPublic.ssize());
 
 			// Convert in self Public
 			bctbx_EDDSA_ECDH_publicKeyConversion(tmp_context, m_context, BCTBX_ECDH_ISSELF);
 
 			// Cleaning
-			bctbx_DestroyEDDSAContext(tmp_context);
+			bctbx_EDDSAWipe(tmp_context);
 		}
 
 		void set_peerPublic(const X<Curve, lime::Xtype::publicKey> &peerPublic) override {
@@ -303,15 +469,15 @@ class bctbx_ECDH : public keyExchange<Curve> {
 		}
 
 		void set_peerPublic(const DSA<Curve, lime::DSAtype::publicKey> &peerPublic) override {
-			// we must create a temporary bctbx_EDDSA context and set the given key in
-			auto tmp_context = bctbx_EDDSAInit<Curve>();
+			// set the given key in our EdDSA conversion context
+			auto tmp_context = conversionContext();
 			bctbx_EDDSA_setPublicKey(tmp_context, peerPublic.data(), peerPublic.ssize());
 
 			// Convert in peer Public
 			bctbx_EDDSA_ECDH_publicKeyConversion(tmp_context, m_context, BCTBX_ECDH_ISPEER);
 
 			// Cleaning
-			bctbx_DestroyEDDSAContext(tmp_context);
+			bctbx_EDDSAWipe(tmp_context);
 		}
 
 		void createKeyPair(std::shared_ptr<lime::RNG> rng) override {
@@ -332,13 +498,31 @@ class bctbx_ECDH : public keyExchange<Curve> {
 			 bctbx_ECDHComputeSecret(m_context, nullptr, nullptr);
 		}
 
-		bctbx_ECDH() {
+		/**
+		 * @brief zero all keys held by the context before it is reused
+		 */
+		void wipe(void) {
+			if (m_context->secret != nullptr) {
+				cleanBuffer(m_context->secret, m_context->secretLength);
+			}
+			for (auto key : {m_context->sharedSecret, m_context->selfPublic, m_context->peerPublic}) {
+				if (key != nullptr) {
+					cleanBuffer(key, m_context->pointCoordinateLength);
+				}
+			}
+		}
+
+		bctbx_ECDH() : m_conversionContext{nullptr} {
 			m_context = bctbx_ECDHInit<Curve>();
 		}
 		~bctbx_ECDH(){
 			/* perform proper destroy cleaning buffers*/
 			bctbx_DestroyECDHContext(m_context);
 			m_context = nullptr;
+			if (m_conversionContext != nullptr) {
+				bctbx_DestroyEDDSAContext(m_conversionContext);
+				m_conversionContext = nullptr;
+			}
 		}
 }; // class bctbx_ECDH
 
@@ -346,12 +530,772 @@ class bctbx_ECDH : public keyExchange<Curve> {
 /* Factory functions */
 template <typename Curve>
 std::shared_ptr<keyExchange<Curve>> make_keyExchange() {
-	return std::make_shared<bctbx_ECDH<Curve>>();
+#ifdef LIME_OPENSSL_BACKEND
+	if (get_cryptoBackend() == CryptoBackend::openssl) {
+		return openssl_backend::make_keyExchange<Curve>();
+	}
+#endif
+	return contextPool<bctbx_ECDH<Curve>>::get();
 }
 
 template <typename Curve>
 std::shared_ptr<Signature<Curve>> make_Signature() {
-	return std::make_shared<bctbx_EDDSA<Curve>>();
+#ifdef LIME_OPENSSL_BACKEND
+	if (get_cryptoBackend() == CryptoBackend::openssl) {
+		return openssl_backend::make_Signature<Curve>();
+	}
+#endif
+	return contextPool<bctbx_EDDSA<Curve>>::get();
+}
+
+/* none of the backends provides batch verification: use a single context for the whole batch and stop at the first invalid signature */
+template <typename Curve>
+bool verify_batch(const std::vector<SignedXPublicKey<Curve>> &signedKeys) {
+	if (signedKeys.empty()) {
+		return true;
+	}
+	auto verifier = make_Signature<Curve>();
+	for (const auto &signedKey : signedKeys) {
+		verifier->set_public(signedKey.signerPublicKey);
+		if (!verifier->verify(signedKey.key, signedKey.signature)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/***** X25519 multi-lane scalar multiplication ***********/
+/* RFC 7748 Montgomery ladder over GF(2^255-19) in radix 2^25.5: 10 unsigned limbs of 26 and 25 bits alternately,
+ * each 64 bits lane of a limb register belongs to an independent ladder */
+namespace {
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define LIME_X25519_MULTIBUFFER
+#define LIME_X25519_TARGET __attribute__((target("avx2")))
+#define LIME_X25519_UNROLL _Pragma("GCC unroll 10") // limbs loops must be unrolled to keep the accumulators in registers
+	constexpr size_t X25519_lanes = 4;
+	constexpr size_t X25519_size = 32;
+	using X25519_limbs = std::array<uint64_t, 10>;
+
+	struct X25519_fe {
+		__m256i v[10];
+	};
+
+	/* limbs of 2*p, added before a subtraction so limbs never get negative */
+	constexpr X25519_limbs X25519_2p{{0x7ffffda, 0x3fffffe, 0x7fffffe, 0x3fffffe, 0x7fffffe, 0x3fffffe, 0x7fffffe, 0x3fffffe, 0x7fffffe, 0x3fffffe}};
+
+	LIME_X25519_TARGET inline __m256i X25519_broadcast(const uint64_t a) {
+		return _mm256_set1_epi64x(static_cast<long long>(a));
+	}
+
+	LIME_X25519_TARGET inline __m256i X25519_mul19(const __m256i a) {
+		return _mm256_add_epi64(_mm256_add_epi64(a, _mm256_slli_epi64(a, 1)), _mm256_slli_epi64(a, 4));
+	}
+
+	LIME_X25519_TARGET inline void X25519_carryEven(X25519_fe &h, const size_t i) {
+		h.v[i+1] = _mm256_add_epi64(h.v[i+1], _mm256_srli_epi64(h.v[i], 26));
+		h.v[i] = _mm256_and_si256(h.v[i], X25519_broadcast(0x3ffffff));
+	}
+
+	LIME_X25519_TARGET inline void X25519_carryOdd(X25519_fe &h, const size_t i) {
+		h.v[i+1] = _mm256_add_epi64(h.v[i+1], _mm256_srli_epi64(h.v[i], 25));
+		h.v[i] = _mm256_and_si256(h.v[i], X25519_broadcast(0x1ffffff));
+	}
+
+	/* bring limbs of up to 62 bits back to 26/25 bits(limb 1 may get a few more bits), the top carry wraps to limb 0 multiplied by 19 */
+	LIME_X25519_TARGET inline void X25519_carry(X25519_fe &h) {
+		for (size_t i=0; i<8; i+=2) {
+			X25519_carryEven(h, i);
+			X25519_carryOdd(h, i+1);
+		}
+		X25519_carryEven(h, 8);
+		const __m256i c = _mm256_srli_epi64(h.v[9], 25);
+		h.v[9] = _mm256_and_si256(h.v[9], X25519_broadcast(0x1ffffff));
+		h.v[0] = _mm256_add_epi64(h.v[0], X25519_mul19(c));
+		X25519_carryEven(h, 0);
+	}
+
+	LIME_X25519_TARGET inline void X25519_add(X25519_fe &h, const X25519_fe &f, const X25519_fe &g) {
+		for (size_t i=0; i<10; i++) {
+			h.v[i] = _mm256_add_epi64(f.v[i], g.v[i]);
+		}
+	}
+
+	/* f and g must be carried */
+	LIME_X25519_TARGET inline void X25519_sub(X25519_fe &h, const X25519_fe &f, const X25519_fe &g) {
+		for (size_t i=0; i<10; i++) {
+			h.v[i] = _mm256_sub_epi64(_mm256_add_epi64(f.v[i], X25519_broadcast(X25519_2p[i])), g.v[i]);
+		}
+	}
+
+	/* operands limbs must fit in 28 bits(carried, sum or difference of carried elements), products are accumulated on 64 bits */
+	LIME_X25519_TARGET inline void X25519_mul(X25519_fe &h, const X25519_fe &f, const X25519_fe &g) {
+		__m256i f2[10]; // odd limbs products of odd limbs are doubled: they land between the 25.5 bits boundaries
+		for (size_t i=0; i<10; i++) {
+			f2[i] = (i&1)?_mm256_add_epi64(f.v[i], f.v[i]):f.v[i];
+		}
+		__m256i lo[10], hi[10]; // hi limbs weight 2^255 = 19
+		for (size_t k=0; k<10; k++) {
+			lo[k] = _mm256_setzero_si256();
+			hi[k] = _mm256_setzero_si256();
+		}
+		LIME_X25519_UNROLL
+		for (size_t i=0; i<10; i++) {
+			LIME_X25519_UNROLL
+			for (size_t j=0; j<10; j++) {
+				const __m256i p = _mm256_mul_epu32(((i&j)&1)?f2[i]:f.v[i], g.v[j]);
+				if (i+j < 10) {
+					lo[i+j] = _mm256_add_epi64(lo[i+j], p);
+				} else {
+					hi[i+j-10] = _mm256_add_epi64(hi[i+j-10], p);
+				}
+			}
+		}
+		for (size_t k=0; k<10; k++) {
+			h.v[k] = _mm256_add_epi64(lo[k], X25519_mul19(hi[k]));
+		}
+		X25519_carry(h);
+	}
+
+	/* same as X25519_mul(h, f, f) but the symmetric products are computed once and doubled */
+	LIME_X25519_TARGET inline void X25519_sq1(X25519_fe &h, const X25519_fe &f) {
+		__m256i f2[10], f4[10]; // 2*f, and 4*f for odd limbs(their products with odd limbs are doubled too)
+		for (size_t i=0; i<10; i++) {
+			f2[i] = _mm256_add_epi64(f.v[i], f.v[i]);
+			f4[i] = (i&1)?_mm256_add_epi64(f2[i], f2[i]):f2[i];
+		}
+		__m256i lo[10], hi[10];
+		for (size_t k=0; k<10; k++) {
+			lo[k] = _mm256_setzero_si256();
+			hi[k] = _mm256_setzero_si256();
+		}
+		LIME_X25519_UNROLL
+		for (size_t i=0; i<10; i++) {
+			const __m256i p = _mm256_mul_epu32((i&1)?f2[i]:f.v[i], f.v[i]);
+			if (2*i < 10) {
+				lo[2*i] = _mm256_add_epi64(lo[2*i], p);
+			} else {
+				hi[2*i-10] = _mm256_add_epi64(hi[2*i-10], p);
+			}
+			LIME_X25519_UNROLL
+			for (size_t j=i+1; j<10; j++) {
+				const __m256i q = _mm256_mul_epu32(((i&j)&1)?f4[i]:f2[i], f.v[j]);
+				if (i+j < 10) {
+					lo[i+j] = _mm256_add_epi64(lo[i+j], q);
+				} else {
+					hi[i+j-10] = _mm256_add_epi64(hi[i+j-10], q);
+				}
+			}
+		}
+		for (size_t k=0; k<10; k++) {
+			h.v[k] = _mm256_add_epi64(lo[k], X25519_mul19(hi[k]));
+		}
+		X25519_carry(h);
+	}
+
+	/* n successive squarings */
+	LIME_X25519_TARGET inline void X25519_sq(X25519_fe &h, const X25519_fe &f, const size_t n=1) {
+		X25519_sq1(h, f);
+		for (size_t i=1; i<n; i++) {
+			X25519_sq1(h, h);
+		}
+	}
+
+	/* multiply by a24 = (486662-2)/4 */
+	LIME_X25519_TARGET inline void X25519_mulA24(X25519_fe &h, const X25519_fe &f) {
+		const __m256i a24 = X25519_broadcast(121665);
+		for (size_t i=0; i<10; i++) {
+			h.v[i] = _mm256_mul_epu32(f.v[i], a24);
+		}
+		X25519_carry(h);
+	}
+
+	/* swap f and g in lanes where mask is all ones */
+	LIME_X25519_TARGET inline void X25519_cswap(X25519_fe &f, X25519_fe &g, const __m256i mask) {
+		for (size_t i=0; i<10; i++) {
+			const __m256i t = _mm256_and_si256(_mm256_xor_si256(f.v[i], g.v[i]), mask);
+			f.v[i] = _mm256_xor_si256(f.v[i], t);
+			g.v[i] = _mm256_xor_si256(g.v[i], t);
+		}
+	}
+
+	/* z^(p-2) */
+	LIME_X25519_TARGET inline void X25519_invert(X25519_fe &out, const X25519_fe &z) {
+		X25519_fe t0, t1, t2, t3;
+		X25519_sq(t0, z); // z^2
+		X25519_sq(t1, t0, 2); // z^8
+		X25519_mul(t1, z, t1); // z^9
+		X25519_mul(t0, t0, t1); // z^11
+		X25519_sq(t2, t0); // z^22
+		X25519_mul(t1, t1, t2); // z^(2^5-1)
+		X25519_sq(t2, t1, 5);
+		X25519_mul(t1, t2, t1); // z^(2^10-1)
+		X25519_sq(t2, t1, 10);
+		X25519_mul(t2, t2, t1); // z^(2^20-1)
+		X25519_sq(t3, t2, 20);
+		X25519_mul(t2, t3, t2); // z^(2^40-1)
+		X25519_sq(t2, t2, 10);
+		X25519_mul(t1, t2, t1); // z^(2^50-1)
+		X25519_sq(t2, t1, 50);
+		X25519_mul(t2, t2, t1); // z^(2^100-1)
+		X25519_sq(t3, t2, 100);
+		X25519_mul(t2, t3, t2); // z^(2^200-1)
+		X25519_sq(t2, t2, 50);
+		X25519_mul(t1, t2, t1); // z^(2^250-1)
+		X25519_sq(t1, t1, 5); // z^(2^255-32)
+		X25519_mul(out, t1, t0); // z^(2^255-21)
+	}
+
+	inline uint64_t X25519_load4(const uint8_t *in) {
+		return static_cast<uint64_t>(in[0]) | (static_cast<uint64_t>(in[1])<<8) | (static_cast<uint64_t>(in[2])<<16) | (static_cast<uint64_t>(in[3])<<24);
+	}
+
+	/* u-coordinate to limbs, the most significant bit is masked as requested by RFC 7748 */
+	void X25519_fromBytes(X25519_limbs &h, const uint8_t *s) {
+		h[0] = X25519_load4(s) & 0x3ffffff;
+		h[1] = (X25519_load4(s+3) >> 2) & 0x1ffffff;
+		h[2] = (X25519_load4(s+6) >> 3) & 0x3ffffff;
+		h[3] = (X25519_load4(s+9) >> 5) & 0x1ffffff;
+		h[4] = (X25519_load4(s+12) >> 6) & 0x3ffffff;
+		h[5] = X25519_load4(s+16) & 0x1ffffff;
+		h[6] = (X25519_load4(s+19) >> 1) & 0x3ffffff;
+		h[7] = (X25519_load4(s+22) >> 3) & 0x1ffffff;
+		h[8] = (X25519_load4(s+25) >> 4) & 0x3ffffff;
+		h[9] = (X25519_load4(s+28) >> 6) & 0x1ffffff;
+	}
+
+	/* carried limbs to the canonical little endian encoding: subtract p if needed */
+	void X25519_toBytes(uint8_t *s, const X25519_limbs &limbs) {
+		int64_t h[10];
+		for (size_t i=0; i<10; i++) {
+			h[i] = static_cast<int64_t>(limbs[i]);
+		}
+		int64_t q = (19*h[9] + (static_cast<int64_t>(1) << 24)) >> 25;
+		for (size_t i=0; i<10; i++) {
+			q = (h[i] + q) >> ((i&1)?25:26);
+		}
+		h[0] += 19*q;
+		for (size_t i=0; i<9; i++) {
+			const int shift = (i&1)?25:26;
+			const int64_t carry = h[i] >> shift;
+			h[i+1] += carry;
+			h[i] -= carry << shift;
+		}
+		h[9] &= 0x1ffffff;
+
+		constexpr std::array<size_t, 10> position{{0, 26, 51, 77, 102, 128, 153, 179, 204, 230}};
+		std::fill(s, s+X25519_size, 0);
+		for (size_t i=0; i<10; i++) {
+			const auto value = static_cast<uint64_t>(h[i]) << (position[i]%8);
+			for (size_t b=0; b<5 && position[i]/8+b < X25519_size; b++) {
+				s[position[i]/8+b] |= static_cast<uint8_t>(value >> (8*b));
+			}
+		}
+		cleanBuffer(reinterpret_cast<uint8_t *>(h), sizeof(h));
+	}
+
+	/* compute scalars[l]*points[l] into outputs[l] for the 4 lanes */
+	LIME_X25519_TARGET void X25519_ladderLanes(const uint8_t *const *scalars, const uint8_t *const *points, uint8_t *const *outputs) {
+		std::array<std::array<uint8_t, X25519_size>, X25519_lanes> k{};
+		X25519_limbs u[X25519_lanes];
+		for (size_t l=0; l<X25519_lanes; l++) {
+			std::copy_n(scalars[l], X25519_size, k[l].begin());
+			k[l][0] &= 248; // clamp scalar
+			k[l][31] &= 127;
+			k[l][31] |= 64;
+			X25519_fromBytes(u[l], points[l]);
+		}
+
+		X25519_fe x1, x2, z2, x3, z3, A, AA, B, BB, E, C, D, DA, CB;
+		for (size_t i=0; i<10; i++) {
+			x1.v[i] = _mm256_set_epi64x(static_cast<long long>(u[3][i]), static_cast<long long>(u[2][i]), static_cast<long long>(u[1][i]), static_cast<long long>(u[0][i]));
+			x2.v[i] = X25519_broadcast(i==0?1:0);
+			z2.v[i] = _mm256_setzero_si256();
+			x3.v[i] = x1.v[i];
+			z3.v[i] = x2.v[i];
+		}
+
+		__m256i swap = _mm256_setzero_si256();
+		for (int t=254; t>=0; t--) {
+			long long bits[X25519_lanes];
+			for (size_t l=0; l<X25519_lanes; l++) {
+				bits[l] = -static_cast<long long>((k[l][t>>3] >> (t&7)) & 1);
+			}
+			const __m256i k_t = _mm256_set_epi64x(bits[3], bits[2], bits[1], bits[0]);
+			swap = _mm256_xor_si256(swap, k_t);
+			X25519_cswap(x2, x3, swap);
+			X25519_cswap(z2, z3, swap);
+			swap = k_t;
+
+			X25519_add(A, x2, z2);
+			X25519_sq(AA, A);
+			X25519_sub(B, x2, z2);
+			X25519_sq(BB, B);
+			X25519_sub(E, AA, BB);
+			X25519_add(C, x3, z3);
+			X25519_sub(D, x3, z3);
+			X25519_mul(DA, D, A);
+			X25519_mul(CB, C, B);
+			X25519_add(x3, DA, CB);
+			X25519_sq(x3, x3);
+			X25519_sub(z3, DA, CB);
+			X25519_sq(z3, z3);
+			X25519_mul(z3, x1, z3);
+			X25519_mul(x2, AA, BB);
+			X25519_mulA24(z2, E);
+			X25519_add(z2, AA, z2);
+			X25519_mul(z2, E, z2);
+		}
+		X25519_cswap(x2, x3, swap);
+		X25519_cswap(z2, z3, swap);
+
+		X25519_invert(z2, z2);
+		X25519_mul(x2, x2, z2);
+
+		alignas(32) uint64_t limb[X25519_lanes];
+		for (size_t i=0; i<10; i++) {
+			_mm256_store_si256(reinterpret_cast<__m256i *>(limb), x2.v[i]);
+			for (size_t l=0; l<X25519_lanes; l++) {
+				u[l][i] = limb[l];
+			}
+		}
+		for (size_t l=0; l<X25519_lanes; l++) {
+			X25519_toBytes(outputs[l], u[l]);
+		}
+
+		// wipe secret material: scalars and intermediate values (the ladder state depends on the scalar bits)
+		cleanBuffer(reinterpret_cast<uint8_t *>(k.data()), sizeof(k));
+		cleanBuffer(reinterpret_cast<uint8_t *>(u), sizeof(u));
+		cleanBuffer(reinterpret_cast<uint8_t *>(limb), sizeof(limb));
+		for (auto fe : {&x2, &z2, &x3, &z3, &A, &AA, &B, &BB, &E, &C, &D, &DA, &CB}) {
+			cleanBuffer(reinterpret_cast<uint8_t *>(fe->v), sizeof(fe->v));
+		}
+	}
+
+	bool X25519_multiSupported(void) {
+		static const bool supported = []() -> bool {
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+		}();
+		return supported;
+	}
+#undef LIME_X25519_TARGET
+#undef LIME_X25519_UNROLL
+#endif // multi-lane X25519
+} // anonymous namespace
+
+/* compute the entries one by one using a key exchange context */
+template <typename Curve>
+static void X_batch_oneByOne(const XbatchEntry<Curve> *entries, const size_t count) {
+	if (count == 0) {
+		return;
+	}
+	auto DH = make_keyExchange<Curve>();
+	X<Curve, lime::Xtype::sharedSecret> sharedSecret; // reused for all entries
+	X<Curve, lime::Xtype::publicKey> selfPublic;
+	for (size_t i=0; i<count; i++) {
+		DH->set_secret(*(entries[i].secret));
+		if (entries[i].peerPublic != nullptr) {
+			DH->set_peerPublic(*(entries[i].peerPublic));
+			DH->computeSharedSecret();
+			DH->get_sharedSecret(sharedSecret);
+			std::copy_n(sharedSecret.cbegin(), sharedSecret.size(), entries[i].output);
+		} else {
+			DH->deriveSelfPublic();
+			DH->get_selfPublic(selfPublic);
+			std::copy_n(selfPublic.cbegin(), selfPublic.size(), entries[i].output);
+		}
+	}
+}
+
+template <typename Curve>
+void X_batch(const std::vector<XbatchEntry<Curve>> &entries) {
+	X_batch<Curve>(entries.data(), entries.size());
+}
+
+template <typename Curve>
+void X_batch(const XbatchEntry<Curve> *entries, const size_t count) {
+#ifdef LIME_X25519_MULTIBUFFER
+	if constexpr (std::is_same<Curve, C255>::value) {
+		if (count > 1 && X25519_multiSupported()) {
+			static constexpr std::array<uint8_t, X25519_size> basePoint{{9}};
+			std::array<const uint8_t *, X25519_lanes> scalars{}, points{};
+			std::array<uint8_t *, X25519_lanes> outputs{};
+			std::array<std::array<uint8_t, X25519_size>, X25519_lanes> dummyOutputs{};
+			for (size_t i=0; i<count; i+=X25519_lanes) {
+				for (size_t l=0; l<X25519_lanes; l++) {
+					if (i+l < count) {
+						const auto &entry = entries[i+l];
+						scalars[l] = entry.secret->data();
+						points[l] = (entry.peerPublic != nullptr)?entry.peerPublic->data():basePoint.data();
+						outputs[l] = entry.output;
+					} else { // fill the missing lanes of the last run with dummy jobs
+						scalars[l] = basePoint.data();
+						points[l] = basePoint.data();
+						outputs[l] = dummyOutputs[l].data();
+					}
+				}
+				X25519_ladderLanes(scalars.data(), points.data(), outputs.data());
+			}
+			return;
+		}
+	}
+#endif
+	X_batch_oneByOne<Curve>(entries, count);
+}
+
+/***** SHA512 compression ***********/
+/* FIPS 180-4 SHA512, used only by HMACkey and HMAC_batch which need to resume hashing from the precomputed key pads states */
+namespace {
+	constexpr size_t SHA512_blockSize = 128;
+	using SHA512state = std::array<uint64_t, 8>;
+
+	constexpr std::array<uint64_t, 80> SHA512_K{{
+		0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL,
+		0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL, 0x12835b0145706fbeULL,
+		0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL, 0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+		0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+		0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL, 0x983e5152ee66dfabULL,
+		0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+		0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL,
+		0x53380d139d95b3dfULL, 0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+		0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+		0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL, 0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL,
+		0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL,
+		0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+		0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL, 0xca273eceea26619cULL,
+		0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL,
+		0x113f9804bef90daeULL, 0x1b710b35131c471bULL, 0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+		0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+	}};
+
+	constexpr std::array<uint64_t, 8> SHA512_IV{{
+		0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+		0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+	}};
+
+	inline uint64_t rotr64(const uint64_t x, const unsigned int n) {
+		return (x >> n) | (x << (64 - n));
+	}
+
+	/* process one 128 bytes block */
+	void SHA512_compress(std::array<uint64_t, 8> &state, const uint8_t *const block) {
+		std::array<uint64_t, 80> W;
+		for (size_t t=0; t<16; t++) {
+			W[t] = 0;
+			for (size_t b=0; b<8; b++) {
+				W[t] = (W[t] << 8) | block[8*t + b];
+			}
+		}
+		for (size_t t=16; t<80; t++) {
+			const uint64_t s0 = rotr64(W[t-15], 1) ^ rotr64(W[t-15], 8) ^ (W[t-15] >> 7);
+			const uint64_t s1 = rotr64(W[t-2], 19) ^ rotr64(W[t-2], 61) ^ (W[t-2] >> 6);
+			W[t] = W[t-16] + s0 + W[t-7] + s1;
+		}
+
+		uint64_t a=state[0], b=state[1], c=state[2], d=state[3], e=state[4], f=state[5], g=state[6], h=state[7];
+		for (size_t t=0; t<80; t++) {
+			const uint64_t T1 = h + (rotr64(e, 14) ^ rotr64(e, 18) ^ rotr64(e, 41)) + ((e & f) ^ (~e & g)) + SHA512_K[t] + W[t];
+			const uint64_t T2 = (rotr64(a, 28) ^ rotr64(a, 34) ^ rotr64(a, 39)) + ((a & b) ^ (a & c) ^ (b & c));
+			h = g; g = f; f = e; e = d + T1;
+			d = c; c = b; b = a; a = T1 + T2;
+		}
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+		state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+		cleanBuffer(reinterpret_cast<uint8_t *>(W.data()), W.size()*sizeof(uint64_t));
+	}
+
+	/* output state as big endian words, truncated to the requested size */
+	void SHA512_digest(const SHA512state &state, uint8_t *hash, const size_t hashSize) {
+		for (size_t i=0; i<std::min(hashSize, SHA512::ssize()); i++) {
+			hash[i] = static_cast<uint8_t>(state[i/8] >> (56 - 8*(i%8)));
+		}
+	}
+
+	/**
+	 * process the last part of the message, pad it and write the digest
+	 * prefixSize is the amount of data already processed in state, it must be a multiple of the block size
+	 */
+	void SHA512_final(std::array<uint64_t, 8> state, const size_t prefixSize, const uint8_t *input, size_t inputSize, uint8_t *hash, const size_t hashSize) {
+		const uint64_t bitLength = static_cast<uint64_t>(prefixSize + inputSize) << 3;
+		while (inputSize >= SHA512_blockSize) {
+			SHA512_compress(state, input);
+			input += SHA512_blockSize;
+			inputSize -= SHA512_blockSize;
+		}
+
+		// padding: 0x80, zeros and a 128 bits length (we never hash more than 2^64 bits, the upper half is 0)
+		std::array<uint8_t, 2*SHA512_blockSize> lastBlocks{};
+		std::copy_n(input, inputSize, lastBlocks.begin());
+		lastBlocks[inputSize] = 0x80;
+		const size_t lastBlocksSize = (inputSize + 17 > SHA512_blockSize) ? 2*SHA512_blockSize : SHA512_blockSize;
+		for (size_t b=0; b<8; b++) {
+			lastBlocks[lastBlocksSize - 1 - b] = static_cast<uint8_t>(bitLength >> (8*b));
+		}
+		for (size_t i=0; i<lastBlocksSize; i+=SHA512_blockSize) {
+			SHA512_compress(state, lastBlocks.data()+i);
+		}
+
+		SHA512_digest(state, hash, hashSize);
+		cleanBuffer(lastBlocks.data(), lastBlocks.size());
+		cleanBuffer(reinterpret_cast<uint8_t *>(state.data()), state.size()*sizeof(uint64_t));
+	}
+
+	/* largest input fitting in one final block with its padding */
+	constexpr size_t SHA512_maxSingleBlockInput = SHA512_blockSize - 17;
+
+	/* build the final block of a message: input(at most SHA512_maxSingleBlockInput bytes), padding and total message length */
+	void SHA512_padBlock(std::array<uint8_t, SHA512_blockSize> &block, const uint8_t *const input, const size_t inputSize, const size_t messageSize) {
+		block.fill(0);
+		std::copy_n(input, inputSize, block.begin());
+		block[inputSize] = 0x80;
+		const uint64_t bitLength = static_cast<uint64_t>(messageSize) << 3;
+		for (size_t b=0; b<8; b++) {
+			block[SHA512_blockSize - 1 - b] = static_cast<uint8_t>(bitLength >> (8*b));
+		}
+	}
+
+	/* A multi-buffer kernel compresses one block in each of its lanes states */
+	using SHA512_multiKernel = void (*)(SHA512state *const *states, const uint8_t *const *blocks);
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define LIME_SHA512_MULTIBUFFER
+#define LIME_ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+	/**
+	 * SHA512 compression of independent states, one per vector lane
+	 * It is always inlined in the kernels so it gets compiled for their target instruction set
+	 */
+	template <typename V, size_t lanes>
+	__attribute__((always_inline)) inline void SHA512_compress_lanes(SHA512state *const *states, const uint8_t *const *blocks) {
+		V W[80];
+		for (size_t t=0; t<16; t++) {
+			for (size_t l=0; l<lanes; l++) {
+				uint64_t w = 0;
+				for (size_t b=0; b<8; b++) {
+					w = (w << 8) | blocks[l][8*t + b];
+				}
+				W[t][l] = w;
+			}
+		}
+		for (size_t t=16; t<80; t++) {
+			const V s0 = LIME_ROTR64(W[t-15], 1) ^ LIME_ROTR64(W[t-15], 8) ^ (W[t-15] >> 7);
+			const V s1 = LIME_ROTR64(W[t-2], 19) ^ LIME_ROTR64(W[t-2], 61) ^ (W[t-2] >> 6);
+			W[t] = W[t-16] + s0 + W[t-7] + s1;
+		}
+
+		V S[8];
+		for (size_t i=0; i<8; i++) {
+			for (size_t l=0; l<lanes; l++) {
+				S[i][l] = (*states[l])[i];
+			}
+		}
+		V a=S[0], b=S[1], c=S[2], d=S[3], e=S[4], f=S[5], g=S[6], h=S[7];
+		for (size_t t=0; t<80; t++) {
+			const V T1 = h + (LIME_ROTR64(e, 14) ^ LIME_ROTR64(e, 18) ^ LIME_ROTR64(e, 41)) + ((e & f) ^ (~e & g)) + SHA512_K[t] + W[t];
+			const V T2 = (LIME_ROTR64(a, 28) ^ LIME_ROTR64(a, 34) ^ LIME_ROTR64(a, 39)) + ((a & b) ^ (a & c) ^ (b & c));
+			h = g; g = f; f = e; e = d + T1;
+			d = c; c = b; b = a; a = T1 + T2;
+		}
+		S[0] += a; S[1] += b; S[2] += c; S[3] += d;
+		S[4] += e; S[5] += f; S[6] += g; S[7] += h;
+		for (size_t i=0; i<8; i++) {
+			for (size_t l=0; l<lanes; l++) {
+				(*states[l])[i] = S[i][l];
+			}
+		}
+		cleanBuffer(reinterpret_cast<uint8_t *>(W), sizeof(W));
+	}
+#undef LIME_ROTR64
+
+	typedef uint64_t SHA512_u64x4 __attribute__((vector_size(32)));
+	typedef uint64_t SHA512_u64x8 __attribute__((vector_size(64)));
+
+	__attribute__((target("avx2"))) void SHA512_compress_avx2(SHA512state *const *states, const uint8_t *const *blocks) {
+		SHA512_compress_lanes<SHA512_u64x4, 4>(states, blocks);
+	}
+
+	__attribute__((target("avx512f"))) void SHA512_compress_avx512(SHA512state *const *states, const uint8_t *const *blocks) {
+		SHA512_compress_lanes<SHA512_u64x8, 8>(states, blocks);
+	}
+#endif // multi-buffer kernels
+
+	constexpr size_t SHA512_maxLanes = 8;
+
+	/* the multi-buffer kernel selected for this CPU, lanes is 1 and kernel nullptr when none is supported */
+	struct SHA512_multi {
+		size_t lanes;
+		SHA512_multiKernel kernel;
+	};
+
+	const SHA512_multi &SHA512_multiSelect(void) {
+		static const SHA512_multi selected = []() -> SHA512_multi {
+#ifdef LIME_SHA512_MULTIBUFFER
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx512f")) {
+				return {8, SHA512_compress_avx512};
+			}
+			if (__builtin_cpu_supports("avx2")) {
+				return {4, SHA512_compress_avx2};
+			}
+#endif
+			return {1, nullptr};
+		}();
+		return selected;
+	}
+
+	/* compress blocks[i] into states[i] for all i < count, using the multi-buffer kernel for runs filling at least half of its lanes */
+	void SHA512_compress_multi(SHA512state *const *states, const uint8_t *const *blocks, const size_t count) {
+		const auto &multi = SHA512_multiSelect();
+		size_t i = 0;
+		if (multi.kernel != nullptr) {
+			for (; i+multi.lanes <= count; i+=multi.lanes) {
+				multi.kernel(states+i, blocks+i);
+			}
+			if (2*(count - i) >= multi.lanes) { // fill the missing lanes of the last run with dummy jobs, unless most of them would be idle
+				std::array<SHA512state, SHA512_maxLanes> dummyStates{};
+				std::array<SHA512state *, SHA512_maxLanes> lastStates{};
+				std::array<const uint8_t *, SHA512_maxLanes> lastBlocks{};
+				for (size_t l=0; l<multi.lanes; l++) {
+					lastStates[l] = (i+l < count) ? states[i+l] : &dummyStates[l];
+					lastBlocks[l] = (i+l < count) ? blocks[i+l] : blocks[i];
+				}
+				multi.kernel(lastStates.data(), lastBlocks.data());
+				cleanBuffer(reinterpret_cast<uint8_t *>(dummyStates.data()), sizeof(dummyStates));
+				return;
+			}
+		}
+		for (; i<count; i++) {
+			SHA512_compress(*states[i], blocks[i]);
+		}
+	}
+} // anonymous namespace
+
+HMACkey<SHA512>::HMACkey(const uint8_t *const key, const size_t keySize) : m_innerState(SHA512_IV), m_outerState(SHA512_IV) {
+	// keys longer than the block size are replaced by their hash
+	std::array<uint8_t, SHA512_blockSize> pad{};
+	if (keySize > SHA512_blockSize) {
+		SHA512_final(SHA512_IV, 0, key, keySize, pad.data(), SHA512::ssize());
+	} else if (keySize > 0) {
+		std::copy_n(key, keySize, pad.begin());
+	}
+
+	for (auto &b : pad) b ^= 0x36; // key XOR ipad
+	SHA512_compress(m_innerState, pad.data());
+	for (auto &b : pad) b ^= 0x36^0x5c; // key XOR opad
+	SHA512_compress(m_outerState, pad.data());
+	cleanBuffer(pad.data(), pad.size());
+}
+
+HMACkey<SHA512>::~HMACkey() {
+	cleanBuffer(reinterpret_cast<uint8_t *>(m_innerState.data()), m_innerState.size()*sizeof(uint64_t));
+	cleanBuffer(reinterpret_cast<uint8_t *>(m_outerState.data()), m_outerState.size()*sizeof(uint64_t));
+}
+
+void HMACkey<SHA512>::compute(const uint8_t *const input, const size_t inputSize, uint8_t *hash, const size_t hashSize) const {
+	std::array<uint8_t, SHA512::ssize()> innerHash;
+	SHA512_final(m_innerState, SHA512_blockSize, input, inputSize, innerHash.data(), innerHash.size());
+	SHA512_final(m_outerState, SHA512_blockSize, innerHash.data(), innerHash.size(), hash, hashSize);
+	cleanBuffer(innerHash.data(), innerHash.size());
+}
+
+/* HMAC_batch must use a specialized template */
+template <typename hashAlgo>
+void HMAC_batch(HMACbatchEntry *entries, const size_t count) {
+	/* if this template is instanciated the static_assert will fail but will give us an error message with faulty hash type */
+	static_assert(sizeof(hashAlgo) != sizeof(hashAlgo), "You must specialize HMAC_batch function template");
+}
+
+/* HMAC_batch specialized template for SHA512: entries are processed by chunks, each chunk runs three multi-buffer passes: keys pads, inner and outer hashes */
+template <> void HMAC_batch<SHA512>(HMACbatchEntry *entries, const size_t count) {
+	constexpr size_t chunkSize = 16;
+	std::array<SHA512state, chunkSize> innerKeys, outerKeys, work; // keys pads states and entries hash states
+	SHA512state carriedInnerKey{}, carriedOuterKey{}; // last key states of the previous chunk
+	std::array<size_t, chunkSize> keyIndex; // the keys states index of each entry in the chunk
+	std::array<std::array<uint8_t, SHA512_blockSize>, 2*chunkSize> blocks;
+	std::array<SHA512state *, 2*chunkSize> jobStates;
+	std::array<const uint8_t *, 2*chunkSize> jobBlocks;
+	std::array<std::array<uint8_t, SHA512::ssize()>, chunkSize> innerHashes;
+
+	for (size_t start=0; start<count; start+=chunkSize) {
+		const size_t n = std::min(chunkSize, count-start);
+		HMACbatchEntry *chunk = entries+start;
+
+		// keys: absorb each distinct key once. When the first entry shares the key of the previous chunk last entry, keep its states:
+		// the key buffer may have been overwritten by an output
+		size_t keysCount = 0, jobs = 0;
+		for (size_t e=0; e<n; e++) {
+			const bool sameKey = (start+e > 0) && (entries[start+e-1].key == chunk[e].key) && (entries[start+e-1].keySize == chunk[e].keySize);
+			if (sameKey && e > 0) {
+				keyIndex[e] = keysCount-1;
+				continue;
+			}
+			keyIndex[e] = keysCount;
+			if (sameKey) { // first entry of the chunk, using the last key of the previous chunk
+				innerKeys[0] = carriedInnerKey;
+				outerKeys[0] = carriedOuterKey;
+				keysCount++;
+				continue;
+			}
+			auto &pad = blocks[2*keysCount];
+			pad.fill(0);
+			if (chunk[e].keySize > SHA512_blockSize) { // keys longer than the block size are replaced by their hash
+				SHA512_final(SHA512_IV, 0, chunk[e].key, chunk[e].keySize, pad.data(), SHA512::ssize());
+			} else if (chunk[e].keySize > 0) {
+				std::copy_n(chunk[e].key, chunk[e].keySize, pad.begin());
+			}
+			auto &opad = blocks[2*keysCount+1];
+			for (size_t i=0; i<SHA512_blockSize; i++) {
+				opad[i] = pad[i]^0x5c;
+				pad[i] ^= 0x36;
+			}
+			innerKeys[keysCount] = SHA512_IV;
+			outerKeys[keysCount] = SHA512_IV;
+			jobStates[jobs] = &innerKeys[keysCount]; jobBlocks[jobs++] = pad.data();
+			jobStates[jobs] = &outerKeys[keysCount]; jobBlocks[jobs++] = opad.data();
+			keysCount++;
+		}
+		SHA512_compress_multi(jobStates.data(), jobBlocks.data(), jobs);
+
+		// inner hashes: H(key XOR ipad || input), inputs too long for a single block are hashed on their own
+		jobs = 0;
+		for (size_t e=0; e<n; e++) {
+			if (chunk[e].inputSize > SHA512_maxSingleBlockInput) {
+				SHA512_final(innerKeys[keyIndex[e]], SHA512_blockSize, chunk[e].input, chunk[e].inputSize, innerHashes[e].data(), SHA512::ssize());
+				continue;
+			}
+			work[e] = innerKeys[keyIndex[e]];
+			SHA512_padBlock(blocks[e], chunk[e].input, chunk[e].inputSize, SHA512_blockSize + chunk[e].inputSize);
+			jobStates[jobs] = &work[e]; jobBlocks[jobs++] = blocks[e].data();
+		}
+		SHA512_compress_multi(jobStates.data(), jobBlocks.data(), jobs);
+		for (size_t e=0; e<n; e++) {
+			if (chunk[e].inputSize <= SHA512_maxSingleBlockInput) {
+				SHA512_digest(work[e], innerHashes[e].data(), SHA512::ssize());
+			}
+		}
+
+		// outer hashes: H(key XOR opad || inner hash)
+		for (size_t e=0; e<n; e++) {
+			work[e] = outerKeys[keyIndex[e]];
+			SHA512_padBlock(blocks[e], innerHashes[e].data(), SHA512::ssize(), SHA512_blockSize + SHA512::ssize());
+			jobStates[e] = &work[e]; jobBlocks[e] = blocks[e].data();
+		}
+		SHA512_compress_multi(jobStates.data(), jobBlocks.data(), n);
+
+		// all keys and inputs of the chunk are consumed, outputs can be written
+		for (size_t e=0; e<n; e++) {
+			SHA512_digest(work[e], chunk[e].hash, chunk[e].hashSize);
+		}
+		// keep the last entry key states available for the next chunk
+		carriedInnerKey = innerKeys[keyIndex[n-1]];
+		carriedOuterKey = outerKeys[keyIndex[n-1]];
+	}
+	cleanBuffer(reinterpret_cast<uint8_t *>(carriedInnerKey.data()), sizeof(carriedInnerKey));
+	cleanBuffer(reinterpret_cast<uint8_t *>(carriedOuterKey.data()), sizeof(carriedOuterKey));
+	cleanBuffer(reinterpret_cast<uint8_t *>(innerKeys.data()), sizeof(innerKeys));
+	cleanBuffer(reinterpret_cast<uint8_t *>(outerKeys.data()), sizeof(outerKeys));
+	cleanBuffer(reinterpret_cast<uint8_t *>(work.data()), sizeof(work));
+	cleanBuffer(reinterpret_cast<uint8_t *>(blocks.data()), sizeof(blocks));
+	cleanBuffer(reinterpret_cast<uint8_t *>(innerHashes.data()), sizeof(innerHashes));
 }
 
 /* HMAC templates */
@@ -364,6 +1308,12 @@ void HMAC(const uint8_t *const key, const size_t keySize, const uint8_t *const i
 
 /* HMAC specialized template for SHA512 */
 template <> void HMAC<SHA512>(const uint8_t *const key, const size_t keySize, const uint8_t *const input, const size_t inputSize, uint8_t *hash, size_t hashSize) {
+#ifdef LIME_OPENSSL_BACKEND
+	if (get_cryptoBackend() == CryptoBackend::openssl) {
+		openssl_backend::HMAC_SHA512(key, keySize, input, inputSize, hash, hashSize);
+		return;
+	}
+#endif
 	bctbx_hmacSha512(key, keySize, input, inputSize, static_cast<uint8_t>(std::min(SHA512::ssize(),hashSize)), hash);
 }
 
@@ -371,13 +1321,24 @@ template <> void HMAC<SHA512>(const uint8_t *const key, const size_t keySize, co
 template <typename hashAlgo, typename infoType>
 void HMAC_KDF(const uint8_t *const salt, const size_t saltSize, const uint8_t *const ikm, const size_t ikmSize, const infoType &info, uint8_t *output, size_t outputSize) {
 	std::array<uint8_t, hashAlgo::ssize()> prk{}; // hold the output of pre-computation
-	// extraction
-	HMAC<hashAlgo>(salt, saltSize, ikm, ikmSize, prk.data(), prk.size());
+	// extraction, an empty salt is common enough(HMAC key is then a buffer of zeros) to keep its pads ready
+	if (saltSize == 0) {
+		static const HMACkey<hashAlgo> emptySalt{nullptr, 0};
+		emptySalt.compute(ikm, ikmSize, prk.data(), prk.size());
+	} else {
+		HMACkey<hashAlgo>{salt, saltSize}.compute(ikm, ikmSize, prk.data(), prk.size());
+	}
+
+	// all expansion rounds use PRK as key
+	const HMACkey<hashAlgo> prkKey{prk.data(), prk.size()};
+	cleanBuffer(prk.data(), prk.size());
 
 	// expansion round 0
-	std::vector<uint8_t> T(info.cbegin(), info.cend());
+	std::vector<uint8_t> T{};
+	T.reserve(hashAlgo::ssize() + info.size() + 1);
+	T.assign(info.cbegin(), info.cend());
 	T.push_back(0x01);
-	HMAC<hashAlgo>(prk.data(), prk.size(), T.data(), T.size(), output, outputSize);
+	prkKey.compute(T.data(), T.size(), output, outputSize);
 
 	// successives expansion rounds
 	size_t index = std::min(outputSize, hashAlgo::ssize());
@@ -385,10 +1346,9 @@ void HMAC_KDF(const uint8_t *const salt, const size_t saltSize, const uint8_t *c
 		T.assign(output+(i-2)*hashAlgo::ssize(), output+(i-1)*hashAlgo::ssize());
 		T.insert(T.end(), info.cbegin(), info.cend());
 		T.push_back(i);
-		HMAC<hashAlgo>(prk.data(), prk.size(), T.data(), T.size(), output+index, outputSize-index);
+		prkKey.compute(T.data(), T.size(), output+index, outputSize-index);
 		index += hashAlgo::ssize();
 	}
-	cleanBuffer(prk.data(), prk.size());
 	cleanBuffer(T.data(), T.size());
 }
 template <typename hashAlgo, typename infoType>
@@ -420,6 +1380,14 @@ bool AEAD_decrypt(const uint8_t *const key, const size_t keySize, const uint8_t
 	return false;
 }
 
+/* multi-threaded AES256-GCM of large buffers for the bctoolbox backend, defined with the multi-lane implementation */
+namespace {
+	size_t AESGCM_parallelWorkers(const size_t size);
+	bool AESGCM_parallel(const bool encrypt, const uint8_t *const key, const uint8_t *const IV, const size_t IVSize,
+			const uint8_t *const input, const size_t inputSize, const uint8_t *const AD, const size_t ADSize,
+			uint8_t *tag, uint8_t *output, const size_t workersCount);
+} // anonymous namespace
+
 /* AEAD scheme specialiazed template with AES256-GCM, 16 bytes auth tag */
 template <> void AEAD_encrypt<AES256GCM>(const uint8_t *const key, const size_t keySize, const uint8_t *const IV, const size_t IVSize,
 		const uint8_t *const plain, const size_t plainSize, const uint8_t *const AD, const size_t ADSize,
@@ -428,6 +1396,18 @@ template <> void AEAD_encrypt<AES256GCM>(const uint8_t *const key, const size_t
 	if (keySize != AES256GCM::keySize() || tagSize != AES256GCM::tagSize()) {
 		throw BCTBX_EXCEPTION << "invalid arguments for AEAD_encrypt AES256-GCM";
 	}
+#ifdef LIME_OPENSSL_BACKEND
+	/* OpenSSL does not expose the GHASH needed to combine segments: a large buffer stays on one thread */
+	if (get_cryptoBackend() == CryptoBackend::openssl) {
+		openssl_backend::AES256GCM_encrypt(key, IV, IVSize, plain, plainSize, AD, ADSize, tag, tagSize, cipher);
+		return;
+	}
+#endif
+	const auto workersCount = AESGCM_parallelWorkers(plainSize);
+	if (workersCount > 1) {
+		AESGCM_parallel(true, key, IV, IVSize, plain, plainSize, AD, ADSize, tag, cipher, workersCount);
+		return;
+	}
 	auto ret = bctbx_aes_gcm_encrypt_and_tag(key, keySize, plain, plainSize, AD, ADSize, IV, IVSize, tag, tagSize, cipher);
 	if (ret != 0) {
 		throw BCTBX_EXCEPTION << "AEAD_encrypt AES256-GCM error: "<<ret;
@@ -441,12 +1421,663 @@ template <> bool AEAD_decrypt<AES256GCM>(const uint8_t *const key, const size_t
 	if (keySize != AES256GCM::keySize() || tagSize != AES256GCM::tagSize()) {
 		throw BCTBX_EXCEPTION << "invalid arguments for AEAD_decrypt AES256-GCM";
 	}
+#ifdef LIME_OPENSSL_BACKEND
+	if (get_cryptoBackend() == CryptoBackend::openssl) {
+		return openssl_backend::AES256GCM_decrypt(key, IV, IVSize, cipher, cipherSize, AD, ADSize, tag, tagSize, plain);
+	}
+#endif
+	const auto workersCount = AESGCM_parallelWorkers(cipherSize);
+	if (workersCount > 1) {
+		return AESGCM_parallel(false, key, IV, IVSize, cipher, cipherSize, AD, ADSize, const_cast<uint8_t *>(tag), plain, workersCount); // tag is only read when decrypting
+	}
 	auto ret = bctbx_aes_gcm_decrypt_and_auth(key, keySize, cipher, cipherSize, AD, ADSize, IV, IVSize, tag, tagSize, plain);
 	if (ret == 0) return true;
 	if (ret == BCTBX_ERROR_AUTHENTICATION_FAILED) return false;
 	throw BCTBX_EXCEPTION << "AEAD_decrypt AES256-GCM error: "<<ret;
 }
 
+/***** ChaCha20-Poly1305 ***********/
+/* RFC 8439 portable implementation: 32 bits words only and Poly1305 on 26 bits limbs so it runs fast on CPU without AES or 64 bits multiplier */
+#define LIME_CHACHA_QR(a, b, c, d) \
+	a += b; d ^= a; d = rotl32(d, 16); \
+	c += d; b ^= c; b = rotl32(b, 12); \
+	a += b; d ^= a; d = rotl32(d, 8); \
+	c += d; b ^= c; b = rotl32(b, 7);
+namespace {
+	inline uint32_t load32_le(const uint8_t *p) {
+		return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1])<<8) | (static_cast<uint32_t>(p[2])<<16) | (static_cast<uint32_t>(p[3])<<24);
+	}
+	inline void store32_le(uint8_t *p, const uint32_t v) {
+		p[0] = static_cast<uint8_t>(v); p[1] = static_cast<uint8_t>(v>>8); p[2] = static_cast<uint8_t>(v>>16); p[3] = static_cast<uint8_t>(v>>24);
+	}
+	inline uint32_t rotl32(const uint32_t v, const int c) {
+		return (v<<c) | (v>>(32-c));
+	}
+
+	/**
+	 * @brief ChaCha20 key stream generator (RFC 8439 section 2.4)
+	 */
+	class chacha20 {
+		private:
+			std::array<uint32_t, 16> m_state;
+		public:
+			chacha20(const uint8_t *const key, const uint8_t *const nonce, const uint32_t counter) {
+				m_state[0] = 0x61707865; m_state[1] = 0x3320646e; m_state[2] = 0x79622d32; m_state[3] = 0x6b206574;
+				for (size_t i=0; i<8; i++) {
+					m_state[4+i] = load32_le(key+4*i);
+				}
+				m_state[12] = counter;
+				for (size_t i=0; i<3; i++) {
+					m_state[13+i] = load32_le(nonce+4*i);
+				}
+			}
+			~chacha20() {
+				cleanBuffer(reinterpret_cast<uint8_t *>(m_state.data()), sizeof(m_state));
+			}
+
+			/* generate the next 64 bytes key stream block and increment the block counter */
+			void block(uint8_t *out) {
+				std::array<uint32_t, 16> x(m_state);
+				for (int i=0; i<10; i++) {
+					LIME_CHACHA_QR(x[0], x[4], x[8], x[12]); LIME_CHACHA_QR(x[1], x[5], x[9], x[13]);
+					LIME_CHACHA_QR(x[2], x[6], x[10], x[14]); LIME_CHACHA_QR(x[3], x[7], x[11], x[15]);
+					LIME_CHACHA_QR(x[0], x[5], x[10], x[15]); LIME_CHACHA_QR(x[1], x[6], x[11], x[12]);
+					LIME_CHACHA_QR(x[2], x[7], x[8], x[13]); LIME_CHACHA_QR(x[3], x[4], x[9], x[14]);
+				}
+				for (size_t i=0; i<16; i++) {
+					store32_le(out+4*i, x[i] + m_state[i]);
+				}
+				m_state[12]++;
+				cleanBuffer(reinterpret_cast<uint8_t *>(x.data()), sizeof(x));
+			}
+
+			/* xor the input with the key stream, may be called only once as a partial last block key stream is discarded */
+			void process(const uint8_t *in, uint8_t *out, size_t size) {
+				std::array<uint8_t, 64> keyStream;
+				while (size > 0) {
+					block(keyStream.data());
+					auto n = std::min(size, keyStream.size());
+					for (size_t i=0; i<n; i++) {
+						out[i] = in[i]^keyStream[i];
+					}
+					in += n; out += n; size -= n;
+				}
+				cleanBuffer(keyStream.data(), keyStream.size());
+			}
+	};
+
+	/**
+	 * @brief Poly1305 one time authenticator (RFC 8439 section 2.5), 26 bits limbs
+	 */
+	class poly1305 {
+		private:
+			std::array<uint32_t, 5> m_r;
+			std::array<uint32_t, 5> m_h;
+			std::array<uint32_t, 4> m_pad;
+			std::array<uint8_t, 16> m_buffer;
+			size_t m_leftover;
+
+			void blocks(const uint8_t *m, size_t size, const uint32_t hibit) {
+				const uint32_t r0=m_r[0], r1=m_r[1], r2=m_r[2], r3=m_r[3], r4=m_r[4];
+				const uint32_t s1=r1*5, s2=r2*5, s3=r3*5, s4=r4*5;
+				uint32_t h0=m_h[0], h1=m_h[1], h2=m_h[2], h3=m_h[3], h4=m_h[4];
+				while (size >= 16) {
+					h0 += load32_le(m) & 0x3ffffff;
+					h1 += (load32_le(m+3)>>2) & 0x3ffffff;
+					h2 += (load32_le(m+6)>>4) & 0x3ffffff;
+					h3 += (load32_le(m+9)>>6) & 0x3ffffff;
+					h4 += (load32_le(m+12)>>8) | hibit;
+
+					uint64_t d0 = static_cast<uint64_t>(h0)*r0 + static_cast<uint64_t>(h1)*s4 + static_cast<uint64_t>(h2)*s3 + static_cast<uint64_t>(h3)*s2 + static_cast<uint64_t>(h4)*s1;
+					uint64_t d1 = static_cast<uint64_t>(h0)*r1 + static_cast<uint64_t>(h1)*r0 + static_cast<uint64_t>(h2)*s4 + static_cast<uint64_t>(h3)*s3 + static_cast<uint64_t>(h4)*s2;
+					uint64_t d2 = static_cast<uint64_t>(h0)*r2 + static_cast<uint64_t>(h1)*r1 + static_cast<uint64_t>(h2)*r0 + static_cast<uint64_t>(h3)*s4 + static_cast<uint64_t>(h4)*s3;
+					uint64_t d3 = static_cast<uint64_t>(h0)*r3 + static_cast<uint64_t>(h1)*r2 + static_cast<uint64_t>(h2)*r1 + static_cast<uint64_t>(h3)*r0 + static_cast<uint64_t>(h4)*s4;
+					uint64_t d4 = static_cast<uint64_t>(h0)*r4 + static_cast<uint64_t>(h1)*r3 + static_cast<uint64_t>(h2)*r2 + static_cast<uint64_t>(h3)*r1 + static_cast<uint64_t>(h4)*r0;
+
+					uint32_t c = static_cast<uint32_t>(d0>>26); h0 = static_cast<uint32_t>(d0) & 0x3ffffff;
+					d1 += c; c = static_cast<uint32_t>(d1>>26); h1 = static_cast<uint32_t>(d1) & 0x3ffffff;
+					d2 += c; c = static_cast<uint32_t>(d2>>26); h2 = static_cast<uint32_t>(d2) & 0x3ffffff;
+					d3 += c; c = static_cast<uint32_t>(d3>>26); h3 = static_cast<uint32_t>(d3) & 0x3ffffff;
+					d4 += c; c = static_cast<uint32_t>(d4>>26); h4 = static_cast<uint32_t>(d4) & 0x3ffffff;
+					h0 += c*5; c = h0>>26; h0 &= 0x3ffffff;
+					h1 += c;
+
+					m += 16; size -= 16;
+				}
+				m_h[0]=h0; m_h[1]=h1; m_h[2]=h2; m_h[3]=h3; m_h[4]=h4;
+			}
+
+		public:
+			poly1305(const uint8_t *const key) : m_h{}, m_buffer{}, m_leftover{0} {
+				/* r is clamped */
+				m_r[0] = load32_le(key) & 0x3ffffff;
+				m_r[1] = (load32_le(key+3)>>2) & 0x3ffff03;
+				m_r[2] = (load32_le(key+6)>>4) & 0x3ffc0ff;
+				m_r[3] = (load32_le(key+9)>>6) & 0x3f03fff;
+				m_r[4] = (load32_le(key+12)>>8) & 0x00fffff;
+				for (size_t i=0; i<4; i++) {
+					m_pad[i] = load32_le(key+16+4*i);
+				}
+			}
+			~poly1305() {
+				cleanBuffer(reinterpret_cast<uint8_t *>(m_r.data()), sizeof(m_r));
+				cleanBuffer(reinterpret_cast<uint8_t *>(m_h.data()), sizeof(m_h));
+				cleanBuffer(reinterpret_cast<uint8_t *>(m_pad.data()), sizeof(m_pad));
+				cleanBuffer(m_buffer.data(), m_buffer.size());
+			}
+
+			void update(const uint8_t *m, size_t size) {
+				if (m_leftover > 0) {
+					auto n = std::min(size, m_buffer.size() - m_leftover);
+					std::copy_n(m, n, m_buffer.data()+m_leftover);
+					m_leftover += n; m += n; size -= n;
+					if (m_leftover < m_buffer.size()) return;
+					blocks(m_buffer.data(), m_buffer.size(), 1<<24);
+					m_leftover = 0;
+				}
+				if (size >= 16) {
+					auto n = size & ~static_cast<size_t>(15);
+					blocks(m, n, 1<<24);
+					m += n; size -= n;
+				}
+				if (size > 0) {
+					std::copy_n(m, size, m_buffer.data());
+					m_leftover = size;
+				}
+			}
+
+			/* pad the data processed so far with zeros to a 16 bytes boundary */
+			void pad16(void) {
+				if (m_leftover > 0) {
+					std::fill(m_buffer.begin()+m_leftover, m_buffer.end(), 0);
+					blocks(m_buffer.data(), m_buffer.size(), 1<<24);
+					m_leftover = 0;
+				}
+			}
+
+			void finish(uint8_t *mac) {
+				if (m_leftover > 0) { // last partial block: append a 1 byte and no high bit
+					m_buffer[m_leftover] = 1;
+					std::fill(m_buffer.begin()+m_leftover+1, m_buffer.end(), 0);
+					blocks(m_buffer.data(), m_buffer.size(), 0);
+					m_leftover = 0;
+				}
+				uint32_t h0=m_h[0], h1=m_h[1], h2=m_h[2], h3=m_h[3], h4=m_h[4];
+				/* fully carry h */
+				uint32_t c = h1>>26; h1 &= 0x3ffffff;
+				h2 += c; c = h2>>26; h2 &= 0x3ffffff;
+				h3 += c; c = h3>>26; h3 &= 0x3ffffff;
+				h4 += c; c = h4>>26; h4 &= 0x3ffffff;
+				h0 += c*5; c = h0>>26; h0 &= 0x3ffffff;
+				h1 += c;
+				/* compute h - p = h + 5 - 2^130 and select it if it does not underflow, in constant time */
+				uint32_t g0 = h0+5; c = g0>>26; g0 &= 0x3ffffff;
+				uint32_t g1 = h1+c; c = g1>>26; g1 &= 0x3ffffff;
+				uint32_t g2 = h2+c; c = g2>>26; g2 &= 0x3ffffff;
+				uint32_t g3 = h3+c; c = g3>>26; g3 &= 0x3ffffff;
+				uint32_t g4 = h4+c-(1<<26);
+				uint32_t mask = (g4>>31) - 1;
+				g0 &= mask; g1 &= mask; g2 &= mask; g3 &= mask; g4 &= mask;
+				mask = ~mask;
+				h0 = (h0&mask)|g0; h1 = (h1&mask)|g1; h2 = (h2&mask)|g2; h3 = (h3&mask)|g3; h4 = (h4&mask)|g4;
+				/* h = (h + pad) mod 2^128 */
+				h0 = h0 | (h1<<26);
+				h1 = (h1>>6) | (h2<<20);
+				h2 = (h2>>12) | (h3<<14);
+				h3 = (h3>>18) | (h4<<8);
+				uint64_t f = static_cast<uint64_t>(h0) + m_pad[0]; store32_le(mac, static_cast<uint32_t>(f));
+				f = static_cast<uint64_t>(h1) + m_pad[1] + (f>>32); store32_le(mac+4, static_cast<uint32_t>(f));
+				f = static_cast<uint64_t>(h2) + m_pad[2] + (f>>32); store32_le(mac+8, static_cast<uint32_t>(f));
+				f = static_cast<uint64_t>(h3) + m_pad[3] + (f>>32); store32_le(mac+12, static_cast<uint32_t>(f));
+			}
+	};
+
+	/* compute the RFC 8439 section 2.8 tag over AD and cipher text, the Poly1305 one time key is the first half of key stream block 0 */
+	void CHACHA20POLY1305_tag(const uint8_t *const key, const uint8_t *const nonce, const uint8_t *const cipher, const size_t cipherSize,
+			const uint8_t *const AD, const size_t ADSize, uint8_t *tag) {
+		std::array<uint8_t, 64> otk;
+		chacha20(key, nonce, 0).block(otk.data());
+		poly1305 mac(otk.data());
+		cleanBuffer(otk.data(), otk.size());
+		mac.update(AD, ADSize);
+		mac.pad16();
+		mac.update(cipher, cipherSize);
+		mac.pad16();
+		std::array<uint8_t, 16> lengths;
+		store32_le(lengths.data(), static_cast<uint32_t>(ADSize));
+		store32_le(lengths.data()+4, static_cast<uint32_t>(static_cast<uint64_t>(ADSize)>>32));
+		store32_le(lengths.data()+8, static_cast<uint32_t>(cipherSize));
+		store32_le(lengths.data()+12, static_cast<uint32_t>(static_cast<uint64_t>(cipherSize)>>32));
+		mac.update(lengths.data(), lengths.size());
+		mac.finish(tag);
+	}
+} // anonymous namespace
+#undef LIME_CHACHA_QR
+
+/* AEAD scheme specialiazed template with ChaCha20-Poly1305, 16 bytes auth tag, the nonce is the first 12 bytes of the given IV */
+template <> void AEAD_encrypt<CHACHA20POLY1305>(const uint8_t *const key, const size_t keySize, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const plain, const size_t plainSize, const uint8_t *const AD, const size_t ADSize,
+		uint8_t *tag, const size_t tagSize, uint8_t *cipher) {
+	/* perforn checks on sizes */
+	if (keySize != CHACHA20POLY1305::keySize() || tagSize != CHACHA20POLY1305::tagSize() || IVSize < CHACHA20POLY1305::nonceSize()) {
+		throw BCTBX_EXCEPTION << "invalid arguments for AEAD_encrypt ChaCha20-Poly1305";
+	}
+#ifdef LIME_OPENSSL_BACKEND
+	if (get_cryptoBackend() == CryptoBackend::openssl) {
+		openssl_backend::CHACHA20POLY1305_encrypt(key, IV, plain, plainSize, AD, ADSize, tag, cipher);
+		return;
+	}
+#endif
+	chacha20(key, IV, 1).process(plain, cipher, plainSize);
+	CHACHA20POLY1305_tag(key, IV, cipher, plainSize, AD, ADSize, tag);
+}
+
+template <> bool AEAD_decrypt<CHACHA20POLY1305>(const uint8_t *const key, const size_t keySize, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const cipher, const size_t cipherSize, const uint8_t *const AD, const size_t ADSize,
+		const uint8_t *const tag, const size_t tagSize, uint8_t *plain) {
+	/* perforn checks on sizes */
+	if (keySize != CHACHA20POLY1305::keySize() || tagSize != CHACHA20POLY1305::tagSize() || IVSize < CHACHA20POLY1305::nonceSize()) {
+		throw BCTBX_EXCEPTION << "invalid arguments for AEAD_decrypt ChaCha20-Poly1305";
+	}
+#ifdef LIME_OPENSSL_BACKEND
+	if (get_cryptoBackend() == CryptoBackend::openssl) {
+		return openssl_backend::CHACHA20POLY1305_decrypt(key, IV, cipher, cipherSize, AD, ADSize, tag, plain);
+	}
+#endif
+	/* authenticate before decrypting, tag comparison in constant time */
+	std::array<uint8_t, 16> computedTag;
+	CHACHA20POLY1305_tag(key, IV, cipher, cipherSize, AD, ADSize, computedTag.data());
+	uint8_t diff = 0;
+	for (size_t i=0; i<computedTag.size(); i++) {
+		diff |= computedTag[i]^tag[i];
+	}
+	if (diff != 0) return false;
+	chacha20(key, IV, 1).process(cipher, plain, cipherSize);
+	return true;
+}
+
+/***** AES256-GCM multi-lane encryption ***********/
+/* NIST SP800-38D GCM over AES-256, the key schedule, counter blocks encryption and GHASH of several independent lanes are interleaved */
+namespace {
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define LIME_AESGCM_MULTIBUFFER
+#define LIME_AESGCM_TARGET __attribute__((target("aes,pclmul,ssse3")))
+#define LIME_AESGCM_UNROLL _Pragma("GCC unroll 16") // lanes and rounds loops must be unrolled to interleave the lanes in registers
+	constexpr size_t AESGCM_lanes = 4;
+	constexpr size_t AES256_rounds = 14;
+	constexpr size_t AESGCM_blockSize = 16;
+
+	/* one lane encryption context, GHASH values are kept byte reflected so the counter increment is a 32 bits addition */
+	struct AESGCM_lane {
+		__m128i roundKeys[AES256_rounds+1];
+		__m128i H; // hash key
+		__m128i J0; // pre-counter block
+		__m128i counter; // current counter block
+		__m128i X; // GHASH accumulator
+	};
+
+	LIME_AESGCM_TARGET inline __m128i AESGCM_reflect(const __m128i a) {
+		return _mm_shuffle_epi8(a, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+	}
+
+	/* AES-256 key expansion steps: even round keys from the previous even one, odd from the previous odd one */
+	LIME_AESGCM_TARGET inline __m128i AES256_expandEven(__m128i k1, __m128i assist) {
+		assist = _mm_shuffle_epi32(assist, 0xff);
+		__m128i t = _mm_slli_si128(k1, 4);
+		k1 = _mm_xor_si128(k1, t);
+		t = _mm_slli_si128(t, 4);
+		k1 = _mm_xor_si128(k1, t);
+		t = _mm_slli_si128(t, 4);
+		k1 = _mm_xor_si128(k1, t);
+		return _mm_xor_si128(k1, assist);
+	}
+
+	LIME_AESGCM_TARGET inline __m128i AES256_expandOdd(const __m128i k1, __m128i k2) {
+		const __m128i assist = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(k1, 0x00), 0xaa);
+		__m128i t = _mm_slli_si128(k2, 4);
+		k2 = _mm_xor_si128(k2, t);
+		t = _mm_slli_si128(t, 4);
+		k2 = _mm_xor_si128(k2, t);
+		t = _mm_slli_si128(t, 4);
+		k2 = _mm_xor_si128(k2, t);
+		return _mm_xor_si128(k2, assist);
+	}
+
+	LIME_AESGCM_TARGET inline void AES256_expandKey(const uint8_t *const key, __m128i *rk) {
+		rk[0] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(key));
+		rk[1] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(key+16));
+		/* aeskeygenassist needs an immediate round constant */
+		rk[2] = AES256_expandEven(rk[0], _mm_aeskeygenassist_si128(rk[1], 0x01)); rk[3] = AES256_expandOdd(rk[2], rk[1]);
+		rk[4] = AES256_expandEven(rk[2], _mm_aeskeygenassist_si128(rk[3], 0x02)); rk[5] = AES256_expandOdd(rk[4], rk[3]);
+		rk[6] = AES256_expandEven(rk[4], _mm_aeskeygenassist_si128(rk[5], 0x04)); rk[7] = AES256_expandOdd(rk[6], rk[5]);
+		rk[8] = AES256_expandEven(rk[6], _mm_aeskeygenassist_si128(rk[7], 0x08)); rk[9] = AES256_expandOdd(rk[8], rk[7]);
+		rk[10] = AES256_expandEven(rk[8], _mm_aeskeygenassist_si128(rk[9], 0x10)); rk[11] = AES256_expandOdd(rk[10], rk[9]);
+		rk[12] = AES256_expandEven(rk[10], _mm_aeskeygenassist_si128(rk[11], 0x20)); rk[13] = AES256_expandOdd(rk[12], rk[11]);
+		rk[14] = AES256_expandEven(rk[12], _mm_aeskeygenassist_si128(rk[13], 0x40));
+	}
+
+	LIME_AESGCM_TARGET inline __m128i AES256_encryptBlock(__m128i block, const __m128i *rk) {
+		block = _mm_xor_si128(block, rk[0]);
+		for (size_t r=1; r<AES256_rounds; r++) {
+			block = _mm_aesenc_si128(block, rk[r]);
+		}
+		return _mm_aesenclast_si128(block, rk[AES256_rounds]);
+	}
+
+	/* GF(2^128) multiplication of byte reflected operands: carry-less multiplication, shift by one bit and reduction */
+	LIME_AESGCM_TARGET inline __m128i GHASH_mult(const __m128i a, const __m128i b) {
+		__m128i lo = _mm_clmulepi64_si128(a, b, 0x00);
+		__m128i hi = _mm_clmulepi64_si128(a, b, 0x11);
+		__m128i mid = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01));
+		lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+		hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+		// shift the 256 bits product left by one bit
+		__m128i carryLo = _mm_srli_epi32(lo, 31);
+		__m128i carryHi = _mm_srli_epi32(hi, 31);
+		lo = _mm_slli_epi32(lo, 1);
+		hi = _mm_slli_epi32(hi, 1);
+		const __m128i carryOut = _mm_srli_si128(carryLo, 12);
+		carryHi = _mm_slli_si128(carryHi, 4);
+		carryLo = _mm_slli_si128(carryLo, 4);
+		lo = _mm_or_si128(lo, carryLo);
+		hi = _mm_or_si128(_mm_or_si128(hi, carryHi), carryOut);
+
+		// reduce modulo x^128 + x^7 + x^2 + x + 1
+		__m128i t = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)), _mm_slli_epi32(lo, 25));
+		const __m128i tHi = _mm_srli_si128(t, 4);
+		t = _mm_slli_si128(t, 12);
+		lo = _mm_xor_si128(lo, t);
+		t = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)), _mm_srli_epi32(lo, 7));
+		t = _mm_xor_si128(t, tHi);
+		lo = _mm_xor_si128(lo, t);
+		return _mm_xor_si128(hi, lo);
+	}
+
+	/* absorb a buffer in the GHASH accumulator, the last partial block is zero padded */
+	LIME_AESGCM_TARGET inline void GHASH_update(__m128i &X, const __m128i H, const uint8_t *const data, const size_t dataSize) {
+		size_t i = 0;
+		for (; i+AESGCM_blockSize <= dataSize; i+=AESGCM_blockSize) {
+			X = GHASH_mult(_mm_xor_si128(X, AESGCM_reflect(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data+i)))), H);
+		}
+		if (i < dataSize) {
+			alignas(16) uint8_t block[AESGCM_blockSize]{};
+			std::copy_n(data+i, dataSize-i, block);
+			X = GHASH_mult(_mm_xor_si128(X, AESGCM_reflect(_mm_load_si128(reinterpret_cast<const __m128i *>(block)))), H);
+		}
+	}
+
+	/* expand the key, derive hash key and pre-counter block, absorb the associated data */
+	LIME_AESGCM_TARGET inline void AESGCM_laneInit(AESGCM_lane &lane, const AEADbatchEntry &entry) {
+		AES256_expandKey(entry.key, lane.roundKeys);
+		lane.H = AESGCM_reflect(AES256_encryptBlock(_mm_setzero_si128(), lane.roundKeys));
+		if (entry.IVSize == 12) { // J0 = IV || 0^31 || 1
+			alignas(16) uint8_t block[AESGCM_blockSize]{};
+			std::copy_n(entry.IV, entry.IVSize, block);
+			block[AESGCM_blockSize-1] = 1;
+			lane.J0 = _mm_load_si128(reinterpret_cast<const __m128i *>(block));
+		} else { // J0 = GHASH(IV || 0 padding || 0^64 || IV bit length)
+			__m128i X = _mm_setzero_si128();
+			GHASH_update(X, lane.H, entry.IV, entry.IVSize);
+			X = GHASH_mult(_mm_xor_si128(X, _mm_set_epi64x(0, static_cast<long long>(entry.IVSize)*8)), lane.H);
+			lane.J0 = AESGCM_reflect(X);
+		}
+		lane.counter = _mm_add_epi32(AESGCM_reflect(lane.J0), _mm_set_epi32(0, 0, 0, 1));
+		lane.X = _mm_setzero_si128();
+		GHASH_update(lane.X, lane.H, entry.AD, entry.ADSize);
+	}
+
+	/* encrypt the plain buffer in all lanes, their counter blocks encryption and GHASH are interleaved */
+	template <size_t lanes>
+	LIME_AESGCM_TARGET void AESGCM_encryptLanes(const AEADbatchEntry *entries, const uint8_t *const plain, const size_t plainSize) {
+		AESGCM_lane ctx[lanes];
+		LIME_AESGCM_UNROLL
+		for (size_t l=0; l<lanes; l++) {
+			AESGCM_laneInit(ctx[l], entries[l]);
+		}
+
+		const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+		for (size_t offset=0; offset<plainSize; offset+=AESGCM_blockSize) {
+			__m128i keyStream[lanes]; // not given to cleanBuffer so it can stay in registers
+			LIME_AESGCM_UNROLL
+			for (size_t l=0; l<lanes; l++) {
+				keyStream[l] = _mm_xor_si128(AESGCM_reflect(ctx[l].counter), ctx[l].roundKeys[0]);
+				ctx[l].counter = _mm_add_epi32(ctx[l].counter, one);
+			}
+			LIME_AESGCM_UNROLL
+			for (size_t r=1; r<AES256_rounds; r++) {
+				LIME_AESGCM_UNROLL
+				for (size_t l=0; l<lanes; l++) {
+					keyStream[l] = _mm_aesenc_si128(keyStream[l], ctx[l].roundKeys[r]);
+				}
+			}
+			LIME_AESGCM_UNROLL
+			for (size_t l=0; l<lanes; l++) {
+				keyStream[l] = _mm_aesenclast_si128(keyStream[l], ctx[l].roundKeys[AES256_rounds]);
+			}
+
+			if (offset+AESGCM_blockSize <= plainSize) {
+				const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(plain+offset));
+				LIME_AESGCM_UNROLL
+				for (size_t l=0; l<lanes; l++) {
+					const __m128i c = _mm_xor_si128(keyStream[l], p);
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(entries[l].cipher+offset), c);
+					ctx[l].X = GHASH_mult(_mm_xor_si128(ctx[l].X, AESGCM_reflect(c)), ctx[l].H);
+				}
+			} else { // last partial block: the cipher block is zero padded for GHASH
+				const size_t remaining = plainSize - offset;
+				alignas(16) uint8_t block[AESGCM_blockSize]{};
+				std::copy_n(plain+offset, remaining, block);
+				const __m128i p = _mm_load_si128(reinterpret_cast<const __m128i *>(block));
+				LIME_AESGCM_UNROLL
+				for (size_t l=0; l<lanes; l++) {
+					_mm_store_si128(reinterpret_cast<__m128i *>(block), _mm_xor_si128(keyStream[l], p));
+					std::fill(block+remaining, block+AESGCM_blockSize, 0);
+					std::copy_n(block, remaining, entries[l].cipher+offset);
+					ctx[l].X = GHASH_mult(_mm_xor_si128(ctx[l].X, AESGCM_reflect(_mm_load_si128(reinterpret_cast<const __m128i *>(block)))), ctx[l].H);
+				}
+				cleanBuffer(block, sizeof(block));
+			}
+		}
+
+		// tag = E(K, J0) ^ GHASH(AD || C || len(AD) || len(C))
+		LIME_AESGCM_UNROLL
+		for (size_t l=0; l<lanes; l++) {
+			const __m128i lengths = _mm_set_epi64x(static_cast<long long>(entries[l].ADSize)*8, static_cast<long long>(plainSize)*8);
+			ctx[l].X = GHASH_mult(_mm_xor_si128(ctx[l].X, lengths), ctx[l].H);
+			const __m128i tag = _mm_xor_si128(AES256_encryptBlock(ctx[l].J0, ctx[l].roundKeys), AESGCM_reflect(ctx[l].X));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(entries[l].tag), tag);
+		}
+		cleanBuffer(reinterpret_cast<uint8_t *>(ctx), sizeof(ctx));
+	}
+
+	bool AESGCM_multiSupported(void) {
+		static const bool supported = []() -> bool {
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+		}();
+		return supported;
+	}
+
+	/* H^n, n > 0 */
+	LIME_AESGCM_TARGET inline __m128i GHASH_power(const __m128i H, const size_t n) {
+		__m128i result = H;
+		for (int bit = 62 - __builtin_clzll(n); bit >= 0; bit--) {
+			result = GHASH_mult(result, result);
+			if ((n>>bit)&1) {
+				result = GHASH_mult(result, H);
+			}
+		}
+		return result;
+	}
+
+	/* one segment of a multi-threaded AES-GCM: counter blocks are encrypted by groups of AESGCM_lanes, the cipher text GHASH starts from a zero accumulator */
+	template <bool encrypt>
+	LIME_AESGCM_TARGET void AESGCM_segment(const __m128i *roundKeys, const __m128i H, __m128i counter,
+			const uint8_t *const input, const size_t size, uint8_t *output, __m128i &X) {
+		const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+		X = _mm_setzero_si128();
+		size_t offset = 0;
+		for (; offset+AESGCM_lanes*AESGCM_blockSize <= size; offset+=AESGCM_lanes*AESGCM_blockSize) {
+			__m128i keyStream[AESGCM_lanes];
+			LIME_AESGCM_UNROLL
+			for (size_t l=0; l<AESGCM_lanes; l++) {
+				keyStream[l] = _mm_xor_si128(AESGCM_reflect(counter), roundKeys[0]);
+				counter = _mm_add_epi32(counter, one);
+			}
+			LIME_AESGCM_UNROLL
+			for (size_t r=1; r<AES256_rounds; r++) {
+				LIME_AESGCM_UNROLL
+				for (size_t l=0; l<AESGCM_lanes; l++) {
+					keyStream[l] = _mm_aesenc_si128(keyStream[l], roundKeys[r]);
+				}
+			}
+			LIME_AESGCM_UNROLL
+			for (size_t l=0; l<AESGCM_lanes; l++) {
+				const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input+offset+l*AESGCM_blockSize));
+				const __m128i out = _mm_xor_si128(_mm_aesenclast_si128(keyStream[l], roundKeys[AES256_rounds]), in);
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(output+offset+l*AESGCM_blockSize), out);
+				X = GHASH_mult(_mm_xor_si128(X, AESGCM_reflect(encrypt?out:in)), H);
+			}
+		}
+		for (; offset<size; offset+=AESGCM_blockSize) {
+			const __m128i keyStream = AES256_encryptBlock(AESGCM_reflect(counter), roundKeys);
+			counter = _mm_add_epi32(counter, one);
+			const size_t blockSize = std::min(AESGCM_blockSize, size-offset);
+			alignas(16) uint8_t block[AESGCM_blockSize]{};
+			std::copy_n(input+offset, blockSize, block);
+			const __m128i in = _mm_load_si128(reinterpret_cast<const __m128i *>(block));
+			_mm_store_si128(reinterpret_cast<__m128i *>(block), _mm_xor_si128(keyStream, in));
+			std::fill(block+blockSize, block+AESGCM_blockSize, 0); // the last partial block is zero padded for GHASH
+			std::copy_n(block, blockSize, output+offset);
+			X = GHASH_mult(_mm_xor_si128(X, AESGCM_reflect(encrypt?_mm_load_si128(reinterpret_cast<const __m128i *>(block)):in)), H);
+			cleanBuffer(block, sizeof(block));
+		}
+	}
+
+	size_t AESGCM_parallelWorkers(const size_t size) {
+		if (lime::settings::AESGCM_parallelThreshold == 0 || size < 2*lime::settings::AESGCM_parallelThreshold || !AESGCM_multiSupported()) {
+			return 1;
+		}
+		return std::max(static_cast<size_t>(1), std::min(static_cast<size_t>(std::thread::hardware_concurrency()), size/lime::settings::AESGCM_parallelThreshold));
+	}
+
+	/* the input is cut in one segment per worker, each worker encrypts its own counter blocks and computes its segment GHASH.
+	 * Segments GHASH are then combined: X = X.H^(segment blocks count) ^ segment GHASH
+	 * return false if the decryption failed authentication, the output is then wiped */
+	LIME_AESGCM_TARGET bool AESGCM_parallel(const bool encrypt, const uint8_t *const key, const uint8_t *const IV, const size_t IVSize,
+			const uint8_t *const input, const size_t inputSize, const uint8_t *const AD, const size_t ADSize,
+			uint8_t *tag, uint8_t *output, const size_t workersCount) {
+		AESGCM_lane ctx;
+		const AEADbatchEntry entry{key, AES256GCM::keySize(), IV, IVSize, AD, ADSize, tag, AES256GCM::tagSize(), output};
+		AESGCM_laneInit(ctx, entry); // ctx.X holds the AD GHASH
+
+		const size_t blocksCount = (inputSize+AESGCM_blockSize-1)/AESGCM_blockSize;
+		const size_t segmentBlocks = (blocksCount+workersCount-1)/workersCount;
+		const size_t segmentsCount = (blocksCount+segmentBlocks-1)/segmentBlocks;
+		struct segmentHash {
+			__m128i X;
+		};
+		std::vector<segmentHash> segmentsX(segmentsCount);
+		auto compute = [&ctx, input, inputSize, output, segmentBlocks, &segmentsX, encrypt](const size_t segment) {
+			const size_t offset = segment*segmentBlocks*AESGCM_blockSize;
+			const size_t size = std::min(segmentBlocks*AESGCM_blockSize, inputSize-offset);
+			const __m128i counter = _mm_add_epi32(ctx.counter, _mm_set_epi32(0, 0, 0, static_cast<int>(segment*segmentBlocks)));
+			if (encrypt) {
+				AESGCM_segment<true>(ctx.roundKeys, ctx.H, counter, input+offset, size, output+offset, segmentsX[segment].X);
+			} else {
+				AESGCM_segment<false>(ctx.roundKeys, ctx.H, counter, input+offset, size, output+offset, segmentsX[segment].X);
+			}
+		};
+		std::vector<std::future<void>> workers{};
+		workers.reserve(segmentsCount-1);
+		for (size_t s=1; s<segmentsCount; s++) {
+			workers.push_back(std::async(std::launch::async, compute, s));
+		}
+		compute(0);
+		for (auto &worker : workers) {
+			worker.get();
+		}
+
+		const __m128i segmentH = GHASH_power(ctx.H, segmentBlocks);
+		for (size_t s=0; s<segmentsCount; s++) {
+			const size_t blocks = std::min(segmentBlocks, blocksCount-s*segmentBlocks);
+			ctx.X = _mm_xor_si128(GHASH_mult(ctx.X, (blocks==segmentBlocks)?segmentH:GHASH_power(ctx.H, blocks)), segmentsX[s].X);
+		}
+		// tag = E(K, J0) ^ GHASH(AD || C || len(AD) || len(C))
+		const __m128i lengths = _mm_set_epi64x(static_cast<long long>(ADSize)*8, static_cast<long long>(inputSize)*8);
+		ctx.X = GHASH_mult(_mm_xor_si128(ctx.X, lengths), ctx.H);
+		const __m128i computedTag = _mm_xor_si128(AES256_encryptBlock(ctx.J0, ctx.roundKeys), AESGCM_reflect(ctx.X));
+		cleanBuffer(reinterpret_cast<uint8_t *>(&ctx), sizeof(ctx));
+		if (encrypt) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(tag), computedTag);
+			return true;
+		}
+		// constant time comparison of the tags
+		const __m128i diff = _mm_xor_si128(computedTag, _mm_loadu_si128(reinterpret_cast<const __m128i *>(tag)));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xFFFF) {
+			cleanBuffer(output, inputSize);
+			return false;
+		}
+		return true;
+	}
+#undef LIME_AESGCM_TARGET
+#undef LIME_AESGCM_UNROLL
+#else // multi-lane AES-GCM
+	size_t AESGCM_parallelWorkers(const size_t size) {
+		return 1;
+	}
+	bool AESGCM_parallel(const bool encrypt, const uint8_t *const key, const uint8_t *const IV, const size_t IVSize,
+			const uint8_t *const input, const size_t inputSize, const uint8_t *const AD, const size_t ADSize,
+			uint8_t *tag, uint8_t *output, const size_t workersCount) {
+		throw BCTBX_EXCEPTION << "multi-threaded AES256-GCM is not available on this platform";
+	}
+#endif // multi-lane AES-GCM
+} // anonymous namespace
+
+/* AEAD_encrypt_batch must use a specialized template */
+template <typename AEADAlgo>
+void AEAD_encrypt_batch(const AEADbatchEntry *entries, const size_t count, const uint8_t *const plain, const size_t plainSize) {
+	/* if this template is instanciated the static_assert will fail but will give us an error message with faulty type */
+	static_assert(sizeof(AEADAlgo) != sizeof(AEADAlgo), "You must specialize AEAD_encrypt_batch function template");
+}
+
+/* AEAD_encrypt_batch specialized template with AES256-GCM: lanes of AESGCM_lanes entries when AES-NI is available, AEAD_encrypt otherwise */
+template <> void AEAD_encrypt_batch<AES256GCM>(const AEADbatchEntry *entries, const size_t count, const uint8_t *const plain, const size_t plainSize) {
+	/* perforn checks on sizes */
+	for (size_t i=0; i<count; i++) {
+		if (entries[i].keySize != AES256GCM::keySize() || entries[i].tagSize != AES256GCM::tagSize() || entries[i].IVSize == 0) {
+			throw BCTBX_EXCEPTION << "invalid arguments for AEAD_encrypt_batch AES256-GCM";
+		}
+	}
+#ifdef LIME_AESGCM_MULTIBUFFER
+	if (AESGCM_multiSupported()) {
+		size_t i = 0;
+		for (; i+AESGCM_lanes <= count; i+=AESGCM_lanes) {
+			AESGCM_encryptLanes<AESGCM_lanes>(entries+i, plain, plainSize);
+		}
+		for (; i<count; i++) {
+			AESGCM_encryptLanes<1>(entries+i, plain, plainSize);
+		}
+		return;
+	}
+#endif
+	for (size_t i=0; i<count; i++) {
+		AEAD_encrypt<AES256GCM>(entries[i].key, entries[i].keySize, entries[i].IV, entries[i].IVSize,
+				plain, plainSize, entries[i].AD, entries[i].ADSize,
+				entries[i].tag, entries[i].tagSize, entries[i].cipher);
+	}
+}
+
+/* AEAD_encrypt_batch specialized template with ChaCha20-Poly1305: entries are processed one by one by AEAD_encrypt */
+template <> void AEAD_encrypt_batch<CHACHA20POLY1305>(const AEADbatchEntry *entries, const size_t count, const uint8_t *const plain, const size_t plainSize) {
+	for (size_t i=0; i<count; i++) {
+		AEAD_encrypt<CHACHA20POLY1305>(entries[i].key, entries[i].keySize, entries[i].IV, entries[i].IVSize,
+				plain, plainSize, entries[i].AD, entries[i].ADSize,
+				entries[i].tag, entries[i].tagSize, entries[i].cipher);
+	}
+}
+
 /* check buffer length are in sync with bctoolbox ones */
 #ifdef EC25519_ENABLED
 	static_assert(BCTBX_ECDH_X25519_PUBLIC_SIZE == X<C255, Xtype::publicKey>::ssize(), "bctoolbox and local defines mismatch");
@@ -486,6 +2117,9 @@ void cleanBuffer(uint8_t *buffer, size_t size) {
 	template class bctbx_EDDSA<C255>;
 	template std::shared_ptr<keyExchange<C255>> make_keyExchange();
 	template std::shared_ptr<Signature<C255>> make_Signature();
+	template bool verify_batch<C255>(const std::vector<SignedXPublicKey<C255>> &signedKeys);
+	template void X_batch<C255>(const std::vector<XbatchEntry<C255>> &entries);
+	template void X_batch<C255>(const XbatchEntry<C255> *entries, const size_t count);
 #endif //EC25519_ENABLED
 
 #ifdef EC448_ENABLED
@@ -493,6 +2127,9 @@ void cleanBuffer(uint8_t *buffer, size_t size) {
 	template class bctbx_EDDSA<C448>;
 	template std::shared_ptr<keyExchange<C448>> make_keyExchange();
 	template std::shared_ptr<Signature<C448>> make_Signature();
+	template bool verify_batch<C448>(const std::vector<SignedXPublicKey<C448>> &signedKeys);
+	template void X_batch<C448>(const std::vector<XbatchEntry<C448>> &entries);
+	template void X_batch<C448>(const XbatchEntry<C448> *entries, const size_t count);
 #endif //EC448_ENABLED
 
 
@@ -59,9 +59,13 @@ namespace lime {
 			constexpr static size_t ssize(void) {return Curve::Xsize(dataType);};
 			/// construct from a std::vector<uint8_t>
 			X(std::vector<uint8_t>::const_iterator buffer) {std::copy_n(buffer, Curve::Xsize(dataType), this->begin());}
+			/// construct from a raw buffer, it shall hold at least ssize() bytes
+			X(const uint8_t *buffer) {std::copy_n(buffer, Curve::Xsize(dataType), this->begin());}
 			X() {};
 			/// copy from a std::vector<uint8_t>
 			void assign(std::vector<uint8_t>::const_iterator buffer) {std::copy_n(buffer, Curve::Xsize(dataType), this->begin());}
+			/// copy from a raw buffer, it shall hold at least ssize() bytes
+			void assign(const uint8_t *buffer) {std::copy_n(buffer, Curve::Xsize(dataType), this->begin());}
 	};
 
 	/**
@@ -100,9 +104,13 @@ namespace lime {
 			constexpr static size_t ssize(void) {return Curve::DSAsize(dataType);};
 			/// contruct from a std::vector<uint8_t>
 			DSA(std::vector<uint8_t>::const_iterator buffer) {std::copy_n(buffer, Curve::DSAsize(dataType), this->begin());}
+			/// construct from a raw buffer, it shall hold at least ssize() bytes
+			DSA(const uint8_t *buffer) {std::copy_n(buffer, Curve::DSAsize(dataType), this->begin());}
 			DSA() {};
 			/// copy from a std::vector<uint8_t>
 			void assign(std::vector<uint8_t>::const_iterator buffer) {std::copy_n(buffer, Curve::DSAsize(dataType), this->begin());}
+			/// copy from a raw buffer, it shall hold at least ssize() bytes
+			void assign(const uint8_t *buffer) {std::copy_n(buffer, Curve::DSAsize(dataType), this->begin());}
 	};
 
 	/**
@@ -176,15 +184,25 @@ class RNG {
 template <typename Curve>
 class keyExchange {
 	public:
-		/* accessors */
+		/* accessors: the keys are written in caller's buffers */
 		/// get Secret key
-		virtual const X<Curve, lime::Xtype::privateKey> get_secret(void) = 0;
+		virtual void get_secret(X<Curve, lime::Xtype::privateKey> &secret) = 0;
 		/// get Self Public key
-		virtual const X<Curve, lime::Xtype::publicKey> get_selfPublic(void) = 0;
+		virtual void get_selfPublic(X<Curve, lime::Xtype::publicKey> &selfPublic) = 0;
 		/// get Peer Public key
-		virtual const X<Curve, lime::Xtype::publicKey> get_peerPublic(void) = 0;
+		virtual void get_peerPublic(X<Curve, lime::Xtype::publicKey> &peerPublic) = 0;
 		/// get shared secret when exchange is completed
-		virtual const X<Curve, lime::Xtype::sharedSecret> get_sharedSecret(void) = 0;
+		virtual void get_sharedSecret(X<Curve, lime::Xtype::sharedSecret> &sharedSecret) = 0;
+
+		/* convenience accessors returning a copy of the key, do not use them on the ratchet or X3DH paths */
+		/// get a copy of the Secret key
+		X<Curve, lime::Xtype::privateKey> get_secret(void) {X<Curve, lime::Xtype::privateKey> secret; get_secret(secret); return secret;}
+		/// get a copy of the Self Public key
+		X<Curve, lime::Xtype::publicKey> get_selfPublic(void) {X<Curve, lime::Xtype::publicKey> selfPublic; get_selfPublic(selfPublic); return selfPublic;}
+		/// get a copy of the Peer Public key
+		X<Curve, lime::Xtype::publicKey> get_peerPublic(void) {X<Curve, lime::Xtype::publicKey> peerPublic; get_peerPublic(peerPublic); return peerPublic;}
+		/// get a copy of the shared secret
+		X<Curve, lime::Xtype::sharedSecret> get_sharedSecret(void) {X<Curve, lime::Xtype::sharedSecret> sharedSecret; get_sharedSecret(sharedSecret); return sharedSecret;}
 
 		/* set keys in context, publics and private keys directly accept Signature formatted keys which are converted to keyExchange format */
 		/// set Secret key
@@ -236,11 +254,17 @@ class keyExchange {
 template <typename Curve>
 class Signature {
 	public:
-		/* accessors */
+		/* accessors: the keys are written in caller's buffers */
 		/// Secret key
-		virtual const DSA<Curve, lime::DSAtype::privateKey> get_secret(void) = 0;
+		virtual void get_secret(DSA<Curve, lime::DSAtype::privateKey> &secretKey) = 0;
 		/// Public key
-		virtual const DSA<Curve, lime::DSAtype::publicKey> get_public(void) = 0;
+		virtual void get_public(DSA<Curve, lime::DSAtype::publicKey> &publicKey) = 0;
+
+		/* convenience accessors returning a copy of the key */
+		/// get a copy of the Secret key
+		DSA<Curve, lime::DSAtype::privateKey> get_secret(void) {DSA<Curve, lime::DSAtype::privateKey> secretKey; get_secret(secretKey); return secretKey;}
+		/// get a copy of the Public key
+		DSA<Curve, lime::DSAtype::publicKey> get_public(void) {DSA<Curve, lime::DSAtype::publicKey> publicKey; get_public(publicKey); return publicKey;}
 
 		/// Secret key
 		virtual void set_secret(const DSA<Curve, lime::DSAtype::privateKey> &secretKey) = 0;
@@ -290,6 +314,64 @@ class Signature {
 		virtual ~Signature() = default;
 }; //class EdDSA
 
+/**
+ * @brief A key exchange public key signed with EdDSA, as a SPk in a key bundle: references to the signer public key, the signed key and the signature
+ *
+ * it does not own any of them, they must outlive it
+ */
+template <typename Curve>
+struct SignedXPublicKey {
+	const DSA<Curve, lime::DSAtype::publicKey> &signerPublicKey; /**< the EdDSA public key to verify the signature with */
+	const X<Curve, lime::Xtype::publicKey> &key; /**< the signed message */
+	const DSA<Curve, lime::DSAtype::signature> &signature; /**< the signature */
+	SignedXPublicKey(const DSA<Curve, lime::DSAtype::publicKey> &signerPublicKey, const X<Curve, lime::Xtype::publicKey> &key, const DSA<Curve, lime::DSAtype::signature> &signature)
+		: signerPublicKey(signerPublicKey), key(key), signature(signature) {};
+};
+
+/**
+ * @brief Verify a batch of signatures, each one with its own signer public key
+ *
+ * The result tells only if all the signatures are valid, use Signature::verify on each of them to find out which one failed
+ *
+ * @param[in]	signedKeys	the signed keys to verify
+ *
+ * @return	true if all the signatures are valid(or the batch is empty), false otherwise
+ */
+template <typename Curve>
+bool verify_batch(const std::vector<SignedXPublicKey<Curve>> &signedKeys);
+
+/**
+ * @brief One scalar multiplication of an X_batch
+ *
+ * it does not own any of the buffers, they must outlive it
+ */
+template <typename Curve>
+struct XbatchEntry {
+	const X<Curve, lime::Xtype::privateKey> *secret; /**< the private key */
+	const X<Curve, lime::Xtype::publicKey> *peerPublic; /**< the peer public key, nullptr to derive the public key matching secret */
+	uint8_t *output; /**< X<Curve, lime::Xtype::sharedSecret>::ssize() bytes: the shared secret, or the public key when peerPublic is nullptr */
+};
+
+/**
+ * @brief Perform a batch of independent key exchange scalar multiplications
+ *
+ * On Curve 25519, when the CPU supports AVX2, the Montgomery ladders of 4 entries run in the lanes of vector registers.
+ * Otherwise(and on Curve 448) each entry is computed by a keyExchange context.
+ *
+ * @param[in]	entries		the computations to perform
+ */
+template <typename Curve>
+void X_batch(const std::vector<XbatchEntry<Curve>> &entries);
+/**
+ * @overload
+ * a batch held in a caller's array: the ratchet and X3DH steps compute their few exchanges without allocating
+ *
+ * @param[in]	entries		the computations to perform
+ * @param[in]	count		number of entries
+ */
+template <typename Curve>
+void X_batch(const XbatchEntry<Curve> *entries, const size_t count);
+
 /**
  * @brief templated HMAC
  *
@@ -308,6 +390,83 @@ void HMAC(const uint8_t *const key, const size_t keySize, const uint8_t *const i
 /* declare template specialisations */
 template <> void HMAC<SHA512>(const uint8_t *const key, const size_t keySize, const uint8_t *const input, const size_t inputSize, uint8_t *hash, size_t hashSize);
 
+/**
+ * @brief HMAC with a key absorbed once
+ *
+ * The hash states after processing the key padded with ipad and opad are computed at construction,
+ * each compute then resumes from them and hashes only its input and the inner digest.
+ * Use it when several HMAC share the same key: chain key step, HKDF expansion or a constant salt.
+ *
+ * @tparam	hashAlgo	the hash algorithm used (only SHA512 available for now)
+ */
+template <typename hashAlgo>
+class HMACkey {
+	/* if this template is instanciated the static_assert will fail but will give us an error message with faulty hash type */
+	static_assert(sizeof(hashAlgo) != sizeof(hashAlgo), "You must specialize HMACkey class template");
+};
+
+/**
+ * @brief HMACkey specialisation for SHA512
+ * bctoolbox exposes one-shot hash only: the SHA512 compression is implemented in lime_crypto_primitives.cpp to keep intermediate states
+ */
+template <>
+class HMACkey<SHA512> {
+	private:
+		std::array<uint64_t, 8> m_innerState; // SHA512 state after processing key XOR ipad
+		std::array<uint64_t, 8> m_outerState; // SHA512 state after processing key XOR opad
+	public:
+		/**
+		 * @param[in]	key	HMAC key
+		 * @param[in]	keySize	previous buffer size
+		 */
+		HMACkey(const uint8_t *const key, const size_t keySize);
+		~HMACkey();
+		HMACkey(const HMACkey<SHA512> &) = delete;
+		HMACkey<SHA512> &operator=(const HMACkey<SHA512> &) = delete;
+
+		/**
+		 * @brief compute HMAC(key, input), output is the same as HMAC<SHA512>
+		 *
+		 * @param[in]	input		HMAC input
+		 * @param[in]	inputSize	previous buffer size
+		 * @param[out]	hash		pointer to the output, it may be the key buffer given at construction
+		 * @param[in]	hashSize	amount of expected data, silently limited to the SHA512 output size
+		 */
+		void compute(const uint8_t *const input, const size_t inputSize, uint8_t *hash, const size_t hashSize) const;
+};
+
+/**
+ * @brief One HMAC computation of a batch, see HMAC_batch
+ */
+struct HMACbatchEntry {
+	const uint8_t *key; /**< HMAC key */
+	size_t keySize; /**< previous buffer size */
+	const uint8_t *input; /**< HMAC input */
+	size_t inputSize; /**< previous buffer size */
+	uint8_t *hash; /**< output buffer, it may be the key buffer */
+	size_t hashSize; /**< amount of expected data, silently limited to the hash output size */
+};
+
+/**
+ * @brief Compute several independent HMAC at once
+ *
+ * The hash compressions of all the entries run in the lanes of a multi-buffer kernel, selected at runtime:
+ * 8 lanes with AVX-512, 4 lanes with AVX2, one by one on other CPUs.
+ * Short inputs(up to 111 bytes for SHA512) benefit from it, longer ones are hashed one by one.
+ *
+ * Consecutive entries using the same key(same pointer and size) absorb it once, so an entry output may overwrite the key it shares
+ * with the following entries: outputs are written once the keys are absorbed. Entries sharing a key must then be consecutive.
+ *
+ * @tparam	hashAlgo	the hash algorithm used (only SHA512 available for now)
+ *
+ * @param[in,out]	entries		the HMAC to compute
+ * @param[in]		count		number of entries
+ */
+template <typename hashAlgo>
+void HMAC_batch(HMACbatchEntry *entries, const size_t count);
+/* declare template specialisations */
+template <> void HMAC_batch<SHA512>(HMACbatchEntry *entries, const size_t count);
+
 /**
  * @brief HKDF as described in RFC5869
  *	@par Compute:
@@ -399,12 +558,59 @@ template <> bool AEAD_decrypt<AES256GCM>(const uint8_t *const key, const size_t
 		const uint8_t *const cipher, const size_t cipherSize, const uint8_t *const AD, const size_t ADSize,
 		const uint8_t *const tag, const size_t tagSize, uint8_t *plain);
 
+template <> void AEAD_encrypt<CHACHA20POLY1305>(const uint8_t *const key, const size_t keySize, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const plain, const size_t plainSize, const uint8_t *const AD, const size_t ADSize,
+		uint8_t *tag, const size_t tagSize, uint8_t *cipher);
+
+template <> bool AEAD_decrypt<CHACHA20POLY1305>(const uint8_t *const key, const size_t keySize, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const cipher, const size_t cipherSize, const uint8_t *const AD, const size_t ADSize,
+		const uint8_t *const tag, const size_t tagSize, uint8_t *plain);
+
+/**
+ * @brief One encryption of an AEAD_encrypt_batch, parameters are the AEAD_encrypt ones
+ */
+struct AEADbatchEntry {
+	const uint8_t *key; /**< Encryption key */
+	size_t keySize; /**< previous buffer size */
+	const uint8_t *IV; /**< Initialisation vector */
+	size_t IVSize; /**< previous buffer size */
+	const uint8_t *AD; /**< Additional data authenticated by the tag */
+	size_t ADSize; /**< previous buffer size */
+	uint8_t *tag; /**< generated tag */
+	size_t tagSize; /**< previous buffer size */
+	uint8_t *cipher; /**< output buffer, shall be at least the length of the plain buffer */
+};
+
+/**
+ * @brief Encrypt and tag the same plain buffer with several keys, IV and AD
+ *
+ * With AES256-GCM the key schedules, counter blocks encryption and GHASH of 4 entries are interleaved using AES-NI and PCLMULQDQ
+ * instructions when the CPU supports them. Otherwise, and with ChaCha20-Poly1305, entries are processed one by one by AEAD_encrypt.
+ *
+ * @tparam	AEADAlgo	the AEAD scheme used: AES256GCM or CHACHA20POLY1305
+ *
+ * @param[in]	entries		the encryptions to perform, key and tag size must match the selected AEAD scheme or an exception is generated
+ * @param[in]	count		number of entries
+ * @param[in]	plain		buffer to be encrypted by all entries
+ * @param[in]	plainSize	Length in bytes of buffer to be encrypted
+ */
+template <typename AEADAlgo>
+void AEAD_encrypt_batch(const AEADbatchEntry *entries, const size_t count, const uint8_t *const plain, const size_t plainSize);
+/* declare template specialisations */
+template <> void AEAD_encrypt_batch<AES256GCM>(const AEADbatchEntry *entries, const size_t count, const uint8_t *const plain, const size_t plainSize);
+template <> void AEAD_encrypt_batch<CHACHA20POLY1305>(const AEADbatchEntry *entries, const size_t count, const uint8_t *const plain, const size_t plainSize);
+
 
 /*************************************************************************************************/
 /********************** Factory Functions ********************************************************/
 /*************************************************************************************************/
 /* Use these to instantiate an object as they will pick the correct undurlying implemenation of virtual classes */
+/* The implementation is the one of the crypto backend selected when the object is created, see lime::set_cryptoBackend */
 std::shared_ptr<RNG> make_RNG();
+/* Get the RNG of the calling thread: created at first call and then reused, it buffers the random generated and is fork safe. Use it for short lived random generation and key Ids instead of creating a new one */
+std::shared_ptr<RNG> thread_RNG();
+
+/* keyExchange and Signature objects are taken from a per thread pool, they go back to it(wiped of any key) when released */
 
 template <typename Curve>
 std::shared_ptr<keyExchange<Curve>> make_keyExchange();
@@ -424,6 +630,9 @@ extern template void HMAC_KDF<SHA512, std::string>(const uint8_t *const salt, co
 #ifdef EC25519_ENABLED
 	extern template std::shared_ptr<keyExchange<C255>> make_keyExchange();
 	extern template std::shared_ptr<Signature<C255>> make_Signature();
+	extern template bool verify_batch<C255>(const std::vector<SignedXPublicKey<C255>> &signedKeys);
+	extern template void X_batch<C255>(const std::vector<XbatchEntry<C255>> &entries);
+	extern template void X_batch<C255>(const XbatchEntry<C255> *entries, const size_t count);
 	extern template class X<C255, lime::Xtype::publicKey>;
 	extern template class X<C255, lime::Xtype::privateKey>;
 	extern template class X<C255, lime::Xtype::sharedSecret>;
@@ -437,6 +646,9 @@ extern template void HMAC_KDF<SHA512, std::string>(const uint8_t *const salt, co
 #ifdef EC448_ENABLED
 	extern template std::shared_ptr<keyExchange<C448>> make_keyExchange();
 	extern template std::shared_ptr<Signature<C448>> make_Signature();
+	extern template bool verify_batch<C448>(const std::vector<SignedXPublicKey<C448>> &signedKeys);
+	extern template void X_batch<C448>(const std::vector<XbatchEntry<C448>> &entries);
+	extern template void X_batch<C448>(const XbatchEntry<C448> *entries, const size_t count);
 	extern template class X<C448, lime::Xtype::publicKey>;
 	extern template class X<C448, lime::Xtype::privateKey>;
 	extern template class X<C448, lime::Xtype::sharedSecret>;
@@ -64,6 +64,17 @@ namespace settings {
 	/// AEAD generates tag 16 bytes long
 	constexpr size_t DRMessageAuthTagSize=16;
 
+	/** Size of the chunks of a cipherMessage encrypted by chunks, each one is followed by its authentication tag
+	 *
+	 * The last chunk may be shorter (even empty), all the others have exactly this size
+	 */
+	constexpr size_t cipherMessageStreamChunkSize=65536;
+	/** info string used in the derivation(HKDF) of random seed into the key and nonce used to encrypt a cipherMessage by chunks
+	 *
+	 * It differs from hkdf_randomSeed_info so a cipherMessage key is never used in both modes
+	 */
+	const std::string hkdf_randomSeedStream_info{"DR Message Stream Key Derivation"};
+
 /******************************************************************************/
 /*                                                                            */
 /* Local Storage related definitions                                          */
@@ -71,10 +82,11 @@ namespace settings {
 /******************************************************************************/
 	/** define a version number for the DB schema as an integer 0xMMmmpp
 	 *
-	 * current version is 0.1.0
+	 * current version is 0.1.3
 	 */
-	constexpr int DBuserVersion=0x000100;
+	constexpr int DBuserVersion=0x000103;
 	constexpr uint16_t DBInactiveUserBit = 0x0100;
+	constexpr uint16_t DBChaCha20Poly1305UserBit = 0x0200;
 	constexpr uint16_t DBCurveIdByte = 0x00FF;
 	constexpr uint8_t DBInvalidIk = 0x00;
 
@@ -21,10 +21,13 @@
 #include "lime_double_ratchet.hpp"
 #include "lime_double_ratchet_protocol.hpp"
 #include "lime_localStorage.hpp"
+#include "lime_compression.hpp"
 
 #include "bctoolbox/exception.hh"
 
 #include <algorithm> //copy_n
+#include <limits>
+#include <unordered_set>
 
 
 using namespace::std;
@@ -75,30 +78,76 @@ namespace lime {
 	 * @param[out]		MK	Message Key(32 bytes) and IV(16 bytes) computed from HMAC_SHA512 keyed with CK
 	 */
 	static void KDF_CK(DRChainKey &CK, DRMKey &MK) noexcept {
+		// both HMAC are keyed by CK: absorb its pads once
+		const HMACkey<SHA512> key{CK.data(), CK.size()};
+
 		// derive MK and IV from CK and constant
-		HMAC<SHA512>(CK.data(), CK.size(), hkdf_mk_info.data(), hkdf_mk_info.size(), MK.data(), MK.size());
+		key.compute(hkdf_mk_info.data(), hkdf_mk_info.size(), MK.data(), MK.size());
+
+		// CK is not used anymore by key, it can be overwritten by the next one
+		key.compute(hkdf_ck_info.data(), hkdf_ck_info.size(), CK.data(), CK.size());
+	}
+
+	/**
+	 * @brief KDF_CK performed on several independent chains at once
+	 *
+	 * The HMAC of all the chains are computed in one batch: their hash compressions share the multi-buffer kernel lanes
+	 *
+	 * @param[in,out]	CKs	Input/output buffers used as key to compute MK and then next CK
+	 * @param[out]		MKs	Message Keys computed from each CK, in the same order, MKs must hold as many keys as CKs
+	 */
+	static void KDF_CK_batch(const std::vector<DRChainKey *> &CKs, lime::secureVector<DRMKey> &MKs) noexcept {
+		std::vector<HMACbatchEntry> entries{};
+		entries.reserve(2*CKs.size());
+		for (size_t i=0; i<CKs.size(); i++) {
+			// the two entries share the CK key: the second one can overwrite it
+			entries.push_back({CKs[i]->data(), CKs[i]->size(), hkdf_mk_info.data(), hkdf_mk_info.size(), MKs[i].data(), MKs[i].size()});
+			entries.push_back({CKs[i]->data(), CKs[i]->size(), hkdf_ck_info.data(), hkdf_ck_info.size(), CKs[i]->data(), CKs[i]->size()});
+		}
+		HMAC_batch<SHA512>(entries.data(), entries.size());
+	}
+
+	/**
+	 * @brief AEAD encryption using the scheme selected at runtime, parameters are the AEAD_encrypt ones
+	 */
+	static void AEAD_encrypt(const lime::AEADAlgorithm AEAD, const uint8_t *const key, const size_t keySize, const uint8_t *const IV, const size_t IVSize,
+			const uint8_t *const plain, const size_t plainSize, const uint8_t *const AD, const size_t ADSize,
+			uint8_t *tag, const size_t tagSize, uint8_t *cipher) {
+		if (AEAD == lime::AEADAlgorithm::chacha20poly1305) {
+			AEAD_encrypt<CHACHA20POLY1305>(key, keySize, IV, IVSize, plain, plainSize, AD, ADSize, tag, tagSize, cipher);
+		} else {
+			AEAD_encrypt<AES256GCM>(key, keySize, IV, IVSize, plain, plainSize, AD, ADSize, tag, tagSize, cipher);
+		}
+	}
 
-		// use temporary buffer, not likely that output and key could be the same buffer
-		DRChainKey tmp;
-		HMAC<SHA512>(CK.data(), CK.size(), hkdf_ck_info.data(), hkdf_ck_info.size(), tmp.data(), tmp.size());
-		CK = tmp;
+	/**
+	 * @brief AEAD decryption using the scheme selected at runtime, parameters are the AEAD_decrypt ones
+	 */
+	static bool AEAD_decrypt(const lime::AEADAlgorithm AEAD, const uint8_t *const key, const size_t keySize, const uint8_t *const IV, const size_t IVSize,
+			const uint8_t *const cipher, const size_t cipherSize, const uint8_t *const AD, const size_t ADSize,
+			const uint8_t *const tag, const size_t tagSize, uint8_t *plain) {
+		if (AEAD == lime::AEADAlgorithm::chacha20poly1305) {
+			return AEAD_decrypt<CHACHA20POLY1305>(key, keySize, IV, IVSize, cipher, cipherSize, AD, ADSize, tag, tagSize, plain);
+		}
+		return AEAD_decrypt<AES256GCM>(key, keySize, IV, IVSize, cipher, cipherSize, AD, ADSize, tag, tagSize, plain);
 	}
 
 	/**
 	 * @brief Decrypt as described is spec section 3.1
 	 *
+	 * @param[in]	AEAD		The AEAD scheme used to encrypt this message, as advertised in its header
 	 * @param[in]	MK		A buffer holding key<32 bytes> || IV<16 bytes>
 	 * @param[in]	ciphertext	buffer holding: header<size depends on Curve type> || ciphertext || auth tag<16 bytes>
 	 * @param[in]	headerSize	Size of the header included in ciphertext
 	 * @param[in]	AD		Associated data
-	 * @param[out]	plaintext	the output message : a vector resized to hold the plaintext.
+	 * @param[out]	plaintext	the output message : a secure vector resized to hold the plaintext.
 	 *
 	 * @return false if authentication failed
 	 *
 	 */
-	static bool decrypt(const lime::DRMKey &MK, const std::vector<uint8_t> &ciphertext, const size_t headerSize, std::vector<uint8_t> &AD, std::vector<uint8_t> &plaintext) {
+	static bool decrypt(const lime::AEADAlgorithm AEAD, const lime::DRMKey &MK, const lime::span<const uint8_t> ciphertext, const size_t headerSize, std::vector<uint8_t> &AD, lime::secureVector<uint8_t> &plaintext) {
 		plaintext.resize(ciphertext.size() - headerSize - lime::settings::DRMessageAuthTagSize); // size of plaintext is: cipher - header - authentication tag, we're getting a vector, we must resize it
-		return AEAD_decrypt<AES256GCM>(MK.data(), lime::settings::DRMessageKeySize, // MK buffer hold key<DRMessageKeySize bytes>||IV<DRMessageIVSize bytes>
+		return AEAD_decrypt(AEAD, MK.data(), lime::settings::DRMessageKeySize, // MK buffer hold key<DRMessageKeySize bytes>||IV<DRMessageIVSize bytes>
 					MK.data()+lime::settings::DRMessageKeySize, lime::settings::DRMessageIVSize,
 					ciphertext.data()+headerSize, plaintext.size(), // cipher text starts after header, length is the one computed for plaintext
 					AD.data(), AD.size(),
@@ -111,8 +160,8 @@ namespace lime {
 	 * used when the ouput is a fixed buffer: we decrypt the random seed used to generate the cipherMessage keys
 	 * No need to resize the plaintext buffer when it has a fixed size.
 	 */
-	static bool decrypt(const lime::DRMKey &MK, const std::vector<uint8_t> &ciphertext, const size_t headerSize, std::vector<uint8_t> &AD, sBuffer<lime::settings::DRrandomSeedSize> &plaintext) {
-		return AEAD_decrypt<AES256GCM>(MK.data(), lime::settings::DRMessageKeySize, // MK buffer hold key<DRMessageKeySize bytes>||IV<DRMessageIVSize bytes>
+	static bool decrypt(const lime::AEADAlgorithm AEAD, const lime::DRMKey &MK, const lime::span<const uint8_t> ciphertext, const size_t headerSize, std::vector<uint8_t> &AD, sBuffer<lime::settings::DRrandomSeedSize> &plaintext) {
+		return AEAD_decrypt(AEAD, MK.data(), lime::settings::DRMessageKeySize, // MK buffer hold key<DRMessageKeySize bytes>||IV<DRMessageIVSize bytes>
 					MK.data()+lime::settings::DRMessageKeySize, lime::settings::DRMessageIVSize,
 					ciphertext.data()+headerSize, plaintext.size(), // cipher text starts after header, length is the one computed for plaintext
 					AD.data(), AD.size(),
@@ -120,6 +169,48 @@ namespace lime {
 					plaintext.data());
 	}
 
+	/**
+	 * @brief Per thread scratch buffer holding the associated data of the DR messages being encrypted or decrypted
+	 *
+	 * It keeps its capacity from one message to the next: once warmed up, assembling the associated data does not allocate anymore
+	 */
+	static std::vector<uint8_t> &ADscratchBuffer(void) {
+		static thread_local std::vector<uint8_t> buffer{};
+		return buffer;
+	}
+
+	/**
+	 * @brief Per thread scratch buffer holding the associated data of the cipherMessage being decrypted: source Device Id || recipient User Id
+	 *
+	 * Same as ADscratchBuffer, it keeps its capacity from one message to the next
+	 */
+	static std::vector<uint8_t> &cipherMessageADscratchBuffer(void) {
+		static thread_local std::vector<uint8_t> buffer{};
+		return buffer;
+	}
+
+	/**
+	 * @brief Per thread scratch buffer holding the message keys of a batch encryption
+	 *
+	 * It keeps its capacity from one batch to the next: past the secure arena largest size class(about 85 keys), a new buffer
+	 * would be a dedicated locked mapping for each batch. It is wiped after each batch.
+	 */
+	static lime::secureVector<DRMKey> &MKscratchBuffer(void) {
+		static thread_local lime::secureVector<DRMKey> buffer{};
+		return buffer;
+	}
+
+	/**
+	 * @brief Per thread scratch buffer holding a decrypted payload which cannot be deciphered directly in the caller's buffer:
+	 * payload in the DR message or compressed payload
+	 *
+	 * It keeps its capacity from one message to the next and is wiped after each use.
+	 */
+	static lime::secureVector<uint8_t> &payloadScratchBuffer(void) {
+		static thread_local lime::secureVector<uint8_t> buffer{};
+		return buffer;
+	}
+
 	/****************************************************************************/
 	/* DR member functions                                                      */
 	/****************************************************************************/
@@ -144,29 +235,25 @@ namespace lime {
 	 * @param[in]	selfDid			Id used in local storage for local user this session shall be attached to
 	 * @param[in]	X3DH_initMessage	at session creation as sender we shall also store the X3DHInit message to be able to include it in all message until we got a response from peer
 	 * @param[in]	RNG_context		A Random Number Generator context used for any rndom generation needed by this session
+	 * @param[in]	AEAD			The AEAD scheme used to encrypt the messages of this session, the receiver adopts it from the first message
 	 */
 	template <typename Curve>
-	DR<Curve>::DR(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const X<Curve, lime::Xtype::publicKey> &peerPublicKey, long int peerDid, const std::string &peerDeviceId, const DSA<Curve, lime::DSAtype::publicKey> &peerIk, long int selfDid, const std::vector<uint8_t> &X3DH_initMessage, std::shared_ptr<RNG> RNG_context)
+	DR<Curve>::DR(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const X<Curve, lime::Xtype::publicKey> &peerPublicKey, long int peerDid, const std::string &peerDeviceId, const DSA<Curve, lime::DSAtype::publicKey> &peerIk, long int selfDid, const std::vector<uint8_t> &X3DH_initMessage, std::shared_ptr<RNG> RNG_context, const lime::AEADAlgorithm AEAD)
 	:m_DHr{peerPublicKey},m_DHr_valid{true}, m_DHs{},m_RK(SK),m_CKs{},m_CKr{},m_Ns(0),m_Nr(0),m_PN(0),m_sharedAD(AD),m_mkskipped{},
 	m_RNG{RNG_context},m_dbSessionId{0},m_usedNr{0},m_usedDHid{0}, m_usedOPkId{0}, m_localStorage{localStorage},m_dirty{DRSessionDbStatus::dirty},m_peerDid{peerDid},m_peerDeviceId{},
-	m_peerIk{},m_db_Uid{selfDid}, m_active_status{true}, m_X3DH_initMessage{X3DH_initMessage}
+	m_peerIk{},m_db_Uid{selfDid}, m_active_status{true}, m_X3DH_initMessage{X3DH_initMessage}, m_AEAD{AEAD}, m_peerCompression{0}
 	{
-		// generate a new self key pair
-		auto DH = make_keyExchange<Curve>();
-		DH->createKeyPair(m_RNG);
-
-		// copy the peer public key into ECDH context
-		DH->set_peerPublic(peerPublicKey);
-
-		// get self key pair from context
-		m_DHs.publicKey() = DH->get_selfPublic();
-		m_DHs.privateKey() = DH->get_secret();
-
-		// compute shared secret
-		DH->computeSharedSecret();
+		// generate a new self key pair: derive its public key and compute the shared secret with the peer in one batch, straight into our buffers
+		m_RNG->randomize(m_DHs.privateKey().data(), m_DHs.privateKey().size());
+		X<Curve, lime::Xtype::sharedSecret> sharedSecret;
+		const std::array<XbatchEntry<Curve>, 2> exchanges{{
+			{&(m_DHs.privateKey()), nullptr, m_DHs.publicKey().data()},
+			{&(m_DHs.privateKey()), &peerPublicKey, sharedSecret.data()}
+		}};
+		X_batch<Curve>(exchanges.data(), exchanges.size());
 
 		// derive the root key
-		KDF_RK<Curve>(m_RK, m_CKs, DH->get_sharedSecret());
+		KDF_RK<Curve>(m_RK, m_CKs, sharedSecret);
 
 		// If we have no peerDid, copy peer DeviceId and Ik in the session so we can use them to create the peer device in local storage when first saving the session
 		if (peerDid == 0) {
@@ -193,7 +280,7 @@ namespace lime {
 	DR<Curve>::DR(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const Xpair<Curve> &selfKeyPair, long int peerDid, const std::string &peerDeviceId, const uint32_t OPk_id, const DSA<Curve, lime::DSAtype::publicKey> &peerIk, long int selfDid, std::shared_ptr<RNG> RNG_context)
 	:m_DHr{},m_DHr_valid{false},m_DHs{selfKeyPair},m_RK(SK),m_CKs{},m_CKr{},m_Ns(0),m_Nr(0),m_PN(0),m_sharedAD(AD),m_mkskipped{},
 	m_RNG{RNG_context},m_dbSessionId{0},m_usedNr{0},m_usedDHid{0}, m_usedOPkId{OPk_id}, m_localStorage{localStorage},m_dirty{DRSessionDbStatus::dirty},m_peerDid{peerDid},m_peerDeviceId{},
-	m_peerIk{},m_db_Uid{selfDid}, m_active_status{true}, m_X3DH_initMessage{}
+	m_peerIk{},m_db_Uid{selfDid}, m_active_status{true}, m_X3DH_initMessage{}, m_AEAD{lime::AEADAlgorithm::aes256gcm}, m_peerCompression{0}
 	{
 		// If we have no peerDid, copy peer DeviceId and Ik in the session so we can use them to create the peer device in local storage when first saving the session
 		if (peerDid == 0) {
@@ -216,7 +303,7 @@ namespace lime {
 	DR<Curve>::DR(std::shared_ptr<lime::Db> localStorage, long sessionId, std::shared_ptr<RNG> RNG_context)
 	:m_DHr{},m_DHr_valid{true},m_DHs{},m_RK{},m_CKs{},m_CKr{},m_Ns(0),m_Nr(0),m_PN(0),m_sharedAD{},m_mkskipped{},
 	m_RNG{RNG_context},m_dbSessionId{sessionId},m_usedNr{0},m_usedDHid{0}, m_usedOPkId{0}, m_localStorage{localStorage},m_dirty{DRSessionDbStatus::clean},m_peerDid{0},m_peerDeviceId{},
-	m_peerIk{},m_db_Uid{0},	m_active_status{false}, m_X3DH_initMessage{}
+	m_peerIk{},m_db_Uid{0},	m_active_status{false}, m_X3DH_initMessage{}, m_AEAD{lime::AEADAlgorithm::aes256gcm}, m_peerCompression{0}
 	{
 		session_load();
 	}
@@ -274,54 +361,84 @@ namespace lime {
 		m_DHr = headerDH;
 
 		// generate a new self key pair
-		auto DH = make_keyExchange<Curve>();
+		Xpair<Curve> DHs;
+		m_RNG->randomize(DHs.privateKey().data(), DHs.privateKey().size());
 
-		// copy the peer public key into ECDH context
-		DH->set_peerPublic(m_DHr);
-		DH->set_selfPublic(m_DHs.publicKey());
-		DH->set_secret(m_DHs.privateKey());
+		// compute in one batch: the receiving chain shared secret with our current key pair, the new self public key and the sending chain shared secret with the new key pair
+		X<Curve, lime::Xtype::sharedSecret> receivingSecret, sendingSecret;
+		const std::array<XbatchEntry<Curve>, 3> exchanges{{
+			{&(m_DHs.privateKey()), &m_DHr, receivingSecret.data()},
+			{&(DHs.privateKey()), nullptr, DHs.publicKey().data()},
+			{&(DHs.privateKey()), &m_DHr, sendingSecret.data()}
+		}};
+		X_batch<Curve>(exchanges.data(), exchanges.size());
 
-		//  Derive the new receiving chain key
-		DH->computeSharedSecret();
-		KDF_RK<Curve>(m_RK, m_CKr, DH->get_sharedSecret());
+		//  Derive the new receiving chain key, then the new sending one
+		KDF_RK<Curve>(m_RK, m_CKr, receivingSecret);
+		KDF_RK<Curve>(m_RK, m_CKs, sendingSecret);
 
-		// generate a new self key pair
-		DH->createKeyPair(m_RNG);
-
-		//  Derive the new sending chain key
-		DH->computeSharedSecret();
-		KDF_RK<Curve>(m_RK, m_CKs, DH->get_sharedSecret());
-
-		// get self key pair from context
-		m_DHs.publicKey() = DH->get_selfPublic();
-		m_DHs.privateKey() = DH->get_secret();
+		// this is our new self key pair
+		m_DHs = DHs;
 
 		// modified the DR session, not in sync anymore with local storage
 		m_dirty = DRSessionDbStatus::dirty_ratchet;
 	}
 
 	/**
-	 * @brief Encrypt using the double-ratchet algorithm.
+	 * @brief Derive in one pass the next message key of several sessions sending chains
 	 *
-	 * @tparam	inputContainer			is used with
-	 * 						- sBuffer: the input is a random seed used to decrypt the cipher message
-	 * 						- std::vector<uint8_t>: the input is directly the plaintext message
+	 * Each session sending chain is moved forward: its next encryptPrepare must be given the derived message key
 	 *
-	 * @param[in]	plaintext			the input to be encrypted, may actually be a 32 bytes buffer holding the seed used to generate key+IV for a AES-GCM encryption to the actual message
-	 * @param[in]	AD				Associated Data, this buffer shall hold: source GRUU<...> || recipient GRUU<...> || [ actual message AEAD auth tag OR recipient User Id]
-	 * @param[out]	ciphertext			buffer holding the header, cipher text and auth tag, shall contain the key and IV used to cipher the actual message, auth tag applies on AD || header
-	 * @param[in]	payloadDirectEncryption		A flag to set in message header: set when having payload in the DR message
+	 * @param[in]	sessions	the sessions, null pointers are ignored. A session must not be given twice
+	 * @param[out]	MKs		the message keys derived, in the sessions order, resized to the sessions count
 	 */
 	template <typename Curve>
-	template <typename inputContainer> // input container can be a sBuffer (fixed size) holding a random seed or std::vector<uint8_t> holding the actual message
-	void DR<Curve>::ratchetEncrypt(const inputContainer &plaintext, std::vector<uint8_t> &&AD, std::vector<uint8_t> &ciphertext, const bool payloadDirectEncryption) {
+	void DR<Curve>::deriveSendingKeys(const std::vector<DR<Curve> *> &sessions, lime::secureVector<DRMKey> &MKs) {
+		MKs.resize(sessions.size());
+		std::vector<DRChainKey *> CKs{};
+		CKs.reserve(sessions.size());
+		for (const auto session : sessions) {
+			if (session != nullptr) {
+				session->m_dirty = DRSessionDbStatus::dirty_encrypt; // the sending chain moves forward
+				CKs.push_back(&(session->m_CKs));
+			}
+		}
+		// derive in the first keys of MKs, then move them to their session index starting from the last one: none is overwritten before being moved
+		KDF_CK_batch(CKs, MKs);
+		for (size_t i=sessions.size(), j=CKs.size(); i-- > 0;) {
+			if (sessions[i] != nullptr) {
+				MKs[i] = MKs[--j];
+			}
+		}
+	}
+
+	/**
+	 * @brief First part of the double-ratchet encryption: move the sending chain forward, build the message header and the AEAD associated data
+	 *
+	 * @param[in]		plaintextSize			size of the input to be encrypted
+	 * @param[in,out]	AD				Associated Data given to ratchetEncrypt, session shared AD and message header are appended to it
+	 * @param[out]		ciphertext			holds the header and is resized to get the cipher text and auth tag after it
+	 * @param[in]		payloadDirectEncryption		A flag to set in message header: set when having payload in the DR message
+	 * @param[in]		cipherMessageAEAD		the AEAD scheme used to encrypt the cipher message, advertised in message header
+	 * @param[in]		cipherMessageStream		A flag to set in message header: set when the cipher message is encrypted by chunks
+	 * @param[in]		payloadCompressed		A flag to set in message header: set when the payload was compressed before its encryption
+	 * @param[in,out]	MK				the message key, derived here from the sending chain unless MKderived is set
+	 * @param[in]		MKderived			true when MK was already derived by deriveSendingKeys
+	 *
+	 * @return the header size: cipher text starts at this offset in the ciphertext buffer
+	 */
+	template <typename Curve>
+	size_t DR<Curve>::encryptPrepare(const size_t plaintextSize, std::vector<uint8_t> &AD, std::vector<uint8_t> &ciphertext, const bool payloadDirectEncryption, const lime::AEADAlgorithm cipherMessageAEAD, const bool cipherMessageStream, const bool payloadCompressed, DRMKey &MK, const bool MKderived) {
 		m_dirty = DRSessionDbStatus::dirty_encrypt; // we're about to modify this session, it won't be in sync anymore with local storage
 		// chain key derivation(also compute message key)
-		DRMKey MK;
-		KDF_CK(m_CKs, MK);
+		if (!MKderived) {
+			KDF_CK(m_CKs, MK);
+		}
 
-		// build header string in the ciphertext buffer
-		double_ratchet_protocol::buildMessage_header(ciphertext, m_Ns, m_PN, m_DHs.publicKey(), m_X3DH_initMessage, payloadDirectEncryption);
+		// build header string in the ciphertext buffer, allocated once at its final size: header size + cipher text size + auth tag size
+		ciphertext.clear();
+		ciphertext.reserve(double_ratchet_protocol::headerSize<Curve>() + m_X3DH_initMessage.size() + plaintextSize + lime::settings::DRMessageAuthTagSize);
+		double_ratchet_protocol::buildMessage_header(ciphertext, m_Ns, m_PN, m_DHs.publicKey(), m_X3DH_initMessage, payloadDirectEncryption, m_AEAD, cipherMessageAEAD, cipherMessageStream, payloadCompressed);
 		auto headerSize = ciphertext.size(); // cipher text holds only the DR header for now
 
 		// increment current sending chain message index
@@ -333,22 +450,122 @@ namespace lime {
 
 		// data will be written directly in the underlying structure by C library, so set size to the actual one
 		// header size + cipher text size + auth tag size
-		ciphertext.resize(ciphertext.size()+plaintext.size()+lime::settings::DRMessageAuthTagSize);
+		ciphertext.resize(ciphertext.size()+plaintextSize+lime::settings::DRMessageAuthTagSize);
+
+		return headerSize;
+	}
+
+	/**
+	 * @brief Last part of the double-ratchet encryption, once the message is encrypted: update the session status and save it
+	 */
+	template <typename Curve>
+	void DR<Curve>::encryptComplete(void) {
+		if (m_Ns >= lime::settings::maxSendingChain) { // if we reached maximum encryption wuthout DH ratchet step, session becomes inactive
+			m_active_status = false;
+		}
+
+		if (session_save(false) == true) { // session_save called with false, will not manage db lock and transaction, it is taken care by ratchetEncrypt caller
+			m_dirty = DRSessionDbStatus::clean; // this session and local storage are back in sync
+		}
+	}
+
+	/**
+	 * @brief Encrypt using the double-ratchet algorithm.
+	 *
+	 * @tparam	inputContainer			is used with
+	 * 						- sBuffer: the input is a random seed used to decrypt the cipher message
+	 * 						- std::vector<uint8_t>: the input is directly the plaintext message
+	 *
+	 * @param[in]	plaintext			the input to be encrypted, may actually be a 32 bytes buffer holding the seed used to generate key+IV for a AES-GCM encryption to the actual message
+	 * @param[in]	AD				Associated Data, this buffer shall hold: source GRUU<...> || recipient GRUU<...> || [ actual message AEAD auth tag OR recipient User Id]
+	 * @param[out]	ciphertext			buffer holding the header, cipher text and auth tag, shall contain the key and IV used to cipher the actual message, auth tag applies on AD || header
+	 * @param[in]	payloadDirectEncryption		A flag to set in message header: set when having payload in the DR message
+	 * @param[in]	cipherMessageAEAD		the AEAD scheme used to encrypt the cipher message, advertised in message header
+	 * @param[in]	cipherMessageStream		A flag to set in message header: set when the cipher message is encrypted by chunks
+	 * @param[in]	payloadCompressed		A flag to set in message header: set when the payload was compressed before its encryption
+	 */
+	template <typename Curve>
+	template <typename inputContainer> // input container can be a sBuffer (fixed size) holding a random seed or std::vector<uint8_t> holding the actual message
+	void DR<Curve>::ratchetEncrypt(const inputContainer &plaintext, std::vector<uint8_t> &&AD, std::vector<uint8_t> &ciphertext, const bool payloadDirectEncryption, const lime::AEADAlgorithm cipherMessageAEAD, const bool cipherMessageStream, const bool payloadCompressed) {
+		DRMKey MK;
+		auto headerSize = encryptPrepare(plaintext.size(), AD, ciphertext, payloadDirectEncryption, cipherMessageAEAD, cipherMessageStream, payloadCompressed, MK, false);
 
-		AEAD_encrypt<AES256GCM>(MK.data(), lime::settings::DRMessageKeySize, // MK buffer also hold the IV
+		AEAD_encrypt(m_AEAD, MK.data(), lime::settings::DRMessageKeySize, // MK buffer also hold the IV
 				MK.data()+lime::settings::DRMessageKeySize, lime::settings::DRMessageIVSize, // IV is stored in the same buffer as key, after it
 				plaintext.data(), plaintext.size(),
 				AD.data(), AD.size(),
 				ciphertext.data()+headerSize+plaintext.size(), lime::settings::DRMessageAuthTagSize, // directly store tag after cipher text in the output buffer
 				ciphertext.data()+headerSize);
 
-		if (m_Ns >= lime::settings::maxSendingChain) { // if we reached maximum encryption wuthout DH ratchet step, session becomes inactive
-			m_active_status = false;
+		encryptComplete();
+	}
+
+	/**
+	 * @brief Encrypt the same input with several sessions using the double-ratchet algorithm.
+	 *
+	 * Produce the same messages than a ratchetEncrypt call on each session but the message keys are derived in one pass
+	 * and the AEAD encryptions of all messages are performed in one batch.
+	 *
+	 * @tparam	inputContainer			see ratchetEncrypt
+	 *
+	 * @param[in]	sessions			the sessions to encrypt with, a session given several times produces successive messages
+	 * @param[in]	plaintext			the input to be encrypted by all sessions
+	 * @param[in]	AD				Associated Data common to all messages
+	 * @param[in]	recipientADs			Associated Data specific to each message, appended to the common one: AD || recipientADs[i] is the AD given to ratchetEncrypt
+	 * @param[out]	ciphertexts			buffers to store each message
+	 * @param[in]	payloadDirectEncryption		A flag to set in messages header: set when having payload in the DR message
+	 * @param[in]	cipherMessageAEAD		the AEAD scheme used to encrypt the cipher message, advertised in messages header
+	 * @param[in]	cipherMessageStream		A flag to set in messages header: set when the cipher message is encrypted by chunks
+	 * @param[in]	payloadCompressed		A flag to set in messages header: set when the payload was compressed before its encryption
+	 */
+	template <typename Curve>
+	template <typename inputContainer>
+	void DR<Curve>::ratchetEncryptBatch(const std::vector<DR<Curve> *> &sessions, const inputContainer &plaintext, const std::vector<uint8_t> &AD, const std::vector<lime::span<const uint8_t>> &recipientADs, const std::vector<std::vector<uint8_t> *> &ciphertexts, const bool payloadDirectEncryption, const lime::AEADAlgorithm cipherMessageAEAD, const bool cipherMessageStream, const bool payloadCompressed) {
+		// derive the message keys in one pass, a session given more than once derives its next keys on its own
+		std::vector<DR<Curve> *> uniqueSessions{};
+		std::unordered_set<DR<Curve> *> seenSessions{};
+		uniqueSessions.reserve(sessions.size());
+		for (const auto session : sessions) {
+			uniqueSessions.push_back(seenSessions.insert(session).second?session:nullptr);
+		}
+		auto &MKs = MKscratchBuffer();
+		MKs.clear();
+		deriveSendingKeys(uniqueSessions, MKs);
+
+		// the associated data of all messages are gathered back to back in the per thread scratch buffer:
+		// given AD || recipient AD || sharedAD stored in session || header (see DR spec section 3.4)
+		// it is reserved at its final size so the AEAD entries can point into it while it is being filled
+		auto &ADbuffer = ADscratchBuffer();
+		ADbuffer.clear();
+		size_t ADbufferSize = 0;
+		for (size_t i=0; i<sessions.size(); i++) {
+			ADbufferSize += AD.size() + recipientADs[i].size() + sessions[i]->m_sharedAD.size() + double_ratchet_protocol::headerSize<Curve>() + sessions[i]->m_X3DH_initMessage.size();
+		}
+		ADbuffer.reserve(ADbufferSize);
+
+		// build the messages headers in order, then encrypt them all at once, one batch per AEAD scheme
+		std::vector<AEADbatchEntry> entries{};
+		std::vector<AEADbatchEntry> chachaEntries{};
+		entries.reserve(sessions.size());
+		for (size_t i=0; i<sessions.size(); i++) {
+			auto &ciphertext = *(ciphertexts[i]);
+			const auto ADoffset = ADbuffer.size();
+			ADbuffer.insert(ADbuffer.end(), AD.cbegin(), AD.cend());
+			ADbuffer.insert(ADbuffer.end(), recipientADs[i].begin(), recipientADs[i].end());
+			auto headerSize = sessions[i]->encryptPrepare(plaintext.size(), ADbuffer, ciphertext, payloadDirectEncryption, cipherMessageAEAD, cipherMessageStream, payloadCompressed, MKs[i], uniqueSessions[i] != nullptr);
+			(sessions[i]->m_AEAD == lime::AEADAlgorithm::chacha20poly1305 ? chachaEntries : entries).push_back({MKs[i].data(), lime::settings::DRMessageKeySize, // MK buffer also hold the IV
+					MKs[i].data()+lime::settings::DRMessageKeySize, lime::settings::DRMessageIVSize,
+					ADbuffer.data()+ADoffset, ADbuffer.size()-ADoffset,
+					ciphertext.data()+headerSize+plaintext.size(), lime::settings::DRMessageAuthTagSize, // directly store tag after cipher text in the output buffer
+					ciphertext.data()+headerSize});
 		}
+		AEAD_encrypt_batch<AES256GCM>(entries.data(), entries.size(), plaintext.data(), plaintext.size());
+		AEAD_encrypt_batch<CHACHA20POLY1305>(chachaEntries.data(), chachaEntries.size(), plaintext.data(), plaintext.size());
 
-		if (session_save(false) == true) { // session_save called with false, will not manage db lock and transaction, it is taken care by ratchetEncrypt caller
-			m_dirty = DRSessionDbStatus::clean; // this session and local storage are back in sync
+		for (const auto session : sessions) {
+			session->encryptComplete();
 		}
+		MKs.clear(); // wipe the message keys, the buffer capacity is kept for the next batch
 	}
 
 
@@ -357,18 +574,21 @@ namespace lime {
 	 *
 	 * @tparam	outputContainer			is used with
 	 * 						- sBuffer: the ouput is a random seed used to decrypt the cipher message
-	 * 						- std::vector<uint8_t>: the output is directly the plaintext message
+	 * 						- lime::secureVector<uint8_t>: the output is directly the payload of the message
 	 *
 	 * @param[in]	ciphertext			Input to be decrypted, is likely to be a 32 bytes vector holding the crypted version of a random seed
-	 * @param[in]	AD				Associated data authenticated along the encryption (initial session AD and DR message header are append to it)
+	 * @param[in,out]	AD			Associated data authenticated along the encryption, session shared AD and DR message header are appended to it:
+	 *						the caller shall resize it back before giving it to another session
 	 * @param[out]	plaintext			Decrypted output
 	 * @param[in]	payloadDirectEncryption		A flag to enforce checking on message type: when set we expect to get payload in the message(so message header matching flag must be set)
+	 * @param[in]	acceptPlaintext			If set, called on the decrypted output before the session is saved: when it returns false, the decryption fails
+	 *						and the session is not saved so the message can be decrypted again
 	 *
 	 * @return	true on success
 	 */
 	template <typename Curve>
-	template <typename outputContainer> // output container can be a sBuffer (fixed size) getting a random seed or std::vector<uint8_t> getting the actual message
-	bool DR<Curve>::ratchetDecrypt(const std::vector<uint8_t> &ciphertext,const std::vector<uint8_t> &AD, outputContainer &plaintext, const bool payloadDirectEncryption) {
+	template <typename outputContainer> // output container can be a sBuffer (fixed size) getting a random seed or lime::secureVector<uint8_t> getting the actual message
+	bool DR<Curve>::ratchetDecrypt(const lime::span<const uint8_t> ciphertext, std::vector<uint8_t> &AD, outputContainer &plaintext, const bool payloadDirectEncryption, const std::function<bool(outputContainer &)> &acceptPlaintext) {
 		// parse header
 		double_ratchet_protocol::DRHeader<Curve> header{ciphertext};
 		if (!header.valid()) { // check it is valid otherwise just stop
@@ -380,10 +600,9 @@ namespace lime {
 			throw BCTBX_EXCEPTION << "DR packet header direct encryption flag ("<<(header.payloadDirectEncryption()?"true":"false")<<") not in sync with caller request("<<(payloadDirectEncryption?"true":"false")<<")";
 		}
 
-		// build an Associated Data buffer: given AD || shared AD stored in session || header (as in DR spec section 3.4)
-		std::vector<uint8_t> DRAD{AD}; // copy given AD
-		DRAD.insert(DRAD.end(), m_sharedAD.cbegin(), m_sharedAD.cend());
-		DRAD.insert(DRAD.end(), ciphertext.cbegin(), ciphertext.cbegin()+header.size());
+		// complete the Associated Data: given AD || shared AD stored in session || header (as in DR spec section 3.4)
+		AD.insert(AD.end(), m_sharedAD.cbegin(), m_sharedAD.cend());
+		AD.insert(AD.end(), ciphertext.begin(), ciphertext.begin()+header.size());
 
 		DRMKey MK;
 		int maxAllowedDerivation = lime::settings::maxMessageSkip;
@@ -391,11 +610,13 @@ namespace lime {
 		if (!m_DHr_valid) { // it's the first message arriving after the initialisation of the chain in receiver mode, we have no existing history in this chain
 			DHRatchet(header.DHs()); // just perform the DH ratchet step
 			m_DHr_valid=true;
+			m_AEAD = header.AEAD(); // use the AEAD scheme selected by the session initiator
 		} else {
 			// check stored message keys
 			if (trySkippedMessageKeys(header.Ns(), header.DHs(), MK)) {
-				if (decrypt(MK, ciphertext, header.size(), DRAD, plaintext) == true) {
+				if (decrypt(header.AEAD(), MK, ciphertext, header.size(), AD, plaintext) == true && (!acceptPlaintext || acceptPlaintext(plaintext))) {
 					//Decrypt went well, we must save the session to DB
+					m_peerCompression = header.compressionCapabilities(); // the peer may have changed its lime version
 					if (session_save() == true) {
 						m_dirty = DRSessionDbStatus::clean; // this session and local storage are back in sync
 						m_usedDHid=0; // reset variables used to tell the local storage to delete them
@@ -424,7 +645,8 @@ namespace lime {
 		m_Nr++;
 
 		//decrypt and save on succes
-		if (decrypt(MK, ciphertext, header.size(), DRAD, plaintext) == true ) {
+		if (decrypt(header.AEAD(), MK, ciphertext, header.size(), AD, plaintext) == true && (!acceptPlaintext || acceptPlaintext(plaintext))) {
+			m_peerCompression = header.compressionCapabilities(); // the compressed payloads the peer can read
 			if (session_save() == true) {
 				m_dirty = DRSessionDbStatus::clean; // this session and local storage are back in sync
 				m_mkskipped.clear(); // potential skipped message keys are now stored in DB, clear the local storage
@@ -436,6 +658,21 @@ namespace lime {
 		}
 	}
 
+	/**
+	 * @brief Can the peer of this session decompress payloads compressed with this algorithm
+	 *
+	 *	The peer advertises in each message it sends the algorithms it can decompress: we know it once we decrypted a message from it
+	 *
+	 * @param[in]	algorithm	the compression algorithm
+	 *
+	 * @return true if the last message decrypted with this session advertised it
+	 */
+	template <typename Curve>
+	bool DR<Curve>::peerDecompresses(const lime::CompressionAlgorithm algorithm) const {
+		const auto flag = double_ratchet_protocol::compressionCapabilityFlag(algorithm);
+		return flag != 0 && (m_peerCompression & flag) == flag;
+	}
+
 	/* template instanciations for Curve25519 and Curve448 */
 #ifdef EC25519_ENABLED
 	extern template bool DR<C255>::session_load();
@@ -451,25 +688,72 @@ namespace lime {
 	template class DR<C448>;
 #endif
 	/**
-	 * @brief Encrypt a message to all recipients, identified by their device id
+	 * @brief Provide the buffer receiving a decrypted message
 	 *
-	 *	The plaintext is first encrypted by one randomly generated key using aes-gcm
-	 *	The key and IV are then encrypted with DR Session specific to each device
+	 * Called with the size of the plaintext once the message is deciphered, before the session is saved.
+	 * Returns false when the caller cannot take a plaintext of that size: the message is then not consumed.
+	 */
+	using plaintextOutput = std::function<bool(const size_t plaintextSize, uint8_t *&plaintext)>;
+
+	/**
+	 * @brief Give a decrypted payload to the caller, decompressed if its DR message header says it was compressed
 	 *
-	 * @param[in,out]	recipients	vector of recipients device id(gruu) and linked DR Session, DR Session are modified by the encryption\n
-	 *					The recipients struct also hold after encryption the double ratchet message targeted to that particular recipient
+	 *	Called before the session is saved: when it fails, the message is not consumed
+	 *
+	 * @param[in]	compressed		the payload compressed flag from the DR message header
+	 * @param[in]	payload			the decrypted payload
+	 * @param[in]	output			provides the buffer receiving the plaintext
+	 * @param[out]	plaintextSize		the size of the plaintext, set even when the output cannot take it
+	 * @param[out]	plaintextTooLarge	set when the output cannot take the plaintext
+	 *
+	 * @return false if the payload cannot be decompressed or the output cannot take it
+	 */
+	static bool outputPayload(const bool compressed, const lime::span<const uint8_t> payload, const plaintextOutput &output, size_t &plaintextSize, bool &plaintextTooLarge) {
+		plaintextSize = payload.size();
+		if (compressed && !decompressedPayloadSize(payload, plaintextSize)) { // unknown algorithm, size over the limit or corrupted header: reject the message
+			return false;
+		}
+		uint8_t *plaintext = nullptr;
+		if (!output(plaintextSize, plaintext)) {
+			LIME_LOGW<<"Decrypted message is "<<plaintextSize<<" bytes long, more than the caller can take: do not consume it";
+			plaintextTooLarge = true;
+			return false;
+		}
+		if (!compressed) {
+			std::copy_n(payload.data(), plaintextSize, plaintext);
+			return true;
+		}
+		if (!decompressPayload(payload, lime::span<uint8_t>{plaintext, plaintextSize})) {
+			cleanBuffer(plaintext, plaintextSize);
+			LIME_LOGW<<"Message correctly deciphered but then failed to decompress it";
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Build the encryption context of a message: select the encryption mode, produce the cipherMessage if needed and the common part of the associated data
+	 *
+	 *	When the payload is in the cipherMessage, it is encrypted by one randomly generated key using aes-gcm or chacha20-poly1305,
+	 *	the seed of this key and IV is kept in the context to be encrypted with the DR Session specific to each device
+	 *	When a compression algorithm is selected, the payload is compressed first if it makes it shorter
+	 *
+	 * @param[in]		recipientsCount	total number of recipients of the message, used by the encryption policy
 	 * @param[in]		plaintext	data to be encrypted
 	 * @param[in]		recipientUserId	the recipient ID, not specific to a device(could be a sip-uri) or a user(could be a group sip-uri)
 	 * @param[in]		sourceDeviceId	the Id of sender device(gruu)
-	 * @param[out]		cipherMessage	message encrypted with a random generated key(and IV). May be an empty buffer depending on encryptionPolicy, recipients and plaintext characteristics
-	 * @param[in]		encryptionPolicy	select how to manage the encryption: direct use of Double Ratchet message or encrypt in the cipher message and use the DR message to share the cipher message key\n
-	 * 						default is optimized output size mode.
-	 * @param[in]		localStorage	pointer to the local storage, used to get lock and start transaction on all DR sessions at once
+	 * @param[in]		cipherMessage	provides the buffer receiving the message encrypted with a random generated key(and IV). It may get an empty one depending on encryptionPolicy, recipients and plaintext characteristics
+	 * @param[in]		encryptionPolicy	select how to manage the encryption: direct use of Double Ratchet message or encrypt in the cipher message and use the DR message to share the cipher message key
+	 * @param[in]		cipherMessageAEAD	the AEAD scheme used to encrypt the cipher message, it shall be supported by all recipients
+	 * @param[in]		compression	the compression algorithm used on the payload, it shall be supported by all recipients(see recipientsCompressionAlgorithm)
 	 */
-	template <typename Curve>
-	void encryptMessage(std::vector<RecipientInfos<Curve>>& recipients, const std::vector<uint8_t>& plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage) {
+	EncryptionContext::EncryptionContext(const size_t recipientsCount, const lime::span<const uint8_t> plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, const cipherMessageOutput &cipherMessage, const lime::EncryptionPolicy encryptionPolicy, const lime::AEADAlgorithm cipherMessageAEAD, const lime::CompressionAlgorithm compression)
+	: cipherMessageAEAD{cipherMessageAEAD}, cipherMessageStream{false}, payloadCompressed{false}, compressedPayload{} {
+		// compress the payload if requested and worth it, it is then encrypted instead of the plaintext
+		payloadCompressed = compressPayload(compression, plaintext, compressedPayload);
+		const lime::span<const uint8_t> payload = payloadCompressed ? lime::span<const uint8_t>{compressedPayload} : plaintext;
+
 		// Shall we set the payload in the DR message or in a separate cupher message buffer?
-		bool payloadDirectEncryption;
 		switch (encryptionPolicy) {
 			case lime::EncryptionPolicy::DRMessage:
 				payloadDirectEncryption = true;
@@ -486,8 +770,8 @@ namespace lime {
 				// - cipher message policy : 	up is <plaintext size + authentication tag size>(cipher message size) + recipient number * random seed size
 				// 				down is recipient number * (random seed size + <plaintext size + authentication tag size>(the cipher message))
 				// Note: We are not taking in consideration the fact that being multipart, the message gets an extra multipart boundary when using cipher message mode
-				if ( 2*recipients.size()*plaintext.size() <=
-						(plaintext.size() + lime::settings::DRMessageAuthTagSize + (2*lime::settings::DRrandomSeedSize + plaintext.size() + lime::settings::DRMessageAuthTagSize)*recipients.size()) )  {
+				if ( 2*recipientsCount*payload.size() <=
+						(payload.size() + lime::settings::DRMessageAuthTagSize + (2*lime::settings::DRrandomSeedSize + payload.size() + lime::settings::DRMessageAuthTagSize)*recipientsCount) )  {
 					payloadDirectEncryption = true;
 				} else {
 					payloadDirectEncryption = false;
@@ -501,7 +785,7 @@ namespace lime {
 				// - DR message policy:     recipients number * plaintext size (plaintext is present encrypted in each recipient message)
 				// - cipher message policy: plaintext size + authentication tag size (the cipher message) + recipients number * random seed size (each DR message holds the random seed as encrypted data)
 				// Note: We are not taking in consideration the fact that being multipart, the message gets an extra multipart boundary when using cipher message mode
-				if ( recipients.size()*plaintext.size() <= (plaintext.size() + lime::settings::DRMessageAuthTagSize + (lime::settings::DRrandomSeedSize*recipients.size())) ) {
+				if ( recipientsCount*payload.size() <= (payload.size() + lime::settings::DRMessageAuthTagSize + (lime::settings::DRrandomSeedSize*recipientsCount)) ) {
 					payloadDirectEncryption = true;
 				} else {
 					payloadDirectEncryption = false;
@@ -514,98 +798,347 @@ namespace lime {
 		 * - Payload in the DR message: recipient User Id || source Device Id || recipient Device Id
 		 *   This buffer will store the part common to all recipients and the recipient Device Is is appended when looping on all recipients performing DR encrypt
 		 */
-		std::vector<uint8_t> AD;
-
-		// used only when payload is not in the DR message
-		lime::sBuffer<lime::settings::DRrandomSeedSize> randomSeed; // this seed is sent in DR message and used to derivate random key + IV to encrypt the actual message
-
 		if (!payloadDirectEncryption) { // Payload is encrypted in a separate cipher message buffer while the key used to encrypt it is in the DR message
 			// First generate a key and IV, use it to encrypt the given message, Associated Data are : sourceDeviceId || recipientUserId
-			// generate the random seed
-			auto RNG_context = make_RNG();
-			RNG_context->randomize(randomSeed);
+			// generate the random seed: it is sent in DR message and used to derivate random key + IV to encrypt the actual message
+			thread_RNG()->randomize(randomSeed);
 
 			// expansion of randomSeed to 48 bytes: 32 bytes random key + 16 bytes nonce, use HKDF with empty salt
-			std::vector<uint8_t> emptySalt;
-			emptySalt.clear(); //just to be sure
 			lime::sBuffer<lime::settings::DRMessageKeySize+lime::settings::DRMessageIVSize> randomKey;
-			HMAC_KDF<SHA512>(emptySalt.data(), emptySalt.size(), randomSeed.data(), randomSeed.size(), lime::settings::hkdf_randomSeed_info, randomKey.data(), randomKey.size());
+			HMAC_KDF<SHA512>(nullptr, 0, randomSeed.data(), randomSeed.size(), lime::settings::hkdf_randomSeed_info, randomKey.data(), randomKey.size());
 
-			// resize cipherMessage vector as it is adressed directly by C library: same as plain message + room for the authentication tag
-			cipherMessage.resize(plaintext.size()+lime::settings::DRMessageAuthTagSize);
+			// get the cipherMessage buffer, it is adressed directly by C library: same as plain message + room for the authentication tag
+			const size_t cipherMessageSize = payload.size()+lime::settings::DRMessageAuthTagSize;
+			uint8_t *cipherMessageBuffer = cipherMessage(cipherMessageSize);
+			if (cipherMessageBuffer == nullptr) {
+				throw BCTBX_EXCEPTION << "Encryption failed: cipherMessage buffer is too small, "<<cipherMessageSize<<" bytes are needed";
+			}
 
 			// AD is source deviceId(gruu) || recipientUserId(sip uri)
 			AD.assign(sourceDeviceId.cbegin(),sourceDeviceId.cend());
 			AD.insert(AD.end(), recipientUserId.cbegin(), recipientUserId.cend());
 
 			// encrypt to cipherMessage buffer
-			AEAD_encrypt<AES256GCM>(randomKey.data(), lime::settings::DRMessageKeySize, // key buffer also hold the IV
+			AEAD_encrypt(cipherMessageAEAD, randomKey.data(), lime::settings::DRMessageKeySize, // key buffer also hold the IV
 				randomKey.data()+lime::settings::DRMessageKeySize, lime::settings::DRMessageIVSize, // IV is stored in the same buffer as key, after it
-				plaintext.data(), plaintext.size(),
+				payload.data(), payload.size(),
 				AD.data(), AD.size(),
-				cipherMessage.data()+plaintext.size(), lime::settings::DRMessageAuthTagSize, // directly store tag after cipher text in the output buffer
-				cipherMessage.data());
+				cipherMessageBuffer+payload.size(), lime::settings::DRMessageAuthTagSize, // directly store tag after cipher text in the output buffer
+				cipherMessageBuffer);
 
 			// Associated Data to Double Ratchet encryption is: auth tag of cipherMessage AEAD || sourceDeviceId || recipient device Id(gruu)
 			// build the common part to AD given to DR Session encryption
-			AD.assign(cipherMessage.cbegin()+plaintext.size(), cipherMessage.cend());
+			AD.assign(cipherMessageBuffer+payload.size(), cipherMessageBuffer+cipherMessageSize);
 		} else { // Payload is directly encrypted in the DR message
 			AD.assign(recipientUserId.cbegin(), recipientUserId.cend());
-			cipherMessage.clear(); // be sure no cipherMessage is produced
+			cipherMessage(0); // be sure no cipherMessage is produced
 		}
 		/* complete AD, it now holds:
 		 * - Payload in the cipherMessage: auth tag from cipherMessage || source Device Id
 		 * - Payload in the DR message: recipient User Id || source Device Id
 		 */
 		AD.insert(AD.end(), sourceDeviceId.cbegin(), sourceDeviceId.cend());
+	}
 
-		// ratchet encrypt write to the db, to avoid a serie of transaction, manage it outside of the loop
-		// acquire lock and open a transaction
-		std::lock_guard<std::recursive_mutex> lock(*(localStorage->m_db_mutex));
-		localStorage->start_transaction();
+	/**
+	 * @brief Build the encryption context of a message whose cipherMessage is encrypted by chunks
+	 *
+	 *	The cipherMessage is produced afterward by a CipherMessageStream built on the random seed of this context.
+	 *	Its authentication tags are not available when the DR messages are produced so their associated data is the one used when the payload is in the DR message:
+	 *	the cipherMessage is bound to the DR messages by the random seed they hold.
+	 *
+	 * @param[in]		recipientUserId		the recipient ID, not specific to a device(could be a sip-uri) or a user(could be a group sip-uri)
+	 * @param[in]		sourceDeviceId		the Id of sender device(gruu)
+	 * @param[in]		cipherMessageAEAD	the AEAD scheme used to encrypt the cipherMessage chunks
+	 */
+	EncryptionContext::EncryptionContext(const std::string& recipientUserId, const std::string& sourceDeviceId, const lime::AEADAlgorithm cipherMessageAEAD)
+	: payloadDirectEncryption{false}, cipherMessageAEAD{cipherMessageAEAD}, cipherMessageStream{true}, payloadCompressed{false}, compressedPayload{}, AD{recipientUserId.cbegin(), recipientUserId.cend()} {
+		thread_RNG()->randomize(randomSeed);
+		// AD is recipient User Id || source Device Id
+		AD.insert(AD.end(), sourceDeviceId.cbegin(), sourceDeviceId.cend());
+	}
 
-		try {
-			for(size_t i=0; i<recipients.size(); i++) {
-				std::vector<uint8_t> recipientAD{AD}; // copy AD
-				recipientAD.insert(recipientAD.end(), recipients[i].deviceId.cbegin(), recipients[i].deviceId.cend()); //insert recipient device id(gruu)
+	/**
+	 * @brief Create a cipherMessage stream
+	 *
+	 * @param[in]	randomSeed		the seed shared in the DR messages, key and nonce are derived from it
+	 * @param[in]	sourceDeviceId		the Id of sender device(gruu)
+	 * @param[in]	recipientUserId		the recipient ID, not specific to a device(could be a sip-uri) or a user(could be a group sip-uri)
+	 * @param[in]	AEAD			the AEAD scheme used to encrypt the chunks
+	 * @param[in]	encrypt			true to encrypt, false to decrypt
+	 */
+	CipherMessageStream::CipherMessageStream(const lime::sBuffer<lime::settings::DRrandomSeedSize> &randomSeed, const std::string &sourceDeviceId, const std::string &recipientUserId, const lime::AEADAlgorithm AEAD, const bool encrypt)
+	: m_key{}, m_AD{sourceDeviceId.cbegin(), sourceDeviceId.cend()}, m_AEAD{AEAD}, m_encrypt{encrypt}, m_chunkIndex{0}, m_buffer{}, m_done{false} {
+		// expansion of randomSeed to 48 bytes: 32 bytes random key + 16 bytes nonce, use HKDF with empty salt
+		HMAC_KDF<SHA512>(nullptr, 0, randomSeed.data(), randomSeed.size(), lime::settings::hkdf_randomSeedStream_info, m_key.data(), m_key.size());
+		// AD is source deviceId(gruu) || recipientUserId(sip uri), as for a cipherMessage encrypted at once
+		m_AD.insert(m_AD.end(), recipientUserId.cbegin(), recipientUserId.cend());
+		m_buffer.reserve(lime::settings::cipherMessageStreamChunkSize + (m_encrypt?0:lime::settings::DRMessageAuthTagSize));
+	}
 
-				if (payloadDirectEncryption) {
-					recipients[i].DRSession->ratchetEncrypt(plaintext, std::move(recipientAD), recipients[i].DRmessage, payloadDirectEncryption);
-				} else {
-					recipients[i].DRSession->ratchetEncrypt(randomSeed, std::move(recipientAD), recipients[i].DRmessage, payloadDirectEncryption);
+	/**
+	 * @brief Encrypt or decrypt one chunk
+	 *
+	 * @param[in]	input		the chunk: plaintext when encrypting, cipher text followed by its tag when decrypting
+	 * @param[in]	inputSize	size of input
+	 * @param[in]	last		is this the last chunk of the message
+	 * @param[out]	output		cipher text followed by its tag or plaintext is appended to this buffer
+	 *
+	 * @return false if the chunk failed authentication, nothing is then appended to output
+	 */
+	bool CipherMessageStream::processChunk(const uint8_t *input, const size_t inputSize, const bool last, std::vector<uint8_t> &output) {
+		if (m_chunkIndex == std::numeric_limits<uint32_t>::max()) {
+			throw BCTBX_EXCEPTION << "Cipher message stream is too long";
+		}
+		// chunk nonce: index in bytes 7 to 10 (big endian) and last flag in byte 11 are xored to the derived one, AES-GCM and ChaCha20-Poly1305 both use these bytes
+		std::array<uint8_t, lime::settings::DRMessageIVSize> nonce;
+		std::copy_n(m_key.cbegin()+lime::settings::DRMessageKeySize, nonce.size(), nonce.begin());
+		nonce[7] ^= static_cast<uint8_t>(m_chunkIndex>>24);
+		nonce[8] ^= static_cast<uint8_t>(m_chunkIndex>>16);
+		nonce[9] ^= static_cast<uint8_t>(m_chunkIndex>>8);
+		nonce[10] ^= static_cast<uint8_t>(m_chunkIndex);
+		nonce[11] ^= last?0x01:0x00;
+		m_chunkIndex++;
+
+		const auto outputSize = output.size();
+		if (m_encrypt) {
+			output.resize(outputSize+inputSize+lime::settings::DRMessageAuthTagSize);
+			AEAD_encrypt(m_AEAD, m_key.data(), lime::settings::DRMessageKeySize, nonce.data(), nonce.size(),
+				input, inputSize,
+				m_AD.data(), m_AD.size(),
+				output.data()+outputSize+inputSize, lime::settings::DRMessageAuthTagSize, // directly store tag after cipher text in the output buffer
+				output.data()+outputSize);
+			return true;
+		}
+
+		const auto plainSize = inputSize-lime::settings::DRMessageAuthTagSize;
+		output.resize(outputSize+plainSize);
+		if (!AEAD_decrypt(m_AEAD, m_key.data(), lime::settings::DRMessageKeySize, nonce.data(), nonce.size(),
+				input, plainSize,
+				m_AD.data(), m_AD.size(),
+				input+plainSize, lime::settings::DRMessageAuthTagSize, // tag is after the cipher text
+				output.data()+outputSize)) {
+			output.resize(outputSize); // do not give away unauthenticated plaintext
+			m_done = true;
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Process the next part of the message
+	 *
+	 *	A complete chunk is kept until more input arrives as only finish knows which one is the last
+	 */
+	bool CipherMessageStream::update(const uint8_t *input, const size_t inputSize, std::vector<uint8_t> &output) {
+		if (m_done) {
+			return false;
+		}
+		const size_t chunkSize = lime::settings::cipherMessageStreamChunkSize + (m_encrypt?0:lime::settings::DRMessageAuthTagSize);
+		size_t remaining = inputSize;
+		while (remaining > 0) {
+			if (m_buffer.size() == chunkSize) { // more input is coming: the buffered chunk is not the last one
+				if (!processChunk(m_buffer.data(), m_buffer.size(), false, output)) {
+					return false;
 				}
+				m_buffer.clear();
+			}
+			if (m_buffer.empty() && remaining > chunkSize) { // a complete chunk followed by more input: process it without buffering
+				if (!processChunk(input, chunkSize, false, output)) {
+					return false;
+				}
+				input += chunkSize;
+				remaining -= chunkSize;
+			} else {
+				const auto size = std::min(chunkSize-m_buffer.size(), remaining);
+				m_buffer.insert(m_buffer.end(), input, input+size);
+				input += size;
+				remaining -= size;
 			}
-		} catch (BctbxException const &e) {
-			localStorage->rollback_transaction();
-			throw BCTBX_EXCEPTION << "Encryption to recipients failed : "<<e.str();
-		} catch (exception const &e) {
-			localStorage->rollback_transaction();
-			throw BCTBX_EXCEPTION << "Encryption to recipients failed : "<<e.what();
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Process the buffered input as the last chunk
+	 */
+	bool CipherMessageStream::finish(std::vector<uint8_t> &output) {
+		if (m_done) {
+			return false;
+		}
+		m_done = true;
+		if (!m_encrypt && m_buffer.size() < lime::settings::DRMessageAuthTagSize) { // even an empty last chunk holds its tag
+			return false;
+		}
+		const auto ret = processChunk(m_buffer.data(), m_buffer.size(), true, output);
+		m_buffer.clear();
+		return ret;
+	}
+
+	/**
+	 * @brief Encrypt a message to all recipients, identified by their device id
+	 *
+	 *	The plaintext is first encrypted by one randomly generated key using aes-gcm
+	 *	The key and IV are then encrypted with DR Session specific to each device
+	 *
+	 * @param[in,out]	recipients	vector of recipients device id(gruu) and linked DR Session, DR Session are modified by the encryption\n
+	 *					The recipients struct also hold after encryption the double ratchet message targeted to that particular recipient
+	 * @param[in]		plaintext	data to be encrypted
+	 * @param[in]		recipientUserId	the recipient ID, not specific to a device(could be a sip-uri) or a user(could be a group sip-uri)
+	 * @param[in]		sourceDeviceId	the Id of sender device(gruu)
+	 * @param[out]		cipherMessage	message encrypted with a random generated key(and IV). May be an empty buffer depending on encryptionPolicy, recipients and plaintext characteristics
+	 * @param[in]		encryptionPolicy	select how to manage the encryption: direct use of Double Ratchet message or encrypt in the cipher message and use the DR message to share the cipher message key\n
+	 * 						default is optimized output size mode.
+	 * @param[in]		localStorage	pointer to the local storage, used to get lock and start transaction on all DR sessions at once
+	 * @param[in]		recipientCallback	if not null, called for each recipient as soon as its DR message is produced and its session saved in local storage.
+	 *					Recipients are then processed by batches of settings::encryptStreamingBatchSize, each batch being committed before its DR messages are given away
+	 */
+	template <typename Curve>
+	void encryptMessage(std::vector<RecipientInfos<Curve>>& recipients, const lime::span<const uint8_t> plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback) {
+		encryptMessage(recipients, plaintext, recipientUserId, sourceDeviceId, [&cipherMessage](const size_t size) {
+				cipherMessage.resize(size);
+				return cipherMessage.data();
+			}, encryptionPolicy, localStorage, recipientCallback);
+	}
+
+	/**
+	 * @brief Encrypt a message to all recipients, writing the cipherMessage in a buffer provided on demand
+	 *
+	 *	Same as above, the cipherMessage buffer is requested once its size is known
+	 *
+	 * @param[in,out]	recipients	vector of recipients device id(gruu) and linked DR Session, DR Session are modified by the encryption
+	 * @param[in]		plaintext	data to be encrypted
+	 * @param[in]		recipientUserId	the recipient ID, not specific to a device(could be a sip-uri) or a user(could be a group sip-uri)
+	 * @param[in]		sourceDeviceId	the Id of sender device(gruu)
+	 * @param[in]		cipherMessage	provides the buffer receiving the cipherMessage, see cipherMessageOutput
+	 * @param[in]		encryptionPolicy	select how to manage the encryption, see above
+	 * @param[in]		localStorage	pointer to the local storage, used to get lock and start transaction on all DR sessions at once
+	 * @param[in]		recipientCallback	if not null, called for each recipient as soon as its DR message is produced and its session saved in local storage
+	 */
+	template <typename Curve>
+	void encryptMessage(std::vector<RecipientInfos<Curve>>& recipients, const lime::span<const uint8_t> plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, const cipherMessageOutput &cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback) {
+		// the cipherMessage is shared by all recipients: use ChaCha20-Poly1305 only when all their sessions do
+		bool chacha = !recipients.empty() && std::all_of(recipients.cbegin(), recipients.cend(), [](const RecipientInfos<Curve> &recipient) {return recipient.DRSession->AEAD() == lime::AEADAlgorithm::chacha20poly1305;});
+		const EncryptionContext context(recipients.size(), plaintext, recipientUserId, sourceDeviceId, cipherMessage, encryptionPolicy, chacha?lime::AEADAlgorithm::chacha20poly1305:lime::AEADAlgorithm::aes256gcm, recipientsCompressionAlgorithm(recipients));
+		encryptMessage(context, recipients, plaintext, localStorage, recipientCallback);
+	}
+
+	/**
+	 * @brief Select the compression algorithm usable for a set of recipients
+	 *
+	 *	Compressed payloads cannot be read by peers not aware of compression or built without the selected algorithm:
+	 *	the algorithm selected by set_compressionAlgorithm is used only when all recipients advertised they can decompress it.
+	 *	Recipients without session yet did not advertise anything.
+	 *
+	 * @param[in]	recipients	the recipients of the message and their DR session, if any
+	 *
+	 * @return the algorithm selected by set_compressionAlgorithm when all recipients can decompress it, CompressionAlgorithm::none otherwise
+	 */
+	template <typename Curve>
+	lime::CompressionAlgorithm recipientsCompressionAlgorithm(const std::vector<RecipientInfos<Curve>> &recipients) {
+		const auto algorithm = lime::get_compressionAlgorithm();
+		if (algorithm == lime::CompressionAlgorithm::none || recipients.empty()) {
+			return lime::CompressionAlgorithm::none;
+		}
+		return std::all_of(recipients.cbegin(), recipients.cend(), [algorithm](const RecipientInfos<Curve> &recipient) {
+				return recipient.DRSession != nullptr && recipient.DRSession->peerDecompresses(algorithm);
+			}) ? algorithm : lime::CompressionAlgorithm::none;
+	}
+
+	/**
+	 * @brief Encrypt a message to a set of recipients using an already built encryption context
+	 *
+	 *	Several calls using the same context produce DR messages all matching the cipherMessage produced at context creation
+	 *
+	 * @param[in]		context		the encryption context of this message: encryption mode, random seed and common associated data
+	 * @param[in,out]	recipients	vector of recipients device id(gruu) and linked DR Session, DR Session are modified by the encryption\n
+	 *					The recipients struct also hold after encryption the double ratchet message targeted to that particular recipient
+	 * @param[in]		plaintext	data to be encrypted, must be the one given to the context creation
+	 * @param[in]		localStorage	pointer to the local storage, used to get lock and start transaction on all DR sessions at once
+	 * @param[in]		recipientCallback	if not null, called for each recipient as soon as its DR message is produced and its session saved in local storage.
+	 *					Recipients are then processed by batches of settings::encryptStreamingBatchSize, each batch being committed before its DR messages are given away
+	 */
+	template <typename Curve>
+	void encryptMessage(const EncryptionContext &context, std::vector<RecipientInfos<Curve>>& recipients, const lime::span<const uint8_t> plaintext, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback) {
+		if (recipients.empty()) {
+			return;
 		}
 
 		// ratchet encrypt write to the db, to avoid a serie of transaction, manage it outside of the loop
-		localStorage->commit_transaction();
+		// When streaming the output, commit by batches: a DR message must not be given away before the session used to produce it is saved
+		const size_t batchSize = recipientCallback ? lime::settings::encryptStreamingBatchSize : recipients.size();
+		size_t batchStart = 0;
+		do {
+			const size_t batchEnd = std::min(batchStart+batchSize, recipients.size());
+			{
+				// acquire lock and open a transaction
+				std::lock_guard<std::recursive_mutex> lock(*(localStorage->m_db_mutex));
+				localStorage->start_transaction();
+
+				try {
+					// encrypt the whole batch at once
+					std::vector<DR<Curve> *> sessions{};
+					std::vector<lime::span<const uint8_t>> recipientADs{};
+					std::vector<std::vector<uint8_t> *> DRmessages{};
+					sessions.reserve(batchEnd-batchStart);
+					recipientADs.reserve(batchEnd-batchStart);
+					DRmessages.reserve(batchEnd-batchStart);
+					for(size_t i=batchStart; i<batchEnd; i++) {
+						sessions.push_back(recipients[i].DRSession.get());
+						recipientADs.emplace_back(reinterpret_cast<const uint8_t *>(recipients[i].deviceId.data()), recipients[i].deviceId.size()); // common AD is completed by the recipient device id(gruu)
+						DRmessages.push_back(&(recipients[i].DRmessage));
+					}
+
+					if (context.payloadDirectEncryption) {
+						DR<Curve>::ratchetEncryptBatch(sessions, context.payloadCompressed?lime::span<const uint8_t>{context.compressedPayload}:plaintext, context.AD, recipientADs, DRmessages, context.payloadDirectEncryption, context.cipherMessageAEAD, context.cipherMessageStream, context.payloadCompressed);
+					} else {
+						DR<Curve>::ratchetEncryptBatch(sessions, context.randomSeed, context.AD, recipientADs, DRmessages, context.payloadDirectEncryption, context.cipherMessageAEAD, context.cipherMessageStream, context.payloadCompressed);
+					}
+				} catch (BctbxException const &e) {
+					localStorage->rollback_transaction();
+					throw BCTBX_EXCEPTION << "Encryption to recipients failed : "<<e.str();
+				} catch (exception const &e) {
+					localStorage->rollback_transaction();
+					throw BCTBX_EXCEPTION << "Encryption to recipients failed : "<<e.what();
+				}
+
+				// ratchet encrypt write to the db, to avoid a serie of transaction, manage it outside of the loop
+				localStorage->commit_transaction();
+			}
+
+			// the batch is safely stored, give it away (outside of the db lock)
+			if (recipientCallback) {
+				for(size_t i=batchStart; i<batchEnd; i++) {
+					recipientCallback(recipients[i]);
+				}
+			}
+			batchStart = batchEnd;
+		} while (batchStart < recipients.size());
 	}
 
 	/**
-	 * @brief Decrypt a message
+	 * @brief Decrypt a message into the buffer provided by the caller
 	 *
-	 *	Decrypts the DR message and if applicable and the DR message was successfully decrypted, decrypt the cipherMessage
+	 *	Decrypts the DR message and if applicable and the DR message was successfully decrypted, decrypt the cipherMessage.
+	 *	The payload is decompressed, if needed, and given to the output before the session is saved: a message which cannot
+	 *	be decompressed or is too large for the output is not consumed.
 	 *
 	 * @param[in]		sourceDeviceId		the device Id of sender(gruu)
 	 * @param[in]		recipientDeviceId	the recipient ID, specific to current device(gruu)
 	 * @param[in]		recipientUserId		the recipient ID, not specific to a device(could be a sip-uri) or a user(could be a group sip-uri)
 	 * @param[in,out]	DRSessions		list of DR Sessions linked to sender device, first one shall be the one registered as active
-	 * @param[out]		DRmessage		Double Ratcher message holding as payload either the encrypted plaintext or the random key used to encrypt it encrypted by the DR session
-	 * @param[out]		cipherMessage		if not zero lenght, plain text encrypted with a random generated key(and IV)
-	 * @param[out]		plaintext		decrypted message
+	 * @param[in]		DRmessage		Double Ratcher message holding as payload either the encrypted plaintext or the random key used to encrypt it encrypted by the DR session
+	 * @param[in]		cipherMessage		if not zero lenght, plain text encrypted with a random generated key(and IV)
+	 * @param[in]		output			provides the buffer receiving the decrypted message
+	 * @param[out]		plaintextSize		size of the decrypted message, also set when the output cannot take it
+	 * @param[out]		plaintextTooLarge	set when a session deciphered the message but the output cannot take it
 	 *
-	 * @return a shared pointer towards the session used to decrypt, nullptr if we couldn't find one to do it
+	 * @return a shared pointer towards the session used to decrypt, nullptr if we couldn't find one to do it or the plaintext was rejected
 	 */
 	template <typename Curve>
-	std::shared_ptr<DR<Curve>> decryptMessage(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<Curve>>>& DRSessions, const std::vector<uint8_t>& DRmessage, const std::vector<uint8_t>& cipherMessage, std::vector<uint8_t>& plaintext) {
+	static std::shared_ptr<DR<Curve>> decryptMessageToOutput(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<Curve>>>& DRSessions, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, const plaintextOutput &output, size_t &plaintextSize, bool &plaintextTooLarge) {
 		bool payloadDirectEncryption = (cipherMessage.size() == 0); // if we do not have any cipher message, then we must be in payload direct encryption mode: the payload is in the DR message
-		std::vector<uint8_t> AD; // the Associated Data authenticated by the AEAD scheme used in DR encrypt/decrypt
+		auto &AD = ADscratchBuffer(); // the Associated Data authenticated by the AEAD scheme used in DR encrypt/decrypt, built once for all the sessions tried
 
 		/* Prepare the AD given to ratchet decrypt, is inpacted by message type
 		 * - Payload in the cipherMessage: auth tag from cipherMessage || source Device Id || recipient Device Id
@@ -616,59 +1149,217 @@ namespace lime {
 			if (cipherMessage.size()<lime::settings::DRMessageAuthTagSize) {
 				throw BCTBX_EXCEPTION << "Invalid cipher message - too short";
 			}
-			AD.assign(cipherMessage.cend()-lime::settings::DRMessageAuthTagSize, cipherMessage.cend());
+			AD.assign(cipherMessage.end()-lime::settings::DRMessageAuthTagSize, cipherMessage.end());
 		} else { // payload in DR message
 			AD.assign(recipientUserId.cbegin(), recipientUserId.cend());
 		}
 		AD.insert(AD.end(), sourceDeviceId.cbegin(), sourceDeviceId.cend());
 		AD.insert(AD.end(), recipientDeviceId.cbegin(), recipientDeviceId.cend());
+		const auto ADSize = AD.size();
+
+		// the AD used for the cipherMessage encryption: source Device Id || recipient User Id, built once for all the sessions tried
+		auto &cipherMessageAD = cipherMessageADscratchBuffer();
+		if (!payloadDirectEncryption) {
+			cipherMessageAD.assign(sourceDeviceId.cbegin(), sourceDeviceId.cend());
+			cipherMessageAD.insert(cipherMessageAD.end(), recipientUserId.cbegin(), recipientUserId.cend());
+		}
 
 		// buffer to store the random seed used to derive key and IV to decrypt message
 		lime::sBuffer<lime::settings::DRrandomSeedSize> randomSeed;
 
+		// the header is the same for all sessions, ratchetDecrypt checks its validity
+		const double_ratchet_protocol::DRHeader<Curve> header{DRmessage};
+		plaintextTooLarge = false;
+
+		// the payload is deciphered here when it cannot be deciphered directly in the output: in the DR message or compressed
+		auto &payload = payloadScratchBuffer();
+
+		// payload in the DR message: give it to the output before the session is saved
+		const std::function<bool(lime::secureVector<uint8_t> &)> acceptPayload = [&](lime::secureVector<uint8_t> &decryptedPayload) {
+			return outputPayload(header.payloadCompressed(), decryptedPayload, output, plaintextSize, plaintextTooLarge);
+		};
+
+		// payload in the cipher message: decipher it with the random seed and give it to the output before the session is saved
+		const std::function<bool(lime::sBuffer<lime::settings::DRrandomSeedSize> &)> acceptRandomSeed = [&](lime::sBuffer<lime::settings::DRrandomSeedSize> &seed) {
+			// payload size is the cipher message one - authentication tag length
+			const size_t payloadSize = cipherMessage.size()-lime::settings::DRMessageAuthTagSize;
+
+			// an uncompressed payload is deciphered directly in the output, a compressed one goes through the scratch buffer
+			uint8_t *plaintext = nullptr;
+			if (header.payloadCompressed()) {
+				payload.resize(payloadSize);
+				plaintext = payload.data();
+			} else {
+				plaintextSize = payloadSize;
+				if (!output(plaintextSize, plaintext)) {
+					LIME_LOGW<<"Decrypted message is "<<plaintextSize<<" bytes long, more than the caller can take: do not consume it";
+					plaintextTooLarge = true;
+					return false;
+				}
+			}
+
+			// rebuild the random key and IV from given seed
+			// use HKDF - RFC 5869 with empty salt
+			lime::sBuffer<lime::settings::DRMessageKeySize+lime::settings::DRMessageIVSize> randomKey;
+			HMAC_KDF<SHA512>(nullptr, 0, seed.data(), seed.size(), lime::settings::hkdf_randomSeed_info, randomKey.data(), randomKey.size());
+
+			// use it to decipher message with the scheme advertised in the DR message header
+			if (!AEAD_decrypt(header.cipherMessageAEAD(), randomKey.data(), lime::settings::DRMessageKeySize, // random key buffer hold key<DRMessageKeySize bytes> || IV<DRMessageIVSize bytes>
+					randomKey.data()+lime::settings::DRMessageKeySize, lime::settings::DRMessageIVSize,
+					cipherMessage.data(), payloadSize, // cipherMessage is Message || auth tag
+					cipherMessageAD.data(), cipherMessageAD.size(),
+					cipherMessage.data()+payloadSize, lime::settings::DRMessageAuthTagSize, // tag is in the last 16 bytes of buffer
+					plaintext)) {
+				cleanBuffer(plaintext, payloadSize);
+				throw BCTBX_EXCEPTION << "Message key correctly deciphered but then failed to decipher message itself";
+			}
+			return !header.payloadCompressed() || outputPayload(true, payload, output, plaintextSize, plaintextTooLarge);
+		};
+
 		for (auto& DRSession : DRSessions) {
 			bool decryptStatus = false;
+			AD.resize(ADSize); // remove what a previous session appended to the AD
 			try {
-				// if payload is in the message, got the output directly in the plaintext buffer
 				if (payloadDirectEncryption) {
-					decryptStatus = DRSession->ratchetDecrypt(DRmessage, AD, plaintext, payloadDirectEncryption);
+					decryptStatus = DRSession->ratchetDecrypt(DRmessage, AD, payload, payloadDirectEncryption, acceptPayload);
 				} else {
-					decryptStatus = DRSession->ratchetDecrypt(DRmessage, AD, randomSeed, payloadDirectEncryption);
+					decryptStatus = DRSession->ratchetDecrypt(DRmessage, AD, randomSeed, payloadDirectEncryption, acceptRandomSeed);
 				}
 			} catch (BctbxException const &e) { // any bctbx Exception is just considered as decryption failed (it shall occurs in case of maximum skipped keys reached or inconsistency ib the direct Encryption flag)
 				LIME_LOGW<<"Double Ratchet session failed to decrypt message and raised an exception saying : "<<e;
 				decryptStatus = false; // lets keep trying with other sessions if provided
 			}
+			// the scratch buffer may hold the deciphered payload, wipe it
+			cleanBuffer(payload.data(), payload.size());
+			payload.clear();
 
-			if (decryptStatus == true) { // we got the DR message correctly deciphered
-				if (payloadDirectEncryption) { // we're done, payload was in the DR message
-					return DRSession;
-				}
-				// recompute the AD used for this encryption: source Device Id || recipient User Id
-				std::vector<uint8_t> localAD{sourceDeviceId.cbegin(), sourceDeviceId.cend()};
-				localAD.insert(localAD.end(), recipientUserId.cbegin(), recipientUserId.cend());
-
-				// resize plaintext vector: same as cipher message - authentication tag length
-				plaintext.resize(cipherMessage.size()-lime::settings::DRMessageAuthTagSize);
-
-				// rebuild the random key and IV from given seed
-				// use HKDF - RFC 5869 with empty salt
-				std::vector<uint8_t> emptySalt;
-				emptySalt.clear();
-				lime::sBuffer<lime::settings::DRMessageKeySize+lime::settings::DRMessageIVSize> randomKey;
-				HMAC_KDF<SHA512>(emptySalt.data(), emptySalt.size(), randomSeed.data(), randomSeed.size(), lime::settings::hkdf_randomSeed_info, randomKey.data(), randomKey.size());
-
-				// use it to decipher message
-				if (AEAD_decrypt<AES256GCM>(randomKey.data(), lime::settings::DRMessageKeySize, // random key buffer hold key<DRMessageKeySize bytes> || IV<DRMessageIVSize bytes>
-						randomKey.data()+lime::settings::DRMessageKeySize, lime::settings::DRMessageIVSize,
-						cipherMessage.data(), cipherMessage.size()-lime::settings::DRMessageAuthTagSize, // cipherMessage is Message || auth tag
-						localAD.data(), localAD.size(),
-						cipherMessage.data()+cipherMessage.size()-lime::settings::DRMessageAuthTagSize, lime::settings::DRMessageAuthTagSize, // tag is in the last 16 bytes of buffer
-						plaintext.data())) {
-					return DRSession;
-				} else {
-					throw BCTBX_EXCEPTION << "Message key correctly deciphered but then failed to decipher message itself";
+			if (decryptStatus == true) { // we got the message correctly deciphered and given to the output, the session is saved
+				return DRSession;
+			}
+			if (plaintextTooLarge) { // the message was deciphered but the caller cannot take it: the session was not saved, do not try the others
+				return nullptr;
+			}
+		}
+		return nullptr; // no session correctly deciphered
+	}
+
+	/**
+	 * @brief Decrypt a message
+	 *
+	 *	Decrypts the DR message and if applicable and the DR message was successfully decrypted, decrypt the cipherMessage
+	 *
+	 * @param[in]		sourceDeviceId		the device Id of sender(gruu)
+	 * @param[in]		recipientDeviceId	the recipient ID, specific to current device(gruu)
+	 * @param[in]		recipientUserId		the recipient ID, not specific to a device(could be a sip-uri) or a user(could be a group sip-uri)
+	 * @param[in,out]	DRSessions		list of DR Sessions linked to sender device, first one shall be the one registered as active
+	 * @param[out]		DRmessage		Double Ratcher message holding as payload either the encrypted plaintext or the random key used to encrypt it encrypted by the DR session
+	 * @param[out]		cipherMessage		if not zero lenght, plain text encrypted with a random generated key(and IV)
+	 * @param[out]		plaintext		decrypted message
+	 *
+	 * @return a shared pointer towards the session used to decrypt, nullptr if we couldn't find one to do it
+	 */
+	template <typename Curve>
+	std::shared_ptr<DR<Curve>> decryptMessage(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<Curve>>>& DRSessions, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, std::vector<uint8_t>& plaintext) {
+		size_t plaintextSize = 0;
+		bool plaintextTooLarge = false;
+		auto DRSession = decryptMessageToOutput<Curve>(sourceDeviceId, recipientDeviceId, recipientUserId, DRSessions, DRmessage, cipherMessage,
+			[&plaintext](const size_t size, uint8_t *&buffer) {
+				plaintext.resize(size);
+				buffer = plaintext.data();
+				return true;
+			}, plaintextSize, plaintextTooLarge);
+		if (DRSession == nullptr) { // a rejected message may have been deciphered in the plaintext
+			cleanBuffer(plaintext.data(), plaintext.size());
+			plaintext.clear();
+		}
+		return DRSession;
+	}
+
+	/**
+	 * @brief Decrypt a message into a caller buffer
+	 *
+	 *	Same as above but the plaintext is deciphered in place in the given buffer.
+	 *	A plaintext larger than the buffer - once decompressed - is rejected before the session is saved:
+	 *	the message is not consumed and can be decrypted again with a larger buffer
+	 *
+	 * @param[in]		sourceDeviceId		the device Id of sender(gruu)
+	 * @param[in]		recipientDeviceId	the recipient ID, specific to current device(gruu)
+	 * @param[in]		recipientUserId		the recipient ID, not specific to a device(could be a sip-uri) or a user(could be a group sip-uri)
+	 * @param[in,out]	DRSessions		list of DR Sessions linked to sender device, first one shall be the one registered as active
+	 * @param[in]		DRmessage		Double Ratcher message holding as payload either the encrypted plaintext or the random key used to encrypt it encrypted by the DR session
+	 * @param[in]		cipherMessage		if not zero lenght, plain text encrypted with a random generated key(and IV)
+	 * @param[out]		plaintext		buffer receiving the decrypted message
+	 * @param[out]		plaintextSize		size of the decrypted message, when it is larger than the buffer: the size needed to get it, 0 on any other failure
+	 *
+	 * @return a shared pointer towards the session used to decrypt, nullptr if we couldn't find one to do it or the plaintext is too large
+	 */
+	template <typename Curve>
+	std::shared_ptr<DR<Curve>> decryptMessage(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<Curve>>>& DRSessions, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, lime::span<uint8_t> plaintext, size_t &plaintextSize) {
+		bool plaintextTooLarge = false;
+		size_t written = 0; // the part of the buffer given to a session, wiped if the message is rejected
+		auto DRSession = decryptMessageToOutput<Curve>(sourceDeviceId, recipientDeviceId, recipientUserId, DRSessions, DRmessage, cipherMessage,
+			[&plaintext, &written](const size_t size, uint8_t *&buffer) {
+				if (size > plaintext.size()) {
+					return false;
 				}
+				written = std::max(written, size);
+				buffer = plaintext.data();
+				return true;
+			}, plaintextSize, plaintextTooLarge);
+		if (DRSession == nullptr) {
+			cleanBuffer(plaintext.data(), written);
+			if (!plaintextTooLarge) {
+				plaintextSize = 0;
+			}
+		}
+		return DRSession;
+	}
+
+	/**
+	 * @brief Decrypt the DR message of a message whose cipherMessage is encrypted by chunks
+	 *
+	 *	On success, the cipherMessage is then decrypted by the produced stream
+	 *
+	 * @param[in]		sourceDeviceId		the device Id of sender(gruu)
+	 * @param[in]		recipientDeviceId	the recipient ID, specific to current device(gruu)
+	 * @param[in]		recipientUserId		the recipient ID, not specific to a device(could be a sip-uri) or a user(could be a group sip-uri)
+	 * @param[in,out]	DRSessions		list of DR Sessions linked to sender device, first one shall be the one registered as active
+	 * @param[in]		DRmessage		Double Ratchet message holding as payload the random seed used to encrypt the cipherMessage
+	 * @param[out]		cipherStream		on success, the stream decrypting the cipherMessage
+	 *
+	 * @return a shared pointer towards the session used to decrypt, nullptr if we couldn't find one to do it
+	 */
+	template <typename Curve>
+	std::shared_ptr<DR<Curve>> decryptMessage(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<Curve>>>& DRSessions, const lime::span<const uint8_t> DRmessage, std::shared_ptr<CipherMessageStream>& cipherStream) {
+		double_ratchet_protocol::DRHeader<Curve> header{DRmessage};
+		if (!header.valid() || !header.cipherMessageStream()) {
+			LIME_LOGW<<"Double Ratchet message does not announce a cipher message encrypted by chunks";
+			return nullptr;
+		}
+
+		// the Associated Data authenticated by the AEAD scheme used in DR encrypt/decrypt: recipient User Id || source Device Id || recipient Device Id
+		auto &AD = ADscratchBuffer();
+		AD.assign(recipientUserId.cbegin(), recipientUserId.cend());
+		AD.insert(AD.end(), sourceDeviceId.cbegin(), sourceDeviceId.cend());
+		AD.insert(AD.end(), recipientDeviceId.cbegin(), recipientDeviceId.cend());
+		const auto ADSize = AD.size();
+
+		// buffer to store the random seed used to derive key and nonce to decrypt message
+		lime::sBuffer<lime::settings::DRrandomSeedSize> randomSeed;
+
+		for (auto& DRSession : DRSessions) {
+			bool decryptStatus = false;
+			AD.resize(ADSize); // remove what a previous session appended to the AD
+			try {
+				decryptStatus = DRSession->ratchetDecrypt(DRmessage, AD, randomSeed, false);
+			} catch (BctbxException const &e) { // any bctbx Exception is just considered as decryption failed
+				LIME_LOGW<<"Double Ratchet session failed to decrypt message and raised an exception saying : "<<e;
+				decryptStatus = false; // lets keep trying with other sessions if provided
+			}
+
+			if (decryptStatus == true) {
+				cipherStream = std::make_shared<CipherMessageStream>(randomSeed, sourceDeviceId, recipientUserId, header.cipherMessageAEAD(), false);
+				return DRSession;
 			}
 		}
 		return nullptr; // no session correctly deciphered
@@ -676,11 +1367,21 @@ namespace lime {
 
 	/* template instanciations for C25519 and C448 encryption/decryption functions */
 #ifdef EC25519_ENABLED
-	template void encryptMessage<C255>(std::vector<RecipientInfos<C255>>& recipients, const std::vector<uint8_t>& plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage);
-	template std::shared_ptr<DR<C255>> decryptMessage<C255>(const std::string& sourceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<C255>>>& DRSessions, const std::vector<uint8_t>& DRmessage, const std::vector<uint8_t>& cipherMessage, std::vector<uint8_t>& plaintext);
+	template void encryptMessage<C255>(std::vector<RecipientInfos<C255>>& recipients, const lime::span<const uint8_t> plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback);
+	template void encryptMessage<C255>(std::vector<RecipientInfos<C255>>& recipients, const lime::span<const uint8_t> plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, const cipherMessageOutput &cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback);
+	template lime::CompressionAlgorithm recipientsCompressionAlgorithm<C255>(const std::vector<RecipientInfos<C255>> &recipients);
+	template void encryptMessage<C255>(const EncryptionContext &context, std::vector<RecipientInfos<C255>>& recipients, const lime::span<const uint8_t> plaintext, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback);
+	template std::shared_ptr<DR<C255>> decryptMessage<C255>(const std::string& sourceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<C255>>>& DRSessions, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, std::vector<uint8_t>& plaintext);
+	template std::shared_ptr<DR<C255>> decryptMessage<C255>(const std::string& sourceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<C255>>>& DRSessions, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, lime::span<uint8_t> plaintext, size_t &plaintextSize);
+	template std::shared_ptr<DR<C255>> decryptMessage<C255>(const std::string& sourceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<C255>>>& DRSessions, const lime::span<const uint8_t> DRmessage, std::shared_ptr<CipherMessageStream>& cipherStream);
 #endif
 #ifdef EC448_ENABLED
-	template void encryptMessage<C448>(std::vector<RecipientInfos<C448>>& recipients, const std::vector<uint8_t>& plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage);
-	template std::shared_ptr<DR<C448>> decryptMessage<C448>(const std::string& sourceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<C448>>>& DRSessions, const std::vector<uint8_t>& DRmessage, const std::vector<uint8_t>& cipherMessage, std::vector<uint8_t>& plaintext);
+	template void encryptMessage<C448>(std::vector<RecipientInfos<C448>>& recipients, const lime::span<const uint8_t> plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback);
+	template void encryptMessage<C448>(std::vector<RecipientInfos<C448>>& recipients, const lime::span<const uint8_t> plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, const cipherMessageOutput &cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback);
+	template lime::CompressionAlgorithm recipientsCompressionAlgorithm<C448>(const std::vector<RecipientInfos<C448>> &recipients);
+	template void encryptMessage<C448>(const EncryptionContext &context, std::vector<RecipientInfos<C448>>& recipients, const lime::span<const uint8_t> plaintext, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback);
+	template std::shared_ptr<DR<C448>> decryptMessage<C448>(const std::string& sourceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<C448>>>& DRSessions, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, std::vector<uint8_t>& plaintext);
+	template std::shared_ptr<DR<C448>> decryptMessage<C448>(const std::string& sourceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<C448>>>& DRSessions, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, lime::span<uint8_t> plaintext, size_t &plaintextSize);
+	template std::shared_ptr<DR<C448>> decryptMessage<C448>(const std::string& sourceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<C448>>>& DRSessions, const lime::span<const uint8_t> DRmessage, std::shared_ptr<CipherMessageStream>& cipherStream);
 #endif
 }
@@ -24,10 +24,12 @@
 #include <unordered_map>
 #include <vector>
 #include <memory>
+#include <functional>
 
 #include "lime_settings.hpp"
 #include "lime_defines.hpp"
 #include "lime_crypto_primitives.hpp"
+#include "lime_secure_memory.hpp"
 
 namespace lime {
 
@@ -62,7 +64,7 @@ namespace lime {
 	template <typename Curve>
 	struct ReceiverKeyChain {
 		X<Curve, lime::Xtype::publicKey> DHr; /**< peer public key identifying this chain */
-		std::unordered_map<std::uint16_t, DRMKey> messageKeys; /**< message keys indexed by Nr */
+		std::unordered_map<std::uint16_t, DRMKey, std::hash<std::uint16_t>, std::equal_to<std::uint16_t>, lime::secureAllocator<std::pair<const std::uint16_t, DRMKey>>> messageKeys; /**< message keys indexed by Nr, held in the secure arena */
 		/**
 		 * Start a new empty chain
 		 * @param[in]	key	the peer DH public key used on this chain
@@ -107,10 +109,15 @@ namespace lime {
 			long int m_db_Uid; // used to link session to a local device Id
 			bool m_active_status; // current status of this session, true if it is the active one, false if it is stale
 			std::vector<uint8_t> m_X3DH_initMessage; // store the X3DH init message to be able to prepend it to any message until we got a first response from peer so we're sure he was able to init the session on his side
+			lime::AEADAlgorithm m_AEAD; // AEAD scheme used to encrypt messages: selected by the initiator, adopted by the receiver from the first message it gets
+			uint8_t m_peerCompression; // compression capability flags advertised by the peer in the last message we decrypted from it, see double_ratchet_protocol::compressionCapabilityFlag
 
 			/*helpers functions */
 			void skipMessageKeys(const uint16_t until, const int limit); /* check if we skipped some messages in current receiving chain, generate and store in session intermediate message keys */
 			void DHRatchet(const X<Curve, lime::Xtype::publicKey> &headerDH); /* perform a Diffie-Hellman ratchet using the given peer public key */
+			static void deriveSendingKeys(const std::vector<DR<Curve> *> &sessions, lime::secureVector<DRMKey> &MKs); /* derive in one pass the next message key of several sessions sending chains */
+			size_t encryptPrepare(const size_t plaintextSize, std::vector<uint8_t> &AD, std::vector<uint8_t> &ciphertext, const bool payloadDirectEncryption, const lime::AEADAlgorithm cipherMessageAEAD, const bool cipherMessageStream, const bool payloadCompressed, DRMKey &MK, const bool MKderived); /* move the sending chain forward, build message header and AD, return the header size */
+			void encryptComplete(void); /* update session status and save it once the message is encrypted */
 			/* local storage related implemented in lime_localStorage.cpp */
 			bool session_save(bool commit=true); /* save/update session in database : updated component depends m_dirty value, when commit is true, commit transaction in DB */
 			bool session_load(); /* load session in database */
@@ -118,7 +125,7 @@ namespace lime {
 
 		public:
 			DR() = delete; // make sure the Double Ratchet is not initialised without parameters
-			DR(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const X<Curve, lime::Xtype::publicKey> &peerPublicKey, const long int peerDid, const std::string &peerDeviceId, const DSA<Curve, lime::DSAtype::publicKey> &peerIk, long int selfDeviceId, const std::vector<uint8_t> &X3DH_initMessage, std::shared_ptr<RNG> RNG_context); // call to initialise a session for sender: we have Shared Key and peer Public key
+			DR(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const X<Curve, lime::Xtype::publicKey> &peerPublicKey, const long int peerDid, const std::string &peerDeviceId, const DSA<Curve, lime::DSAtype::publicKey> &peerIk, long int selfDeviceId, const std::vector<uint8_t> &X3DH_initMessage, std::shared_ptr<RNG> RNG_context, const lime::AEADAlgorithm AEAD=lime::AEADAlgorithm::aes256gcm); // call to initialise a session for sender: we have Shared Key and peer Public key
 			DR(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const Xpair<Curve> &selfKeyPair, long int peerDid, const std::string &peerDeviceId, const uint32_t OPk_id, const DSA<Curve, lime::DSAtype::publicKey> &peerIk, long int selfDeviceId, std::shared_ptr<RNG> RNG_context); // call at initialisation of a session for receiver: we have Share Key and self key pair
 			DR(std::shared_ptr<lime::Db> localStorage, long sessionId, std::shared_ptr<RNG> RNG_context); // load session from DB
 			DR(DR<Curve> &a) = delete; // can't copy a session, force usage of shared pointers
@@ -126,13 +133,20 @@ namespace lime {
 			~DR();
 
 			template<typename inputContainer>
-			void ratchetEncrypt(const inputContainer &plaintext, std::vector<uint8_t> &&AD, std::vector<uint8_t> &ciphertext, const bool payloadDirectEncryption);
+			void ratchetEncrypt(const inputContainer &plaintext, std::vector<uint8_t> &&AD, std::vector<uint8_t> &ciphertext, const bool payloadDirectEncryption, const lime::AEADAlgorithm cipherMessageAEAD, const bool cipherMessageStream, const bool payloadCompressed);
+			template<typename inputContainer>
+			static void ratchetEncryptBatch(const std::vector<DR<Curve> *> &sessions, const inputContainer &plaintext, const std::vector<uint8_t> &AD, const std::vector<lime::span<const uint8_t>> &recipientADs, const std::vector<std::vector<uint8_t> *> &ciphertexts, const bool payloadDirectEncryption, const lime::AEADAlgorithm cipherMessageAEAD, const bool cipherMessageStream, const bool payloadCompressed); // encrypt the same input with several sessions at once
 			template<typename outputContainer>
-			bool ratchetDecrypt(const std::vector<uint8_t> &cipherText, const std::vector<uint8_t> &AD, outputContainer &plaintext, const bool payloadDirectEncryption);
+			bool ratchetDecrypt(const lime::span<const uint8_t> cipherText, std::vector<uint8_t> &AD, outputContainer &plaintext, const bool payloadDirectEncryption, const std::function<bool(outputContainer &)> &acceptPlaintext=nullptr);
 			/// return the session's local storage id
 			long int dbSessionId(void) const {return m_dbSessionId;};
 			/// return the current status of session
 			bool isActive(void) const {return m_active_status;}
+			/// return the AEAD scheme used to encrypt messages in this session
+			lime::AEADAlgorithm AEAD(void) const {return m_AEAD;}
+			bool peerDecompresses(const lime::CompressionAlgorithm algorithm) const; // can the peer read payloads compressed with this algorithm
+			/// return true when the sending chain is long enough to start renewing this session (see settings::sendingChainRenewal)
+			bool needsRenewal(void) const {return lime::settings::sendingChainRenewal < lime::settings::maxSendingChain && m_Ns >= lime::settings::sendingChainRenewal;}
 	};
 
 
@@ -159,23 +173,104 @@ namespace lime {
 		RecipientInfos(const std::string &deviceId) : RecipientData(deviceId),  DRSession{nullptr} {};
 	};
 
+	/**
+	 * @brief Provide the buffer receiving the cipherMessage of a message
+	 *
+	 * Called once the encryption mode is selected, with the size of the cipherMessage: 0 when the payload is in the DR messages.
+	 * Returns nullptr when the caller buffer cannot hold it.
+	 */
+	using cipherMessageOutput = std::function<uint8_t *(const size_t cipherMessageSize)>;
+
+	/**
+	 * @brief Hold the part of a message encryption common to all its recipients
+	 *
+	 * It is built once per message so the encryption to the recipients can be performed in several passes producing the same cipherMessage
+	 */
+	struct EncryptionContext {
+		bool payloadDirectEncryption; /**< true when the payload is encrypted in each DR message, false when it is in the cipherMessage */
+		lime::sBuffer<lime::settings::DRrandomSeedSize> randomSeed; /**< the seed used to derive cipherMessage key and IV, encrypted in each DR message. Not used when payloadDirectEncryption is set */
+		lime::AEADAlgorithm cipherMessageAEAD; /**< the AEAD scheme used to encrypt the cipherMessage, advertised in each DR message header. Not used when payloadDirectEncryption is set */
+		bool cipherMessageStream; /**< true when the cipherMessage is encrypted by chunks by a CipherMessageStream, advertised in each DR message header */
+		bool payloadCompressed; /**< true when the payload was compressed before its encryption, advertised in each DR message header */
+		std::vector<uint8_t> compressedPayload; /**< the compressed payload encrypted instead of the plaintext when payloadCompressed is set */
+		std::vector<uint8_t> AD; /**< associated data common to all recipients: cipherMessage auth tag or recipient User Id, followed by source device Id */
+
+		EncryptionContext(const size_t recipientsCount, const lime::span<const uint8_t> plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, const cipherMessageOutput &cipherMessage, const lime::EncryptionPolicy encryptionPolicy, const lime::AEADAlgorithm cipherMessageAEAD=lime::AEADAlgorithm::aes256gcm, const lime::CompressionAlgorithm compression=lime::CompressionAlgorithm::none);
+		EncryptionContext(const std::string& recipientUserId, const std::string& sourceDeviceId, const lime::AEADAlgorithm cipherMessageAEAD); // cipherMessage encrypted by chunks
+		EncryptionContext(EncryptionContext &a) = delete; // no copy, it holds secret material
+		EncryptionContext &operator=(EncryptionContext &a) = delete;
+	};
+
+	/**
+	 * @brief Encrypt or decrypt by chunks a cipherMessage too large to be held in memory
+	 *
+	 * The key and nonce are derived from the random seed shared in the DR messages. The cipherMessage is a serie of chunks of
+	 * settings::cipherMessageStreamChunkSize bytes, except the last one which may be shorter or even empty, each followed by its authentication tag.
+	 * Each chunk nonce is the derived one with the chunk index xored in bytes 7 to 10 and a last chunk flag in byte 11
+	 * so chunks cannot be reordered, dropped, or the message truncated without failing the authentication.
+	 */
+	class CipherMessageStream : public lime::CipherStream {
+		private:
+			lime::sBuffer<lime::settings::DRMessageKeySize+lime::settings::DRMessageIVSize> m_key; // key || nonce derived from the random seed
+			std::vector<uint8_t> m_AD; // source device Id || recipient User Id, authenticated with each chunk
+			const lime::AEADAlgorithm m_AEAD; // AEAD scheme used on each chunk
+			const bool m_encrypt; // true when encrypting, false when decrypting
+			uint32_t m_chunkIndex; // index of the next chunk to process
+			std::vector<uint8_t> m_buffer; // input not processed yet: at most one chunk (and its tag when decrypting)
+			bool m_done; // set once finished or after an authentication failure
+
+			bool processChunk(const uint8_t *input, const size_t inputSize, const bool last, std::vector<uint8_t> &output); // encrypt or decrypt one chunk, append the result to output
+
+		public:
+			CipherMessageStream(const lime::sBuffer<lime::settings::DRrandomSeedSize> &randomSeed, const std::string &sourceDeviceId, const std::string &recipientUserId, const lime::AEADAlgorithm AEAD, const bool encrypt);
+			CipherMessageStream(CipherMessageStream &a) = delete; // no copy, it holds secret material
+			CipherMessageStream &operator=(CipherMessageStream &a) = delete;
+			bool update(const uint8_t *input, const size_t inputSize, std::vector<uint8_t> &output) override;
+			bool finish(std::vector<uint8_t> &output) override;
+	};
+
 	// helpers function wich are the one to be used to encrypt/decrypt messages
 	template <typename Curve>
-	void encryptMessage(std::vector<RecipientInfos<Curve>>& recipients, const std::vector<uint8_t>& plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage);
+	void encryptMessage(std::vector<RecipientInfos<Curve>>& recipients, const lime::span<const uint8_t> plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback=nullptr);
+
+	template <typename Curve>
+	void encryptMessage(std::vector<RecipientInfos<Curve>>& recipients, const lime::span<const uint8_t> plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, const cipherMessageOutput &cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback=nullptr);
+
+	template <typename Curve>
+	void encryptMessage(const EncryptionContext &context, std::vector<RecipientInfos<Curve>>& recipients, const lime::span<const uint8_t> plaintext, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback);
+
+	template <typename Curve>
+	lime::CompressionAlgorithm recipientsCompressionAlgorithm(const std::vector<RecipientInfos<Curve>> &recipients);
+
+	template <typename Curve>
+	std::shared_ptr<DR<Curve>> decryptMessage(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<Curve>>>& DRSessions, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, std::vector<uint8_t>& plaintext);
+
+	template <typename Curve>
+	std::shared_ptr<DR<Curve>> decryptMessage(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<Curve>>>& DRSessions, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, lime::span<uint8_t> plaintext, size_t &plaintextSize);
 
 	template <typename Curve>
-	std::shared_ptr<DR<Curve>> decryptMessage(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<Curve>>>& DRSessions, const std::vector<uint8_t>& DRmessage, const std::vector<uint8_t>& cipherMessage, std::vector<uint8_t>& plaintext);
+	std::shared_ptr<DR<Curve>> decryptMessage(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<Curve>>>& DRSessions, const lime::span<const uint8_t> DRmessage, std::shared_ptr<CipherMessageStream>& cipherStream);
 
 	/* this templates are instanciated once in the lime_double_ratchet.cpp file, explicitly tell anyone including this header that there is no need to re-instanciate them */
 #ifdef EC25519_ENABLED
 	extern template class DR<C255>;
-	extern template void encryptMessage<C255>(std::vector<RecipientInfos<C255>>& recipients, const std::vector<uint8_t>& plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage);
-	extern template std::shared_ptr<DR<C255>> decryptMessage<C255>(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<C255>>>& DRSessions, const std::vector<uint8_t>& DRmessage, const std::vector<uint8_t>& cipherMessage, std::vector<uint8_t>& plaintext);
+	extern template void encryptMessage<C255>(std::vector<RecipientInfos<C255>>& recipients, const lime::span<const uint8_t> plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback);
+	extern template void encryptMessage<C255>(std::vector<RecipientInfos<C255>>& recipients, const lime::span<const uint8_t> plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, const cipherMessageOutput &cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback);
+	extern template lime::CompressionAlgorithm recipientsCompressionAlgorithm<C255>(const std::vector<RecipientInfos<C255>> &recipients);
+	extern template void encryptMessage<C255>(const EncryptionContext &context, std::vector<RecipientInfos<C255>>& recipients, const lime::span<const uint8_t> plaintext, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback);
+	extern template std::shared_ptr<DR<C255>> decryptMessage<C255>(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<C255>>>& DRSessions, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, std::vector<uint8_t>& plaintext);
+	extern template std::shared_ptr<DR<C255>> decryptMessage<C255>(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<C255>>>& DRSessions, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, lime::span<uint8_t> plaintext, size_t &plaintextSize);
+	extern template std::shared_ptr<DR<C255>> decryptMessage<C255>(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<C255>>>& DRSessions, const lime::span<const uint8_t> DRmessage, std::shared_ptr<CipherMessageStream>& cipherStream);
 #endif
 #ifdef EC448_ENABLED
 	extern template class DR<C448>;
-	extern template void encryptMessage<C448>(std::vector<RecipientInfos<C448>>& recipients, const std::vector<uint8_t>& plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage);
-	extern template std::shared_ptr<DR<C448>> decryptMessage<C448>(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<C448>>>& DRSessions, const std::vector<uint8_t>& DRmessage, const std::vector<uint8_t>& cipherMessage, std::vector<uint8_t>& plaintext);
+	extern template void encryptMessage<C448>(std::vector<RecipientInfos<C448>>& recipients, const lime::span<const uint8_t> plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback);
+	extern template void encryptMessage<C448>(std::vector<RecipientInfos<C448>>& recipients, const lime::span<const uint8_t> plaintext, const std::string& recipientUserId, const std::string& sourceDeviceId, const cipherMessageOutput &cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback);
+	extern template lime::CompressionAlgorithm recipientsCompressionAlgorithm<C448>(const std::vector<RecipientInfos<C448>> &recipients);
+	extern template void encryptMessage<C448>(const EncryptionContext &context, std::vector<RecipientInfos<C448>>& recipients, const lime::span<const uint8_t> plaintext, std::shared_ptr<lime::Db> localStorage, const limeRecipientCallback &recipientCallback);
+	extern template std::shared_ptr<DR<C448>> decryptMessage<C448>(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<C448>>>& DRSessions, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, std::vector<uint8_t>& plaintext);
+	extern template std::shared_ptr<DR<C448>> decryptMessage<C448>(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<C448>>>& DRSessions, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, lime::span<uint8_t> plaintext, size_t &plaintextSize);
+	extern template std::shared_ptr<DR<C448>> decryptMessage<C448>(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::string& recipientUserId, std::vector<std::shared_ptr<DR<C448>>>& DRSessions, const lime::span<const uint8_t> DRmessage, std::shared_ptr<CipherMessageStream>& cipherStream);
 #endif
 
 }
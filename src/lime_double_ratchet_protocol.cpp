@@ -18,6 +18,7 @@
 */
 #include "lime/lime.hpp"
 #include "lime_double_ratchet_protocol.hpp"
+#include "lime_compression.hpp"
 
 #include "bctoolbox/exception.hh"
 
@@ -62,7 +63,37 @@ namespace lime {
 
 	namespace double_ratchet_protocol {
 
+		/**
+		 * @brief Get the DR message type flag advertising the ability to decompress payloads compressed with the given algorithm
+		 *
+		 * @param[in]	algorithm	the compression algorithm
+		 *
+		 * @return the matching flag, 0 for CompressionAlgorithm::none
+		 */
+		uint8_t compressionCapabilityFlag(const lime::CompressionAlgorithm algorithm) noexcept {
+			switch (algorithm) {
+				case lime::CompressionAlgorithm::zlib:
+					return static_cast<uint8_t>(DR_message_type::zlib_capable_flag);
+				case lime::CompressionAlgorithm::zstd:
+					return static_cast<uint8_t>(DR_message_type::zstd_capable_flag);
+				default:
+					return 0;
+			}
+		}
 
+		/**
+		 * @brief the compression capability flags of this build, advertised in every DR message header
+		 */
+		static uint8_t localCompressionCapabilities(void) noexcept {
+			static const uint8_t capabilities = [](){
+				uint8_t flags = 0;
+				for (const auto algorithm : lime::available_compressionAlgorithms()) {
+					flags |= compressionCapabilityFlag(algorithm);
+				}
+				return flags;
+			}();
+			return capabilities;
+		}
 
 		/**
 		 * @brief  build an X3DH init message to insert in DR header
@@ -83,9 +114,10 @@ namespace lime {
 		 */
 		template <typename Curve>
 		void buildMessage_X3DHinit(std::vector<uint8_t> &message, const DSA<Curve, lime::DSAtype::publicKey> &Ik, const X<Curve, lime::Xtype::publicKey> &Ek, const uint32_t SPk_id, const uint32_t OPk_id, const bool OPk_flag) noexcept {
-			// make sure message is cleared and set its first byte to OPk flag
-			message.assign(1, static_cast<uint8_t>(OPk_flag?DR_X3DH_OPk_flag::withOPk:DR_X3DH_OPk_flag::withoutOPk));
-			message.reserve(1+Ik.size()+Ek.size()+4+(OPk_flag?4:0));
+			// make sure message is cleared, allocated once at its exact size and set its first byte to OPk flag
+			message.clear();
+			message.reserve(X3DHinitSize<Curve>(OPk_flag));
+			message.push_back(static_cast<uint8_t>(OPk_flag?DR_X3DH_OPk_flag::withOPk:DR_X3DH_OPk_flag::withoutOPk));
 
 			message.insert(message.end(), Ik.cbegin(), Ik.cend());
 			message.insert(message.end(), Ek.cbegin(), Ek.cend());
@@ -113,7 +145,7 @@ namespace lime {
 		 * When this function is called, we already parsed the DR message to extract the X3DH_initMessage
 		 * all checks were already performed by the Double Ratchet packet parser, just grab the data
 		 *
-		 * @param[in]	message		the message to parse
+		 * @param[in]	message		the message to parse, it is read in place
 		 * @param[out]	Ik		peer public Identity key
 		 * @param[out]	Ek		peer public Ephemeral key
 		 * @param[out]	SPk_id		self Signed prekey id
@@ -121,14 +153,14 @@ namespace lime {
 		 * @param[out]	OPk_flag	true if an OPk flag was present in the message
 		 */
 		template <typename Curve>
-		void parseMessage_X3DHinit(const std::vector<uint8_t>message, DSA<Curve, lime::DSAtype::publicKey> &Ik, X<Curve, lime::Xtype::publicKey> &Ek, uint32_t &SPk_id, uint32_t &OPk_id, bool &OPk_flag) noexcept {
+		void parseMessage_X3DHinit(const lime::span<const uint8_t> message, DSA<Curve, lime::DSAtype::publicKey> &Ik, X<Curve, lime::Xtype::publicKey> &Ek, uint32_t &SPk_id, uint32_t &OPk_id, bool &OPk_flag) noexcept {
 			OPk_flag = (message[0] == static_cast<uint8_t>(DR_X3DH_OPk_flag::withOPk))?true:false;
 			size_t index = 1;
 
-			Ik.assign(message.cbegin()+index);
+			Ik.assign(message.begin()+index);
 			index += DSA<Curve, lime::DSAtype::publicKey>::ssize();
 
-			Ek.assign(message.cbegin()+index);
+			Ek.assign(message.begin()+index);
 			index += X<Curve, lime::Xtype::publicKey>::ssize();
 
 			SPk_id = static_cast<uint32_t>(message[index])<<24 |
@@ -149,12 +181,12 @@ namespace lime {
 		 * @brief check the message for presence of X3DH init in the header, extract it if there is one
 		 *
 		 * @param[in]	message			A buffer holding the message, it shall be DR header || DR message. If there is a X3DH init message it is in the DR header
-		 * @param[out]	X3DH_initMessage 	A buffer holding the X3DH input message
+		 * @param[out]	X3DH_initMessage 	A view on the X3DH init message inside the given message buffer, which must outlive it
 		 *
 		 * @return true if a X3DH init message was found, false otherwise (also in case of invalid packet)
 		 */
 		template <typename Curve>
-		bool parseMessage_get_X3DHinit(const std::vector<uint8_t> &message, std::vector<uint8_t> &X3DH_initMessage) noexcept {
+		bool parseMessage_get_X3DHinit(const lime::span<const uint8_t> message, lime::span<const uint8_t> &X3DH_initMessage) noexcept {
 			// we need to parse the first 4 bytes of the packet to determine if we have a valid one and an X3DH init in it
 			if (message.size()<headerSize<Curve>()) {
 				return false;
@@ -179,8 +211,8 @@ namespace lime {
 						return false;
 					}
 
-					// copy the message in the output buffer
-					X3DH_initMessage.assign(message.cbegin()+3, message.cbegin()+3+x3dh_initMessageSize);
+					// point to the X3DH init message, no copy
+					X3DH_initMessage = message.subspan(3, x3dh_initMessageSize);
 				}
 					return true;
 
@@ -202,28 +234,46 @@ namespace lime {
 		 *	PN<2 bytes> ||\n
 		 *	DHs<...>
 		 *
-		 * @param[out]	header				the buffer containing header to be sent to recipient
+		 * @param[in,out]	header				the header to be sent to recipient is appended to this buffer, the caller shall reserve its final size
 		 * @param[in]	Ns				Index of sending chain
 		 * @param[in]	PN				Index of previous sending chain
 		 * @param[in]	DHs				Current DH public key
 		 * @param[in]	X3DH_initMessage		A buffer holding an X3DH init message to be inserted in header. If empty message type X3DH init flag is not set
 		 * @param[in]	payloadDirectEncryption		Set the Payload Direct Encryption flag in header
+		 * @param[in]	AEAD				AEAD scheme used to encrypt the Double Ratchet packet
+		 * @param[in]	cipherMessageAEAD		AEAD scheme used to encrypt the cipher message, ignored when payloadDirectEncryption is set
+		 * @param[in]	cipherMessageStream		Set the cipher message stream flag in header, ignored when payloadDirectEncryption is set
+		 * @param[in]	payloadCompressed		Set the payload compressed flag in header
 		 */
 		template <typename Curve>
-		void buildMessage_header(std::vector<uint8_t> &header, const uint16_t Ns, const uint16_t PN, const X<Curve, lime::Xtype::publicKey> &DHs, const std::vector<uint8_t> X3DH_initMessage, const bool payloadDirectEncryption) noexcept {
+		void buildMessage_header(std::vector<uint8_t> &header, const uint16_t Ns, const uint16_t PN, const X<Curve, lime::Xtype::publicKey> &DHs, const lime::span<const uint8_t> X3DH_initMessage, const bool payloadDirectEncryption, const lime::AEADAlgorithm AEAD, const lime::AEADAlgorithm cipherMessageAEAD, const bool cipherMessageStream, const bool payloadCompressed) noexcept {
 			// Header is one buffer composed of:
 			// Version Number<1 byte> || message Type <1 byte> || curve Id <1 byte> || [<x3d init <variable>] || Ns <2 bytes> || PN <2 bytes> || Key type byte Id(1 byte) || self public key<DHKey::size bytes>
-			header.assign(1, static_cast<uint8_t>(double_ratchet_protocol::DR_v01));
+			header.push_back(static_cast<uint8_t>(double_ratchet_protocol::DR_v01));
 			uint8_t messageType = 0;
 			if (payloadDirectEncryption) { // if requested, turn the payload direct encryption flag on
 				messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::payload_direct_encryption_flag); // turn on the flag
+			} else {
+				if (cipherMessageAEAD == lime::AEADAlgorithm::chacha20poly1305) {
+					messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::cipherMessage_chacha20poly1305_flag);
+				}
+				if (cipherMessageStream) {
+					messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::cipherMessage_stream_flag);
+				}
 			}
+			if (AEAD == lime::AEADAlgorithm::chacha20poly1305) {
+				messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::DR_chacha20poly1305_flag);
+			}
+			if (payloadCompressed) {
+				messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::payload_compressed_flag);
+			}
+			messageType |= localCompressionCapabilities(); // let the peer know which compressed payloads we can read
 
 			if (X3DH_initMessage.size()>0) { // we do have an X3DH init message to insert in the header
 				messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::X3DH_init_flag); // turn on the flag
 				header.push_back(messageType);
 				header.push_back(static_cast<uint8_t>(Curve::curveId()));
-				header.insert(header.end(), X3DH_initMessage.cbegin(), X3DH_initMessage.cend());
+				header.insert(header.end(), X3DH_initMessage.begin(), X3DH_initMessage.end());
 			} else {
 				messageType &= ~static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::X3DH_init_flag); // be sure to have this flag turned off
 				header.push_back(messageType);
@@ -240,10 +290,10 @@ namespace lime {
 		 * @brief parse a buffer to find a header at the begining of it
 		 *
 		 *	it perform some check on DR version byte and key id byte
-		 *	The valid flag is set if a valid header is found in input buffer
+		 *	The valid flag is set if a valid header is found in input buffer, which is parsed in place
 		 */
 		template <typename Curve>
-		DRHeader<Curve>::DRHeader(const std::vector<uint8_t> header) : m_Ns{0},m_PN{0},m_DHs{},m_valid{false},m_size{0}{ // init valid to false and check during parsing if all is ok
+		DRHeader<Curve>::DRHeader(const lime::span<const uint8_t> header) : m_Ns{0},m_PN{0},m_DHs{},m_valid{false},m_size{0},m_payload_direct_encryption{false},m_AEAD{lime::AEADAlgorithm::aes256gcm},m_cipherMessage_AEAD{lime::AEADAlgorithm::aes256gcm},m_cipherMessage_stream{false},m_payload_compressed{false},m_compression_capabilities{0}{ // init valid to false and check during parsing if all is ok
 			// make sure we have at least enough data to parse version<1 byte> || message type<1 byte> || curve Id<1 byte> || [x3dh init] || OPk flag without any ulterior checks on size
 			if (header.size()<headerSize<Curve>()) {
 				return; // the valid_flag is false
@@ -259,6 +309,15 @@ namespace lime {
 					} else {
 						m_payload_direct_encryption = false;
 					}
+					if (messageType & static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::DR_chacha20poly1305_flag)) {
+						m_AEAD = lime::AEADAlgorithm::chacha20poly1305;
+					}
+					if (messageType & static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::cipherMessage_chacha20poly1305_flag)) {
+						m_cipherMessage_AEAD = lime::AEADAlgorithm::chacha20poly1305;
+					}
+					m_cipherMessage_stream = (messageType & static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::cipherMessage_stream_flag)) != 0;
+					m_payload_compressed = (messageType & static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::payload_compressed_flag)) != 0;
+					m_compression_capabilities = messageType & (static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::zlib_capable_flag)|static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::zstd_capable_flag));
 					if (messageType & static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::X3DH_init_flag)) {
 						// header is :	Version<1 byte> ||
 						// 		message type <1 byte> ||
@@ -282,7 +341,7 @@ namespace lime {
 						if (header.size() >=  m_size) { //header shall be actually longer because buffer pass is the whole message
 							m_Ns = header[3+x3dh_initMessageSize]<<8|header[4+x3dh_initMessageSize];
 							m_PN = header[5+x3dh_initMessageSize]<<8|header[6+x3dh_initMessageSize];
-							m_DHs = X<Curve, lime::Xtype::publicKey>{header.cbegin()+7+x3dh_initMessageSize}; // DH key start after header other infos
+							m_DHs.assign(header.begin()+7+x3dh_initMessageSize); // DH key start after header other infos
 							m_valid = true;
 						}
 					} else { // There is no X3DH init message in the DR header
@@ -295,7 +354,7 @@ namespace lime {
 						if (header.size() >=  m_size) { //header shall be actually longer because buffer pass is the whole message
 							m_Ns = header[3]<<8|header[4];
 							m_PN = header[5]<<8|header[6];
-							m_DHs = X<Curve, lime::Xtype::publicKey>{header.cbegin()+7}; // DH key start after header other infos
+							m_DHs.assign(header.begin()+7); // DH key start after header other infos
 							m_valid = true;
 						}
 					}
@@ -312,9 +371,9 @@ namespace lime {
 		//template size_t headerSize<C255>() noexcept;
 		//template size_t X3DHinitSize<C255>(bool haveOPk) noexcept;
 		template void buildMessage_X3DHinit<C255>(std::vector<uint8_t> &message, const DSA<C255, lime::DSAtype::publicKey> &Ik, const X<C255, lime::Xtype::publicKey> &Ek, const uint32_t SPk_id, const uint32_t OPk_id, const bool OPk_flag) noexcept;
-		template void parseMessage_X3DHinit<C255>(const std::vector<uint8_t>message, DSA<C255, lime::DSAtype::publicKey> &Ik, X<C255, lime::Xtype::publicKey> &Ek, uint32_t &SPk_id, uint32_t &OPk_id, bool &OPk_flag) noexcept;
-		template bool parseMessage_get_X3DHinit<C255>(const std::vector<uint8_t> &message, std::vector<uint8_t> &X3DH_initMessage) noexcept;
-		template void buildMessage_header<C255>(std::vector<uint8_t> &header, const uint16_t Ns, const uint16_t PN, const X<C255, lime::Xtype::publicKey> &DHs, const std::vector<uint8_t> X3DH_initMessage, const bool payloadDirectEncryption) noexcept;
+		template void parseMessage_X3DHinit<C255>(const lime::span<const uint8_t> message, DSA<C255, lime::DSAtype::publicKey> &Ik, X<C255, lime::Xtype::publicKey> &Ek, uint32_t &SPk_id, uint32_t &OPk_id, bool &OPk_flag) noexcept;
+		template bool parseMessage_get_X3DHinit<C255>(const lime::span<const uint8_t> message, lime::span<const uint8_t> &X3DH_initMessage) noexcept;
+		template void buildMessage_header<C255>(std::vector<uint8_t> &header, const uint16_t Ns, const uint16_t PN, const X<C255, lime::Xtype::publicKey> &DHs, const lime::span<const uint8_t> X3DH_initMessage, const bool payloadDirectEncryption, const lime::AEADAlgorithm AEAD, const lime::AEADAlgorithm cipherMessageAEAD, const bool cipherMessageStream, const bool payloadCompressed) noexcept;
 		template class DRHeader<C255>;
 #endif
 
@@ -322,9 +381,9 @@ namespace lime {
 		//template size_t headerSize<C448>() noexcept;
 		//template size_t X3DHinitSize<C448>(bool haveOPk) noexcept;
 		template void buildMessage_X3DHinit<C448>(std::vector<uint8_t> &message, const DSA<C448, lime::DSAtype::publicKey> &Ik, const X<C448, lime::Xtype::publicKey> &Ek, const uint32_t SPk_id, const uint32_t OPk_id, const bool OPk_flag) noexcept;
-		template void parseMessage_X3DHinit<C448>(const std::vector<uint8_t>message, DSA<C448, lime::DSAtype::publicKey> &Ik, X<C448, lime::Xtype::publicKey> &Ek, uint32_t &SPk_id, uint32_t &OPk_id, bool &OPk_flag) noexcept;
-		template bool parseMessage_get_X3DHinit<C448>(const std::vector<uint8_t> &message, std::vector<uint8_t> &X3DH_initMessage) noexcept;
-		template void buildMessage_header<C448>(std::vector<uint8_t> &header, const uint16_t Ns, const uint16_t PN, const X<C448, lime::Xtype::publicKey> &DHs, const std::vector<uint8_t> X3DH_initMessage, const bool payloadDirectEncryption) noexcept;
+		template void parseMessage_X3DHinit<C448>(const lime::span<const uint8_t> message, DSA<C448, lime::DSAtype::publicKey> &Ik, X<C448, lime::Xtype::publicKey> &Ek, uint32_t &SPk_id, uint32_t &OPk_id, bool &OPk_flag) noexcept;
+		template bool parseMessage_get_X3DHinit<C448>(const lime::span<const uint8_t> message, lime::span<const uint8_t> &X3DH_initMessage) noexcept;
+		template void buildMessage_header<C448>(std::vector<uint8_t> &header, const uint16_t Ns, const uint16_t PN, const X<C448, lime::Xtype::publicKey> &DHs, const lime::span<const uint8_t> X3DH_initMessage, const bool payloadDirectEncryption, const lime::AEADAlgorithm AEAD, const lime::AEADAlgorithm cipherMessageAEAD, const bool cipherMessageStream, const bool payloadCompressed) noexcept;
 		template class DRHeader<C448>;
 #endif
 
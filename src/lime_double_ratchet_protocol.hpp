@@ -20,6 +20,7 @@
 #ifndef lime_double_ratchet_protocol_hpp
 #define lime_double_ratchet_protocol_hpp
 
+#include "lime/lime.hpp"
 #include "lime_crypto_primitives.hpp"
 
 namespace lime {
@@ -52,13 +53,15 @@ namespace lime {
 		template <typename Curve>
 		void buildMessage_X3DHinit(std::vector<uint8_t> &message, const DSA<Curve, lime::DSAtype::publicKey> &Ik, const X<Curve, lime::Xtype::publicKey> &Ek, const uint32_t SPk_id, const uint32_t OPk_id, const bool OPk_flag) noexcept;
 		template <typename Curve>
-		void parseMessage_X3DHinit(const std::vector<uint8_t>message, DSA<Curve, lime::DSAtype::publicKey> &Ik, X<Curve, lime::Xtype::publicKey> &Ek, uint32_t &SPk_id, uint32_t &OPk_id, bool &OPk_flag) noexcept;
+		void parseMessage_X3DHinit(const lime::span<const uint8_t> message, DSA<Curve, lime::DSAtype::publicKey> &Ik, X<Curve, lime::Xtype::publicKey> &Ek, uint32_t &SPk_id, uint32_t &OPk_id, bool &OPk_flag) noexcept;
 
 		template <typename Curve>
-		bool parseMessage_get_X3DHinit(const std::vector<uint8_t> &message, std::vector<uint8_t> &X3DH_initMessage) noexcept;
+		bool parseMessage_get_X3DHinit(const lime::span<const uint8_t> message, lime::span<const uint8_t> &X3DH_initMessage) noexcept;
 
 		template <typename Curve>
-		void buildMessage_header(std::vector<uint8_t> &header, const uint16_t Ns, const uint16_t PN, const X<Curve, lime::Xtype::publicKey> &DHs, const std::vector<uint8_t> X3DH_initMessage, const bool payloadDirectEncryption) noexcept;
+		void buildMessage_header(std::vector<uint8_t> &header, const uint16_t Ns, const uint16_t PN, const X<Curve, lime::Xtype::publicKey> &DHs, const lime::span<const uint8_t> X3DH_initMessage, const bool payloadDirectEncryption, const lime::AEADAlgorithm AEAD, const lime::AEADAlgorithm cipherMessageAEAD, const bool cipherMessageStream, const bool payloadCompressed) noexcept;
+
+		uint8_t compressionCapabilityFlag(const lime::CompressionAlgorithm algorithm) noexcept;
 
 		/**
 		 * @brief helper class and functions to parse Double Ratchet message header and access its components
@@ -72,6 +75,11 @@ namespace lime {
 				bool m_valid; /**< is this header valid? */
 				size_t m_size; /**< store the size of parsed header */
 				bool m_payload_direct_encryption; /**< flag to store the message encryption mode: in the double ratchet packet or using a random key to encrypt it separately and encrypt the key in the DR packet */
+				lime::AEADAlgorithm m_AEAD; /**< AEAD scheme used to encrypt the double ratchet packet */
+				lime::AEADAlgorithm m_cipherMessage_AEAD; /**< AEAD scheme used to encrypt the cipher message, if any */
+				bool m_cipherMessage_stream; /**< is the cipher message encrypted by chunks (see CipherMessageStream) */
+				bool m_payload_compressed; /**< was the payload compressed before its encryption */
+				uint8_t m_compression_capabilities; /**< compression capability flags of the sender, see compressionCapabilityFlag */
 
 			public:
 				/// read-only accessor to Sender Chain index (Ns)
@@ -84,29 +92,39 @@ namespace lime {
 				bool valid(void) const {return m_valid;}
 				/// what encryption mode is advertised in this header
 				bool payloadDirectEncryption(void) const {return m_payload_direct_encryption;}
+				/// AEAD scheme used to encrypt this double ratchet packet
+				lime::AEADAlgorithm AEAD(void) const {return m_AEAD;}
+				/// AEAD scheme used to encrypt the cipher message associated to this packet
+				lime::AEADAlgorithm cipherMessageAEAD(void) const {return m_cipherMessage_AEAD;}
+				/// is the cipher message associated to this packet encrypted by chunks
+				bool cipherMessageStream(void) const {return m_cipherMessage_stream;}
+				/// was the payload compressed before its encryption (see decompressPayload)
+				bool payloadCompressed(void) const {return m_payload_compressed;}
+				/// the compression capability flags advertised by the sender: the algorithms it can decompress (see compressionCapabilityFlag)
+				uint8_t compressionCapabilities(void) const {return m_compression_capabilities;}
 				/// read-only accessor to the size of parsed header
 				size_t size(void) {return m_size;}
 
 				/* ctor/dtor */
 				DRHeader() = delete;
-				DRHeader(const std::vector<uint8_t> header);
+				DRHeader(const lime::span<const uint8_t> header);
 				~DRHeader() {};
 		 };
 
 		/* this templates are intanciated in lime_double_ratchet_procotocol.cpp, do not re-instanciate it anywhere else */
 #ifdef EC25519_ENABLED
 		extern template void buildMessage_X3DHinit<C255>(std::vector<uint8_t> &message, const DSA<C255, lime::DSAtype::publicKey> &Ik, const X<C255, lime::Xtype::publicKey> &Ek, const uint32_t SPk_id, const uint32_t OPk_id, const bool OPk_flag) noexcept;
-		extern template void parseMessage_X3DHinit<C255>(const std::vector<uint8_t>message, DSA<C255, lime::DSAtype::publicKey> &Ik, X<C255, lime::Xtype::publicKey> &Ek, uint32_t &SPk_id, uint32_t &OPk_id, bool &OPk_flag) noexcept;
-		extern template bool parseMessage_get_X3DHinit<C255>(const std::vector<uint8_t> &message, std::vector<uint8_t> &X3DH_initMessage) noexcept;
-		extern template void buildMessage_header<C255>(std::vector<uint8_t> &header, const uint16_t Ns, const uint16_t PN, const X<C255, lime::Xtype::publicKey> &DHs, const std::vector<uint8_t> X3DH_initMessage, const bool payloadDirectEncryption) noexcept;
+		extern template void parseMessage_X3DHinit<C255>(const lime::span<const uint8_t> message, DSA<C255, lime::DSAtype::publicKey> &Ik, X<C255, lime::Xtype::publicKey> &Ek, uint32_t &SPk_id, uint32_t &OPk_id, bool &OPk_flag) noexcept;
+		extern template bool parseMessage_get_X3DHinit<C255>(const lime::span<const uint8_t> message, lime::span<const uint8_t> &X3DH_initMessage) noexcept;
+		extern template void buildMessage_header<C255>(std::vector<uint8_t> &header, const uint16_t Ns, const uint16_t PN, const X<C255, lime::Xtype::publicKey> &DHs, const lime::span<const uint8_t> X3DH_initMessage, const bool payloadDirectEncryption, const lime::AEADAlgorithm AEAD, const lime::AEADAlgorithm cipherMessageAEAD, const bool cipherMessageStream, const bool payloadCompressed) noexcept;
 		extern template class DRHeader<C255>;
 #endif
 
 #ifdef EC448_ENABLED
 		extern template void buildMessage_X3DHinit<C448>(std::vector<uint8_t> &message, const DSA<C448, lime::DSAtype::publicKey> &Ik, const X<C448, lime::Xtype::publicKey> &Ek, const uint32_t SPk_id, const uint32_t OPk_id, const bool OPk_flag) noexcept;
-		extern template void parseMessage_X3DHinit<C448>(const std::vector<uint8_t>message, DSA<C448, lime::DSAtype::publicKey> &Ik, X<C448, lime::Xtype::publicKey> &Ek, uint32_t &SPk_id, uint32_t &OPk_id, bool &OPk_flag) noexcept;
-		extern template bool parseMessage_get_X3DHinit<C448>(const std::vector<uint8_t> &message, std::vector<uint8_t> &X3DH_initMessage) noexcept;
-		extern template void buildMessage_header<C448>(std::vector<uint8_t> &header, const uint16_t Ns, const uint16_t PN, const X<C448, lime::Xtype::publicKey> &DHs, const std::vector<uint8_t> X3DH_initMessage, const bool payloadDirectEncryption) noexcept;
+		extern template void parseMessage_X3DHinit<C448>(const lime::span<const uint8_t> message, DSA<C448, lime::DSAtype::publicKey> &Ik, X<C448, lime::Xtype::publicKey> &Ek, uint32_t &SPk_id, uint32_t &OPk_id, bool &OPk_flag) noexcept;
+		extern template bool parseMessage_get_X3DHinit<C448>(const lime::span<const uint8_t> message, lime::span<const uint8_t> &X3DH_initMessage) noexcept;
+		extern template void buildMessage_header<C448>(std::vector<uint8_t> &header, const uint16_t Ns, const uint16_t PN, const X<C448, lime::Xtype::publicKey> &DHs, const lime::span<const uint8_t> X3DH_initMessage, const bool payloadDirectEncryption, const lime::AEADAlgorithm AEAD, const lime::AEADAlgorithm cipherMessageAEAD, const bool cipherMessageStream, const bool payloadCompressed) noexcept;
 		extern template class DRHeader<C448>;
 #endif
 		/* These constants are needed only for tests purpose, otherwise their usage is internal only to double_ratchet_protocol.hpp */
@@ -115,10 +133,30 @@ namespace lime {
 
 		/** @brief DR message type byte bit mapping
 		 * @code{.unparsed}
-		 * | 7  6  5  4  3  2                1                      0         |
-		 * | <  Unused      > Payload_Direct_Encryption_Flag  X3DH_Init_Flag  |
+		 * | 7                 6                 5                         4                           3                        2                       1                      0         |
+		 * | Zstd_Capable_Flag Zlib_Capable_Flag Payload_Compressed_Flag  CipherMessage_Stream_Flag  CipherMessage_ChaCha20_Flag  DR_ChaCha20_Flag  Payload_Direct_Encryption_Flag  X3DH_Init_Flag  |
 		 * @endcode
 		 *
+		 * Zstd_Capable_Flag (bit 7), Zlib_Capable_Flag (bit 6):
+		 *      - set  : the sender can decompress payloads compressed with this algorithm, it is set in every message it sends
+		 *      - unset: the sender cannot, or is not aware of compression: payloads sent to it shall not be compressed with this algorithm
+		 *
+		 * Payload_Compressed_Flag (bit 5):
+		 *      - set  : the payload, in the Double Ratchet packet or in the cipher message, was compressed before its encryption, see compressPayload
+		 *      - unset: the payload is not compressed
+		 *
+		 * CipherMessage_Stream_Flag (bit 4):
+		 *      - set  : the cipher message is encrypted by chunks, each one authenticated separately, see CipherMessageStream
+		 *      - unset: the cipher message, if any, is encrypted at once
+		 *
+		 * CipherMessage_ChaCha20_Flag (bit 3):
+		 *      - set  : the cipher message is encrypted using ChaCha20-Poly1305
+		 *      - unset: the cipher message, if any, is encrypted using AES256-GCM
+		 *
+		 * DR_ChaCha20_Flag (bit 2):
+		 *      - set  : the Double Ratchet packet is encrypted using ChaCha20-Poly1305
+		 *      - unset: the Double Ratchet packet is encrypted using AES256-GCM
+		 *
 		 * Payload_Direct_Encryptiun Flag (bit 1):
 		 *      - set  : the Double Ratchet packet encrypts the user plaintext
 		 *      - unset: the Double Ratchet packet encrypts a random seed used to encrypt the user plaintext
@@ -129,7 +167,13 @@ namespace lime {
 		 */
 		enum class DR_message_type : uint8_t{
 			X3DH_init_flag=0x01, /**< bit 0 */
-			payload_direct_encryption_flag=0x02 /**< bit 1 */
+			payload_direct_encryption_flag=0x02, /**< bit 1 */
+			DR_chacha20poly1305_flag=0x04, /**< bit 2 */
+			cipherMessage_chacha20poly1305_flag=0x08, /**< bit 3 */
+			cipherMessage_stream_flag=0x10, /**< bit 4 */
+			payload_compressed_flag=0x20, /**< bit 5 */
+			zlib_capable_flag=0x40, /**< bit 6 */
+			zstd_capable_flag=0x80 /**< bit 7 */
 		};
 
 		/** @brief haveOPk byte from X3DH init message mapping
@@ -234,7 +234,7 @@ int lime_ffi_is_user(lime_manager_t manager, const char *localDeviceId) {
 
 int lime_ffi_encryptOutBuffersMaximumSize(const size_t plainMessageSize, const enum lime_ffi_CurveId curve, size_t *DRmessageSize, size_t *cipherMessageSize) {
 	/* cipherMessage maximum size is plain message size + auth tag size */
-	*cipherMessageSize = plainMessageSize + lime::settings::DRMessageAuthTagSize;
+	*cipherMessageSize = LimeManager::cipherMessageMaximumSize(plainMessageSize);
 
 	/* DRmessage maximum size is :
 	 * DRmessage header size + X3DH init size + MAX(plain message size, RandomSeed Size) + auth tag size */
@@ -343,12 +343,13 @@ enum lime_ffi_PeerDeviceStatus lime_ffi_decrypt(lime_manager_t manager, const ch
 		uint8_t *const plainMessage, size_t *plainMessageSize) {
 
 	try {
-		std::vector<uint8_t> l_plainMessage{};
-		auto ret = manager->context->decrypt(std::string(localDeviceId), std::string(recipientUserId), std::string(senderDeviceId), std::vector<uint8_t>(DRmessage, DRmessage+DRmessageSize), std::vector<uint8_t>(cipherMessage, cipherMessage+cipherMessageSize), l_plainMessage);
+		// decrypt directly from and to the caller buffers
+		size_t l_plainMessageSize = 0;
+		auto ret = manager->context->decrypt(std::string(localDeviceId), std::string(recipientUserId), std::string(senderDeviceId), lime::span<const uint8_t>(DRmessage, DRmessageSize), lime::span<const uint8_t>(cipherMessage, cipherMessageSize), lime::span<uint8_t>(plainMessage, *plainMessageSize), l_plainMessageSize);
 
-		if (l_plainMessage.size()<=*plainMessageSize) {
-			std::copy_n(l_plainMessage.data(), l_plainMessage.size(), plainMessage);
-			*plainMessageSize = l_plainMessage.size();
+		// on success, or on failure because the buffer is too small, give back the size of the plaintext
+		if (ret != lime::PeerDeviceStatus::fail || l_plainMessageSize > *plainMessageSize) {
+			*plainMessageSize = l_plainMessageSize;
 		}
 		return lime2ffi_PeerDeviceStatus(ret);
 	} catch (BctbxException const &e) {
@@ -22,8 +22,10 @@
 #include <memory>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <queue>
 #include <mutex>
+#include <chrono>
 
 #include "lime/lime.hpp"
 #include "lime_lime.hpp"
@@ -53,6 +55,7 @@ namespace lime {
 
 			/* X3DH keys */
 			DSApair<Curve> m_Ik; // our identity key pair, is loaded from DB only if requested(to sign a SPK or to perform X3DH init)
+			Xpair<Curve> m_Ik_X; // our identity key pair converted to key exchange format, computed when m_Ik is loaded
 			bool m_Ik_loaded; // did we load the Ik yet?
 
 			/* local storage related */
@@ -64,8 +67,20 @@ namespace lime {
 			std::string m_X3DH_Server_URL; // url of x3dh key server
 
 			/* Double ratchet related */
+			lime::AEADAlgorithm m_AEAD; // AEAD scheme used by the sessions we initiate
 			std::unordered_map<std::string, std::shared_ptr<DR<Curve>>> m_DR_sessions_cache; // store already loaded DR session
 
+			/* X3DH related */
+			std::unordered_map<std::string, std::chrono::steady_clock::time_point> m_noBundle_cache; // peer devices the X3DH server has no key bundle for, mapped to the expiration of this information
+			std::unordered_set<std::string> m_renewal_requested; // peer devices we requested a key bundle for in background to renew their session
+			std::unordered_map<long int, std::pair<DSA<Curve, lime::DSAtype::publicKey>, X<Curve, lime::Xtype::publicKey>>> m_peerIk_X_cache; // peer devices Ik and their conversion to key exchange format, indexed by peer device Id in local storage
+			std::unordered_map<uint32_t, std::chrono::steady_clock::time_point> m_OPk_consumption; // our OPks dispatched by the X3DH server during the last settings::OPk_consumptionWindow, mapped to the time we noticed it
+			size_t m_OPk_serverCount; // estimation of our OPk count on X3DH server: the last count retrieved minus the consumption noticed since
+			bool m_OPk_serverCount_known; // false until we retrieved our OPk count from X3DH server
+			std::chrono::steady_clock::time_point m_OPk_lastCheck; // the last time we asked the X3DH server for our OPk count
+			uint16_t m_OPk_serverLowLimit; // the OPk server low limit given to the last update_OPk, 0 until one is performed
+			uint16_t m_OPk_batchSize; // the OPk batch size given to the last update_OPk
+
 			/* encryption queue: encryption requesting asynchronous operation(connection to X3DH server) are queued to avoid repeating a request to server */
 			std::shared_ptr<callbackUserData<Curve>> m_ongoing_encryption;
 			std::queue<std::shared_ptr<callbackUserData<Curve>>> m_encryption_queue;
@@ -80,6 +95,10 @@ namespace lime {
 			void get_SelfIdentityKey(); // check our Identity key pair is loaded in Lime object, retrieve it from DB if it isn't
 			void cache_DR_sessions(std::vector<RecipientInfos<Curve>> &internal_recipients, std::vector<std::string> &missing_devices); // loop on internal recipient an try to load in DR session cache the one which have no session attached 
 			void get_DRSessions(const std::string &senderDeviceId, const long int ignoreThisDRSessionId, std::vector<std::shared_ptr<DR<Curve>>> &DRSessions); // load from local storage in DRSessions all DR session matching the peerDeviceId, ignore the one picked by id in 2nd arg
+			void noBundle_cache_load(); // load from local storage the peer devices without key bundle which are still in the negative cache TTL
+			void noBundle_cache_insert(const std::string &peerDeviceId); // the X3DH server has no key bundle for this peer device, do not ask again before settings::noBundle_cacheTTL
+			void noBundle_cache_erase(const std::string &peerDeviceId); // remove a peer device from the negative cache, it proved to have keys
+			bool noBundle_cache_find(const std::string &peerDeviceId); // is this peer device in the negative cache and the information not expired yet
 
 			/* X3DH related  - part related to exchange with server or localStorage - implemented in lime_x3dh_protocol.cpp or lime_localStorage.cpp */
 			void X3DH_generate_SPk(X<Curve, lime::Xtype::publicKey> &publicSPk, DSA<Curve, lime::DSAtype::signature> &SPk_sig, uint32_t &SPk_id, const bool load=false); // generate a new Signed Pre-Key key pair, store it in DB and set its public key, signature and Id in given params
@@ -88,9 +107,22 @@ namespace lime {
 			bool is_currentSPk_valid(void); // check validity of current SPk
 			void X3DH_get_OPk(uint32_t OPk_id, Xpair<Curve> &OPk); // retrieve matching OPk from localStorage, throw an exception if not found
 			void X3DH_updateOPkStatus(const std::vector<uint32_t> &OPkIds); // update OPks to tag those not anymore on X3DH server but not used and destroyed yet
+			void X3DH_get_activeOPkIds(std::vector<uint32_t> &OPkIds); // get the ids of our OPks not known yet to have been dispatched by X3DH server
+			/* OPk replenishment related, implemented in lime_x3dh_protocol.cpp */
+			void OPk_consumption_record(const uint32_t OPkId); // record the consumption of one of our OPks
+			size_t OPk_expectedConsumption(void); // estimate how many OPks will be consumed during the next settings::OPk_updatePeriod
+			uint16_t OPk_replenishCount(const size_t serverCount, const uint16_t OPkServerLowLimit, const uint16_t OPkBatchSize); // how many OPks shall we upload to server
+			bool OPk_replenishNeeded(void); // shall we check our OPk count on server before the next periodic update
 			/* X3DH related  - part related to X3DH DR session initiation, implemented in lime_x3dh.cpp */
-			void X3DH_init_sender_session(const std::vector<X3DH_peerBundle<Curve>> &peersBundle); // compute a sender X3DH using the data from peer bundle, then create and load the DR_Session
-			std::shared_ptr<DR<Curve>> X3DH_init_receiver_session(const std::vector<uint8_t> X3DH_initMessage, const std::string &senderDeviceId); // from received X3DH init packet, try to compute the shared secrets, then create the DR_Session
+			void X3DH_init_sender_session(const std::vector<X3DH_peerBundle<Curve>> &peersBundle, const bool renewal=false); // compute a sender X3DH using the data from peer bundle, then create and load the DR_Session
+			std::shared_ptr<DR<Curve>> X3DH_init_receiver_session(const lime::span<const uint8_t> X3DH_initMessage, const std::string &senderDeviceId, uint32_t &OPk_id); // from received X3DH init packet, try to compute the shared secrets, then create the DR_Session, OPk_id is the one of our OPk it used(0 if none)
+			bool peerIk_X_cache_find(const long int peerDid, const DSA<Curve, lime::DSAtype::publicKey> &peerIk, X<Curve, lime::Xtype::publicKey> &peerIk_X); // get the key exchange format of a peer device Ik if we already converted it
+			void peerIk_X_cache_insert(const long int peerDid, const DSA<Curve, lime::DSAtype::publicKey> &peerIk, const X<Curve, lime::Xtype::publicKey> &peerIk_X); // store the key exchange format of a peer device Ik
+
+			/* encryption related, implemented in lime.cpp */
+			void process_encrypt(std::shared_ptr<callbackUserData<Curve>> userData); // encrypt the request held by userData, queue it or fetch missing key bundles if needed
+			template <typename decryptFunction>
+			lime::PeerDeviceStatus process_decrypt(const std::string &recipientUserId, const std::string &senderDeviceId, const lime::span<const uint8_t> DRmessage, const decryptFunction &decrypt); // find or create the DR session decrypting the message, decrypt does the actual decryption
 
 			/* network related, implemented in lime_x3dh_protocol.cpp */
 			void postToX3DHServer(std::shared_ptr<callbackUserData<Curve>> userData, const std::vector<uint8_t> &message); // send a request to X3DH server
@@ -99,7 +131,7 @@ namespace lime {
 
 		public: /* Implement API defined in lime_lime.hpp in LimeGeneric abstract class */
 			Lime(std::shared_ptr<lime::Db> localStorage, const std::string &deviceId, const std::string &url, const limeX3DHServerPostData &X3DH_post_data);
-			Lime(std::shared_ptr<lime::Db> localStorage, const std::string &deviceId, const std::string &url, const limeX3DHServerPostData &X3DH_post_data, const long int Uid);
+			Lime(std::shared_ptr<lime::Db> localStorage, const std::string &deviceId, const std::string &url, const limeX3DHServerPostData &X3DH_post_data, const long int Uid, const lime::AEADAlgorithm AEAD);
 			~Lime();
 			Lime(Lime<Curve> &a) = delete; // can't copy a session, force usage of shared pointers
 			Lime<Curve> &operator=(Lime<Curve> &a) = delete; // can't copy a session
@@ -109,10 +141,16 @@ namespace lime {
 			void update_SPk(const limeCallback &callback) override;
 			void update_OPk(const limeCallback &callback, uint16_t OPkServerLowLimit, uint16_t OPkBatchSize) override;
 			void get_Ik(std::vector<uint8_t> &Ik) override;
-			void encrypt(std::shared_ptr<const std::string> recipientUserId, std::shared_ptr<std::vector<RecipientData>> recipients, std::shared_ptr<const std::vector<uint8_t>> plainMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<std::vector<uint8_t>> cipherMessage, const limeCallback &callback) override;
-			lime::PeerDeviceStatus decrypt(const std::string &recipientUserId, const std::string &senderDeviceId, const std::vector<uint8_t> &DRmessage, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plainMessage) override;
+			void encrypt(std::shared_ptr<const std::string> recipientUserId, std::shared_ptr<std::vector<RecipientData>> recipients, std::shared_ptr<const std::vector<uint8_t>> plainMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<std::vector<uint8_t>> cipherMessage, const limeCallback &callback, const limeRecipientCallback &recipientCallback) override;
+			void encrypt(const std::string &recipientUserId, lime::span<RecipientData> recipients, lime::span<const uint8_t> plainMessage, const lime::EncryptionPolicy encryptionPolicy, lime::span<uint8_t> cipherMessage, size_t &cipherMessageSize, const limeCallback &callback, const limeRecipientCallback &recipientCallback) override;
+			lime::PeerDeviceStatus decrypt(const std::string &recipientUserId, const std::string &senderDeviceId, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, std::vector<uint8_t> &plainMessage) override;
+			lime::PeerDeviceStatus decrypt(const std::string &recipientUserId, const std::string &senderDeviceId, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, lime::span<uint8_t> plainMessage, size_t &plainMessageSize) override;
+			std::shared_ptr<lime::CipherStream> encrypt_stream(std::shared_ptr<const std::string> recipientUserId, std::shared_ptr<std::vector<RecipientData>> recipients, const limeCallback &callback) override;
+			lime::PeerDeviceStatus decrypt_stream(const std::string &recipientUserId, const std::string &senderDeviceId, const lime::span<const uint8_t> DRmessage, std::shared_ptr<lime::CipherStream> &cipherStream) override;
 			void set_x3dhServerUrl(const std::string &x3dhServerUrl) override;
 			std::string get_x3dhServerUrl() override;
+			void set_AEADAlgorithm(const lime::AEADAlgorithm algorithm) override;
+			lime::AEADAlgorithm get_AEADAlgorithm() override;
 			void stale_sessions(const std::string &peerDeviceId) override;
 	};
 
@@ -125,16 +163,32 @@ namespace lime {
 		std::weak_ptr<Lime<Curve>> limeObj;
 		/// is a lambda closure, not real idea of what is its lifetime but it seems ok to hold it this way
 		const limeCallback callback;
-		/// Recipient username. Needed for encryption: get a shared ref to keep params alive
-		std::shared_ptr<const std::string> recipientUserId;
-		/// Recipient data vector. Needed for encryption: get a shared ref to keep params alive
-		std::shared_ptr<std::vector<RecipientData>> recipients;
-		/// plaintext. Needed for encryption: get a shared ref to keep params alive
-		std::shared_ptr<const std::vector<uint8_t>> plainMessage;
-		/// ciphertext buffer. Needed for encryption: get a shared ref to keep params alive
-		std::shared_ptr<std::vector<uint8_t>> cipherMessage;
+		/// per recipient result callback from the original encryption request, may be empty
+		const limeRecipientCallback recipientCallback;
+		/// Recipient username. Needed for encryption: points to the string given to encrypt, nullptr when not running an encryption request
+		const std::string *recipientUserId;
+		/// Recipient data. Needed for encryption: view on the buffer given to encrypt
+		lime::span<RecipientData> recipients;
+		/// plaintext. Needed for encryption: view on the buffer given to encrypt
+		lime::span<const uint8_t> plainMessage;
+		/// ciphertext buffer. Needed for encryption: provides the buffer given to encrypt, nullptr when the cipherMessage is streamed
+		const cipherMessageOutput cipherMessage;
+		/// When encrypt was given shared pointers: get a shared ref to keep params alive. Left empty when the caller guarantees the buffers lifetime
+		std::shared_ptr<const std::string> recipientUserIdOwner;
+		/// When encrypt was given shared pointers: get a shared ref to keep params alive
+		std::shared_ptr<std::vector<RecipientData>> recipientsOwner;
+		/// When encrypt was given shared pointers: get a shared ref to keep params alive
+		std::shared_ptr<const std::vector<uint8_t>> plainMessageOwner;
+		/// When encrypt was given shared pointers: get a shared ref to keep params alive
+		std::shared_ptr<std::vector<uint8_t>> cipherMessageOwner;
 		/// the encryption policy from the original encryption request(if running an encryption request), copy its value instead of holding a shared_ptr on it
 		lime::EncryptionPolicy encryptionPolicy;
+		/// When part of the recipients are encrypted before the key bundles for the others arrive, the context shared by both passes (same cipherMessage)
+		std::unique_ptr<EncryptionContext> encryptionContext;
+		/// Recipients already encrypted by a previous pass, indexed as recipients
+		std::vector<bool> encryptedRecipients;
+		/// Peer devices a background session renewal request fetches key bundles for, their renewal flag is cleared when the request ends
+		std::vector<std::string> renewalDevices;
 		/// Used when fetching from server self OPk to check if we shall upload more
 		uint16_t OPkServerLowLimit;
 		/// Used when fetching from server self OPk : how many will we upload if needed
@@ -142,24 +196,46 @@ namespace lime {
 
 		/// created at user create/delete and keys Post. EncryptionPolicy is not used, set it to the default value anyway
 		callbackUserData(std::weak_ptr<Lime<Curve>> thiz, const limeCallback &callbackRef, uint16_t OPkInitialBatchSize=lime::settings::OPk_initialBatchSize)
-			: limeObj{thiz}, callback{callbackRef},
-			recipientUserId{nullptr}, recipients{nullptr}, plainMessage{nullptr}, cipherMessage{nullptr},
-			encryptionPolicy(lime::EncryptionPolicy::optimizeUploadSize), OPkServerLowLimit(0), OPkBatchSize(OPkInitialBatchSize) {};
+			: limeObj{thiz}, callback{callbackRef}, recipientCallback{nullptr},
+			recipientUserId{nullptr}, recipients{}, plainMessage{}, cipherMessage{nullptr},
+			recipientUserIdOwner{nullptr}, recipientsOwner{nullptr}, plainMessageOwner{nullptr}, cipherMessageOwner{nullptr},
+			encryptionPolicy(lime::EncryptionPolicy::optimizeUploadSize), encryptionContext{nullptr}, encryptedRecipients{}, renewalDevices{}, OPkServerLowLimit(0), OPkBatchSize(OPkInitialBatchSize) {};
 
 		/// created at update: getSelfOPks. EncryptionPolicy is not used, set it to the default value anyway
 		callbackUserData(std::weak_ptr<Lime<Curve>> thiz, const limeCallback &callbackRef, uint16_t OPkServerLowLimit, uint16_t OPkBatchSize)
-			: limeObj{thiz}, callback{callbackRef},
-			recipientUserId{nullptr}, recipients{nullptr}, plainMessage{nullptr}, cipherMessage{nullptr},
-			encryptionPolicy(lime::EncryptionPolicy::optimizeUploadSize), OPkServerLowLimit{OPkServerLowLimit}, OPkBatchSize{OPkBatchSize} {};
+			: limeObj{thiz}, callback{callbackRef}, recipientCallback{nullptr},
+			recipientUserId{nullptr}, recipients{}, plainMessage{}, cipherMessage{nullptr},
+			recipientUserIdOwner{nullptr}, recipientsOwner{nullptr}, plainMessageOwner{nullptr}, cipherMessageOwner{nullptr},
+			encryptionPolicy(lime::EncryptionPolicy::optimizeUploadSize), encryptionContext{nullptr}, encryptedRecipients{}, renewalDevices{}, OPkServerLowLimit{OPkServerLowLimit}, OPkBatchSize{OPkBatchSize} {};
 
-		/// created at encrypt(getPeerBundle)
+		/// created at encrypt
 		callbackUserData(std::weak_ptr<Lime<Curve>> thiz, const limeCallback &callbackRef,
 				std::shared_ptr<const std::string> recipientUserId, std::shared_ptr<std::vector<RecipientData>> recipients,
 				std::shared_ptr<const std::vector<uint8_t>> plainMessage, std::shared_ptr<std::vector<uint8_t>> cipherMessage,
-				lime::EncryptionPolicy policy)
-			: limeObj{thiz}, callback{callbackRef},
-			recipientUserId{recipientUserId}, recipients{recipients}, plainMessage{plainMessage}, cipherMessage{cipherMessage}, // copy construct all shared_ptr
-			encryptionPolicy(policy), OPkServerLowLimit(0), OPkBatchSize(0) {};
+				lime::EncryptionPolicy policy, const limeRecipientCallback &recipientCallbackRef)
+			: limeObj{thiz}, callback{callbackRef}, recipientCallback{recipientCallbackRef},
+			recipientUserId{recipientUserId.get()}, recipients{*recipients},
+			plainMessage{plainMessage ? lime::span<const uint8_t>{*plainMessage} : lime::span<const uint8_t>{}},
+			cipherMessage{cipherMessage ? cipherMessageOutput{[cipherMessage = cipherMessage.get()](const size_t size) {cipherMessage->resize(size); return cipherMessage->data();}} : nullptr},
+			recipientUserIdOwner{recipientUserId}, recipientsOwner{recipients}, plainMessageOwner{plainMessage}, cipherMessageOwner{cipherMessage}, // copy construct all shared_ptr
+			encryptionPolicy(policy), encryptionContext{nullptr}, encryptedRecipients(recipients->size(), false), renewalDevices{}, OPkServerLowLimit(0), OPkBatchSize(0) {};
+
+		/// created at encrypt on buffers borrowed from the caller, the cipherMessage buffer is large enough for any encryption mode(see LimeManager::cipherMessageMaximumSize)
+		callbackUserData(std::weak_ptr<Lime<Curve>> thiz, const limeCallback &callbackRef,
+				const std::string &recipientUserId, lime::span<RecipientData> recipients,
+				lime::span<const uint8_t> plainMessage, lime::span<uint8_t> cipherMessage, size_t &cipherMessageSize,
+				lime::EncryptionPolicy policy, const limeRecipientCallback &recipientCallbackRef)
+			: limeObj{thiz}, callback{callbackRef}, recipientCallback{recipientCallbackRef},
+			recipientUserId{&recipientUserId}, recipients{recipients}, plainMessage{plainMessage},
+			cipherMessage{[cipherMessage, &cipherMessageSize](const size_t size) {
+				if (size > cipherMessage.size()) {
+					return static_cast<uint8_t *>(nullptr);
+				}
+				cipherMessageSize = size;
+				return cipherMessage.data();
+			}},
+			recipientUserIdOwner{nullptr}, recipientsOwner{nullptr}, plainMessageOwner{nullptr}, cipherMessageOwner{nullptr},
+			encryptionPolicy(policy), encryptionContext{nullptr}, encryptedRecipients(recipients.size(), false), renewalDevices{}, OPkServerLowLimit(0), OPkBatchSize(0) {};
 
 		/// do not copy callback data, force passing the pointer around after creation
 		callbackUserData(callbackUserData &a) = delete;
@@ -86,6 +86,18 @@ namespace lime {
 		/// we use authentication tag size of 16 bytes
 		static constexpr size_t tagSize(void) {return 16;};
 	};
+
+	/**
+	 * @brief CHACHA20POLY1305 (RFC 8439) buffers size definition
+	 */
+	struct CHACHA20POLY1305 {
+		/// key size is 32 bytes
+		static constexpr size_t keySize(void) {return 32;};
+		/// authentication tag size is 16 bytes
+		static constexpr size_t tagSize(void) {return 16;};
+		/// nonce size is 12 bytes, when a longer IV is given only its first 12 bytes are used
+		static constexpr size_t nonceSize(void) {return 12;};
+	};
 }
 
 #endif /* lime_keys_hpp */
@@ -72,8 +72,25 @@ namespace lime {
 		 * 					this callback will be called giving the exit status and an error message in case of failure.
 		 * 					It is advised to capture a copy of cipherMessage and recipients shared_ptr in this callback so they can access
 		 * 					the output of encryption as it won't be part of the callback parameters.
+		 * @param[in]		recipientCallback	if not null, called for each recipient as soon as its DR message is ready, before the final callback.
+		 * 					Recipients with a ready session are then encrypted without waiting for the key bundles needed by the others
 		*/
-		virtual void encrypt(std::shared_ptr<const std::string> recipientUserId, std::shared_ptr<std::vector<RecipientData>> recipients, std::shared_ptr<const std::vector<uint8_t>> plainMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<std::vector<uint8_t>> cipherMessage, const limeCallback &callback) = 0;
+		virtual void encrypt(std::shared_ptr<const std::string> recipientUserId, std::shared_ptr<std::vector<RecipientData>> recipients, std::shared_ptr<const std::vector<uint8_t>> plainMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<std::vector<uint8_t>> cipherMessage, const limeCallback &callback, const limeRecipientCallback &recipientCallback) = 0;
+		/**
+		 * @brief Encrypt a buffer(text or file) for a given list of recipient devices, borrowing the caller buffers
+		 *
+		 * Same as the other encrypt form but the parameters are accessed in place: the caller guarantees they stay valid until the callback is called
+		 *
+		 * @param[in]		recipientUserId		the Id of intended recipient, see encrypt
+		 * @param[in,out]	recipients		view on the caller list of RecipientData, see encrypt
+		 * @param[in]		plainMessage		view on the caller buffer holding the message to encrypt
+		 * @param[in]		encryptionPolicy	select how to manage the encryption, see encrypt
+		 * @param[out]		cipherMessage		the caller buffer to store the encrypted message, see encrypt. When smaller than LimeManager::cipherMessageMaximumSize, the encryption fails
+		 * @param[out]		cipherMessageSize	the size of the cipherMessage written in the caller buffer, or the size needed when it is too small
+		 * @param[in]		callback		called once the encryption to all recipients is completed, see encrypt
+		 * @param[in]		recipientCallback	if not null, called for each recipient as soon as its Double Ratchet message is ready, see encrypt
+		*/
+		virtual void encrypt(const std::string &recipientUserId, lime::span<RecipientData> recipients, lime::span<const uint8_t> plainMessage, const lime::EncryptionPolicy encryptionPolicy, lime::span<uint8_t> cipherMessage, size_t &cipherMessageSize, const limeCallback &callback, const limeRecipientCallback &recipientCallback) = 0;
 
 		/**
 		 * @brief Decrypt the given message
@@ -87,7 +104,48 @@ namespace lime {
 		 *
 		 * @return	true if the decryption is successfull, false otherwise
 		*/
-		virtual lime::PeerDeviceStatus decrypt(const std::string &recipientUserId, const std::string &senderDeviceId, const std::vector<uint8_t> &DRmessage, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plainMessage) = 0;
+		virtual lime::PeerDeviceStatus decrypt(const std::string &recipientUserId, const std::string &senderDeviceId, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, std::vector<uint8_t> &plainMessage) = 0;
+		/**
+		 * @brief Decrypt the given message in a caller buffer
+		 *
+		 * Same as the other decrypt form but the plaintext is deciphered in place in the caller buffer
+		 *
+		 * @param[in]	recipientUserId	the Id of intended recipient, see decrypt
+		 * @param[in]	senderDeviceId	the device Id (GRUU) of the message sender
+		 * @param[in]	DRmessage	the Double Ratchet message targeted to current device
+		 * @param[in]	cipherMessage	part of cipher routed to all recipient devices, see decrypt
+		 * @param[out]	plainMessage	the caller buffer: a larger plaintext fails to decrypt before the message key is consumed
+		 * @param[out]	plainMessageSize	the size of the plaintext, or the size needed when it is larger than plainMessage
+		 *
+		 * @return	fail if we cannot decrypt the message, the sender device status otherwise
+		*/
+		virtual lime::PeerDeviceStatus decrypt(const std::string &recipientUserId, const std::string &senderDeviceId, const lime::span<const uint8_t> DRmessage, const lime::span<const uint8_t> cipherMessage, lime::span<uint8_t> plainMessage, size_t &plainMessageSize) = 0;
+
+		/**
+		 * @brief Encrypt by chunks a message too large to be held in memory for a given list of recipient devices
+		 *
+		 * The random seed used to encrypt the cipherMessage is generated and encrypted to the recipients as in encrypt,
+		 * the cipherMessage is produced by the returned stream, it does not depend on the encryption to the recipients and can start right away.
+		 *
+		 * @param[in]		recipientUserId		the Id of intended recipient, shall be a sip:uri of user or conference, is used as associated data to ensure no-one can mess with intended recipient
+		 * @param[in,out]	recipients		a list of RecipientData, see encrypt
+		 * @param[in]		callback		called once the DR messages of all recipients are produced, see encrypt
+		 *
+		 * @return the stream producing the cipherMessage
+		*/
+		virtual std::shared_ptr<lime::CipherStream> encrypt_stream(std::shared_ptr<const std::string> recipientUserId, std::shared_ptr<std::vector<RecipientData>> recipients, const limeCallback &callback) = 0;
+
+		/**
+		 * @brief Decrypt the Double Ratchet message of a message whose cipherMessage is encrypted by chunks
+		 *
+		 * @param[in]	recipientUserId	the Id of intended recipient, shall be a sip:uri of user or conference, is used as associated data to ensure no-one can mess with intended recipient
+		 * @param[in]	senderDeviceId	the device Id (GRUU) of the message sender
+		 * @param[in]	DRmessage	the Double Ratchet message targeted to current device
+		 * @param[out]	cipherStream	on success, the stream decrypting the cipherMessage
+		 *
+		 * @return	fail if we cannot decrypt the DR message, the sender device status otherwise
+		*/
+		virtual lime::PeerDeviceStatus decrypt_stream(const std::string &recipientUserId, const std::string &senderDeviceId, const lime::span<const uint8_t> DRmessage, std::shared_ptr<lime::CipherStream> &cipherStream) = 0;
 
 
 
@@ -157,6 +215,20 @@ namespace lime {
 		 */
 		virtual std::string get_x3dhServerUrl() = 0;
 
+		/**
+		 * @brief Set the AEAD scheme used by the sessions this user initiates from now on
+		 *
+		 * @param[in]	algorithm		The AEAD scheme to use in new sessions
+		 */
+		virtual void set_AEADAlgorithm(const lime::AEADAlgorithm algorithm) = 0;
+
+		/**
+		 * @brief Get the AEAD scheme used by the sessions this user initiates
+		 *
+		 * @return The AEAD scheme used in new sessions
+		 */
+		virtual lime::AEADAlgorithm get_AEADAlgorithm() = 0;
+
 		/**
 		 * @brief Stale all sessions between localDeviceId and peerDevice.
 		 * If peerDevice keep using this session to encrypt and we decrypt with success, the session will be reactivated
@@ -75,8 +75,24 @@ Db::Db(const std::string &filename, std::shared_ptr<std::recursive_mutex> db_mut
 			sql<<"INSERT INTO db_module_version(name,version) VALUES('lime',:DbVersion)", use(lime::settings::DBuserVersion);
 		} else { // and we had an older version
 			/* Do the update here */
-			sql<<"ALTER TABLE lime_LocalUsers ADD COLUMN updateTs DATETIME";
-			sql<<"UPDATE lime_LocalUsers SET updateTs = CURRENT_TIMESTAMP";
+			if (userVersion < 0x000100) { // version 0.1.0 added the update timestamp
+				sql<<"ALTER TABLE lime_LocalUsers ADD COLUMN updateTs DATETIME";
+				sql<<"UPDATE lime_LocalUsers SET updateTs = CURRENT_TIMESTAMP";
+			}
+			if (userVersion < 0x000101) { // version 0.1.1 added the peer devices without key bundle table
+				sql<<"CREATE TABLE lime_NoBundlePeerDevices( \
+							Uid INTEGER NOT NULL, \
+							DeviceId TEXT NOT NULL, \
+							timeStamp DATETIME DEFAULT CURRENT_TIMESTAMP, \
+							PRIMARY KEY(Uid, DeviceId), \
+							FOREIGN KEY(Uid) REFERENCES lime_LocalUsers(Uid) ON UPDATE CASCADE ON DELETE CASCADE);";
+			}
+			if (userVersion < 0x000102) { // version 0.1.2 added the AEAD scheme selection, existing sessions keep AES256-GCM
+				sql<<"ALTER TABLE DR_sessions ADD COLUMN AEAD INTEGER NOT NULL DEFAULT 0";
+			}
+			if (userVersion < 0x000103) { // version 0.1.3 added the peer compression capabilities, unknown until the peer sends a message
+				sql<<"ALTER TABLE DR_sessions ADD COLUMN Compression INTEGER NOT NULL DEFAULT 0";
+			}
 			// update version number
 			sql<<"UPDATE db_module_version SET version = :DbVersion WHERE name='lime'", use(lime::settings::DBuserVersion);
 			tr.commit(); // commit all the previous queries
@@ -99,6 +115,8 @@ Db::Db(const std::string &filename, std::shared_ptr<std::recursive_mutex> db_mut
 		*  - Status : 0 is for stale and 1 is for active, only one session shall be active for a peer device, by default created as active
 		*  - timeStamp : is updated when session change status and is used to remove stale session after determined time in cleaning operation
 		*  - X3DHInit : when we are initiator, store the generated X3DH init message and keep sending it until we've got at least a reply from peer
+		*  - AEAD : the AEAD scheme used to encrypt the messages of this session, mapped in lime.hpp by the AEADAlgorithm enum class
+		*  - Compression : the compression capability flags advertised by the peer in the last message decrypted with this session, see double_ratchet_protocol::compressionCapabilityFlag
 		*/
 		sql<<"CREATE TABLE DR_sessions( \
 					Did INTEGER NOT NULL DEFAULT 0, \
@@ -116,6 +134,8 @@ Db::Db(const std::string &filename, std::shared_ptr<std::recursive_mutex> db_mut
 					Status INTEGER NOT NULL DEFAULT 1, \
 					timeStamp DATETIME DEFAULT CURRENT_TIMESTAMP, \
 					X3DHInit BLOB DEFAULT NULL, \
+					AEAD INTEGER NOT NULL DEFAULT 0, \
+					Compression INTEGER NOT NULL DEFAULT 0, \
 					FOREIGN KEY(Did) REFERENCES lime_PeerDevices(Did) ON UPDATE CASCADE ON DELETE CASCADE, \
 					FOREIGN KEY(Uid) REFERENCES lime_LocalUsers(Uid) ON UPDATE CASCADE ON DELETE CASCADE);";
 	
@@ -152,8 +172,8 @@ Db::Db(const std::string &filename, std::shared_ptr<std::recursive_mutex> db_mut
 		*  - Ik : public||private indentity key (EdDSA key)
 		*  - server : the URL of key Server
 		*  - curveId : identifies the curve used by this user - MUST be in sync with server. This integer stores also the activation byte.
-		*  		Mapping is: <Activation byte>||<CurveId byte>
-		*  		Activation byte is: 0x00 Active, 0x01 inactive
+		*  		Mapping is: <Flags byte>||<CurveId byte>
+		*  		Flags byte is: bit 0 set when inactive, bit 1 set when initiating sessions using ChaCha20-Poly1305 instead of AES256-GCM
 		*  		CurveId byte: as set in lime.hpp
 		*  		default the curveId value to 0 which is not one of the possible values (defined in lime.hpp)
 		*  - updateTs : Last update timestamp. When was performed an update operation for this user.
@@ -185,6 +205,18 @@ Db::Db(const std::string &filename, std::shared_ptr<std::recursive_mutex> db_mut
 					Ik BLOB NOT NULL, \
 					Status UNSIGNED INTEGER DEFAULT 0);";
 	
+		/* Peer Devices without key bundle : negative cache of the key bundle requests to the X3DH server
+		* - Uid : the local user who requested the key bundle, the answer depends on its X3DH server
+		* - DeviceId : peer device id (shall be its GRUU)
+		* - timeStamp : when the X3DH server answered it has no key bundle for this device, the entry expires after settings::noBundle_cacheTTL
+		*/
+		sql<<"CREATE TABLE lime_NoBundlePeerDevices( \
+					Uid INTEGER NOT NULL, \
+					DeviceId TEXT NOT NULL, \
+					timeStamp DATETIME DEFAULT CURRENT_TIMESTAMP, \
+					PRIMARY KEY(Uid, DeviceId), \
+					FOREIGN KEY(Uid) REFERENCES lime_LocalUsers(Uid) ON UPDATE CASCADE ON DELETE CASCADE);";
+
 		/*** X3DH tables ***/
 		/* Signed pre-key :
 		* - SPKid : the primary key must be a random number as it is public, so avoid leaking information on number of key used
@@ -232,10 +264,11 @@ Db::Db(const std::string &filename, std::shared_ptr<std::recursive_mutex> db_mut
  * @param[out]	Uid		the DB internal Id matching given userId (if find in DB, 0 if not find, -1 if found but not active)
  * @param[out]	curveId		the curve selected at user creation
  * @param[out]	url		the url of the X3DH server this user is registered on
+ * @param[out]	AEAD		the AEAD scheme used by the sessions this user initiates
  * @param[in]	allStatus	allow loading of inactive user if set to true(default is false)
  *
  */
-void Db::load_LimeUser(const std::string &deviceId, long int &Uid, lime::CurveId &curveId, std::string &url, const bool allStatus)
+void Db::load_LimeUser(const std::string &deviceId, long int &Uid, lime::CurveId &curveId, std::string &url, lime::AEADAlgorithm &AEAD, const bool allStatus)
 {
 	std::lock_guard<std::recursive_mutex> lock(*m_db_mutex);
 	int curve=0;
@@ -250,6 +283,8 @@ void Db::load_LimeUser(const std::string &deviceId, long int &Uid, lime::CurveId
 			}
 		}
 
+		AEAD = (curve&lime::settings::DBChaCha20Poly1305UserBit) ? lime::AEADAlgorithm::chacha20poly1305 : lime::AEADAlgorithm::aes256gcm;
+
 		// turn back integer value retrieved from DB into a lime::CurveId
 		switch (curve&lime::settings::DBCurveIdByte) {
 			case static_cast<uint8_t>(lime::CurveId::c25519):
@@ -594,6 +629,7 @@ void Db::set_updateTs(const std::string &deviceId) {
 void Db::delete_peerDevice(const std::string &peerDeviceId) {
 	std::lock_guard<std::recursive_mutex> lock(*m_db_mutex);
 	sql<<"DELETE FROM lime_peerDevices WHERE DeviceId = :peerDeviceId;", use(peerDeviceId);
+	sql<<"DELETE FROM lime_NoBundlePeerDevices WHERE DeviceId = :peerDeviceId;", use(peerDeviceId);
 }
 
 /**
@@ -772,6 +808,8 @@ bool DR<Curve>::session_save(bool commit) { // commit default to true
 			/* this one is written in base only at creation and never updated again */
 			blob AD(m_localStorage->sql);
 			AD.write(0, (char *)(m_sharedAD.data()), m_sharedAD.size());
+			int AEAD = static_cast<uint8_t>(m_AEAD);
+			int compression = m_peerCompression;
 
 			// Check if we have a peer device already in storage
 			if (m_peerDid == 0) { // no : we must insert it(failure will result in exception being thrown, let it flow up then)
@@ -784,9 +822,9 @@ bool DR<Curve>::session_save(bool commit) { // commit default to true
 			if (m_X3DH_initMessage.size()>0) {
 				blob X3DH_initMessage(m_localStorage->sql);
 				X3DH_initMessage.write(0, (char *)(m_X3DH_initMessage.data()), m_X3DH_initMessage.size());
-				m_localStorage->sql<<"INSERT INTO DR_sessions(Ns,Nr,PN,DHr,DHs,RK,CKs,CKr,AD,Did,Uid,X3DHInit) VALUES(:Ns,:Nr,:PN,:DHr,:DHs,:RK,:CKs,:CKr,:AD,:Did,:Uid,:X3DHinit);", use(m_Ns), use(m_Nr), use(m_PN), use(DHr), use(DHs), use(RK), use(CKs), use(CKr), use(AD), use(m_peerDid), use(m_db_Uid), use(X3DH_initMessage);
+				m_localStorage->sql<<"INSERT INTO DR_sessions(Ns,Nr,PN,DHr,DHs,RK,CKs,CKr,AD,Did,Uid,X3DHInit,AEAD,Compression) VALUES(:Ns,:Nr,:PN,:DHr,:DHs,:RK,:CKs,:CKr,:AD,:Did,:Uid,:X3DHinit,:AEAD,:Compression);", use(m_Ns), use(m_Nr), use(m_PN), use(DHr), use(DHs), use(RK), use(CKs), use(CKr), use(AD), use(m_peerDid), use(m_db_Uid), use(X3DH_initMessage), use(AEAD), use(compression);
 			} else {
-				m_localStorage->sql<<"INSERT INTO DR_sessions(Ns,Nr,PN,DHr,DHs,RK,CKs,CKr,AD,Did,Uid) VALUES(:Ns,:Nr,:PN,:DHr,:DHs,:RK,:CKs,:CKr,:AD,:Did,:Uid);", use(m_Ns), use(m_Nr), use(m_PN), use(DHr), use(DHs), use(RK), use(CKs), use(CKr), use(AD), use(m_peerDid), use(m_db_Uid);
+				m_localStorage->sql<<"INSERT INTO DR_sessions(Ns,Nr,PN,DHr,DHs,RK,CKs,CKr,AD,Did,Uid,AEAD,Compression) VALUES(:Ns,:Nr,:PN,:DHr,:DHs,:RK,:CKs,:CKr,:AD,:Did,:Uid,:AEAD,:Compression);", use(m_Ns), use(m_Nr), use(m_PN), use(DHr), use(DHs), use(RK), use(CKs), use(CKr), use(AD), use(m_peerDid), use(m_db_Uid), use(AEAD), use(compression);
 			}
 			// if insert went well we shall be able to retrieve the last insert id to save it in the Session object
 			/*** WARNING: unportable section of code, works only with sqlite3 backend ***/
@@ -826,7 +864,9 @@ bool DR<Curve>::session_save(bool commit) { // commit default to true
 					blob CKr(m_localStorage->sql);
 					CKr.write(0, (char *)(m_CKr.data()), m_CKr.size());
 
-					m_localStorage->sql<<"UPDATE DR_sessions SET Ns= :Ns, Nr= :Nr, PN= :PN, DHr= :DHr,DHs= :DHs, RK= :RK, CKs= :CKs, CKr= :CKr, Status = 1,  X3DHInit = NULL WHERE sessionId = :sessionId;", use(m_Ns), use(m_Nr), use(m_PN), use(DHr), use(DHs), use(RK), use(CKs), use(CKr), use(m_dbSessionId);
+					int compression = m_peerCompression;
+
+					m_localStorage->sql<<"UPDATE DR_sessions SET Ns= :Ns, Nr= :Nr, PN= :PN, DHr= :DHr,DHs= :DHs, RK= :RK, CKs= :CKs, CKr= :CKr, Status = 1,  X3DHInit = NULL, Compression= :Compression WHERE sessionId = :sessionId;", use(m_Ns), use(m_Nr), use(m_PN), use(DHr), use(DHs), use(RK), use(CKs), use(CKr), use(compression), use(m_dbSessionId);
 				}
 					break;
 				case DRSessionDbStatus::dirty_decrypt: // decrypt modifies: CKr and Nr. Also set Status to active and clear X3DH init message if there is one(it is actually useless as our first reply from peer shall trigger a ratchet&decrypt)
@@ -839,7 +879,8 @@ bool DR<Curve>::session_save(bool commit) { // commit default to true
 
 					blob CKr(m_localStorage->sql);
 					CKr.write(0, (char *)(m_CKr.data()), m_CKr.size());
-					m_localStorage->sql<<"UPDATE DR_sessions SET Nr= :Nr, CKr= :CKr, Status = 1, X3DHInit = NULL WHERE sessionId = :sessionId;", use(m_Nr), use(CKr), use(m_dbSessionId);
+					int compression = m_peerCompression;
+					m_localStorage->sql<<"UPDATE DR_sessions SET Nr= :Nr, CKr= :CKr, Status = 1, X3DHInit = NULL, Compression= :Compression WHERE sessionId = :sessionId;", use(m_Nr), use(CKr), use(compression), use(m_dbSessionId);
 				}
 					break;
 				case DRSessionDbStatus::dirty_encrypt: // encrypt modifies: CKs and Ns
@@ -929,7 +970,9 @@ bool DR<Curve>::session_load() {
 	// create an empty DR session
 	indicator ind;
 	int status; // retrieve an int from DB, turn it into a bool to store in object
-	m_localStorage->sql<<"SELECT Did,Uid,Ns,Nr,PN,DHr,DHs,RK,CKs,CKr,AD,Status,X3DHInit FROM DR_sessions WHERE sessionId = :sessionId LIMIT 1", into(m_peerDid), into(m_db_Uid), into(m_Ns), into(m_Nr), into(m_PN), into(DHr), into(DHs), into(RK), into(CKs), into(CKr), into(AD), into(status), into(X3DH_initMessage,ind), use(m_dbSessionId);
+	int AEAD = 0;
+	int compression = 0;
+	m_localStorage->sql<<"SELECT Did,Uid,Ns,Nr,PN,DHr,DHs,RK,CKs,CKr,AD,Status,X3DHInit,AEAD,Compression FROM DR_sessions WHERE sessionId = :sessionId LIMIT 1", into(m_peerDid), into(m_db_Uid), into(m_Ns), into(m_Nr), into(m_PN), into(DHr), into(DHs), into(RK), into(CKs), into(CKr), into(AD), into(status), into(X3DH_initMessage,ind), into(AEAD), into(compression), use(m_dbSessionId);
 
 	if (m_localStorage->sql.got_data()) { // TODO : some more specific checks on length of retrieved data?
 		DHr.read(0, (char *)(m_DHr.data()), m_DHr.size());
@@ -948,6 +991,8 @@ bool DR<Curve>::session_load() {
 		} else {
 			m_active_status = false;
 		}
+		m_AEAD = (AEAD == static_cast<uint8_t>(lime::AEADAlgorithm::chacha20poly1305)) ? lime::AEADAlgorithm::chacha20poly1305 : lime::AEADAlgorithm::aes256gcm;
+		m_peerCompression = static_cast<uint8_t>(compression);
 		return true;
 	} else { // something went wrong with the DB, we cannot retrieve the session
 		return false;
@@ -1090,10 +1135,10 @@ bool Lime<Curve>::activate_user() {
 
 	// update in DB
 	try {
-		// Don't create stack variable in the method call directly
-		uint8_t curveId = static_cast<int8_t>(Curve::curveId());
+		// Don't create stack variable in the method call directly, keep the AEAD selection flag
+		int activeCurveId = (curveId&lime::settings::DBChaCha20Poly1305UserBit) | static_cast<uint8_t>(Curve::curveId());
 
-		m_localStorage->sql<<"UPDATE lime_LocalUsers SET curveId = :curveId WHERE Uid = :Uid;", use(curveId), use(Uid);
+		m_localStorage->sql<<"UPDATE lime_LocalUsers SET curveId = :curveId WHERE Uid = :Uid;", use(activeCurveId), use(Uid);
 	} catch (exception const &e) {
 		tr.rollback();
 		throw BCTBX_EXCEPTION << "Lime user activation failed. DB backend says: "<<e.what();
@@ -1114,6 +1159,12 @@ void Lime<Curve>::get_SelfIdentityKey() {
 		if (m_localStorage->sql.got_data()) { // Found it, it is stored in one buffer Public || Private
 			Ik_blob.read(0, (char *)(m_Ik.publicKey().data()), m_Ik.publicKey().size()); // Read the public key
 			Ik_blob.read(m_Ik.publicKey().size(), (char *)(m_Ik.privateKey().data()), m_Ik.privateKey().size()); // Read the private key
+			// convert it once to key exchange format, X3DH uses this form at each session initiation
+			auto DH = make_keyExchange<Curve>();
+			DH->set_secret(m_Ik.privateKey());
+			DH->set_selfPublic(m_Ik.publicKey());
+			DH->get_secret(m_Ik_X.privateKey());
+			DH->get_selfPublic(m_Ik_X.publicKey());
 			m_Ik_loaded = true; // set the flag
 		}
 	}
@@ -1155,7 +1206,7 @@ void Lime<Curve>::X3DH_generate_SPk(X<Curve, lime::Xtype::publicKey> &publicSPk,
 	// Generate a new ECDH Key pair
 	auto DH = make_keyExchange<Curve>();
 	DH->createKeyPair(m_RNG);
-	publicSPk = DH->get_selfPublic();
+	DH->get_selfPublic(publicSPk);
 
 	// Sign the public key with our identity key
 	auto SPkSign = make_Signature<Curve>();
@@ -1174,9 +1225,10 @@ void Lime<Curve>::X3DH_generate_SPk(X<Curve, lime::Xtype::publicKey> &publicSPk,
 		activeSPkIds.insert(activeSPkId);
 	}
 
-	SPk_id = m_RNG->randomize();
+	auto rng = thread_RNG(); // buffered: Ids do not cost a DRBG call each
+	SPk_id = rng->randomize();
 	while (activeSPkIds.insert(SPk_id).second == false) { // This one was already in
-		SPk_id = m_RNG->randomize();
+		SPk_id = rng->randomize();
 	}
 
 	// insert all this in DB
@@ -1251,11 +1303,12 @@ void Lime<Curve>::X3DH_generate_OPks(std::vector<X<Curve, lime::Xtype::publicKey
 		}
 	}
 
-	// we must create OPk_number new Ids
+	// we must create OPk_number new Ids and keys: draw them from the calling thread buffered RNG, not one DRBG call each
+	auto rng = thread_RNG();
 	while (OPk_ids.size() < OPk_number){
 		// Generate a random OPk Id
 		// Sqlite doesn't really support unsigned value, the randomize function makes sure that the MSbit is set to 0 to not fall into strange bugs with that
-		uint32_t OPk_id = m_RNG->randomize();
+		uint32_t OPk_id = rng->randomize();
 
 		if (activeOPkIds.insert(OPk_id).second) { // if this one wasn't in the set
 			OPk_ids.push_back(OPk_id);
@@ -1268,22 +1321,26 @@ void Lime<Curve>::X3DH_generate_OPks(std::vector<X<Curve, lime::Xtype::publicKey
 	uint32_t OPk_id;
 	statement st = (m_localStorage->sql.prepare << "INSERT INTO X3DH_OPK(OPKid, OPK,Uid) VALUES(:OPKid,:OPK,:Uid)", use(OPk_id), use(OPk), use(m_db_Uid));
 
-	// Create an key exchange context to create key pairs
-	auto DH = make_keyExchange<Curve>();
+	// Generate the new ECDH Key pairs: random private keys, the public ones are derived in one batch
+	lime::secureVector<Xpair<Curve>> OPkPairs(OPk_ids.size());
+	std::vector<XbatchEntry<Curve>> derivations{};
+	derivations.reserve(OPkPairs.size());
+	for (auto &OPkPair : OPkPairs) {
+		rng->randomize(OPkPair.privateKey().data(), OPkPair.privateKey().size());
+		derivations.push_back({&(OPkPair.privateKey()), nullptr, OPkPair.publicKey().data()});
+	}
+	X_batch<Curve>(derivations);
 
 	try {
-		for (auto id : OPk_ids) { // loop on all ids
-			// Generate a new ECDH Key pair
-			DH->createKeyPair(m_RNG);
-
+		for (size_t i=0; i<OPk_ids.size(); i++) { // loop on all ids
 			// Insert in DB: store Public Key || Private Key
-			OPk.write(0, (const char *)(DH->get_selfPublic().data()), X<Curve, lime::Xtype::publicKey>::ssize());
-			OPk.write(X<Curve, lime::Xtype::publicKey>::ssize(), (const char *)(DH->get_secret().data()), X<Curve, lime::Xtype::privateKey>::ssize());
-			OPk_id = id; // store also the key id
+			OPk.write(0, (const char *)(OPkPairs[i].publicKey().data()), X<Curve, lime::Xtype::publicKey>::ssize());
+			OPk.write(X<Curve, lime::Xtype::publicKey>::ssize(), (const char *)(OPkPairs[i].privateKey().data()), X<Curve, lime::Xtype::privateKey>::ssize());
+			OPk_id = OPk_ids[i]; // store also the key id
 			st.execute(true);
 
 			// set in output vector
-			publicOPks.emplace_back(DH->get_selfPublic());
+			publicOPks.emplace_back(OPkPairs[i].publicKey());
 		}
 	} catch (exception &e) {
 		OPk_ids.clear();
@@ -1359,7 +1416,7 @@ void Lime<Curve>::cache_DR_sessions(std::vector<RecipientInfos<Curve>> &internal
 		auto sessionId = r.get<int>(0);
 		auto peerDeviceId = r.get<std::string>(1);
 
-		auto DRsession = std::make_shared<DR<Curve>>(m_localStorage, sessionId, m_RNG); // load session from local storage
+		auto DRsession = make_secure_shared<DR<Curve>>(m_localStorage, sessionId, m_RNG); // load session from local storage
 		requestedDevices[peerDeviceId] = DRsession; // store found session in a our temp container
 		m_DR_sessions_cache[peerDeviceId] = DRsession; // session is also stored in cache
 	}
@@ -1385,10 +1442,95 @@ void Lime<Curve>::get_DRSessions(const std::string &senderDeviceId, const long i
 
 	for (const auto &sessionId : rs) {
 		/* load session in cache DRSessions */
-		DRSessions.push_back(make_shared<DR<Curve>>(m_localStorage, sessionId, m_RNG)); // load session from cache
+		DRSessions.push_back(make_secure_shared<DR<Curve>>(m_localStorage, sessionId, m_RNG)); // load session from cache
 	}
 };
 
+/**
+ * @brief Load from local storage the peer devices the X3DH server had no key bundle for, still in the negative cache TTL
+ * Expired ones are deleted from local storage
+ */
+template <typename Curve>
+void Lime<Curve>::noBundle_cache_load() {
+	if (lime::settings::noBundle_cacheTTL == 0 || !lime::settings::noBundle_cachePersistent) return;
+
+	std::lock_guard<std::recursive_mutex> lock(*(m_localStorage->m_db_mutex));
+	try {
+		m_localStorage->sql<<"DELETE FROM lime_NoBundlePeerDevices WHERE Uid = :Uid AND timeStamp < datetime('now', '-"<<lime::settings::noBundle_cacheTTL<<" seconds');", use(m_db_Uid);
+
+		// retrieve the age of the information (in seconds) to compute its expiration
+		rowset<row> rs = (m_localStorage->sql.prepare << "SELECT DeviceId, CAST((julianday('now') - julianday(timeStamp))*86400 AS INTEGER) FROM lime_NoBundlePeerDevices WHERE Uid = :Uid;", use(m_db_Uid));
+		const auto now = std::chrono::steady_clock::now();
+		for (const auto &r : rs) {
+			auto age = std::chrono::seconds(r.get<int>(1));
+			m_noBundle_cache[r.get<std::string>(0)] = now - age + std::chrono::seconds(lime::settings::noBundle_cacheTTL);
+		}
+	} catch (exception const &e) { // this is just an optimisation, do not fail the user load
+		LIME_LOGE<<"Cannot load peer devices without key bundle for user "<<m_selfDeviceId<<". DB backend says: "<<e.what();
+	}
+}
+
+/**
+ * @brief Insert a peer device in the negative cache: the X3DH server has no key bundle for it
+ * Key bundle requests will not include it until settings::noBundle_cacheTTL expires
+ *
+ * @param[in]	peerDeviceId	the peer device Id (shall be its GRUU)
+ */
+template <typename Curve>
+void Lime<Curve>::noBundle_cache_insert(const std::string &peerDeviceId) {
+	if (lime::settings::noBundle_cacheTTL == 0) return;
+
+	m_noBundle_cache[peerDeviceId] = std::chrono::steady_clock::now() + std::chrono::seconds(lime::settings::noBundle_cacheTTL);
+
+	if (lime::settings::noBundle_cachePersistent) {
+		std::lock_guard<std::recursive_mutex> lock(*(m_localStorage->m_db_mutex));
+		try {
+			m_localStorage->sql<<"INSERT OR REPLACE INTO lime_NoBundlePeerDevices(Uid,DeviceId) VALUES(:Uid,:DeviceId);", use(m_db_Uid), use(peerDeviceId);
+		} catch (exception const &e) { // this is just an optimisation, keep going with the in memory version
+			LIME_LOGE<<"Cannot store peer device "<<peerDeviceId<<" without key bundle for user "<<m_selfDeviceId<<". DB backend says: "<<e.what();
+		}
+	}
+}
+
+/**
+ * @brief Remove a peer device from the negative cache, from memory and local storage
+ * Call is silently ignored if the device is not in cache
+ *
+ * @param[in]	peerDeviceId	the peer device Id (shall be its GRUU)
+ */
+template <typename Curve>
+void Lime<Curve>::noBundle_cache_erase(const std::string &peerDeviceId) {
+	if (m_noBundle_cache.erase(peerDeviceId) == 0) return; // local storage holds nothing valid not already in memory
+
+	if (lime::settings::noBundle_cachePersistent) {
+		std::lock_guard<std::recursive_mutex> lock(*(m_localStorage->m_db_mutex));
+		try {
+			m_localStorage->sql<<"DELETE FROM lime_NoBundlePeerDevices WHERE Uid = :Uid AND DeviceId = :DeviceId;", use(m_db_Uid), use(peerDeviceId);
+		} catch (exception const &e) {
+			LIME_LOGE<<"Cannot remove peer device "<<peerDeviceId<<" without key bundle for user "<<m_selfDeviceId<<". DB backend says: "<<e.what();
+		}
+	}
+}
+
+/**
+ * @brief Check if a peer device is in the negative cache, drop it from memory if its entry expired
+ *
+ * @param[in]	peerDeviceId	the peer device Id (shall be its GRUU)
+ *
+ * @return true if the X3DH server recently answered it has no key bundle for this device
+ */
+template <typename Curve>
+bool Lime<Curve>::noBundle_cache_find(const std::string &peerDeviceId) {
+	auto cacheElem = m_noBundle_cache.find(peerDeviceId);
+	if (cacheElem == m_noBundle_cache.end()) return false;
+
+	if (cacheElem->second <= std::chrono::steady_clock::now()) { // expired, local storage is cleaned at next load
+		m_noBundle_cache.erase(cacheElem);
+		return false;
+	}
+	return true;
+}
+
 /**
  * @brief retrieve matching SPk from localStorage, throw an exception if not found
  *
@@ -1472,6 +1614,23 @@ void Lime<Curve>::X3DH_updateOPkStatus(const std::vector<uint32_t> &OPkIds) {
 	m_localStorage->sql << "DELETE FROM X3DH_OPK WHERE Uid = :Uid AND Status = 0 AND timeStamp < date('now', '-"<<lime::settings::OPk_limboTime_days<<" day');", use(m_db_Uid);
 }
 
+/**
+ * @brief Get the Ids of our OPks whose status is still on server
+ *
+ * 	Comparing them with the list retrieved from X3DH server gives the OPks dispatched since last check
+ *
+ * @param[out]	OPkIds	the ids of the OPks not known yet to have been dispatched by X3DH server
+ */
+template <typename Curve>
+void Lime<Curve>::X3DH_get_activeOPkIds(std::vector<uint32_t> &OPkIds) {
+	std::lock_guard<std::recursive_mutex> lock(*(m_localStorage->m_db_mutex));
+	OPkIds.clear();
+	rowset<row> rs = (m_localStorage->sql.prepare << "SELECT OPKid FROM X3DH_OPK WHERE Uid = :Uid AND Status = 1;", use(m_db_Uid));
+	for (const auto &r : rs) {
+		OPkIds.push_back(static_cast<uint32_t>(r.get<int>(0)));
+	}
+}
+
 template <typename Curve>
 void Lime<Curve>::set_x3dhServerUrl(const std::string &x3dhServerUrl) {
 	std::lock_guard<std::recursive_mutex> lock(*(m_localStorage->m_db_mutex));
@@ -1490,6 +1649,26 @@ void Lime<Curve>::set_x3dhServerUrl(const std::string &x3dhServerUrl) {
 	tr.commit();
 }
 
+template <typename Curve>
+void Lime<Curve>::set_AEADAlgorithm(const lime::AEADAlgorithm algorithm) {
+	std::lock_guard<std::recursive_mutex> lock(*(m_localStorage->m_db_mutex));
+	transaction tr(m_localStorage->sql);
+
+	// the selection is a flag in the curveId column, update in DB, do not check presence as we're called after a load_user who already ensure that
+	try {
+		int flag = (algorithm == lime::AEADAlgorithm::chacha20poly1305) ? lime::settings::DBChaCha20Poly1305UserBit : 0;
+		int mask = ~lime::settings::DBChaCha20Poly1305UserBit;
+		m_localStorage->sql<<"UPDATE lime_LocalUsers SET curveId = (curveId & :mask) | :flag WHERE UserId = :userId;", use(mask), use(flag), use(m_selfDeviceId);
+	} catch (exception const &e) {
+		tr.rollback();
+		throw BCTBX_EXCEPTION << "Cannot set the AEAD scheme for user "<<m_selfDeviceId<<". DB backend says: "<<e.what();
+	}
+	// update in the Lime object
+	m_AEAD = algorithm;
+
+	tr.commit();
+}
+
 template <typename Curve>
 void Lime<Curve>::stale_sessions(const std::string &peerDeviceId) {
 	std::lock_guard<std::recursive_mutex> lock(*(m_localStorage->m_db_mutex));
@@ -1515,11 +1694,17 @@ void Lime<Curve>::stale_sessions(const std::string &peerDeviceId) {
 	template void Lime<C255>::X3DH_generate_OPks(std::vector<X<C255, lime::Xtype::publicKey>> &publicOPks, std::vector<uint32_t> &OPk_ids, const uint16_t OPk_number, const bool load);
 	template void Lime<C255>::cache_DR_sessions(std::vector<RecipientInfos<C255>> &internal_recipients, std::vector<std::string> &missing_devices);
 	template void Lime<C255>::get_DRSessions(const std::string &senderDeviceId, const long int ignoreThisDBSessionId, std::vector<std::shared_ptr<DR<C255>>> &DRSessions);
+	template void Lime<C255>::noBundle_cache_load();
+	template void Lime<C255>::noBundle_cache_insert(const std::string &peerDeviceId);
+	template void Lime<C255>::noBundle_cache_erase(const std::string &peerDeviceId);
+	template bool Lime<C255>::noBundle_cache_find(const std::string &peerDeviceId);
 	template void Lime<C255>::X3DH_get_SPk(uint32_t SPk_id, Xpair<C255> &SPk);
 	template bool Lime<C255>::is_currentSPk_valid(void);
 	template void Lime<C255>::X3DH_get_OPk(uint32_t OPk_id, Xpair<C255> &SPk);
 	template void Lime<C255>::X3DH_updateOPkStatus(const std::vector<uint32_t> &OPkIds);
+	template void Lime<C255>::X3DH_get_activeOPkIds(std::vector<uint32_t> &OPkIds);
 	template void Lime<C255>::set_x3dhServerUrl(const std::string &x3dhServerUrl);
+	template void Lime<C255>::set_AEADAlgorithm(const lime::AEADAlgorithm algorithm);
 	template void Lime<C255>::stale_sessions(const std::string &peerDeviceId);
 #endif
 
@@ -1531,11 +1716,17 @@ void Lime<Curve>::stale_sessions(const std::string &peerDeviceId) {
 	template void Lime<C448>::X3DH_generate_OPks(std::vector<X<C448, lime::Xtype::publicKey>> &publicOPks, std::vector<uint32_t> &OPk_ids, const uint16_t OPk_number, const bool load);
 	template void Lime<C448>::cache_DR_sessions(std::vector<RecipientInfos<C448>> &internal_recipients, std::vector<std::string> &missing_devices);
 	template void Lime<C448>::get_DRSessions(const std::string &senderDeviceId, const long int ignoreThisDBSessionId, std::vector<std::shared_ptr<DR<C448>>> &DRSessions);
+	template void Lime<C448>::noBundle_cache_load();
+	template void Lime<C448>::noBundle_cache_insert(const std::string &peerDeviceId);
+	template void Lime<C448>::noBundle_cache_erase(const std::string &peerDeviceId);
+	template bool Lime<C448>::noBundle_cache_find(const std::string &peerDeviceId);
 	template void Lime<C448>::X3DH_get_SPk(uint32_t SPk_id, Xpair<C448> &SPk);
 	template bool Lime<C448>::is_currentSPk_valid(void);
 	template void Lime<C448>::X3DH_get_OPk(uint32_t OPk_id, Xpair<C448> &SPk);
 	template void Lime<C448>::X3DH_updateOPkStatus(const std::vector<uint32_t> &OPkIds);
+	template void Lime<C448>::X3DH_get_activeOPkIds(std::vector<uint32_t> &OPkIds);
 	template void Lime<C448>::set_x3dhServerUrl(const std::string &x3dhServerUrl);
+	template void Lime<C448>::set_AEADAlgorithm(const lime::AEADAlgorithm algorithm);
 	template void Lime<C448>::stale_sessions(const std::string &peerDeviceId);
 #endif
 
@@ -49,7 +49,7 @@ namespace lime {
 		Db(const std::string &filename, std::shared_ptr<std::recursive_mutex> db_mutex);
 		~Db(){sql.close();};
 
-		void load_LimeUser(const std::string &deviceId, long int &Uid, lime::CurveId &curveId, std::string &url, const bool allStatus=false);
+		void load_LimeUser(const std::string &deviceId, long int &Uid, lime::CurveId &curveId, std::string &url, lime::AEADAlgorithm &AEAD, const bool allStatus=false);
 		void delete_LimeUser(const std::string &deviceId);
 		void clean_DRSessions();
 		void clean_SPk();
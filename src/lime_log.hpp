@@ -22,9 +22,25 @@
 #define BCTBX_LOG_DOMAIN "lime"
 #include <bctoolbox/logging.h>
 
-#define LIME_LOGD BCTBX_SLOGD
-#define LIME_LOGI BCTBX_SLOGI
-#define LIME_LOGW BCTBX_SLOGW
-#define LIME_LOGE BCTBX_SLOGE
+/* The log level is checked before the message is built: when it is not enabled, the streamed arguments are not evaluated.
+ * Use LIME_LOGD_ENABLED/LIME_LOGI_ENABLED to skip the building of traces given to LIME_LOGD/LIME_LOGI.
+ * When configured with ENABLE_DEBUG_LOGS=NO, LIME_DEBUG_LOGS_DISABLED is defined and the debug and info logs are compiled out. */
+#define LIME_LOG_ENABLED(level) (bctbx_log_level_enabled(BCTBX_LOG_DOMAIN, (level)) != 0)
+#define LIME_SLOG(level) if (!LIME_LOG_ENABLED(level)) {} else pumpstream(BCTBX_LOG_DOMAIN, (level))
+
+#ifdef LIME_DEBUG_LOGS_DISABLED
+/* the arguments are still compiled, so they do not produce unused variable warnings, but the statement is dead code */
+#define LIME_LOGD_ENABLED false
+#define LIME_LOGI_ENABLED false
+#define LIME_LOGD if (true) {} else pumpstream(BCTBX_LOG_DOMAIN, BCTBX_LOG_DEBUG)
+#define LIME_LOGI if (true) {} else pumpstream(BCTBX_LOG_DOMAIN, BCTBX_LOG_MESSAGE)
+#else
+#define LIME_LOGD_ENABLED LIME_LOG_ENABLED(BCTBX_LOG_DEBUG)
+#define LIME_LOGI_ENABLED LIME_LOG_ENABLED(BCTBX_LOG_MESSAGE)
+#define LIME_LOGD LIME_SLOG(BCTBX_LOG_DEBUG)
+#define LIME_LOGI LIME_SLOG(BCTBX_LOG_MESSAGE)
+#endif
+#define LIME_LOGW LIME_SLOG(BCTBX_LOG_WARNING)
+#define LIME_LOGE LIME_SLOG(BCTBX_LOG_ERROR)
 
 #endif //lime_log_hpp
@@ -116,7 +116,39 @@ namespace lime {
 		LimeManager::load_user(user, localDeviceId);
 
 		// call the encryption function
-		user->encrypt(recipientUserId, recipients, plainMessage, encryptionPolicy, cipherMessage, callback);
+		user->encrypt(recipientUserId, recipients, plainMessage, encryptionPolicy, cipherMessage, callback, nullptr);
+	}
+
+	void LimeManager::encrypt(const std::string &localDeviceId, std::shared_ptr<const std::string> recipientUserId, std::shared_ptr<std::vector<RecipientData>> recipients, std::shared_ptr<const std::vector<uint8_t>> plainMessage, std::shared_ptr<std::vector<uint8_t>> cipherMessage, const limeRecipientCallback &recipientCallback, const limeCallback &callback, const lime::EncryptionPolicy encryptionPolicy) {
+		// Load user object
+		std::shared_ptr<LimeGeneric> user;
+		LimeManager::load_user(user, localDeviceId);
+
+		// call the encryption function
+		user->encrypt(recipientUserId, recipients, plainMessage, encryptionPolicy, cipherMessage, callback, recipientCallback);
+	}
+
+	void LimeManager::encrypt(const std::string &localDeviceId, const std::string &recipientUserId, lime::span<RecipientData> recipients, lime::span<const uint8_t> plainMessage, lime::span<uint8_t> cipherMessage, size_t &cipherMessageSize, const limeCallback &callback, const lime::EncryptionPolicy encryptionPolicy) {
+		// Load user object
+		std::shared_ptr<LimeGeneric> user;
+		LimeManager::load_user(user, localDeviceId);
+
+		// call the encryption function, it works on the caller buffers
+		user->encrypt(recipientUserId, recipients, plainMessage, encryptionPolicy, cipherMessage, cipherMessageSize, callback, nullptr);
+	}
+
+	void LimeManager::encrypt(const std::string &localDeviceId, const std::string &recipientUserId, lime::span<RecipientData> recipients, lime::span<const uint8_t> plainMessage, lime::span<uint8_t> cipherMessage, size_t &cipherMessageSize, const limeRecipientCallback &recipientCallback, const limeCallback &callback, const lime::EncryptionPolicy encryptionPolicy) {
+		// Load user object
+		std::shared_ptr<LimeGeneric> user;
+		LimeManager::load_user(user, localDeviceId);
+
+		// call the encryption function, it works on the caller buffers
+		user->encrypt(recipientUserId, recipients, plainMessage, encryptionPolicy, cipherMessage, cipherMessageSize, callback, recipientCallback);
+	}
+
+	size_t LimeManager::cipherMessageMaximumSize(const size_t plainMessageSize) noexcept {
+		// the payload is compressed only when it gets shorter: the largest cipherMessage is the plain message followed by the authentication tag
+		return plainMessageSize + lime::settings::DRMessageAuthTagSize;
 	}
 
 	lime::PeerDeviceStatus LimeManager::decrypt(const std::string &localDeviceId, const std::string &recipientUserId, const std::string &senderDeviceId, const std::vector<uint8_t> &DRmessage, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plainMessage) {
@@ -141,6 +173,37 @@ namespace lime {
 		return user->decrypt(recipientUserId, senderDeviceId, DRmessage, emptyCipherMessage, plainMessage);
 	}
 
+	lime::PeerDeviceStatus LimeManager::decrypt(const std::string &localDeviceId, const std::string &recipientUserId, const std::string &senderDeviceId, lime::span<const uint8_t> DRmessage, lime::span<const uint8_t> cipherMessage, lime::span<uint8_t> plainMessage, size_t &plainMessageSize) {
+		// Load user object
+		std::shared_ptr<LimeGeneric> user;
+		LimeManager::load_user(user, localDeviceId);
+
+		// call the decryption function: the plaintext is deciphered in the caller buffer, a larger one is rejected before the message key is consumed
+		auto status = user->decrypt(recipientUserId, senderDeviceId, DRmessage, cipherMessage, plainMessage, plainMessageSize);
+		if (status == lime::PeerDeviceStatus::fail && plainMessageSize > plainMessage.size()) {
+			LIME_LOGE<<"Decrypt: output buffer of "<<plainMessage.size()<<" bytes is too small, "<<plainMessageSize<<" bytes are needed";
+		}
+		return status;
+	}
+
+	std::shared_ptr<lime::CipherStream> LimeManager::encrypt_stream(const std::string &localDeviceId, std::shared_ptr<const std::string> recipientUserId, std::shared_ptr<std::vector<RecipientData>> recipients, const limeCallback &callback) {
+		// Load user object
+		std::shared_ptr<LimeGeneric> user;
+		LimeManager::load_user(user, localDeviceId);
+
+		// call the encryption function
+		return user->encrypt_stream(recipientUserId, recipients, callback);
+	}
+
+	lime::PeerDeviceStatus LimeManager::decrypt_stream(const std::string &localDeviceId, const std::string &recipientUserId, const std::string &senderDeviceId, const std::vector<uint8_t> &DRmessage, std::shared_ptr<lime::CipherStream> &cipherStream) {
+		// Load user object
+		std::shared_ptr<LimeGeneric> user;
+		LimeManager::load_user(user, localDeviceId);
+
+		// call the decryption function
+		return user->decrypt_stream(recipientUserId, senderDeviceId, DRmessage, cipherStream);
+	}
+
 
 	/* This version use default settings */
 	void LimeManager::update(const std::string &localDeviceId, const limeCallback &callback) {
@@ -255,5 +318,21 @@ namespace lime {
 		return user->get_x3dhServerUrl();
 	}
 
+	void LimeManager::set_AEADAlgorithm(const std::string &localDeviceId, const lime::AEADAlgorithm algorithm) {
+		// load user (generate an exception if not found, let it flow up)
+		std::shared_ptr<LimeGeneric> user;
+		LimeManager::load_user(user, localDeviceId);
+
+		user->set_AEADAlgorithm(algorithm);
+	}
+
+	lime::AEADAlgorithm LimeManager::get_AEADAlgorithm(const std::string &localDeviceId) {
+		// load user (generate an exception if not found, let it flow up)
+		std::shared_ptr<LimeGeneric> user;
+		LimeManager::load_user(user, localDeviceId);
+
+		return user->get_AEADAlgorithm();
+	}
+
 
 } // namespace lime
@@ -0,0 +1,214 @@
+/*
+	lime_secure_memory.cpp
+	@author Johan Pascal
+	@copyright 	Copyright (C) 2019  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lime_log.hpp"
+#include "lime_secure_memory.hpp"
+#include "lime_settings.hpp"
+#include "lime_crypto_primitives.hpp"
+
+#include <array>
+#include <mutex>
+#include <new>
+
+#if defined(_WIN32)
+#include <windows.h>
+#define LIME_SECURE_ARENA_PAGES
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define LIME_SECURE_ARENA_PAGES
+#endif
+
+namespace lime {
+
+namespace {
+	/* small buffers are served from power of 2 size classes: 16, 32, ..., 4096 bytes */
+	constexpr size_t minBlockSize = 16;
+	constexpr size_t maxBlockSize = 4096;
+	constexpr size_t sizeClassesCount = 9;
+	static_assert((minBlockSize<<(sizeClassesCount-1)) == maxBlockSize, "secure arena size classes shall span minBlockSize to maxBlockSize");
+	static_assert(lime::settings::secureArenaRegionSize >= maxBlockSize && lime::settings::secureArenaRegionSize%maxBlockSize == 0, "secure arena region size shall be a multiple of the largest size class");
+
+	size_t sizeClass(const size_t size) noexcept {
+		size_t index = 0;
+		for (size_t blockSize = minBlockSize; blockSize < size; blockSize <<= 1) index++;
+		return index;
+	}
+
+#ifdef LIME_SECURE_ARENA_PAGES
+	size_t pageSize(void) noexcept {
+		static const size_t size = []() {
+#if defined(_WIN32)
+			SYSTEM_INFO info;
+			GetSystemInfo(&info);
+			return static_cast<size_t>(info.dwPageSize);
+#else
+			return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+		}();
+		return size;
+	}
+
+	size_t roundToPage(const size_t size) noexcept {
+		const auto page = pageSize();
+		return ((size + page - 1)/page)*page;
+	}
+
+	/* lock a mapping in RAM, the first failure is logged: the process may not be allowed to lock that much memory */
+	void lockPages(void *pages, const size_t size) noexcept {
+#if defined(_WIN32)
+		const bool locked = (VirtualLock(pages, size) != 0);
+#else
+		const bool locked = (mlock(pages, size) == 0);
+#ifdef MADV_DONTDUMP
+		madvise(pages, size, MADV_DONTDUMP);
+#endif
+#endif
+		static std::once_flag warned;
+		if (!locked) {
+			std::call_once(warned, []{LIME_LOGW<<"Secure arena: unable to lock key material memory, it may be swapped to disk";});
+		}
+	}
+
+	/**
+	 * map size bytes(rounded to page size) surrounded by two inaccessible guard pages
+	 * @return the accessible part of the mapping, nullptr on failure
+	 */
+	uint8_t *mapGuarded(const size_t size) noexcept {
+		const auto page = pageSize();
+		const auto usableSize = roundToPage(size);
+#if defined(_WIN32)
+		auto mapping = static_cast<uint8_t *>(VirtualAlloc(nullptr, usableSize + 2*page, MEM_RESERVE, PAGE_NOACCESS));
+		if (mapping == nullptr) return nullptr;
+		if (VirtualAlloc(mapping + page, usableSize, MEM_COMMIT, PAGE_READWRITE) == nullptr) {
+			VirtualFree(mapping, 0, MEM_RELEASE);
+			return nullptr;
+		}
+#else
+		auto mapping = static_cast<uint8_t *>(mmap(nullptr, usableSize + 2*page, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0));
+		if (mapping == MAP_FAILED) return nullptr;
+		if (mprotect(mapping + page, usableSize, PROT_READ|PROT_WRITE) != 0) {
+			munmap(mapping, usableSize + 2*page);
+			return nullptr;
+		}
+#endif
+		lockPages(mapping + page, usableSize);
+		return mapping + page;
+	}
+
+	/* release a mapping created by mapGuarded, the caller already wiped it */
+	void unmapGuarded(uint8_t *buffer, const size_t size) noexcept {
+		const auto page = pageSize();
+		const auto usableSize = roundToPage(size);
+#if defined(_WIN32)
+		VirtualUnlock(buffer, usableSize);
+		VirtualFree(buffer - page, 0, MEM_RELEASE);
+#else
+		munlock(buffer, usableSize);
+		munmap(buffer - page, usableSize + 2*page);
+#endif
+	}
+#else // LIME_SECURE_ARENA_PAGES
+	/* no page management on this platform: the arena still wipes and recycles the buffers */
+	uint8_t *mapGuarded(const size_t size) noexcept {
+		return static_cast<uint8_t *>(::operator new(size, std::nothrow));
+	}
+	void unmapGuarded(uint8_t *buffer, const size_t) noexcept {
+		::operator delete(buffer);
+	}
+#endif // LIME_SECURE_ARENA_PAGES
+
+	/**
+	 * @brief The secure arena: guarded regions of settings::secureArenaRegionSize bytes are sliced in blocks of one size class
+	 * and chained in the free list of this class.
+	 * Released blocks are wiped and go back to their free list, regions are never given back to the system.
+	 */
+	class secureArena {
+		private:
+			struct freeBlock {
+				freeBlock *next;
+			};
+			std::mutex m_mutex;
+			std::array<freeBlock *, sizeClassesCount> m_freeBlocks;
+
+			/* slice a new region in blocks of the given class, must be called holding the mutex */
+			bool addRegion(const size_t classIndex) noexcept {
+				auto region = mapGuarded(lime::settings::secureArenaRegionSize);
+				if (region == nullptr) return false;
+				const size_t blockSize = minBlockSize<<classIndex;
+				for (size_t offset = lime::settings::secureArenaRegionSize; offset >= blockSize; offset -= blockSize) {
+					auto block = reinterpret_cast<freeBlock *>(region + offset - blockSize);
+					block->next = m_freeBlocks[classIndex];
+					m_freeBlocks[classIndex] = block;
+				}
+				return true;
+			}
+
+		public:
+			secureArena() : m_mutex{}, m_freeBlocks{} {}
+
+			void *allocate(const size_t size) {
+				if (size > maxBlockSize) {
+					auto buffer = mapGuarded(size);
+					if (buffer == nullptr) throw std::bad_alloc();
+					return buffer;
+				}
+				const auto classIndex = sizeClass(size);
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_freeBlocks[classIndex] == nullptr && !addRegion(classIndex)) {
+					throw std::bad_alloc();
+				}
+				auto block = m_freeBlocks[classIndex];
+				m_freeBlocks[classIndex] = block->next;
+				block->next = nullptr; // blocks are delivered zeroed
+				return block;
+			}
+
+			void deallocate(void *buffer, const size_t size) noexcept {
+				if (size > maxBlockSize) {
+					cleanBuffer(static_cast<uint8_t *>(buffer), size);
+					unmapGuarded(static_cast<uint8_t *>(buffer), size);
+					return;
+				}
+				const auto classIndex = sizeClass(size);
+				cleanBuffer(static_cast<uint8_t *>(buffer), minBlockSize<<classIndex); // wipe the whole block, not just the part in use
+				auto block = static_cast<freeBlock *>(buffer);
+				std::lock_guard<std::mutex> lock(m_mutex);
+				block->next = m_freeBlocks[classIndex];
+				m_freeBlocks[classIndex] = block;
+			}
+	};
+
+	/* the arena is never destroyed: objects holding secure memory may be released during static destruction */
+	secureArena &arena(void) {
+		static secureArena *instance = new secureArena();
+		return *instance;
+	}
+} // anonymous namespace
+
+void *secureArena_allocate(const size_t size) {
+	return arena().allocate(size == 0 ? 1 : size);
+}
+
+void secureArena_deallocate(void *buffer, const size_t size) noexcept {
+	if (buffer == nullptr) return;
+	arena().deallocate(buffer, size == 0 ? 1 : size);
+}
+
+} // namespace lime
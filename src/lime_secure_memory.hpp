@@ -0,0 +1,89 @@
+/*
+	lime_secure_memory.hpp
+	@author Johan Pascal
+	@copyright 	Copyright (C) 2019  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef lime_secure_memory_hpp
+#define lime_secure_memory_hpp
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace lime {
+	/**
+	 * @brief Allocate a buffer from the secure arena
+	 *
+	 * The arena memory is locked in RAM(when the process is allowed to), excluded from core dumps where the platform supports it
+	 * and its regions are surrounded by inaccessible guard pages. Small buffers are served from per size class free lists,
+	 * buffers larger than a page get their own guarded mapping.
+	 *
+	 * @param[in]	size	requested size in bytes
+	 *
+	 * @return a buffer aligned at least on 16 bytes, throws std::bad_alloc on failure
+	 */
+	void *secureArena_allocate(const size_t size);
+
+	/**
+	 * @brief Give back to the secure arena a buffer obtained from secureArena_allocate, it is wiped before anything else
+	 *
+	 * @param[in]	buffer	the buffer to release, nullptr is ignored
+	 * @param[in]	size	the size given to secureArena_allocate for this buffer
+	 */
+	void secureArena_deallocate(void *buffer, const size_t size) noexcept;
+
+	/**
+	 * @brief Standard allocator serving its memory from the secure arena
+	 *
+	 * Used for long lived key material(Lime and DR objects, skipped message keys) and the per message key buffers
+	 * so they never reach swap nor a core dump and are wiped as soon as released.
+	 */
+	template <typename T>
+	struct secureAllocator {
+		using value_type = T;
+
+		secureAllocator() noexcept = default;
+		template <typename U>
+		secureAllocator(const secureAllocator<U> &) noexcept {}
+
+		T *allocate(const std::size_t n) {
+			return static_cast<T *>(secureArena_allocate(n*sizeof(T)));
+		}
+		void deallocate(T *p, const std::size_t n) noexcept {
+			secureArena_deallocate(p, n*sizeof(T));
+		}
+	};
+	template <typename T, typename U>
+	bool operator==(const secureAllocator<T> &, const secureAllocator<U> &) noexcept { return true; }
+	template <typename T, typename U>
+	bool operator!=(const secureAllocator<T> &, const secureAllocator<U> &) noexcept { return false; }
+
+	/** a vector holding its elements in the secure arena */
+	template <typename T>
+	using secureVector = std::vector<T, secureAllocator<T>>;
+
+	/**
+	 * @brief same as std::make_shared but the object and its control block are allocated in the secure arena
+	 */
+	template <typename T, typename... Args>
+	std::shared_ptr<T> make_secure_shared(Args&&... args) {
+		return std::allocate_shared<T>(secureAllocator<T>{}, std::forward<Args>(args)...);
+	}
+} // namespace lime
+
+#endif //lime_secure_memory_hpp
@@ -61,9 +61,49 @@ namespace settings {
 	 */
 	constexpr std::uint16_t maxSendingChain=1000;
 
+	/** @brief Sending chain length at which a session is renewed
+	 *
+	 * when an encryption brings the sending chain to this length, a key bundle for this peer device is fetched in background from the X3DH server
+	 * and the new session replaces the current one, so the sending chain never reaches maxSendingChain on a send path waiting for the X3DH server.
+	 * Set it to maxSendingChain to disable the proactive renewal.
+	 */
+	constexpr std::uint16_t sendingChainRenewal=900;
+
+	static_assert(sendingChainRenewal<=maxSendingChain, "Session renewal must start before the sending chain reaches its maximum length");
+
 	/** Lifetime of a session once not active anymore, unit is day */
 	constexpr unsigned int DRSession_limboTime_days=30;
 
+	/** @brief Number of recipients encrypted and committed in local storage at once when the encryption output is streamed to the caller
+	 *
+	 * each batch is committed before its DR messages are given to the caller so a smaller value gives the first messages earlier but costs more transactions
+	 */
+	constexpr size_t encryptStreamingBatchSize=16;
+
+	static_assert(encryptStreamingBatchSize>0, "Encryption streaming batch size cannot be 0");
+
+	/** @brief Size in bytes from which an AES256-GCM encryption or decryption(of a cipherMessage) is spread over several threads
+	 *
+	 * the buffer is cut in segments encrypted on up to std::thread::hardware_concurrency threads(each handling at least this number of bytes)
+	 * and the GHASH of the segments are combined so the output is the same as the one thread encryption.
+	 * Requires AES-NI and PCLMULQDQ instructions. Set it to 0 to always encrypt on the calling thread.
+	 */
+	constexpr size_t AESGCM_parallelThreshold=256*1024;
+
+	/** @brief Payload size in bytes from which it is compressed before encryption, when a compression algorithm is selected(see set_compressionAlgorithm)
+	 *
+	 * a compressed payload is sent only if it is shorter than the original one
+	 */
+	constexpr size_t payloadCompressionThreshold=128;
+
+	/** Maximum size in bytes of a decompressed payload, a compressed payload announcing more is rejected */
+	constexpr size_t payloadDecompressionMaxSize=64*1024*1024;
+
+	/// zlib compression level: 1(fastest) to 9(smallest output)
+	constexpr int zlibCompressionLevel=6;
+	/// zstd compression level: 1(fastest) to 19(smallest output)
+	constexpr int zstdCompressionLevel=3;
+
 /******************************************************************************/
 /*                                                                            */
 /* X3DH related definitions                                                   */
@@ -85,6 +125,55 @@ namespace settings {
 	constexpr unsigned int OPk_limboTime_days=SPK_lifeTime_days+SPK_limboTime_days;
 	/// in seconds, how often should we perform an update (check if we should publish new OPk, cleaning DB routine etc...)
 	constexpr unsigned int OPk_updatePeriod=86400; // 1 day
+	/// in seconds, period on which the OPk consumption is observed to size and schedule the OPk batches
+	constexpr unsigned int OPk_consumptionWindow=OPk_updatePeriod;
+	/// in seconds, minimum delay between two checks of the OPk count on server triggered by the observed consumption between the periodic updates
+	constexpr unsigned int OPk_replenishMinInterval=600; // 10 minutes
+	/// upper bound of an OPk batch enlarged to match the observed consumption
+	constexpr uint16_t OPk_maxBatchSize = OPk_initialBatchSize;
+
+	/** @brief in seconds, how long a peer device the X3DH server has no key bundle for is excluded from key bundle requests
+	 *
+	 * during this period, encryptions to this device fail without asking the X3DH server. The device leaves the cache earlier if it sends us a message
+	 * or is deleted using delete_peerDevice. Setting it to 0 disables this negative cache.
+	 */
+	constexpr unsigned int noBundle_cacheTTL=3600; // 1 hour
+	/// store the peer devices without key bundle in local storage too, so this information survives a reload of the local user
+	constexpr bool noBundle_cachePersistent=true;
+
+	/** @brief Number of key bundles from which the X3DH sender sessions computation is spread over several threads
+	 *
+	 * signature verification, key exchanges and key derivations of each bundle are independent, they are dispatched on up to
+	 * std::thread::hardware_concurrency threads(each handling at least this number of bundles) while local storage access
+	 * and sessions cache insertion remain on the calling thread. Set it to 0 to always compute on the calling thread.
+	 */
+	constexpr size_t X3DH_parallelInitThreshold=16;
+
+	/** @brief Number of peer devices identity keys kept in their key exchange format
+	 *
+	 * X3DH uses the peer Ik converted from signature to key exchange format, the conversion is cached(indexed by local storage peer device Id)
+	 * to avoid computing it again at each session creation with a known device. Set it to 0 to disable the cache.
+	 */
+	constexpr size_t X3DH_peerIkCacheSize=256;
+
+	/** @brief Number of released key exchange or signature contexts kept by each thread for reuse
+	 *
+	 * contexts are wiped of all key material when released. Set it to 0 to create a new context at each request.
+	 */
+	constexpr size_t cryptoContextPoolSize=4;
+
+	/** @brief Size in bytes of the regions the secure arena holding key material reserves at once
+	 *
+	 * each region is locked in memory and surrounded by guard pages, it is sliced in blocks of a single size class(16 to 4096 bytes).
+	 * It shall be a multiple of 4096.
+	 */
+	constexpr size_t secureArenaRegionSize=64*1024;
+
+	/** @brief Size in bytes of the random blocks drawn at once by the per thread RNG(see thread_RNG)
+	 *
+	 * key Ids, seeds and private keys are served from this buffer, requests over a quarter of it go straight to the underlying RNG.
+	 */
+	constexpr size_t RNGbufferSize=4096;
 
 } // namespace settings
 
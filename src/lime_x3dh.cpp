@@ -23,117 +23,248 @@
 #include "lime_double_ratchet_protocol.hpp"
 #include "bctoolbox/exception.hh"
 #include "lime_crypto_primitives.hpp"
+#include "lime_secure_memory.hpp"
+
+#include <future>
+#include <thread>
 
 using namespace::std;
 using namespace::lime;
 
 namespace lime {
+	/**
+	 * @brief Input and output of the X3DH sender computation for one peer bundle: everything needed to create the DR session
+	 */
+	template <typename Curve>
+	struct X3DH_senderInit {
+		long int peerDid; /**< the peer device Id in local storage, 0 if it is not there yet */
+		X<Curve, lime::Xtype::publicKey> peerIk_X; /**< the peer Ik in key exchange format: given when found in cache, computed otherwise */
+		bool peerIk_X_cached; /**< true when peerIk_X was given by the cache */
+		DRChainKey SK; /**< the shared secret computed by X3DH */
+		SharedADBuffer AD; /**< the shared AD used in DR session */
+		std::vector<uint8_t> X3DH_initMessage; /**< the X3DH init message to be sent with the first DR messages */
+		bool verified; /**< false if the SPk signature check failed, other fields are then not computed */
+		X3DH_senderInit() : peerDid{0}, peerIk_X{}, peerIk_X_cached{false}, SK{}, AD{}, X3DH_initMessage{}, verified{false} {};
+	};
+
+	/**
+	 * @brief Compute the X3DH sender side for a set of peer bundles as decribed in X3DH reference section 3.3
+	 *
+	 *  This part does not access local storage nor any Lime object member but the (already loaded) identity key, so it can be run on any thread
+	 *  The SPk signatures must have been verified before
+	 *  All the key exchanges of all the bundles are independent: they are performed in one batch
+	 *
+	 * @param[in]		peerBundles	the key bundles retrieved from the X3DH server
+	 * @param[in]		selfIk		our identity key pair, only read
+	 * @param[in]		selfIk_X	our identity key pair in key exchange format, only read
+	 * @param[in]		selfDeviceId	our device Id
+	 * @param[in]		rng		the random number generator used to create the ephemeral keys, it must not be shared with an other thread
+	 * @param[in,out]	outs		one per bundle: the peer Ik in key exchange format if it was cached (it is computed and set otherwise), the computed shared secret, AD and X3DH init message
+	 */
+	template <typename Curve>
+	static void X3DH_compute_senders(const std::vector<const X3DH_peerBundle<Curve> *> &peerBundles, DSApair<Curve> &selfIk, Xpair<Curve> &selfIk_X, const std::string &selfDeviceId, std::shared_ptr<RNG> rng, const std::vector<X3DH_senderInit<Curve> *> &outs) {
+		if (peerBundles.empty()) return;
+
+		// HKDF input : We will compute HKDF with a concat of F and all DH computed, see X3DH spec section 2.2 for what is F
+		// use sBuffer of size able to hold also DH4 even if we may not use it
+		constexpr size_t FSize = DSA<Curve, lime::DSAtype::publicKey>::ssize(); // F is of DSA public key size
+		constexpr size_t DHSize = X<Curve, lime::Xtype::sharedSecret>::ssize();
+		lime::secureVector<sBuffer<FSize + DHSize*4>> HKDF_inputs(peerBundles.size());
+		lime::secureVector<Xpair<Curve>> Eks(peerBundles.size()); // Ephemeral key Exchange key pairs
+		std::vector<XbatchEntry<Curve>> exchanges{};
+		exchanges.reserve(5*peerBundles.size());
+
+		auto DH = make_keyExchange<Curve>(); // used to convert the peer Ik to key exchange format
+		for (size_t i=0; i<peerBundles.size(); i++) {
+			const auto &peerBundle = *(peerBundles[i]);
+			auto &out = *(outs[i]);
+			auto &HKDF_input = HKDF_inputs[i];
+			auto &Ek = Eks[i];
+			HKDF_input.fill(0xFF); // HKDF_input holds F
+
+			// Generate Ephemeral key Exchange key pair: Ek, its public key is derived in the batch
+			rng->randomize(Ek.privateKey().data(), Ek.privateKey().size());
+			exchanges.push_back({&(Ek.privateKey()), nullptr, Ek.publicKey().data()});
+
+			if (!out.peerIk_X_cached) {
+				DH->set_peerPublic(peerBundle.Ik); // peer Ik Signature key is converted to keyExchange format
+				DH->get_peerPublic(out.peerIk_X); // keep the conversion so it can be cached
+			}
+
+			// DH1 = DH(self Ik, peer SPk), Ik already converted to keyExchange format
+			exchanges.push_back({&(selfIk_X.privateKey()), &(peerBundle.SPk), HKDF_input.data()+FSize});
+			// DH2 = DH(Ek, peer Ik)
+			exchanges.push_back({&(Ek.privateKey()), &(out.peerIk_X), HKDF_input.data()+FSize+DHSize});
+			// DH3 = DH(Ek, peer SPk)
+			exchanges.push_back({&(Ek.privateKey()), &(peerBundle.SPk), HKDF_input.data()+FSize+2*DHSize});
+			// DH4 = DH(Ek, peer OPk) (if any OPk in bundle)
+			if (peerBundle.bundleFlag == lime::X3DHKeyBundleFlag::OPk) {
+				exchanges.push_back({&(Ek.privateKey()), &(peerBundle.OPk), HKDF_input.data()+FSize+3*DHSize});
+			}
+		}
+		DH = nullptr; // be sure to destroy and clean the keyExchange object as soon as we do not need it anymore
+
+		X_batch<Curve>(exchanges); // HKDF_inputs now hold F || DH1 || DH2 || DH3 || DH4
+
+		/* as specified in X3DH spec section 2.2, use a as salt a 0 filled buffer long as the hash function output */
+		std::vector<uint8_t> salt(SHA512::ssize(), 0);
+		for (size_t i=0; i<peerBundles.size(); i++) {
+			const auto &peerBundle = *(peerBundles[i]);
+			auto &out = *(outs[i]);
+			const bool hasOPk = (peerBundle.bundleFlag == lime::X3DHKeyBundleFlag::OPk);
+
+			// Compute SK = HKDF(F || DH1 || DH2 || DH3 || DH4)
+			HMAC_KDF<SHA512>(salt.data(), salt.size(), HKDF_inputs[i].data(), FSize + DHSize*(hasOPk?4:3), lime::settings::X3DH_SK_info, out.SK.data(), out.SK.size());
+
+			// Generate X3DH init message: as in X3DH spec section 3.3:
+			double_ratchet_protocol::buildMessage_X3DHinit(out.X3DH_initMessage, selfIk.publicKey(), Eks[i].publicKey(), peerBundle.SPk_id, peerBundle.OPk_id, hasOPk);
+
+			// Generate the shared AD used in DR session
+			// AD is HKDF(session Initiator Ik || session receiver Ik || session Initiator device Id || session receiver device Id)
+			std::vector<uint8_t>AD_input{selfIk.publicKey().cbegin(), selfIk.publicKey().cend()};
+			AD_input.insert(AD_input.end(), peerBundle.Ik.cbegin(), peerBundle.Ik.cend());
+			AD_input.insert(AD_input.end(), selfDeviceId.cbegin(), selfDeviceId.cend());
+			AD_input.insert(AD_input.end(), peerBundle.deviceId.cbegin(), peerBundle.deviceId.cend());
+			HMAC_KDF<SHA512>(salt, AD_input, lime::settings::X3DH_AD_info, out.AD.data(), out.AD.size()); // use the same salt as for SK computation but a different info string
+		}
+	}
+
 	/**
 	 * @brief Get a vector of peer bundle and initiate a DR Session with it. Created sessions are stored in lime cache and db along the X3DH init packet
 	 *  as decribed in X3DH reference section 3.3
+	 *
+	 *  The process runs in three stages:
+	 *  - select the bundles to process (noBundle and renewal filtering), check the peer devices in local storage and look for their converted Ik in cache
+	 *  - verify the SPk signatures in batch and compute the X3DH shared secrets with batched key exchanges, spread over several threads when there are at least settings::X3DH_parallelInitThreshold bundles
+	 *  - insert the sessions and the newly converted peer Ik in cache, in the order of the given bundles
+	 *
+	 * @param[in]	peersBundle	the key bundles retrieved from the X3DH server
+	 * @param[in]	renewal		when true, the bundles were fetched to renew sessions close to their sending chain limit:
+	 * 				the new session replaces the cached one unless the peer replied meanwhile
 	 */
 	template <typename Curve>
-	void Lime<Curve>::X3DH_init_sender_session(const std::vector<X3DH_peerBundle<Curve>> &peersBundle) {
+	void Lime<Curve>::X3DH_init_sender_session(const std::vector<X3DH_peerBundle<Curve>> &peersBundle, const bool renewal) {
+		// select the bundles we shall build a session from
+		std::vector<const X3DH_peerBundle<Curve> *> bundles{};
+		bundles.reserve(peersBundle.size());
 		for (const auto &peerBundle : peersBundle) {
 			// do we have a key bundle to build this message from ?
 			if (peerBundle.bundleFlag == lime::X3DHKeyBundleFlag::noBundle) {
+				if (renewal) { // the current session is still usable: do not cache the device as bundleless, a later encryption retries the renewal
+					m_renewal_requested.erase(peerBundle.deviceId);
+				} else {
+					noBundle_cache_insert(peerBundle.deviceId); // do not ask the X3DH server again for a while
+				}
 				continue;
 			}
-			// Verifify SPk_signature, throw an exception if it fails
-			auto SPkVerify = make_Signature<Curve>();
-			SPkVerify->set_public(peerBundle.Ik);
-
-			if (!SPkVerify->verify(peerBundle.SPk, peerBundle.SPk_sig)) {
-				LIME_LOGE<<"X3DH: SPk signature verification failed for device "<<peerBundle.deviceId;
-				throw BCTBX_EXCEPTION << "Verify signature on SPk failed for deviceId "<<peerBundle.deviceId;
+			noBundle_cache_erase(peerBundle.deviceId);
+
+			if (renewal) {
+				// a reply from peer performed a DH ratchet step on the current session: it does not need to be renewed anymore
+				auto sessionElem = m_DR_sessions_cache.find(peerBundle.deviceId);
+				if (sessionElem != m_DR_sessions_cache.end() && sessionElem->second->isActive() && !sessionElem->second->needsRenewal()) {
+					m_renewal_requested.erase(peerBundle.deviceId);
+					continue;
+				}
 			}
+			bundles.push_back(&peerBundle);
+		}
+		if (bundles.empty()) return;
+
+		get_SelfIdentityKey(); // make sure it is in context, the computation stage only reads it
 
+		lime::secureVector<X3DH_senderInit<Curve>> inits(bundles.size()); // holds the shared secrets
+		for (size_t i=0; i<bundles.size(); i++) {
 			// before going on, check if peer informations are ok, if the returned Id is 0, it means this peer was not in storage yet
 			// throw an exception in case of failure, just let it flow up
-			auto peerDid = m_localStorage->check_peerDevice(peerBundle.deviceId, peerBundle.Ik);
-
-			// Initiate HKDF input : We will compute HKDF with a concat of F and all DH computed, see X3DH spec section 2.2 for what is F
-			// use sBuffer of size able to hold also DH$ even if we may not use it
-			sBuffer<DSA<Curve, lime::DSAtype::publicKey>::ssize() + X<Curve, lime::Xtype::sharedSecret>::ssize()*4> HKDF_input;
-			HKDF_input.fill(0xFF); // HKDF_input holds F
-			size_t HKDF_input_index = DSA<Curve, lime::DSAtype::publicKey>::ssize(); // F is of DSA public key size
+			inits[i].peerDid = m_localStorage->check_peerDevice(bundles[i]->deviceId, bundles[i]->Ik);
+			inits[i].peerIk_X_cached = peerIk_X_cache_find(inits[i].peerDid, bundles[i]->Ik, inits[i].peerIk_X);
+		}
 
-			// Compute DH1 = DH(self Ik, peer SPk) - selfIk context already holds selfIk.
-			get_SelfIdentityKey(); // make sure it is in context
-			auto DH = make_keyExchange<Curve>();
-			DH->set_secret(m_Ik.privateKey()); // Ik Signature key is converted to keyExchange format
-			DH->set_selfPublic(m_Ik.publicKey());
-			DH->set_peerPublic(peerBundle.SPk);
-			DH->computeSharedSecret();
-			auto DH_out = DH->get_sharedSecret();
-			std::copy_n(DH_out.cbegin(), DH_out.size(), HKDF_input.begin()+HKDF_input_index); // HKDF_input holds F || DH1
-			HKDF_input_index += DH_out.size();
-
-			// Generate Ephemeral key Exchange key pair: Ek, from now DH will hold Ek as private and self public key
-			DH->createKeyPair(m_RNG);
-
-			// Compute DH3 = DH(Ek, peer SPk) - peer SPk was already set as peer Public
-			DH->computeSharedSecret();
-			DH_out = DH->get_sharedSecret();
-			std::copy_n(DH_out.cbegin(), DH_out.size(), HKDF_input.begin()+HKDF_input_index + DH_out.size()); // HKDF_input holds F || DH1 || empty slot || DH3
-
-			// Compute DH2 = DH(Ek, peer Ik)
-			DH->set_peerPublic(peerBundle.Ik); // peer Ik Signature key is converted to keyExchange format
-			DH->computeSharedSecret();
-			DH_out = DH->get_sharedSecret();
-			std::copy_n(DH_out.cbegin(), DH_out.size(), HKDF_input.begin()+HKDF_input_index); // HKDF_input holds F || DH1 || DH2 || DH3
-			HKDF_input_index += 2*DH_out.size();
-
-			// Compute DH4 = DH(Ek, peer OPk) (if any OPk in bundle)
-			if (peerBundle.bundleFlag == lime::X3DHKeyBundleFlag::OPk) {
-				DH->set_peerPublic(peerBundle.OPk);
-				DH->computeSharedSecret();
-				DH_out = DH->get_sharedSecret();
-				std::copy_n(DH_out.cbegin(), DH_out.size(), HKDF_input.begin()+HKDF_input_index); // HKDF_input holds F || DH1 || DH2 || DH3 || DH4
-				HKDF_input_index += DH_out.size();
+		// compute the X3DH shared secrets: each bundle is independent so spread them over threads if there are enough
+		size_t workersCount = 1;
+		if (lime::settings::X3DH_parallelInitThreshold > 0) {
+			workersCount = std::max(static_cast<size_t>(1), std::min(static_cast<size_t>(std::thread::hardware_concurrency()), bundles.size()/lime::settings::X3DH_parallelInitThreshold));
+		}
+		auto compute = [this, &bundles, &inits, workersCount](const size_t workerIndex) {
+			// Verify the SPk signatures of this worker's bundles in one batch, if it fails check them one by one to find out which bundles are faulty
+			std::vector<SignedXPublicKey<Curve>> signedSPks{};
+			signedSPks.reserve(bundles.size()/workersCount + 1);
+			for (size_t i=workerIndex; i<bundles.size(); i+=workersCount) {
+				signedSPks.emplace_back(bundles[i]->Ik, bundles[i]->SPk, bundles[i]->SPk_sig);
 			}
+			bool allVerified = verify_batch<Curve>(signedSPks);
+			auto SPkVerify = allVerified?nullptr:make_Signature<Curve>();
+
+			std::vector<const X3DH_peerBundle<Curve> *> verifiedBundles{};
+			std::vector<X3DH_senderInit<Curve> *> verifiedInits{};
+			for (size_t i=workerIndex; i<bundles.size(); i+=workersCount) {
+				if (allVerified) {
+					inits[i].verified = true;
+				} else {
+					SPkVerify->set_public(bundles[i]->Ik);
+					inits[i].verified = SPkVerify->verify(bundles[i]->SPk, bundles[i]->SPk_sig);
+				}
+				if (inits[i].verified) {
+					verifiedBundles.push_back(bundles[i]);
+					verifiedInits.push_back(&(inits[i]));
+				}
+			}
+			X3DH_compute_senders<Curve>(verifiedBundles, m_Ik, m_Ik_X, m_selfDeviceId, thread_RNG(), verifiedInits); // the RNG of the running thread: no DRBG is created and seeded per call
+		};
+		if (workersCount > 1) {
+			LIME_LOGI<<"X3DH compute "<<bundles.size()<<" sessions on "<<workersCount<<" threads";
+			std::vector<std::future<void>> workers{};
+			workers.reserve(workersCount-1);
+			for (size_t w=1; w<workersCount; w++) {
+				workers.push_back(std::async(std::launch::async, compute, w));
+			}
+			compute(0);
+			for (auto &worker : workers) {
+				worker.get(); // would rethrow an exception raised in the worker
+			}
+		} else {
+			compute(0);
+		}
 
-			// Compute SK = HKDF(F || DH1 || DH2 || DH3 || DH4)
-			DRChainKey SK;
-			/* as specified in X3DH spec section 2.2, use a as salt a 0 filled buffer long as the hash function output */
-			std::vector<uint8_t> salt(SHA512::ssize(), 0);
-			HMAC_KDF<SHA512>(salt.data(), salt.size(), HKDF_input.data(), HKDF_input_index, lime::settings::X3DH_SK_info, SK.data(), SK.size());
-
-			// Generate X3DH init message: as in X3DH spec section 3.3:
-			std::vector<uint8_t> X3DH_initMessage{};
-			double_ratchet_protocol::buildMessage_X3DHinit(X3DH_initMessage, m_Ik.publicKey(), DH->get_selfPublic(), peerBundle.SPk_id, peerBundle.OPk_id, (peerBundle.bundleFlag == lime::X3DHKeyBundleFlag::OPk));
-
-			DH = nullptr; // be sure to destroy and clean the keyExchange object as soon as we do not need it anymore
+		// access local storage and sessions cache, in the bundles order
+		for (size_t i=0; i<bundles.size(); i++) {
+			const auto &peerBundle = *(bundles[i]);
+			auto &init = inits[i];
+			// Verifify SPk_signature, throw an exception if it failed
+			if (!init.verified) {
+				LIME_LOGE<<"X3DH: SPk signature verification failed for device "<<peerBundle.deviceId;
+				throw BCTBX_EXCEPTION << "Verify signature on SPk failed for deviceId "<<peerBundle.deviceId;
+			}
 
-			// Generate the shared AD used in DR session
-			SharedADBuffer AD; // AD is HKDF(session Initiator Ik || session receiver Ik || session Initiator device Id || session receiver device Id)
-			std::vector<uint8_t>AD_input{m_Ik.publicKey().cbegin(), m_Ik.publicKey().cend()};
-			AD_input.insert(AD_input.end(), peerBundle.Ik.cbegin(), peerBundle.Ik.cend());
-			AD_input.insert(AD_input.end(), m_selfDeviceId.cbegin(), m_selfDeviceId.cend());
-			AD_input.insert(AD_input.end(), peerBundle.deviceId.cbegin(), peerBundle.deviceId.cend());
-			HMAC_KDF<SHA512>(salt, AD_input, lime::settings::X3DH_AD_info, AD.data(), AD.size()); // use the same salt as for SK computation but a different info string
+			if (!init.peerIk_X_cached) {
+				peerIk_X_cache_insert(init.peerDid, peerBundle.Ik, init.peerIk_X);
+			}
 
 			// Generate DR_Session and put it in cache(but not in localStorage yet, that would be done when first message generation will be complete)
 			// it could happend that we eventually already have a session for this peer device if we received an initial message from it while fetching its key bundle(very unlikely but...)
 			// in that case just keep on building our new session so the peer device knows it must get rid of the OPk, sessions will eventually converge into only one when messages
 			// stop crossing themselves on the network.
 			// If the fetch bundle doesn't hold OPk, just ignore our newly built session, and use existing one
-			if (peerBundle.bundleFlag == lime::X3DHKeyBundleFlag::OPk) {
+			// When renewing, always replace the session in cache: the new one is saved as active(and the old one staled) at first encryption
+			if (peerBundle.bundleFlag == lime::X3DHKeyBundleFlag::OPk || renewal) {
 				m_DR_sessions_cache.erase(peerBundle.deviceId); // will just do nothing if this peerDeviceId is not in cache
 			}
 
-			m_DR_sessions_cache.emplace(peerBundle.deviceId, make_shared<DR<Curve>>(m_localStorage, SK, AD, peerBundle.SPk, peerDid, peerBundle.deviceId, peerBundle.Ik, m_db_Uid, X3DH_initMessage, m_RNG)); // will just do nothing if this peerDeviceId is already in cache
+			m_DR_sessions_cache.emplace(peerBundle.deviceId, make_secure_shared<DR<Curve>>(m_localStorage, init.SK, init.AD, peerBundle.SPk, init.peerDid, peerBundle.deviceId, peerBundle.Ik, m_db_Uid, init.X3DH_initMessage, m_RNG, m_AEAD)); // will just do nothing if this peerDeviceId is already in cache
 
+			m_renewal_requested.erase(peerBundle.deviceId); // a session renewal can be requested again for this device
 			LIME_LOGI<<"X3DH created session with device "<<peerBundle.deviceId;
 		}
 	}
 
 	template <typename Curve>
-	std::shared_ptr<DR<Curve>> Lime<Curve>::X3DH_init_receiver_session(const std::vector<uint8_t> X3DH_initMessage, const std::string &senderDeviceId) {
+	std::shared_ptr<DR<Curve>> Lime<Curve>::X3DH_init_receiver_session(const lime::span<const uint8_t> X3DH_initMessage, const std::string &senderDeviceId, uint32_t &OPk_id) {
 		DSA<Curve, lime::DSAtype::publicKey> peerIk{};
 		X<Curve, lime::Xtype::publicKey> Ek{};
 		bool OPk_flag = false;
-		uint32_t SPk_id=0, OPk_id=0;
+		uint32_t SPk_id=0;
+		OPk_id=0;
 
 		double_ratchet_protocol::parseMessage_X3DHinit(X3DH_initMessage, peerIk, Ek, SPk_id, OPk_id, OPk_flag);
 
@@ -145,6 +276,11 @@ namespace lime {
 			X3DH_get_OPk(OPk_id, OPk); // this one will throw an exception if the OPk is not found in local storage, let it flow up
 		}
 
+		// check the new peer device Id in Storage, if it is not found, the DR session will add it when it saves itself after successful decryption
+		auto peerDid = m_localStorage->check_peerDevice(senderDeviceId, peerIk);
+		X<Curve, lime::Xtype::publicKey> peerIk_X{};
+		bool peerIk_X_cached = peerIk_X_cache_find(peerDid, peerIk, peerIk_X);
+
 		// Compute 	DH1 = DH(SPk, peer Ik)
 		// 		DH2 = DH(self Ik, Ek)
 		// 		DH3 = DH(SPk, Ek)
@@ -156,44 +292,26 @@ namespace lime {
 		HKDF_input.fill(0xFF); // HKDF_input holds F
 		size_t HKDF_input_index = DSA<Curve, lime::DSAtype::publicKey>::ssize(); // F is of DSA public key size
 
-		auto DH = make_keyExchange<Curve>();
-
-		// DH1 (SPk, peerIk)
-		DH->set_secret(SPk.privateKey());
-		DH->set_selfPublic(SPk.publicKey());
-		DH->set_peerPublic(peerIk); // peer Ik key is converted from Signature to key exchange format
-		DH->computeSharedSecret();
-		auto DH_out = DH->get_sharedSecret();
-		std::copy_n(DH_out.cbegin(), DH_out.size(), HKDF_input.begin()+HKDF_input_index); // HKDF_input holds F || DH1
-		HKDF_input_index += DH_out.size();
-
-		// Then DH3 = DH(SPk, Ek) as we already have SPk in the key Exchange context, we will go back for DH2 after this one
-		DH->set_peerPublic(Ek);
-		DH->computeSharedSecret();
-		DH_out = DH->get_sharedSecret();
-		std::copy_n(DH_out.cbegin(), DH_out.size(), HKDF_input.begin()+HKDF_input_index + DH_out.size()); // HKDF_input holds F || DH1 || empty slot || DH3
-
-		// DH2 = DH(self Ik, Ek), Ek is already DH context
-		// convert self ED Ik pair into X keys
-		get_SelfIdentityKey(); // make sure self IK is in context
-		DH->set_secret(m_Ik.privateKey()); // self Ik key is converted from Signature to key exchange format
-		DH->set_selfPublic(m_Ik.publicKey());
-		DH->computeSharedSecret();
-		DH_out = DH->get_sharedSecret();
-		std::copy_n(DH_out.cbegin(), DH_out.size(), HKDF_input.begin()+HKDF_input_index); // HKDF_input holds F || DH1 || DH2 || DH3
-		HKDF_input_index += 2*DH_out.size();
-
-		if (OPk_flag) { // there is an OPk id
-			// DH4 = DH(OPk, Ek) Ek is already in context
-			DH->set_secret(OPk.privateKey());
-			DH->set_selfPublic(OPk.publicKey());
-			DH->computeSharedSecret();
-			DH_out = DH->get_sharedSecret();
-			std::copy_n(DH_out.cbegin(), DH_out.size(), HKDF_input.begin()+HKDF_input_index); // HKDF_input holds F || DH1 || DH2 || DH3 DH4
-			HKDF_input_index += DH_out.size();
+		// DH1 uses the peer Ik in key exchange format: convert it if it is not cached
+		if (!peerIk_X_cached) {
+			auto DH = make_keyExchange<Curve>();
+			DH->set_peerPublic(peerIk); // peer Ik key is converted from Signature to key exchange format
+			DH->get_peerPublic(peerIk_X);
+			peerIk_X_cache_insert(peerDid, peerIk, peerIk_X);
 		}
-
-		DH = nullptr; // be sure to destroy and clean the keyExchange object as soon as we do not need it anymore
+		get_SelfIdentityKey(); // make sure self IK is in context, it holds its conversion to X keys
+
+		// compute all the DH in one batch, directly in the HKDF input buffer
+		constexpr size_t DHSize = X<Curve, lime::Xtype::sharedSecret>::ssize();
+		const std::array<XbatchEntry<Curve>, 4> exchanges{{
+			{&(SPk.privateKey()), &peerIk_X, HKDF_input.data()+HKDF_input_index}, // DH1
+			{&(m_Ik_X.privateKey()), &Ek, HKDF_input.data()+HKDF_input_index+DHSize}, // DH2
+			{&(SPk.privateKey()), &Ek, HKDF_input.data()+HKDF_input_index+2*DHSize}, // DH3
+			{&(OPk.privateKey()), &Ek, HKDF_input.data()+HKDF_input_index+3*DHSize} // DH4, only if there is an OPk id
+		}};
+		const size_t exchangesCount = OPk_flag?4:3;
+		X_batch<Curve>(exchanges.data(), exchangesCount);
+		HKDF_input_index += exchangesCount*DHSize; // HKDF_input holds F || DH1 || DH2 || DH3 || DH4(optionnal)
 
 		// Compute SK = HKDF(F || DH1 || DH2 || DH3 || DH4) (DH4 optionnal)
 		DRChainKey SK;
@@ -209,22 +327,59 @@ namespace lime {
 		AD_input.insert(AD_input.end(), m_selfDeviceId.cbegin(), m_selfDeviceId.cend());
 		HMAC_KDF<SHA512>(salt, AD_input, lime::settings::X3DH_AD_info, AD.data(), AD.size()); // use the same salt as for SK computation but a different info string
 
-		// check the new peer device Id in Storage, if it is not found, the DR session will add it when it saves itself after successful decryption
-		auto peerDid = m_localStorage->check_peerDevice(senderDeviceId, peerIk);
-		auto DRSession = make_shared<DR<Curve>>(m_localStorage, SK, AD, SPk, peerDid, senderDeviceId, OPk_flag?OPk_id:0, peerIk, m_db_Uid, m_RNG);
+		auto DRSession = make_secure_shared<DR<Curve>>(m_localStorage, SK, AD, SPk, peerDid, senderDeviceId, OPk_flag?OPk_id:0, peerIk, m_db_Uid, m_RNG);
 
 		return DRSession;
 	}
 
+	/**
+	 * @brief Get the key exchange format of a peer device Ik if we already converted it
+	 *
+	 * @param[in]	peerDid		the peer device Id in local storage, nothing is cached for devices not in local storage(Id 0)
+	 * @param[in]	peerIk		the peer device Ik, the cached conversion is used only if it was computed from this one
+	 * @param[out]	peerIk_X	the peer Ik in key exchange format, untouched if not found
+	 *
+	 * @return true if the converted key was found in cache
+	 */
+	template <typename Curve>
+	bool Lime<Curve>::peerIk_X_cache_find(const long int peerDid, const DSA<Curve, lime::DSAtype::publicKey> &peerIk, X<Curve, lime::Xtype::publicKey> &peerIk_X) {
+		if (peerDid == 0) return false;
+		auto cached = m_peerIk_X_cache.find(peerDid);
+		if (cached == m_peerIk_X_cache.end() || cached->second.first != peerIk) return false;
+		peerIk_X = cached->second.second;
+		return true;
+	}
+
+	/**
+	 * @brief Store the key exchange format of a peer device Ik
+	 * When the cache holds settings::X3DH_peerIkCacheSize keys, an arbitrary one is removed
+	 *
+	 * @param[in]	peerDid		the peer device Id in local storage, nothing is cached for devices not in local storage(Id 0)
+	 * @param[in]	peerIk		the peer device Ik
+	 * @param[in]	peerIk_X	the peer Ik in key exchange format
+	 */
+	template <typename Curve>
+	void Lime<Curve>::peerIk_X_cache_insert(const long int peerDid, const DSA<Curve, lime::DSAtype::publicKey> &peerIk, const X<Curve, lime::Xtype::publicKey> &peerIk_X) {
+		if (peerDid == 0 || lime::settings::X3DH_peerIkCacheSize == 0) return;
+		if (m_peerIk_X_cache.size() >= lime::settings::X3DH_peerIkCacheSize && m_peerIk_X_cache.count(peerDid) == 0) {
+			m_peerIk_X_cache.erase(m_peerIk_X_cache.begin());
+		}
+		m_peerIk_X_cache[peerDid] = std::make_pair(peerIk, peerIk_X);
+	}
+
 	/* Instanciate templated member functions */
 #ifdef EC25519_ENABLED
-	template void Lime<C255>::X3DH_init_sender_session(const std::vector<X3DH_peerBundle<C255>> &peerBundle);
-	template std::shared_ptr<DR<C255>> Lime<C255>::X3DH_init_receiver_session(const std::vector<uint8_t> X3DH_initMessage, const std::string &peerDeviceId);
+	template void Lime<C255>::X3DH_init_sender_session(const std::vector<X3DH_peerBundle<C255>> &peerBundle, const bool renewal);
+	template std::shared_ptr<DR<C255>> Lime<C255>::X3DH_init_receiver_session(const lime::span<const uint8_t> X3DH_initMessage, const std::string &peerDeviceId, uint32_t &OPk_id);
+	template bool Lime<C255>::peerIk_X_cache_find(const long int peerDid, const DSA<C255, lime::DSAtype::publicKey> &peerIk, X<C255, lime::Xtype::publicKey> &peerIk_X);
+	template void Lime<C255>::peerIk_X_cache_insert(const long int peerDid, const DSA<C255, lime::DSAtype::publicKey> &peerIk, const X<C255, lime::Xtype::publicKey> &peerIk_X);
 #endif
 
 #ifdef EC448_ENABLED
-	template void Lime<C448>::X3DH_init_sender_session(const std::vector<X3DH_peerBundle<C448>> &peerBundle);
-	template std::shared_ptr<DR<C448>> Lime<C448>::X3DH_init_receiver_session(const std::vector<uint8_t> X3DH_initMessage, const std::string &peerDeviceId);
+	template void Lime<C448>::X3DH_init_sender_session(const std::vector<X3DH_peerBundle<C448>> &peerBundle, const bool renewal);
+	template std::shared_ptr<DR<C448>> Lime<C448>::X3DH_init_receiver_session(const lime::span<const uint8_t> X3DH_initMessage, const std::string &peerDeviceId, uint32_t &OPk_id);
+	template bool Lime<C448>::peerIk_X_cache_find(const long int peerDid, const DSA<C448, lime::DSAtype::publicKey> &peerIk, X<C448, lime::Xtype::publicKey> &peerIk_X);
+	template void Lime<C448>::peerIk_X_cache_insert(const long int peerDid, const DSA<C448, lime::DSAtype::publicKey> &peerIk, const X<C448, lime::Xtype::publicKey> &peerIk_X);
 #endif
 
 }
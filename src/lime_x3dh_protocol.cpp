@@ -28,6 +28,7 @@
 #include <iostream> // ostreamstring to generate incoming/outgoing messages debug trace
 #include <iomanip>
 #include <mutex>
+#include <algorithm>
 
 
 using namespace::std;
@@ -149,20 +150,46 @@ namespace lime {
 			return "inconsistent"; // to make compiler happy, there is no reason to end here actually
 		}
 
+		/**
+		 * @brief Stream a buffer as comma separated hexadecimal bytes in the messages traces
+		 *
+		 * Given to a LIME_LOGx stream, the dump is produced only when the log is actually emitted
+		 */
+		struct hexDump {
+			const lime::span<const uint8_t> buffer; /**< the buffer to dump */
+		};
+		static std::ostream &operator<<(std::ostream &os, const hexDump &dump) {
+			const auto flags = os.flags();
+			const auto fill = os.fill('0');
+			os << hex;
+			for (const auto byte : dump.buffer) {
+				os << setw(2) << static_cast<unsigned int>(byte) << ", ";
+			}
+			os.flags(flags);
+			os.fill(fill);
+			return os;
+		}
+
 		/**
 		 * @brief Build X3DH message header using current protocol Version byte
 		 *
+		 * The message buffer is reset and its capacity reserved for the whole message so the builders append the body without reallocation
+		 *
+		 * @param[out]	message		the buffer holding the well formed header ready to be expanded to include the message body
 		 * @param[in]	message_type	The message type we are creating
 		 * @param[in]	curve		The curve Id we're working with
-		 *
-		 * @return	a vector holding the well formed header ready to be expanded to include the message body
+		 * @param[in]	bodySize	size of the message body the caller is about to append
 		 */
-		static std::vector<uint8_t> X3DH_makeHeader(const x3dh_message_type message_type, const lime::CurveId curve) noexcept{
+		static void X3DH_makeHeader(std::vector<uint8_t> &message, const x3dh_message_type message_type, const lime::CurveId curve, const size_t bodySize) noexcept{
 			LIME_LOGI<<hex<<setfill('0')<<"Build outgoing X3DH message:"<<endl
 				<<"    Protocol Version is 0x"<<setw(2)<<static_cast<unsigned int>(X3DH_protocolVersion)<<endl
 				<<"    Message Type is "<<x3dh_messageTypeString(message_type)<<" (0x"<<setw(2)<<static_cast<unsigned int>(message_type)<<")"<<endl
 				<<"    CurveId is 0x"<<setw(2)<<static_cast<unsigned int>(curve);
-			return std::vector<uint8_t> {X3DH_protocolVersion, static_cast<uint8_t>(message_type), static_cast<uint8_t>(curve)};
+			message.clear();
+			message.reserve(X3DH_headerSize + bodySize);
+			message.push_back(X3DH_protocolVersion);
+			message.push_back(static_cast<uint8_t>(message_type));
+			message.push_back(static_cast<uint8_t>(curve));
 		}
 
 		/**
@@ -178,8 +205,17 @@ namespace lime {
 		 */
 		template <typename Curve>
 		void buildMessage_registerUser(std::vector<uint8_t> &message, const DSA<Curve, lime::DSAtype::publicKey> &Ik, const X<Curve, lime::Xtype::publicKey> &SPk, const DSA<Curve, lime::DSAtype::signature> &Sig, const uint32_t SPk_id, const std::vector<X<Curve, lime::Xtype::publicKey>> &OPks, const std::vector<uint32_t> &OPk_ids) noexcept {
+			// check we do not try to upload more than 2^16 OPks as the counter is on 2 bytes
+			auto OPkCount = OPks.size();
+			if (OPkCount > 0xFFFF) {
+				OPkCount = 0xFFFF;
+				LIME_LOGW << "Trying to publish "<<static_cast<unsigned int>(OPks.size())<<" OPks wich is more than the maximum allowed. Actually publish the first 2^16 and discard the rest";
+			}
+
 			// create the header
-			message = X3DH_makeHeader(x3dh_message_type::registerUser, Curve::curveId());
+			X3DH_makeHeader(message, x3dh_message_type::registerUser, Curve::curveId(),
+				DSA<Curve, lime::DSAtype::publicKey>::ssize() + X<Curve, lime::Xtype::publicKey>::ssize() + DSA<Curve, lime::DSAtype::signature>::ssize() + 4 // Ik, SPk, Sig, SPk Id
+				+ 2 + OPkCount*(X<Curve, lime::Xtype::publicKey>::ssize() + 4)); // OPk count, OPks and their Ids
 			// append the Ik
 			message.insert(message.end(), Ik.cbegin(), Ik.cend());
 			// append SPk, Signature and SPkId
@@ -190,51 +226,33 @@ namespace lime {
 			message.push_back(static_cast<uint8_t>((SPk_id>>8)&0xFF));
 			message.push_back(static_cast<uint8_t>((SPk_id)&0xFF));
 
-			// check we do not try to upload more than 2^16 OPks as the counter is on 2 bytes
-			auto OPkCount = OPks.size();
-			if (OPkCount > 0xFFFF) {
-				OPkCount = 0xFFFF;
-				LIME_LOGW << "Trying to publish "<<static_cast<unsigned int>(OPks.size())<<" OPks wich is more than the maximum allowed. Actually publish the first 2^16 and discard the rest";
-			}
-
 			// append OPks number and a sequence of OPk || OPk_id
 			message.push_back(static_cast<uint8_t>(((OPkCount)>>8)&0xFF));
 			message.push_back(static_cast<uint8_t>((OPkCount)&0xFF));
 
-			// debug trace
-			ostringstream message_trace;
-			message_trace << hex << setfill('0') << "Outgoing X3DH registerUser message holds:"<<endl<<"    Ik:";
-			std::for_each(Ik.cbegin(), Ik.cend(), [&message_trace] (unsigned int i) {
-				message_trace << setw(2) << i << ", ";
-			});
-
-			message_trace <<endl<<"    SPk:";
-			std::for_each(SPk.cbegin(), SPk.cend(), [&message_trace] (unsigned int i) {
-				message_trace << setw(2) << i << ", ";
-			});
-			message_trace << endl <<"    SPk Signature:";
-			std::for_each(Sig.cbegin(), Sig.cend(), [&message_trace] (unsigned int i) {
-				message_trace << setw(2) << i << ", ";
-			});
-			message_trace << endl <<"    SPk Id: 0x"<< setw(8) << static_cast<unsigned int>(SPk_id);
-
-			message_trace << endl << dec << setfill('0') << "    " << static_cast<unsigned int>(OPkCount)<<" OPks."<< hex;
-
 			for (decltype(OPkCount) i=0; i<OPkCount; i++) {
 				message.insert(message.end(), OPks[i].cbegin(), OPks[i].cend());
 				message.push_back(static_cast<uint8_t>((OPk_ids[i]>>24)&0xFF));
 				message.push_back(static_cast<uint8_t>((OPk_ids[i]>>16)&0xFF));
 				message.push_back(static_cast<uint8_t>((OPk_ids[i]>>8)&0xFF));
 				message.push_back(static_cast<uint8_t>((OPk_ids[i])&0xFF));
-
-				// debug trace
-				message_trace << endl <<"        OPk id: 0x"<< setw(8) << static_cast<unsigned int>(OPk_ids[i]) <<"        OPk:";
-				std::for_each(OPks[i].cbegin(), OPks[i].cend(), [&message_trace] (unsigned int i) {
-					message_trace << setw(2) << i << ", ";
-				});
 			}
 
-			LIME_LOGI<<message_trace.str();
+			// debug trace
+			if (LIME_LOGI_ENABLED) {
+				ostringstream message_trace;
+				message_trace << hex << setfill('0') << "Outgoing X3DH registerUser message holds:"<<endl<<"    Ik:"<<hexDump{Ik};
+				message_trace <<endl<<"    SPk:"<<hexDump{SPk};
+				message_trace << endl <<"    SPk Signature:"<<hexDump{Sig};
+				message_trace << endl <<"    SPk Id: 0x"<< setw(8) << static_cast<unsigned int>(SPk_id);
+
+				message_trace << endl << dec << setfill('0') << "    " << static_cast<unsigned int>(OPkCount)<<" OPks."<< hex;
+				for (decltype(OPkCount) i=0; i<OPkCount; i++) {
+					message_trace << endl <<"        OPk id: 0x"<< setw(8) << static_cast<unsigned int>(OPk_ids[i]) <<"        OPk:"<<hexDump{OPks[i]};
+				}
+
+				LIME_LOGI<<message_trace.str();
+			}
 		}
 
 		/**
@@ -247,7 +265,7 @@ namespace lime {
 		template <typename Curve>
 		void buildMessage_deleteUser(std::vector<uint8_t> &message) noexcept {
 			// create the header
-			message = X3DH_makeHeader(x3dh_message_type::deleteUser, Curve::curveId());
+			X3DH_makeHeader(message, x3dh_message_type::deleteUser, Curve::curveId(), 0);
 		}
 
 
@@ -266,7 +284,7 @@ namespace lime {
 		template <typename Curve>
 		void buildMessage_publishSPk(std::vector<uint8_t> &message, const X<Curve, lime::Xtype::publicKey> &SPk, const DSA<Curve, lime::DSAtype::signature> &Sig, const uint32_t SPk_id) noexcept {
 			// create the header
-			message = X3DH_makeHeader(x3dh_message_type::postSPk, Curve::curveId());
+			X3DH_makeHeader(message, x3dh_message_type::postSPk, Curve::curveId(), X<Curve, lime::Xtype::publicKey>::ssize() + DSA<Curve, lime::DSAtype::signature>::ssize() + 4);
 			// append SPk, Signature and SPkId
 			message.insert(message.end(), SPk.cbegin(), SPk.cend());
 			message.insert(message.end(), Sig.cbegin(), Sig.cend());
@@ -276,17 +294,9 @@ namespace lime {
 			message.push_back(static_cast<uint8_t>((SPk_id)&0xFF));
 
 			// debug trace
-			ostringstream message_trace;
-			message_trace << hex << setfill('0') << "Outgoing X3DH postSPk message holds:"<<endl<<"    SPk:";
-			std::for_each(SPk.cbegin(), SPk.cend(), [&message_trace] (unsigned int i) {
-				message_trace << setw(2) << i << ", ";
-			});
-			message_trace << endl <<"    SPk Signature:";
-			std::for_each(Sig.cbegin(), Sig.cend(), [&message_trace] (unsigned int i) {
-				message_trace << setw(2) << i << ", ";
-			});
-			message_trace << endl <<"    SPk Id: 0x"<< setw(8) << static_cast<unsigned int>(SPk_id);
-			LIME_LOGI<<message_trace.str();
+			LIME_LOGI << hex << setfill('0') << "Outgoing X3DH postSPk message holds:"<<endl<<"    SPk:"<<hexDump{SPk}
+				<< endl <<"    SPk Signature:"<<hexDump{Sig}
+				<< endl <<"    SPk Id: 0x"<< setw(8) << static_cast<unsigned int>(SPk_id);
 		}
 
 		/**
@@ -302,9 +312,6 @@ namespace lime {
 		 */
 		template <typename Curve>
 		void buildMessage_publishOPks(std::vector<uint8_t> &message, const std::vector<X<Curve, lime::Xtype::publicKey>> &OPks, const std::vector<uint32_t> &OPk_ids) noexcept {
-			// create the header
-			message = X3DH_makeHeader(x3dh_message_type::postOPks, Curve::curveId());
-
 			auto OPkCount = OPks.size();
 
 			// check we do not try to upload more than 2^16 OPks as the counter is on 2 bytes
@@ -313,30 +320,30 @@ namespace lime {
 				LIME_LOGW << "Trying to publish "<<static_cast<unsigned int>(OPks.size())<<" OPks wich is more than the maximum allowed. Actually publish the first 2^!6 and discard the rest";
 			}
 
+			// create the header
+			X3DH_makeHeader(message, x3dh_message_type::postOPks, Curve::curveId(), 2 + OPkCount*(X<Curve, lime::Xtype::publicKey>::ssize() + 4));
+
 			// append OPks number and a sequence of OPk || OPk_id
 			message.push_back(static_cast<uint8_t>(((OPkCount)>>8)&0xFF));
 			message.push_back(static_cast<uint8_t>((OPkCount)&0xFF));
 
-			// debug trace
-			ostringstream message_trace;
-			message_trace << dec << setfill('0') << "Outgoing X3DH postOPks message holds "<< static_cast<unsigned int>(OPkCount)<<" OPks."<< hex;
-
 			for (decltype(OPkCount) i=0; i<OPkCount; i++) {
 				message.insert(message.end(), OPks[i].cbegin(), OPks[i].cend());
 				message.push_back(static_cast<uint8_t>((OPk_ids[i]>>24)&0xFF));
 				message.push_back(static_cast<uint8_t>((OPk_ids[i]>>16)&0xFF));
 				message.push_back(static_cast<uint8_t>((OPk_ids[i]>>8)&0xFF));
 				message.push_back(static_cast<uint8_t>((OPk_ids[i])&0xFF));
-
-				// debug trace
-				message_trace << endl <<"    OPk id: 0x"<< setw(8) << static_cast<unsigned int>(OPk_ids[i]) <<"    OPk:";
-				std::for_each(OPks[i].cbegin(), OPks[i].cend(), [&message_trace] (unsigned int i) {
-					message_trace << setw(2) << i << ", ";
-				});
 			}
 
-			//debug trace
-			LIME_LOGI<<message_trace.str();
+			// debug trace
+			if (LIME_LOGI_ENABLED) {
+				ostringstream message_trace;
+				message_trace << dec << setfill('0') << "Outgoing X3DH postOPks message holds "<< static_cast<unsigned int>(OPkCount)<<" OPks."<< hex;
+				for (decltype(OPkCount) i=0; i<OPkCount; i++) {
+					message_trace << endl <<"    OPk id: 0x"<< setw(8) << static_cast<unsigned int>(OPk_ids[i]) <<"    OPk:"<<hexDump{OPks[i]};
+				}
+				LIME_LOGI<<message_trace.str();
+			}
 		}
 
 		/**
@@ -351,21 +358,21 @@ namespace lime {
 		 */
 		template <typename Curve>
 		void buildMessage_getPeerBundles(std::vector<uint8_t> &message, std::vector<std::string> &peer_device_ids) noexcept {
-			// create the header
-			message = X3DH_makeHeader(x3dh_message_type::getPeerBundle, Curve::curveId());
-
-			// append peer number
-			message.push_back(static_cast<uint8_t>(((peer_device_ids.size())>>8)&0xFF));
-			message.push_back(static_cast<uint8_t>((peer_device_ids.size())&0xFF));
-
 			if (peer_device_ids.size()>0xFFFF) { // we're asking for more than 2^16 key bundles, really?
 				LIME_LOGW<<"We are about to request for more than 2^16 key bundles to the X3DH server, it won't fit in protocol, truncate the request to 2^16 but it's very very unusual";
 				peer_device_ids.resize(0xFFFF); // resize to max possible value
 			}
 
-			// debug trace
-			ostringstream message_trace;
-			message_trace << dec << setfill('0') << "Outgoing X3DH getPeerBundles message holds "<< static_cast<unsigned int>(peer_device_ids.size())<<" devices id."<< hex;
+			// create the header
+			size_t bodySize = 2;
+			for (const auto &peer_device_id : peer_device_ids) {
+				bodySize += 2 + peer_device_id.size();
+			}
+			X3DH_makeHeader(message, x3dh_message_type::getPeerBundle, Curve::curveId(), bodySize);
+
+			// append peer number
+			message.push_back(static_cast<uint8_t>(((peer_device_ids.size())>>8)&0xFF));
+			message.push_back(static_cast<uint8_t>((peer_device_ids.size())&0xFF));
 
 			// append a sequence of peer device Id size(on 2 bytes) || device id
 			for (const auto &peer_device_id : peer_device_ids) {
@@ -373,16 +380,18 @@ namespace lime {
 				message.push_back(static_cast<uint8_t>((peer_device_id.size())&0xFF));
 				message.insert(message.end(),peer_device_id.cbegin(), peer_device_id.cend());
 				LIME_LOGI<<"Request X3DH keys for device "<<peer_device_id;
-
-				// debug trace
-				message_trace << endl << dec <<"    Device id("<< static_cast<unsigned int>(peer_device_id.size())<<"bytes): "<<peer_device_id<<" HEX:"<<hex;
-				std::for_each(peer_device_id.cbegin(), peer_device_id.cend(), [&message_trace] (unsigned int i) {
-					message_trace << setw(2) << i << ", ";
-				});
 			}
 
-			//debug trace
-			LIME_LOGI<<message_trace.str();
+			// debug trace
+			if (LIME_LOGI_ENABLED) {
+				ostringstream message_trace;
+				message_trace << dec << setfill('0') << "Outgoing X3DH getPeerBundles message holds "<< static_cast<unsigned int>(peer_device_ids.size())<<" devices id."<< hex;
+				for (const auto &peer_device_id : peer_device_ids) {
+					message_trace << endl << dec <<"    Device id("<< static_cast<unsigned int>(peer_device_id.size())<<"bytes): "<<peer_device_id<<" HEX:"
+						<<hexDump{{reinterpret_cast<const uint8_t *>(peer_device_id.data()), peer_device_id.size()}};
+				}
+				LIME_LOGI<<message_trace.str();
+			}
 		}
 
 		/**
@@ -395,7 +404,7 @@ namespace lime {
 		template <typename Curve>
 		void buildMessage_getSelfOPks(std::vector<uint8_t> &message) noexcept {
 			// create the header
-			message = X3DH_makeHeader(x3dh_message_type::getSelfOPks, Curve::curveId());
+			X3DH_makeHeader(message, x3dh_message_type::getSelfOPks, Curve::curveId(), 0);
 		}
 
 
@@ -410,99 +419,88 @@ namespace lime {
 		 * @return	true if message is well formed(check performed mostly on header value, correct header but not well formed message body are not detected at this point)
 		 */
 		template <typename Curve>
-		bool parseMessage_getType(const std::vector<uint8_t> &body, x3dh_message_type &message_type, x3dh_error_code &error_code, const limeCallback callback) noexcept {
-			// Trace incoming message parsing their content to display human readable trace
-			ostringstream message_trace;
-			message_trace << hex << setfill('0') << "Incoming X3DH message: "<<endl;
-			// first display the whole message in hexa
-			std::for_each(body.cbegin(), body.cend(), [&message_trace] (unsigned int i) {
-				message_trace << setw(2) << i << ", ";
-			});
+		bool parseMessage_getType(const lime::span<const uint8_t> body, x3dh_message_type &message_type, x3dh_error_code &error_code, const limeCallback callback) noexcept {
+			// Trace incoming message parsing their content to display human readable trace: the whole message in hexa then its header
+			// it is given to the logs and thus built only when they are emitted
+			const auto message_trace = [&body](const std::string &messageType) {
+				ostringstream trace;
+				trace << hex << setfill('0') << "Incoming X3DH message: "<<endl<<hexDump{body};
+				if (!messageType.empty()) {
+					trace<<endl<<"    Protocol Version is 0x"<<setw(2)<<static_cast<unsigned int>(body[0])<<endl
+						<<"    Message Type is "<<messageType<<" (0x"<<setw(2)<<static_cast<unsigned int>(body[1])<<")"<<endl
+						<<"    CurveId is 0x"<<setw(2)<<static_cast<unsigned int>(body[2])<<endl;
+				}
+				return trace.str();
+			};
 
 			// check message holds at leat a header before trying to read it
 			if (body.size()<X3DH_headerSize) {
-				LIME_LOGE<<"Got an invalid response from X3DH server"<<endl<< message_trace.str()<<endl<<"    Invalid Incoming X3DH message";
+				LIME_LOGE<<"Got an invalid response from X3DH server"<<endl<< message_trace("")<<endl<<"    Invalid Incoming X3DH message";
 				if (callback) callback(lime::CallbackReturn::fail, "Got an invalid response from X3DH server");
-				LIME_LOGE<<message_trace.str()<<endl;
+				LIME_LOGE<<message_trace("")<<endl;
 				return false;
 			}
 
 			// check X3DH protocol version
 			if (body[0] != static_cast<uint8_t>(X3DH_protocolVersion)) {
-				LIME_LOGE<<"X3DH server runs an other version of X3DH protocol(server "<<static_cast<unsigned int>(body[0])<<" - local "<<static_cast<unsigned int>(X3DH_protocolVersion)<<")"<<endl<<message_trace.str()<<endl<<"    Invalid Incoming X3DH message";
+				LIME_LOGE<<"X3DH server runs an other version of X3DH protocol(server "<<static_cast<unsigned int>(body[0])<<" - local "<<static_cast<unsigned int>(X3DH_protocolVersion)<<")"<<endl<<message_trace("")<<endl<<"    Invalid Incoming X3DH message";
 				if (callback) callback(lime::CallbackReturn::fail, "X3DH server and client protocol version mismatch");
-				LIME_LOGE<<message_trace.str()<<endl;
+				LIME_LOGE<<message_trace("")<<endl;
 				return false;
 			}
 
 			// check curve id
 			if (body[2] != static_cast<uint8_t>(Curve::curveId())) {
-				LIME_LOGE<<"X3DH server runs curve Id "<<static_cast<unsigned int>(body[2])<<" while local is set to "<<static_cast<unsigned int>(Curve::curveId())<<" for this server)"<<endl<<message_trace.str()<<endl<<"    Invalid Incoming X3DH message";
+				LIME_LOGE<<"X3DH server runs curve Id "<<static_cast<unsigned int>(body[2])<<" while local is set to "<<static_cast<unsigned int>(Curve::curveId())<<" for this server)"<<endl<<message_trace("")<<endl<<"    Invalid Incoming X3DH message";
 				if (callback) callback(lime::CallbackReturn::fail, "X3DH server and client curve Id mismatch");
 				return false;
 			}
 
-			// message trace: add the protocol version, message type is appended in the switch
-			message_trace<<endl<<"    Protocol Version is 0x"<<setw(2)<<static_cast<unsigned int>(body[0])<<endl;
-
 			// retrieve message_type from body[1]
 			switch (static_cast<uint8_t>(body[1])) {
 				case static_cast<uint8_t>(x3dh_message_type::registerUser) :
 					message_type = x3dh_message_type::registerUser;
-					message_trace<<"    Message Type is registerUser (0x"<<setw(2)<<static_cast<unsigned int>(x3dh_message_type::registerUser)<<")";
 					break;
 				case static_cast<uint8_t>(x3dh_message_type::deleteUser) :
 					message_type = x3dh_message_type::deleteUser;
-					message_trace<<"    Message Type is deleteUser (0x"<<setw(2)<<static_cast<unsigned int>(x3dh_message_type::deleteUser)<<")";
 					break;
 				case static_cast<uint8_t>(x3dh_message_type::postSPk) :
 					message_type = x3dh_message_type::postSPk;
-					message_trace<<"    Message Type is postSPk (0x"<<setw(2)<<static_cast<unsigned int>(x3dh_message_type::postSPk)<<")";
 					break;
 				case static_cast<uint8_t>(x3dh_message_type::postOPks) :
 					message_type = x3dh_message_type::postOPks;
-					message_trace<<"    Message Type is postOPks (0x"<<setw(2)<<static_cast<unsigned int>(x3dh_message_type::postOPks)<<")";
 					break;
 				case static_cast<uint8_t>(x3dh_message_type::getPeerBundle) :
 					message_type = x3dh_message_type::getPeerBundle;
-					message_trace<<"    Message Type is getPeerBundle (0x"<<setw(2)<<static_cast<unsigned int>(x3dh_message_type::getPeerBundle)<<")";
 					break;
 				case static_cast<uint8_t>(x3dh_message_type::peerBundle) :
 					message_type = x3dh_message_type::peerBundle;
-					message_trace<<"    Message Type is peerBundle (0x"<<setw(2)<<static_cast<unsigned int>(x3dh_message_type::peerBundle)<<")";
 					break;
 				case static_cast<uint8_t>(x3dh_message_type::getSelfOPks) :
 					message_type = x3dh_message_type::getSelfOPks;
-					message_trace<<"    Message Type is getSelfOPks (0x"<<setw(2)<<static_cast<unsigned int>(x3dh_message_type::getSelfOPks)<<")";
 					break;
 				case static_cast<uint8_t>(x3dh_message_type::selfOPks) :
 					message_type = x3dh_message_type::selfOPks;
-					message_trace<<"    Message Type is selfOPks (0x"<<setw(2)<<static_cast<unsigned int>(x3dh_message_type::selfOPks)<<")";
 					break;
 				case static_cast<uint8_t>(x3dh_message_type::error) :
 					message_type = x3dh_message_type::error;
-					message_trace<<"    Message Type is error (0x"<<setw(2)<<static_cast<unsigned int>(x3dh_message_type::error)<<")";
 					break;
 				default: // unknown message type: invalid packet
-					message_trace<<"    Message Type is Unknown (0x"<<setw(2)<<static_cast<unsigned int>(body[1])<<")"<<endl<<"    Invalid Incoming X3DH message";
-					LIME_LOGE<<message_trace.str()<<endl;
+					LIME_LOGE<<message_trace("Unknown")<<"    Invalid Incoming X3DH message"<<endl;
 					return false;
 			}
 
-			// message trace : display also the curve Id so we identify the 3 bytes of message header
-			message_trace<<endl<<"    CurveId is 0x"<<setw(2)<<static_cast<unsigned int>(body[2])<<endl;
-
 			// retrieve the error code if needed
 			if (message_type == x3dh_message_type::error) {
 				if (body.size()<X3DH_headerSize+1) { // error message contains at least 1 byte of error code + possible message
-					LIME_LOGE<<message_trace.str()<<endl;
+					LIME_LOGE<<message_trace(x3dh_messageTypeString(message_type))<<endl;
 					return false;
 				}
 
 				if (body.size() == X3DH_headerSize+1) {
 					LIME_LOGE<<"X3DH server respond error : code "<<static_cast<unsigned int>(body[X3DH_headerSize])<<" (no error message)";
 				} else {
-					LIME_LOGE<<"X3DH server respond error : code "<<static_cast<unsigned int>(body[X3DH_headerSize])<<" : "<<std::string(body.cbegin()+X3DH_headerSize+1, body.cend());
+					LIME_LOGE<<"X3DH server respond error : code "<<static_cast<unsigned int>(body[X3DH_headerSize])<<" : "<<std::string(body.begin()+X3DH_headerSize+1, body.end());
 				}
 
 				switch (static_cast<uint8_t>(body[X3DH_headerSize])) {
@@ -544,11 +542,45 @@ namespace lime {
 						error_code = x3dh_error_code::unknown_error_code;
 				}
 			}
-			LIME_LOGI<<message_trace.str()<<endl<<"    Valid Incoming X3DH message";
+			LIME_LOGI<<message_trace(x3dh_messageTypeString(message_type))<<endl<<"    Valid Incoming X3DH message";
 
 			return true;
 		}
 
+		/**
+		 * @brief Display the peer bundles parsed from a peerBundles message in human readable format:
+		 * - number of key bundles in the message
+		 * -     device id
+		 * -        Ik
+		 * -        SPkid, SPk, SPk signature
+		 * -        OPkid OPk if any
+		 *
+		 * @param[in]	peersBundleCount	number of key bundles announced in the message
+		 * @param[in]	peersBundle		the bundles parsed so far
+		 *
+		 * @return the message trace
+		 */
+		template <typename Curve>
+		static std::string peerBundlesTrace(const uint16_t peersBundleCount, const std::vector<X3DH_peerBundle<Curve>> &peersBundle) {
+			ostringstream message_trace;
+			message_trace << dec << "X3DH Peer Bundles message holds "<<static_cast<unsigned int>(peersBundleCount)<<" key bundles"<<setfill('0');
+			for (const auto &peerBundle : peersBundle) {
+				message_trace << endl << dec << "    Device Id ("<<static_cast<unsigned int>(peerBundle.deviceId.size())<<" bytes): "<<peerBundle.deviceId;
+				if (peerBundle.bundleFlag == lime::X3DHKeyBundleFlag::noBundle) {
+					message_trace << " has no key bundle"<<endl;
+					continue;
+				}
+				bool haveOPk = (peerBundle.bundleFlag == lime::X3DHKeyBundleFlag::OPk);
+				message_trace << (haveOPk?" has ":" does not have ")<<"OPk"<<endl<<"        Ik: "<<hexDump{peerBundle.Ik};
+				message_trace << hex <<endl<<"        SPk Id: 0x"<< setw(8) << static_cast<unsigned int>(peerBundle.SPk_id)<<endl<<"        SPk: "<<hexDump{peerBundle.SPk};
+				message_trace <<endl<<"        SPk Signature: "<<hexDump{peerBundle.SPk_sig};
+				if (haveOPk) {
+					message_trace <<endl<<"        OPk Id: 0x" << setw(8) << static_cast<unsigned int>(peerBundle.OPk_id)<<endl<<"        OPk: "<<hexDump{peerBundle.OPk};
+				}
+			}
+			return message_trace.str();
+		}
+
 		/**
 		 * @brief Parse a peerBundles message and populate a vector of peerBundles
 		 *
@@ -569,7 +601,7 @@ namespace lime {
 		 * @return true if all went ok, false and empty peersBundle otherwise
 		 */
 		template <typename Curve>
-		bool parseMessage_getPeerBundles(const std::vector<uint8_t> &body, std::vector<X3DH_peerBundle<Curve>> &peersBundle) noexcept {
+		bool parseMessage_getPeerBundles(const lime::span<const uint8_t> body, std::vector<X3DH_peerBundle<Curve>> &peersBundle) noexcept {
 			peersBundle.clear();
 			if (body.size() < X3DH_headerSize+2) { // we must be able to at least have a count of bundles
 				LIME_LOGE<<"Unable to parse content of X3DH peer Bundles message, body size is only "<<static_cast<unsigned int>(body.size());
@@ -580,21 +612,12 @@ namespace lime {
 
 			size_t index = X3DH_headerSize+2;
 
-			// message trace, display the incoming peer bundles in human readable format:
-			// - number of key bundles in the message
-			// -     device id
-			// -        Ik
-			// -        SPkid, SPk, SPk signature
-			// -        OPkid OPk if any
-			ostringstream message_trace;
-			message_trace << dec << "X3DH Peer Bundles message holds "<<static_cast<unsigned int>(peersBundleCount)<<" key bundles"<<setfill('0');
-
 			// loop on all expected bundles
 			for (auto i=0; i<peersBundleCount; i++) {
 				if (body.size() < index + 2) { // check we have at least a device size to read
-					peersBundle.clear();
 					LIME_LOGE<<"Invalid message: size is not what expected, cannot read device size, discard without parsing";
-					LIME_LOGD<<"message_trace so far: "<<message_trace.str();
+					LIME_LOGD<<"message_trace so far: "<<peerBundlesTrace(peersBundleCount, peersBundle);
+					peersBundle.clear();
 					return false;
 				}
 
@@ -603,12 +626,12 @@ namespace lime {
 				index += 2;
 
 				if (body.size() < index + deviceIdSize + 1) { // check we have at enough data to read: device size and the following flag
-					peersBundle.clear();
 					LIME_LOGE<<"Invalid message: size is not what expected, cannot read device id(size is"<<int(deviceIdSize)<<"), discard without parsing";
-					LIME_LOGD<<"message_trace so far: "<<message_trace.str();
+					LIME_LOGD<<"message_trace so far: "<<peerBundlesTrace(peersBundleCount, peersBundle);
+					peersBundle.clear();
 					return false;
 				}
-				std::string deviceId{body.cbegin()+index, body.cbegin()+index+deviceIdSize};
+				std::string deviceId{body.begin()+index, body.begin()+index+deviceIdSize};
 				index += deviceIdSize;
 
 				// check if we have a key bundle and an OPk. Possible flag values: 0 no OPk, 1 OPk, 2 no key bundle at all
@@ -626,15 +649,13 @@ namespace lime {
 						break;
 					default:
 						LIME_LOGE<<"Invalid X3DH message: unexpected flag value "<<body[index]<<" in "<<deviceId<<" key bundle";
-						LIME_LOGD<<"message_trace so far: "<<message_trace.str();
+						LIME_LOGD<<"message_trace so far: "<<peerBundlesTrace(peersBundleCount, peersBundle);
 						peersBundle.clear();
 						return false;
 				}
 
 				// if there is no bundle, just skip to the next one
 				if (keyBundleFlag == lime::X3DHKeyBundleFlag::noBundle) {
-					// add device Id (and its size) to the trace
-					message_trace << endl << dec << "    Device Id ("<<static_cast<unsigned int>(deviceIdSize)<<" bytes): "<<deviceId<<" has no key bundle"<<endl;
 					peersBundle.emplace_back(std::move(deviceId));
 					index += 1;
 					continue; // skip to next one
@@ -643,63 +664,38 @@ namespace lime {
 				bool haveOPk = (keyBundleFlag == lime::X3DHKeyBundleFlag::OPk);
 				index += 1;
 
-				// add device Id (and its size) and flag to the trace
-				message_trace << endl << dec << "    Device Id ("<<static_cast<unsigned int>(deviceIdSize)<<" bytes): "<<deviceId<<(haveOPk?" has ":" does not have ")<<"OPk"<<endl<<"        Ik: ";
-
 				if (body.size() < index + DSA<Curve, lime::DSAtype::publicKey>::ssize() + X<Curve, lime::Xtype::publicKey>::ssize() + DSA<Curve, lime::DSAtype::signature>::ssize() + 4 + (haveOPk?(X<Curve, lime::Xtype::publicKey>::ssize()+4):0) ) {
-					peersBundle.clear();
 					LIME_LOGE<<"Invalid message: size is not what expected, not enough buffer to hold keys bundle, discard without parsing";
-					LIME_LOGD<<"message_trace so far: "<<message_trace.str();
+					LIME_LOGD<<"message_trace so far: "<<peerBundlesTrace(peersBundleCount, peersBundle);
+					peersBundle.clear();
 					return false;
 				}
 
-				// retrieve simple pointers to all keys and signature, the X3DH_peerBundle constructor will construct the keys out of them
-				const auto Ik = body.cbegin()+index; index += DSA<Curve, lime::DSAtype::publicKey>::ssize();
-
-				// add Ik to message trace
-				message_trace << hex << setfill('0');
-				std::for_each(Ik, Ik + DSA<Curve, lime::DSAtype::publicKey>::ssize(), [&message_trace] (unsigned int i) {
-					message_trace << setw(2) << i << ", ";
-				});
+				// retrieve pointers into the message to all keys and signature, the X3DH_peerBundle constructor will construct the keys out of them
+				const auto Ik = body.data()+index; index += DSA<Curve, lime::DSAtype::publicKey>::ssize();
 
-				const auto SPk = body.cbegin()+index; index += X<Curve, lime::Xtype::publicKey>::ssize();
+				const auto SPk = body.data()+index; index += X<Curve, lime::Xtype::publicKey>::ssize();
 				uint32_t SPk_id = static_cast<uint32_t>(body[index])<<24 |
 						static_cast<uint32_t>(body[index+1])<<16 |
 						static_cast<uint32_t>(body[index+2])<<8 |
 						static_cast<uint32_t>(body[index+3]);
 				index += 4;
-				const auto SPk_sig = body.cbegin()+index; index += DSA<Curve, lime::DSAtype::signature>::ssize();
-
-				// add SPk Id, SPk and SPk signature to the trace
-				message_trace <<endl<<"        SPk Id: 0x"<< setw(8) << static_cast<unsigned int>(SPk_id)<<endl<<"        SPk: ";
-				std::for_each(SPk, SPk + X<Curve, lime::Xtype::publicKey>::ssize(), [&message_trace] (unsigned int i) {
-					message_trace << setw(2) << i << ", ";
-				});
-				message_trace <<endl<<"        SPk Signature: ";
-				std::for_each(SPk_sig, SPk_sig + DSA<Curve, lime::DSAtype::signature>::ssize(), [&message_trace] (unsigned int i) {
-					message_trace << setw(2) << i << ", ";
-				});
+				const auto SPk_sig = body.data()+index; index += DSA<Curve, lime::DSAtype::signature>::ssize();
 
 				if (haveOPk) {
-					const auto OPk = body.cbegin()+index; index += X<Curve, lime::Xtype::publicKey>::ssize();
+					const auto OPk = body.data()+index; index += X<Curve, lime::Xtype::publicKey>::ssize();
 					uint32_t OPk_id = static_cast<uint32_t>(body[index])<<24 |
 						static_cast<uint32_t>(body[index+1])<<16 |
 						static_cast<uint32_t>(body[index+2])<<8 |
 						static_cast<uint32_t>(body[index+3]);
 					index += 4;
 
-					// add OPk Id and OPk to the trace
-					message_trace <<endl<<"        OPk Id: 0x" << setw(8) << static_cast<unsigned int>(OPk_id)<<endl<<"        OPk: ";
-					std::for_each(OPk, OPk + X<Curve, lime::Xtype::publicKey>::ssize(), [&message_trace] (unsigned int i) {
-						message_trace << setw(2) << i << ", ";
-					});
-
 					peersBundle.emplace_back(std::move(deviceId), Ik, SPk, SPk_id, SPk_sig, OPk, OPk_id);
 				} else {
 					peersBundle.emplace_back(std::move(deviceId), Ik, SPk, SPk_id, SPk_sig);
 				}
 			}
-			LIME_LOGI<<message_trace.str();
+			LIME_LOGI<<peerBundlesTrace(peersBundleCount, peersBundle);
 			return true;
 		}
 
@@ -716,7 +712,7 @@ namespace lime {
 		 * @return true if all went ok, false otherwise
 		 */
 		template <typename Curve>
-		bool parseMessage_selfOPks(const std::vector<uint8_t> &body, std::vector<uint32_t> &selfOPkIds) noexcept {
+		bool parseMessage_selfOPks(const lime::span<const uint8_t> body, std::vector<uint32_t> &selfOPkIds) noexcept {
 			selfOPkIds.clear();
 			if (body.size() < X3DH_headerSize+2) { // we must be able to at least have a count of bundles
 
@@ -730,13 +726,6 @@ namespace lime {
 			}
 			size_t index = X3DH_headerSize+2;
 
-			// message trace, display the incoming self OPks in human readable format:
-			// - number of OPks in the message
-			// -        OPkid
-			ostringstream message_trace;
-			message_trace << dec << "X3DH self OPks message holds "<<static_cast<unsigned int>(selfOPkIdsCount)<<" OPk Ids"<<endl;
-			message_trace << hex;
-
 			// loop on all OPk Ids
 			for (auto i=0; i<selfOPkIdsCount; i++) { // they are in big endian
 				uint32_t OPk_id = static_cast<uint32_t>(body[index])<<24 |
@@ -745,9 +734,20 @@ namespace lime {
 						static_cast<uint32_t>(body[index+3]);
 				index+=4;
 				selfOPkIds.push_back(OPk_id);
-				message_trace <<"    OPk Id: 0x"<< setw(8) << static_cast<unsigned int>(OPk_id)<<endl;
 			}
-			LIME_LOGI<<message_trace.str();
+
+			// message trace, display the incoming self OPks in human readable format:
+			// - number of OPks in the message
+			// -        OPkid
+			if (LIME_LOGI_ENABLED) {
+				ostringstream message_trace;
+				message_trace << dec << "X3DH self OPks message holds "<<static_cast<unsigned int>(selfOPkIdsCount)<<" OPk Ids"<<endl;
+				message_trace << hex << setfill('0');
+				for (const auto OPk_id : selfOPkIds) {
+					message_trace <<"    OPk Id: 0x"<< setw(8) << static_cast<unsigned int>(OPk_id)<<endl;
+				}
+				LIME_LOGI<<message_trace.str();
+			}
 			return true;
 		}
 
@@ -779,16 +779,22 @@ namespace lime {
 	 */
 	template <typename Curve>
 	void Lime<Curve>::cleanUserData(std::shared_ptr<callbackUserData<Curve>> userData) {
-		if (userData->plainMessage!=nullptr) { // only encryption request for X3DH bundle would populate the plainMessage field of user data structure
+		if (userData->recipientUserId!=nullptr) { // only encryption request for X3DH bundle would populate the recipientUserId field of user data structure
 			// userData is actually a part of the Lime Object and allocated as a shared pointer, just set it to nullptr it will cleanly destroy it
 			m_ongoing_encryption = nullptr;
 			// check if others encryptions are in queue and call them if needed
 			if (!m_encryption_queue.empty()) {
 				auto userData = m_encryption_queue.front();
 				m_encryption_queue.pop(); // remove it from queue and do it, as there is no more ongoing it shall be processed even if the queue still holds elements
-				encrypt(userData->recipientUserId, userData->recipients, userData->plainMessage, userData->encryptionPolicy, userData->cipherMessage, userData->callback);
+				process_encrypt(userData);
 			}
 		} else { // its not an encryption, just set userData to null it shall destroy it
+			if (!userData->renewalDevices.empty()) { // a session renewal request is over: succeeded or not, a renewal can be requested again for these devices
+				std::lock_guard<std::mutex> lock(m_mutex);
+				for (const auto &deviceId : userData->renewalDevices) {
+					m_renewal_requested.erase(deviceId);
+				}
+			}
 			userData = nullptr;
 		}
 	}
@@ -854,6 +860,20 @@ namespace lime {
 						return;
 					}
 
+					// no recipients: this is a background session renewal, no encryption is waiting for it
+					if (userData->recipientUserId == nullptr) {
+						try {
+							std::lock_guard<std::mutex> lock(m_mutex);
+							X3DH_init_sender_session(peersBundle, true);
+						} catch (BctbxException &e) { // cleanUserData clears the renewal flag of the requested devices: a later encryption requests it again
+							LIME_LOGE<<"Session renewal failed for user "<<m_selfDeviceId<<" : "<<e.str();
+						} catch (exception const &e) {
+							LIME_LOGE<<"Session renewal failed for user "<<m_selfDeviceId<<" : "<<e.what();
+						}
+						cleanUserData(userData);
+						return;
+					}
+
 					// generate X3DH init packets, create a store DR Sessions(in Lime obj cache, they'll be stored in DB when the first encryption will occurs)
 					try {
 						//Note: if while we were waiting for the peer bundle we did get an init message from him and created a session
@@ -875,7 +895,7 @@ namespace lime {
 					for (const auto &peerBundle:peersBundle) {
 						// get all the bundless peer Devices
 						if (peerBundle.bundleFlag == lime::X3DHKeyBundleFlag::noBundle) {
-							for (auto &recipient:*(userData->recipients)) {
+							for (auto &recipient:userData->recipients) {
 								// and set their recipient status to fail so the encrypt function would ignore them
 								if (recipient.deviceId == peerBundle.deviceId) {
 									recipient.peerStatus = lime::PeerDeviceStatus::fail;
@@ -885,7 +905,7 @@ namespace lime {
 					}
 
 					// call the encrypt function again, it will call the callback when done, encryption queue won't be processed as still locked by the m_ongoing_encryption member
-					encrypt(userData->recipientUserId, userData->recipients, userData->plainMessage, userData->encryptionPolicy, userData->cipherMessage, callback);
+					process_encrypt(userData);
 
 					// now we can safely delete the user data, note that this may trigger an other encryption if there is one in queue
 					cleanUserData(userData);
@@ -902,16 +922,28 @@ namespace lime {
 						return;
 					}
 
+					// our OPks still tagged as on server locally but not in the server list were dispatched since last check: account them in the consumption
+					std::vector<uint32_t> activeOPkIds{};
+					X3DH_get_activeOPkIds(activeOPkIds);
+					std::sort(selfOPkIds.begin(), selfOPkIds.end());
+					for (const auto OPkId : activeOPkIds) {
+						if (!std::binary_search(selfOPkIds.cbegin(), selfOPkIds.cend(), OPkId)) {
+							OPk_consumption_record(OPkId);
+						}
+					}
+
 					// update in LocalStorage the OPk status: tag removed from server and delete old keys
 					X3DH_updateOPkStatus(selfOPkIds);
 
-					// Check if we shall upload more packets
-					if (selfOPkIds.size() < userData->OPkServerLowLimit) {
+					// Check if we shall upload more packets, the batch size is adapted to the observed consumption
+					auto OPkCount = OPk_replenishCount(selfOPkIds.size(), userData->OPkServerLowLimit, userData->OPkBatchSize);
+					m_OPk_serverCount = selfOPkIds.size() + OPkCount;
+					m_OPk_serverCount_known = true;
+					if (OPkCount > 0) {
 						// generate and publish the OPks
 						std::vector<X<Curve, lime::Xtype::publicKey>> OPks{};
 						std::vector<uint32_t> OPk_ids{};
-						// Generate OPks OPkBatchSize (or more if we need more to reach ServerLowLimit)
-						X3DH_generate_OPks(OPks, OPk_ids, std::max(userData->OPkBatchSize, static_cast<uint16_t>(userData->OPkServerLowLimit - selfOPkIds.size())) );
+						X3DH_generate_OPks(OPks, OPk_ids, OPkCount);
 						std::vector<uint8_t> X3DHmessage{};
 						x3dh_protocol::buildMessage_publishOPks(X3DHmessage, OPks, OPk_ids);
 						postToX3DHServer(userData, X3DHmessage);
@@ -987,16 +1019,109 @@ namespace lime {
 			});
 	}
 
+	/**
+	 * @brief record the consumption of one of our OPks
+	 *
+	 * 	The consumption is noticed either when we receive a X3DH init message using it or when the X3DH server
+	 * 	count shows it was dispatched. An OPk already recorded is not counted twice.
+	 *
+	 * @param[in]	OPkId	the id of the consumed OPk
+	 */
+	template <typename Curve>
+	void Lime<Curve>::OPk_consumption_record(const uint32_t OPkId) {
+		if (m_OPk_consumption.emplace(OPkId, std::chrono::steady_clock::now()).second) {
+			if (m_OPk_serverCount > 0) m_OPk_serverCount--;
+		}
+	}
+
+	/**
+	 * @brief estimate how many OPks will be consumed during the next settings::OPk_updatePeriod
+	 *
+	 * 	The estimation is based on the consumption observed during the last settings::OPk_consumptionWindow, older records are discarded
+	 *
+	 * @return the expected OPk consumption
+	 */
+	template <typename Curve>
+	size_t Lime<Curve>::OPk_expectedConsumption(void) {
+		auto now = std::chrono::steady_clock::now();
+		for (auto it = m_OPk_consumption.begin(); it != m_OPk_consumption.end(); ) {
+			if (now - it->second > std::chrono::seconds(lime::settings::OPk_consumptionWindow)) {
+				it = m_OPk_consumption.erase(it);
+			} else {
+				++it;
+			}
+		}
+		return m_OPk_consumption.size()*lime::settings::OPk_updatePeriod/lime::settings::OPk_consumptionWindow;
+	}
+
+	/**
+	 * @brief compute how many OPks we shall upload to X3DH server
+	 *
+	 * 	When the server holds less than OPkServerLowLimit OPks, upload a batch of OPkBatchSize or more to reach the low limit.
+	 * 	If the expected consumption until next update exceeds this low limit, raise the limit to it and upload enough keys to
+	 * 	cover the expected consumption on top of the low limit, up to settings::OPk_maxBatchSize.
+	 *
+	 * @param[in]	serverCount		OPk count on server
+	 * @param[in]	OPkServerLowLimit	If server holds less OPk than this limit, generate and upload a batch of OPks
+	 * @param[in]	OPkBatchSize		Number of OPks in a batch uploaded to server
+	 *
+	 * @return the number of OPks to generate and upload, 0 if the server holds enough of them
+	 */
+	template <typename Curve>
+	uint16_t Lime<Curve>::OPk_replenishCount(const size_t serverCount, const uint16_t OPkServerLowLimit, const uint16_t OPkBatchSize) {
+		auto expected = OPk_expectedConsumption();
+		if (serverCount >= std::max(static_cast<size_t>(OPkServerLowLimit), expected)) {
+			return 0;
+		}
+
+		size_t count = OPkBatchSize;
+		if (OPkServerLowLimit > serverCount) {
+			count = std::max(count, OPkServerLowLimit - serverCount);
+		}
+		if (expected > OPkServerLowLimit) { // the fixed low limit won't last until next update, adapt to the observed consumption
+			count = std::max(count, std::min(expected + OPkServerLowLimit - serverCount, static_cast<size_t>(lime::settings::OPk_maxBatchSize)));
+			LIME_LOGI<<"User "<<m_selfDeviceId<<" expects "<<expected<<" OPks consumption until next update, upload "<<count<<" OPks";
+		}
+		return static_cast<uint16_t>(count);
+	}
+
+	/**
+	 * @brief check if the OPk count on server shall be checked before the next periodic update
+	 *
+	 * 	It is the case when an update was performed, the estimated OPk count on server fell under the low limit
+	 * 	(raised to the expected consumption if needed) and the last check is older than settings::OPk_replenishMinInterval
+	 *
+	 * @return true if update_OPk shall be called
+	 */
+	template <typename Curve>
+	bool Lime<Curve>::OPk_replenishNeeded(void) {
+		if (!m_OPk_serverCount_known || m_OPk_serverLowLimit == 0) {
+			return false;
+		}
+		if (std::chrono::steady_clock::now() - m_OPk_lastCheck < std::chrono::seconds(lime::settings::OPk_replenishMinInterval)) {
+			return false;
+		}
+		return m_OPk_serverCount < std::max(static_cast<size_t>(m_OPk_serverLowLimit), OPk_expectedConsumption());
+	}
+
 	/* Instanciate templated member functions */
 #ifdef EC25519_ENABLED
 	template void Lime<C255>::postToX3DHServer(std::shared_ptr<callbackUserData<C255>> userData, const std::vector<uint8_t> &message);
 	template void Lime<C255>::process_response(std::shared_ptr<callbackUserData<C255>> userData, int responseCode, const std::vector<uint8_t> &responseBody) noexcept;
 	template void Lime<C255>::cleanUserData(std::shared_ptr<callbackUserData<C255>> userData);
+	template void Lime<C255>::OPk_consumption_record(const uint32_t OPkId);
+	template size_t Lime<C255>::OPk_expectedConsumption(void);
+	template uint16_t Lime<C255>::OPk_replenishCount(const size_t serverCount, const uint16_t OPkServerLowLimit, const uint16_t OPkBatchSize);
+	template bool Lime<C255>::OPk_replenishNeeded(void);
 #endif
 
 #ifdef EC448_ENABLED
 	template void Lime<C448>::postToX3DHServer(std::shared_ptr<callbackUserData<C448>> userData, const std::vector<uint8_t> &message);
 	template void Lime<C448>::process_response(std::shared_ptr<callbackUserData<C448>> userData, int responseCode, const std::vector<uint8_t> &responseBody) noexcept;
 	template void Lime<C448>::cleanUserData(std::shared_ptr<callbackUserData<C448>> userData);
+	template void Lime<C448>::OPk_consumption_record(const uint32_t OPkId);
+	template size_t Lime<C448>::OPk_expectedConsumption(void);
+	template uint16_t Lime<C448>::OPk_replenishCount(const size_t serverCount, const uint16_t OPkServerLowLimit, const uint16_t OPkBatchSize);
+	template bool Lime<C448>::OPk_replenishNeeded(void);
 #endif
 } //namespace lime
@@ -49,7 +49,7 @@ namespace lime {
 		const uint32_t OPk_id; /**< id of the peer device current public pre-signed key */
 
 		/**
-		 * Constructor gets vector<uint8_t> iterators to all needed data and copy them into correct data types
+		 * Constructor gets pointers into the parsed message to all needed data and copy them into correct data types
 		 *
 		 * @param[in]	deviceId	peer Device Id providing this key bundle
 		 * @param[in]	Ik		peer public identity key (DSA format)
@@ -59,13 +59,13 @@ namespace lime {
 		 * @param[in]	OPk		One-time Pre-key (X format) - this parameter is optionnal
 		 * @param[in]	OPk_id		id of the One-time Pre-key - this parameter is optionnal
 		 */
-		X3DH_peerBundle(std::string &&deviceId, std::vector<uint8_t>::const_iterator Ik, std::vector<uint8_t>::const_iterator SPk, uint32_t SPk_id, std::vector<uint8_t>::const_iterator SPk_sig, std::vector<uint8_t>::const_iterator OPk, uint32_t OPk_id) :
+		X3DH_peerBundle(std::string &&deviceId, const uint8_t *Ik, const uint8_t *SPk, uint32_t SPk_id, const uint8_t *SPk_sig, const uint8_t *OPk, uint32_t OPk_id) :
 		deviceId{deviceId}, Ik{Ik}, SPk{SPk}, SPk_id{SPk_id}, SPk_sig{SPk_sig}, bundleFlag{lime::X3DHKeyBundleFlag::OPk}, OPk{OPk}, OPk_id{OPk_id} {};
 		/**
 		 * @overload
 		 * construct without OPk when not present in the parsed bundle
 		 */
-		X3DH_peerBundle(std::string &&deviceId, std::vector<uint8_t>::const_iterator Ik, std::vector<uint8_t>::const_iterator SPk, uint32_t SPk_id, std::vector<uint8_t>::const_iterator SPk_sig) :
+		X3DH_peerBundle(std::string &&deviceId, const uint8_t *Ik, const uint8_t *SPk, uint32_t SPk_id, const uint8_t *SPk_sig) :
 		deviceId{deviceId}, Ik{Ik}, SPk{SPk}, SPk_id{SPk_id}, SPk_sig{SPk_sig}, bundleFlag{lime::X3DHKeyBundleFlag::noOPk}, OPk{}, OPk_id{0} {};
 		/**
 		 * @overload
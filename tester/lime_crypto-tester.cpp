@@ -18,10 +18,12 @@
 */
 
 #include "lime_log.hpp"
+#include "lime/lime.hpp"
 #include "lime-tester.hpp"
 #include "lime-tester-utils.hpp"
 #include "lime_keys.hpp"
 #include "lime_crypto_primitives.hpp"
+#include "lime_secure_memory.hpp"
 
 #include <bctoolbox/tester.h>
 #include <bctoolbox/port.h>
@@ -30,8 +32,13 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <algorithm>
 #include <stdio.h>
 #include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 
 using namespace::std;
 using namespace::lime;
@@ -89,6 +96,67 @@ void keyExchange_test(void) {
 
 	/* Compare them */
 	BC_ASSERT_TRUE(Alice->get_sharedSecret()==Bob->get_sharedSecret());
+
+	/* Released contexts are reused: they must not hold any key material from their previous user */
+	auto AliceSecret = Alice->get_secret();
+	auto AliceContext = Alice.get();
+	Alice = nullptr;
+	auto Carol = make_keyExchange<Curve>();
+	if (Carol.get() == AliceContext) {
+		auto CarolSecret = Carol->get_secret();
+		BC_ASSERT_FALSE(CarolSecret == AliceSecret);
+		BC_ASSERT_TRUE(std::all_of(CarolSecret.cbegin(), CarolSecret.cend(), [](uint8_t b){return b==0;}));
+	}
+	/* and are fully functional */
+	Carol->createKeyPair(rng);
+	Carol->set_peerPublic(Bob->get_selfPublic());
+	Bob->set_peerPublic(Carol->get_selfPublic());
+	Carol->computeSharedSecret();
+	Bob->computeSharedSecret();
+	BC_ASSERT_TRUE(Carol->get_sharedSecret()==Bob->get_sharedSecret());
+
+	/* Batched key exchanges give the same public keys and shared secrets than the keyExchange context: more entries than the lanes of the batch */
+	constexpr size_t batchSize = 9;
+	std::vector<Xpair<Curve>> batchKeys(batchSize);
+	std::vector<X<Curve, lime::Xtype::sharedSecret>> batchOutputs(batchSize);
+	std::vector<XbatchEntry<Curve>> batch{};
+	for (size_t i=0; i<batchSize; i++) {
+		rng->randomize(batchKeys[i].privateKey().data(), batchKeys[i].privateKey().size());
+		Carol->set_secret(batchKeys[i].privateKey());
+		Carol->deriveSelfPublic();
+		batchKeys[i].publicKey() = Carol->get_selfPublic();
+	}
+	for (size_t i=0; i<batchSize; i++) { // odd entries derive a public key, even ones compute a shared secret with the next key
+		batch.push_back({&(batchKeys[i].privateKey()), (i%2==0)?&(batchKeys[(i+1)%batchSize].publicKey()):nullptr, batchOutputs[i].data()});
+	}
+	X_batch<Curve>(batch);
+	for (size_t i=0; i<batchSize; i++) {
+		if (i%2 == 0) {
+			Carol->set_secret(batchKeys[(i+1)%batchSize].privateKey());
+			Carol->set_peerPublic(batchKeys[i].publicKey());
+			Carol->computeSharedSecret();
+			BC_ASSERT_TRUE(Carol->get_sharedSecret() == batchOutputs[i]);
+		} else {
+			BC_ASSERT_TRUE(std::equal(batchOutputs[i].cbegin(), batchOutputs[i].cend(), batchKeys[i].publicKey().cbegin()));
+		}
+	}
+
+	/* a batch given as an array, as the DH ratchet does it: keys are read from the context into caller's buffers */
+	X<Curve, lime::Xtype::sharedSecret> ratchetSecret, contextSecret;
+	X<Curve, lime::Xtype::publicKey> ratchetPublic, contextPublic;
+	const std::array<XbatchEntry<Curve>, 2> ratchet{{
+		{&(batchKeys[0].privateKey()), nullptr, ratchetPublic.data()},
+		{&(batchKeys[0].privateKey()), &(batchKeys[1].publicKey()), ratchetSecret.data()}
+	}};
+	X_batch<Curve>(ratchet.data(), ratchet.size());
+	Carol->set_secret(batchKeys[0].privateKey());
+	Carol->deriveSelfPublic();
+	Carol->set_peerPublic(batchKeys[1].publicKey());
+	Carol->computeSharedSecret();
+	Carol->get_selfPublic(contextPublic);
+	Carol->get_sharedSecret(contextSecret);
+	BC_ASSERT_TRUE(ratchetPublic == contextPublic);
+	BC_ASSERT_TRUE(ratchetSecret == contextSecret);
 }
 
 template <typename Curve>
@@ -141,7 +209,44 @@ void keyExchange_bench(uint64_t runTime_ms) {
 	freq = 1000*runCount/static_cast<double>(span);
 	snprintSI(freq_unit, freq, "computations/s");
 	snprintSI(period_unit, 1/freq, "s/computation");
-	LIME_LOGI<<"Shared Secret "<<int(runCount)<<" computations in "<<int(span)<<" ms : "<<period_unit<<" "<<freq_unit<<endl<<endl;
+	LIME_LOGI<<"Shared Secret "<<int(runCount)<<" computations in "<<int(span)<<" ms : "<<period_unit<<" "<<freq_unit<<endl;
+
+	/* Same computations performed in batches */
+	std::vector<Xpair<Curve>> batchKeys(batch_size);
+	std::vector<X<Curve, lime::Xtype::sharedSecret>> batchOutputs(batch_size);
+	std::vector<XbatchEntry<Curve>> derivations{}, exchanges{};
+	auto BobPublic = Bob->get_selfPublic();
+	for (size_t i=0; i<batch_size; i++) {
+		rng->randomize(batchKeys[i].privateKey().data(), batchKeys[i].privateKey().size());
+		derivations.push_back({&(batchKeys[i].privateKey()), nullptr, batchKeys[i].publicKey().data()});
+		exchanges.push_back({&(batchKeys[i].privateKey()), &BobPublic, batchOutputs[i].data()});
+	}
+
+	start = bctbx_get_cur_time_ms();
+	span=0;
+	runCount = 0;
+	while (span<runTime_ms) {
+		X_batch<Curve>(derivations);
+		span = bctbx_get_cur_time_ms() - start;
+		runCount += batch_size;
+	}
+	freq = 1000*runCount/static_cast<double>(span);
+	snprintSI(freq_unit, freq, "keys/s");
+	snprintSI(period_unit, 1/freq, "s/keys");
+	LIME_LOGI<<"Batched key generation "<<int(runCount)<<" ECDH keys in "<<int(span)<<" ms : "<<period_unit<<" "<<freq_unit<<endl;
+
+	start = bctbx_get_cur_time_ms();
+	span=0;
+	runCount = 0;
+	while (span<runTime_ms) {
+		X_batch<Curve>(exchanges);
+		span = bctbx_get_cur_time_ms() - start;
+		runCount += batch_size;
+	}
+	freq = 1000*runCount/static_cast<double>(span);
+	snprintSI(freq_unit, freq, "computations/s");
+	snprintSI(period_unit, 1/freq, "s/computation");
+	LIME_LOGI<<"Batched Shared Secret "<<int(runCount)<<" computations in "<<int(span)<<" ms : "<<period_unit<<" "<<freq_unit<<endl<<endl;
 }
 
 static void exchange(void) {
@@ -202,6 +307,34 @@ void signAndVerify_test(void) {
 	BC_ASSERT_FALSE(Vera->verify(aliceMessage, bobSignature));
 	BC_ASSERT_TRUE(Vera->verify(bobMessage, bobSignature));
 
+	/* Batch verification of signed key exchange public keys, each signed by a different key */
+	constexpr size_t batchSize = 8;
+	std::vector<DSA<Curve, lime::DSAtype::publicKey>> signersPublic(batchSize);
+	std::vector<X<Curve, lime::Xtype::publicKey>> signedKeys(batchSize);
+	std::vector<DSA<Curve, lime::DSAtype::signature>> signatures(batchSize);
+	auto signer = make_Signature<Curve>();
+	auto keyExchangeContext = make_keyExchange<Curve>();
+	for (size_t i=0; i<batchSize; i++) {
+		signer->createKeyPair(rng);
+		signersPublic[i] = signer->get_public();
+		keyExchangeContext->createKeyPair(rng);
+		signedKeys[i] = keyExchangeContext->get_selfPublic();
+		signer->sign(signedKeys[i], signatures[i]);
+	}
+	std::vector<SignedXPublicKey<Curve>> batch{};
+	BC_ASSERT_TRUE(verify_batch<Curve>(batch)); // an empty batch is valid
+	for (size_t i=0; i<batchSize; i++) {
+		batch.emplace_back(signersPublic[i], signedKeys[i], signatures[i]);
+	}
+	BC_ASSERT_TRUE(verify_batch<Curve>(batch));
+	/* corrupt one signature: the batch fails, individual verification pinpoints it */
+	signatures[batchSize/2][0] ^= 0x01;
+	BC_ASSERT_FALSE(verify_batch<Curve>(batch));
+	for (size_t i=0; i<batchSize; i++) {
+		Vera->set_public(signersPublic[i]);
+		BC_ASSERT_TRUE(Vera->verify(signedKeys[i], signatures[i]) == (i != batchSize/2));
+	}
+
 	/* Bob and Alice create keyExchange context */
 	auto AliceKeyExchange = make_keyExchange<Curve>();
 	auto BobKeyExchange = make_keyExchange<Curve>();
@@ -221,6 +354,16 @@ void signAndVerify_test(void) {
 
 	/* Compare them */
 	BC_ASSERT_TRUE(AliceKeyExchange->get_sharedSecret()==BobKeyExchange->get_sharedSecret());
+
+	/* Keys converted once to X format and then used as is (as X3DH does with cached identity keys) give the same shared secret */
+	auto AliceSecret_X = AliceKeyExchange->get_secret();
+	auto BobPublic_X = AliceKeyExchange->get_peerPublic();
+	auto CachedKeyExchange = make_keyExchange<Curve>();
+	CachedKeyExchange->set_secret(AliceSecret_X);
+	CachedKeyExchange->set_peerPublic(BobPublic_X);
+	CachedKeyExchange->computeSharedSecret();
+	BC_ASSERT_TRUE(CachedKeyExchange->get_sharedSecret()==BobKeyExchange->get_sharedSecret());
+	BC_ASSERT_TRUE(BobKeyExchange->get_selfPublic()==BobPublic_X);
 }
 
 template <typename Curve>
@@ -519,6 +662,58 @@ static void hashMac_KDF(void) {
 	HMAC_KDF<SHA512>(salt, IKM, info, output.data(), output.size());
 	BC_ASSERT_TRUE(OKM==output);
 
+	/* HMAC with precomputed key pads gives the same output as the one shot HMAC, test key and input sizes around the SHA512 block and padding boundaries */
+	auto RNG_context = make_RNG();
+	for (size_t keySize : {0, 1, 32, 64, 127, 128, 129, 200}) {
+		std::vector<uint8_t> key(keySize);
+		RNG_context->randomize(key.data(), key.size());
+		HMACkey<SHA512> precomputedKey{key.data(), key.size()};
+		for (size_t inputSize : {0, 1, 32, 111, 112, 127, 128, 129, 240, 256, 1000}) {
+			std::vector<uint8_t> input(inputSize);
+			RNG_context->randomize(input.data(), input.size());
+			std::array<uint8_t, SHA512::ssize()> expected{}, hash{};
+			HMAC<SHA512>(key.data(), key.size(), input.data(), input.size(), expected.data(), expected.size());
+			precomputedKey.compute(input.data(), input.size(), hash.data(), hash.size());
+			BC_ASSERT_TRUE(expected == hash);
+		}
+	}
+
+	/* batched HMAC gives the same output as the one shot HMAC: more entries than a batch chunk, consecutive entries sharing a key(the last one overwriting it as in chain key derivation) and inputs too long for a single block */
+	constexpr size_t batchSize = 41;
+	std::vector<std::vector<uint8_t>> keys(batchSize), inputs(batchSize), expectedHashes(batchSize);
+	std::vector<std::array<uint8_t, SHA512::ssize()>> hashes(batchSize);
+	std::vector<HMACbatchEntry> entries{};
+	for (size_t i=0; i<batchSize; i++) {
+		inputs[i].resize((i%7==0)?200:(i%3));
+		RNG_context->randomize(inputs[i].data(), inputs[i].size());
+		if (i%3 != 0) { // share previous entry key
+			keys[i] = keys[i-1];
+		} else {
+			keys[i].resize(32);
+			RNG_context->randomize(keys[i].data(), keys[i].size());
+		}
+	}
+	for (size_t i=0; i<batchSize; i++) {
+		expectedHashes[i].resize((i%3==2)?32:SHA512::ssize());
+		HMAC<SHA512>(keys[i].data(), keys[i].size(), inputs[i].data(), inputs[i].size(), expectedHashes[i].data(), expectedHashes[i].size());
+	}
+	for (size_t i=0; i<batchSize; i++) {
+		auto keyIndex = i - i%3; // entries sharing a key use the same buffer
+		if (i%3 == 2) { // output in the key buffer
+			entries.push_back({keys[keyIndex].data(), keys[keyIndex].size(), inputs[i].data(), inputs[i].size(), keys[keyIndex].data(), 32});
+		} else {
+			entries.push_back({keys[keyIndex].data(), keys[keyIndex].size(), inputs[i].data(), inputs[i].size(), hashes[i].data(), hashes[i].size()});
+		}
+	}
+	HMAC_batch<SHA512>(entries.data(), entries.size());
+	for (size_t i=0; i<batchSize; i++) {
+		if (i%3 == 2) {
+			BC_ASSERT_TRUE(std::equal(expectedHashes[i].cbegin(), expectedHashes[i].cend(), keys[i-2].cbegin()));
+		} else {
+			BC_ASSERT_TRUE(std::equal(expectedHashes[i].cbegin(), expectedHashes[i].cend(), hashes[i].cbegin()));
+		}
+	}
+
 
 	/* Run benchmarks */
 	if (bench) {
@@ -733,6 +928,77 @@ static void AEAD(void) {
 	BC_ASSERT_TRUE(tag==pattern_tag);
 	BC_ASSERT_TRUE(AEAD_decrypt<AES256GCM>(key.data(), key.size(), IV.data(), IV.size(), pattern_cipher.data(), pattern_cipher.size(), AD.data(), AD.size(), pattern_tag.data(), pattern_tag.size(), plain.data()));
 	BC_ASSERT_TRUE(plain==pattern_plain);
+
+	/* Test vector for ChaCha20-Poly1305 from RFC 8439 - section 2.8.2 */
+	key.assign({0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f, 0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f});
+	IV.assign({0x07, 0x00, 0x00, 0x00, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47});
+	AD.assign({0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7});
+	pattern_plain.assign({0x4c, 0x61, 0x64, 0x69, 0x65, 0x73, 0x20, 0x61, 0x6e, 0x64, 0x20, 0x47, 0x65, 0x6e, 0x74, 0x6c, 0x65, 0x6d, 0x65, 0x6e, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x63, 0x6c, 0x61, 0x73, 0x73, 0x20, 0x6f, 0x66, 0x20, 0x27, 0x39, 0x39, 0x3a, 0x20, 0x49, 0x66, 0x20, 0x49, 0x20, 0x63, 0x6f, 0x75, 0x6c, 0x64, 0x20, 0x6f, 0x66, 0x66, 0x65, 0x72, 0x20, 0x79, 0x6f, 0x75, 0x20, 0x6f, 0x6e, 0x6c, 0x79, 0x20, 0x6f, 0x6e, 0x65, 0x20, 0x74, 0x69, 0x70, 0x20, 0x66, 0x6f, 0x72, 0x20, 0x74, 0x68, 0x65, 0x20, 0x66, 0x75, 0x74, 0x75, 0x72, 0x65, 0x2c, 0x20, 0x73, 0x75, 0x6e, 0x73, 0x63, 0x72, 0x65, 0x65, 0x6e, 0x20, 0x77, 0x6f, 0x75, 0x6c, 0x64, 0x20, 0x62, 0x65, 0x20, 0x69, 0x74, 0x2e});
+	pattern_cipher.assign({0xd3, 0x1a, 0x8d, 0x34, 0x64, 0x8e, 0x60, 0xdb, 0x7b, 0x86, 0xaf, 0xbc, 0x53, 0xef, 0x7e, 0xc2, 0xa4, 0xad, 0xed, 0x51, 0x29, 0x6e, 0x08, 0xfe, 0xa9, 0xe2, 0xb5, 0xa7, 0x36, 0xee, 0x62, 0xd6, 0x3d, 0xbe, 0xa4, 0x5e, 0x8c, 0xa9, 0x67, 0x12, 0x82, 0xfa, 0xfb, 0x69, 0xda, 0x92, 0x72, 0x8b, 0x1a, 0x71, 0xde, 0x0a, 0x9e, 0x06, 0x0b, 0x29, 0x05, 0xd6, 0xa5, 0xb6, 0x7e, 0xcd, 0x3b, 0x36, 0x92, 0xdd, 0xbd, 0x7f, 0x2d, 0x77, 0x8b, 0x8c, 0x98, 0x03, 0xae, 0xe3, 0x28, 0x09, 0x1b, 0x58, 0xfa, 0xb3, 0x24, 0xe4, 0xfa, 0xd6, 0x75, 0x94, 0x55, 0x85, 0x80, 0x8b, 0x48, 0x31, 0xd7, 0xbc, 0x3f, 0xf4, 0xde, 0xf0, 0x8e, 0x4b, 0x7a, 0x9d, 0xe5, 0x76, 0xd2, 0x65, 0x86, 0xce, 0xc6, 0x4b, 0x61, 0x16});
+	pattern_tag.assign({0x1a, 0xe1, 0x0b, 0x59, 0x4f, 0x09, 0xe2, 0x6a, 0x7e, 0x90, 0x2e, 0xcb, 0xd0, 0x60, 0x06, 0x91});
+	cipher.resize(pattern_plain.size());
+	plain.resize(pattern_plain.size());
+	tag.resize(CHACHA20POLY1305::tagSize());
+
+	AEAD_encrypt<CHACHA20POLY1305>(key.data(), key.size(), IV.data(), IV.size(), pattern_plain.data(), pattern_plain.size(), AD.data(), AD.size(), tag.data(), tag.size(), cipher.data());
+	BC_ASSERT_TRUE(cipher==pattern_cipher);
+	BC_ASSERT_TRUE(tag==pattern_tag);
+	BC_ASSERT_TRUE(AEAD_decrypt<CHACHA20POLY1305>(key.data(), key.size(), IV.data(), IV.size(), pattern_cipher.data(), pattern_cipher.size(), AD.data(), AD.size(), pattern_tag.data(), pattern_tag.size(), plain.data()));
+	BC_ASSERT_TRUE(plain==pattern_plain);
+	/* a 16 bytes IV, as given by the double ratchet, uses only its first 12 bytes as nonce */
+	IV.insert(IV.end(), {0xff, 0xff, 0xff, 0xff});
+	AEAD_encrypt<CHACHA20POLY1305>(key.data(), key.size(), IV.data(), IV.size(), pattern_plain.data(), pattern_plain.size(), AD.data(), AD.size(), tag.data(), tag.size(), cipher.data());
+	BC_ASSERT_TRUE(cipher==pattern_cipher);
+	BC_ASSERT_TRUE(tag==pattern_tag);
+	/* a modified tag fails the authentication */
+	pattern_tag[0] ^= 0x01;
+	BC_ASSERT_FALSE(AEAD_decrypt<CHACHA20POLY1305>(key.data(), key.size(), IV.data(), IV.size(), pattern_cipher.data(), pattern_cipher.size(), AD.data(), AD.size(), pattern_tag.data(), pattern_tag.size(), plain.data()));
+
+	/* batched encryption gives the same output as one by one encryption: more entries than the interleaved lanes, various IV, AD and plain sizes */
+	auto RNG_context = make_RNG();
+	for (size_t plainSize : {0, 1, 16, 32, 33, 100}) {
+		constexpr size_t batchSize = 7;
+		std::vector<uint8_t> batchPlain(plainSize);
+		RNG_context->randomize(batchPlain.data(), batchPlain.size());
+		std::vector<std::vector<uint8_t>> keys(batchSize), IVs(batchSize), ADs(batchSize), ciphers(batchSize), tags(batchSize);
+		std::vector<AEADbatchEntry> entries{};
+		for (size_t i=0; i<batchSize; i++) {
+			keys[i].resize(AES256GCM::keySize());
+			IVs[i].resize((i%2==0)?16:12);
+			ADs[i].resize(5*i);
+			ciphers[i].resize(plainSize);
+			tags[i].resize(AES256GCM::tagSize());
+			RNG_context->randomize(keys[i].data(), keys[i].size());
+			RNG_context->randomize(IVs[i].data(), IVs[i].size());
+			RNG_context->randomize(ADs[i].data(), ADs[i].size());
+			entries.push_back({keys[i].data(), keys[i].size(), IVs[i].data(), IVs[i].size(), ADs[i].data(), ADs[i].size(), tags[i].data(), tags[i].size(), ciphers[i].data()});
+		}
+		AEAD_encrypt_batch<AES256GCM>(entries.data(), entries.size(), batchPlain.data(), batchPlain.size());
+		for (size_t i=0; i<batchSize; i++) {
+			cipher.resize(plainSize);
+			AEAD_encrypt<AES256GCM>(keys[i].data(), keys[i].size(), IVs[i].data(), IVs[i].size(), batchPlain.data(), batchPlain.size(), ADs[i].data(), ADs[i].size(), tag.data(), tag.size(), cipher.data());
+			BC_ASSERT_TRUE(cipher==ciphers[i]);
+			BC_ASSERT_TRUE(tag==tags[i]);
+		}
+	}
+
+	/* buffers large enough to be encrypted on several threads give the same output as the one thread encryption of the batch */
+	for (size_t plainSize : {4*lime::settings::AESGCM_parallelThreshold, 3*lime::settings::AESGCM_parallelThreshold+37}) {
+		std::vector<uint8_t> largePlain(plainSize), largeCipher(plainSize), batchCipher(plainSize), largeBack(plainSize);
+		std::vector<uint8_t> largeIV(lime::settings::DRMessageIVSize), batchTag(AES256GCM::tagSize());
+		RNG_context->randomize(largePlain.data(), largePlain.size());
+		RNG_context->randomize(largeIV.data(), largeIV.size());
+		AEAD_encrypt<AES256GCM>(key.data(), key.size(), largeIV.data(), largeIV.size(), largePlain.data(), largePlain.size(), AD.data(), AD.size(), tag.data(), tag.size(), largeCipher.data());
+		AEADbatchEntry entry{key.data(), key.size(), largeIV.data(), largeIV.size(), AD.data(), AD.size(), batchTag.data(), batchTag.size(), batchCipher.data()};
+		AEAD_encrypt_batch<AES256GCM>(&entry, 1, largePlain.data(), largePlain.size());
+		BC_ASSERT_TRUE(largeCipher==batchCipher);
+		BC_ASSERT_TRUE(tag==batchTag);
+		BC_ASSERT_TRUE(AEAD_decrypt<AES256GCM>(key.data(), key.size(), largeIV.data(), largeIV.size(), largeCipher.data(), largeCipher.size(), AD.data(), AD.size(), tag.data(), tag.size(), largeBack.data()));
+		BC_ASSERT_TRUE(largeBack==largePlain);
+		/* a modified cipher text fails the authentication */
+		largeCipher[plainSize/2] ^= 0x01;
+		BC_ASSERT_FALSE(AEAD_decrypt<AES256GCM>(key.data(), key.size(), largeIV.data(), largeIV.size(), largeCipher.data(), largeCipher.size(), AD.data(), AD.size(), tag.data(), tag.size(), largeBack.data()));
+	}
 }
 
 /**
@@ -745,12 +1011,11 @@ static void AEAD(void) {
  * To get an more readable perspective, mean and sqrt are divided by 0x7FFFFFFF
  * and result are tested agains 0.5 and 1/sqrt(12)
  *
+ * @param[in]	rng_source	the RNG to test
  */
-static void RNG_test(void) {
+static void RNG_stat_test(std::shared_ptr<RNG> rng_source) {
 	constexpr size_t NB_INT31_TESTED=10000;
 
-	/* init the RNG */
-	auto rng_source = make_RNG();
 	uint32_t random_uint31 = rng_source->randomize();
 
 	long double m0=static_cast<long double>(random_uint31),
@@ -787,12 +1052,274 @@ static void RNG_test(void) {
 	LIME_LOGD << NB_INT31_TESTED << " 31 bits unsigned integers generated Mean " << m0 << " Sigma "<<s0<<std::endl;
 }
 
+static void RNG_test(void) {
+	RNG_stat_test(make_RNG());
+
+	/* the thread RNG serves small requests from its buffer, large ones bypass it */
+	auto rng = thread_RNG();
+	BC_ASSERT_TRUE(rng == thread_RNG());
+	RNG_stat_test(rng);
+	sBuffer<lime::settings::DRrandomSeedSize> seed1, seed2;
+	rng->randomize(seed1);
+	rng->randomize(seed2);
+	BC_ASSERT_TRUE(seed1 != seed2);
+	std::vector<uint8_t> large(2*lime::settings::RNGbufferSize, 0);
+	rng->randomize(large.data(), large.size());
+	BC_ASSERT_TRUE(std::count(large.cbegin(), large.cend(), 0) < 64); // around 32 expected
+}
+
+#ifndef _WIN32
+/**
+ * Thread RNG across a fork: the child must not serve the random bytes buffered by the parent
+ */
+static void RNG_fork_test(void) {
+	auto rng = thread_RNG();
+	sBuffer<lime::settings::DRrandomSeedSize> parentSeed, childSeed;
+	rng->randomize(parentSeed); // warm up: the buffer holds the next random bytes of the parent
+
+	int fds[2];
+	if (pipe(fds) != 0) {
+		BC_FAIL("cannot create pipe");
+		return;
+	}
+	auto pid = fork();
+	if (pid == 0) { // child: draw from the same thread RNG and give the bytes to the parent
+		close(fds[0]);
+		rng->randomize(childSeed);
+		auto written = write(fds[1], childSeed.data(), childSeed.size());
+		_exit(written == static_cast<ssize_t>(childSeed.size()) ? 0 : 1);
+	}
+	close(fds[1]);
+	BC_ASSERT_TRUE(pid > 0);
+	if (pid > 0) {
+		rng->randomize(parentSeed);
+		size_t received = 0;
+		while (received < childSeed.size()) {
+			auto ret = read(fds[0], childSeed.data()+received, childSeed.size()-received);
+			if (ret <= 0) break;
+			received += static_cast<size_t>(ret);
+		}
+		int status = 0;
+		BC_ASSERT_EQUAL(waitpid(pid, &status, 0), pid, pid_t, "%d");
+		BC_ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+		BC_ASSERT_EQUAL(received, childSeed.size(), size_t, "%zu");
+		BC_ASSERT_TRUE(parentSeed != childSeed);
+	}
+	close(fds[0]);
+}
+#endif
+
+/**
+ * Secure arena: buffers of every size class and large ones are aligned, delivered zeroed and wiped when released
+ */
+static void secureArena_test(void) {
+	for (size_t size : {1, 16, 17, 48, 1000, 4096, 4097, 100000}) {
+		auto buffer = static_cast<uint8_t *>(secureArena_allocate(size));
+		BC_ASSERT_EQUAL(reinterpret_cast<uintptr_t>(buffer)%16, 0, uintptr_t, "%lu");
+		BC_ASSERT_TRUE(std::all_of(buffer, buffer+size, [](uint8_t b){return b==0;}));
+		memset(buffer, 0xA5, size);
+		const auto released = buffer;
+		secureArena_deallocate(buffer, size);
+		buffer = static_cast<uint8_t *>(secureArena_allocate(size));
+		if (size <= 4096) { // up to the largest size class, the block released is the next one served for this size
+			BC_ASSERT_TRUE(buffer == released);
+		}
+		BC_ASSERT_TRUE(std::all_of(buffer, buffer+size, [](uint8_t b){return b==0;}));
+		secureArena_deallocate(buffer, size);
+	}
+
+	// containers and shared objects in the arena
+	secureVector<sBuffer<48>> keys(1000);
+	for (size_t i=0; i<keys.size(); i++) {
+		keys[i].fill(static_cast<uint8_t>(i));
+	}
+	bool match = true;
+	for (size_t i=0; i<keys.size(); i++) {
+		match = match && (keys[i][47] == static_cast<uint8_t>(i));
+	}
+	BC_ASSERT_TRUE(match);
+	auto key = make_secure_shared<sBuffer<32>>();
+	key->fill(0x42);
+	BC_ASSERT_EQUAL((*key)[31], 0x42, uint8_t, "%d");
+}
+
+static const char *cryptoBackendName(const CryptoBackend backend) {
+	switch (backend) {
+		case CryptoBackend::bctoolbox:
+			return "bctoolbox";
+		case CryptoBackend::openssl:
+			return "OpenSSL";
+	}
+	return "unknown";
+}
+
+static void symmetric_bench(uint64_t runTime_ms) {
+	constexpr size_t batch_size = 500;
+	std::vector<uint8_t> key(AES256GCM::keySize()), IV(lime::settings::DRMessageIVSize), AD(lime::settings::DRSessionSharedADSize), tag(AES256GCM::tagSize());
+	lime_tester::randomize(key.data(), key.size());
+	lime_tester::randomize(IV.data(), IV.size());
+	lime_tester::randomize(AD.data(), AD.size());
+	std::array<uint8_t, 64> hash;
+
+	auto start = bctbx_get_cur_time_ms();
+	uint64_t span=0;
+	size_t runCount = 0;
+	while (span<runTime_ms) {
+		for (size_t i=0; i<batch_size; i++) {
+			HMAC<SHA512>(key.data(), key.size(), AD.data(), AD.size(), hash.data(), hash.size());
+		}
+		span = bctbx_get_cur_time_ms() - start;
+		runCount += batch_size;
+	}
+	auto freq = 1000*runCount/static_cast<double>(span);
+	std::string freq_unit, period_unit;
+	snprintSI(freq_unit, freq, "computations/s");
+	snprintSI(period_unit, 1/freq, "s/computation");
+	LIME_LOGI<<"HMAC-SHA512 "<<int(runCount)<<" computations on "<<AD.size()<<" bytes in "<<int(span)<<" ms : "<<period_unit<<" "<<freq_unit<<endl;
+
+	/* the size of a cipher message random key and of a typical short message */
+	for (size_t plainSize : {static_cast<size_t>(lime::settings::DRrandomSeedSize), static_cast<size_t>(1024)}) {
+		std::vector<uint8_t> plain(plainSize), cipher(plainSize);
+		lime_tester::randomize(plain.data(), plain.size());
+		start = bctbx_get_cur_time_ms();
+		span=0;
+		runCount = 0;
+		while (span<runTime_ms) {
+			for (size_t i=0; i<batch_size; i++) {
+				AEAD_encrypt<AES256GCM>(key.data(), key.size(), IV.data(), IV.size(), plain.data(), plain.size(), AD.data(), AD.size(), tag.data(), tag.size(), cipher.data());
+			}
+			span = bctbx_get_cur_time_ms() - start;
+			runCount += batch_size;
+		}
+		freq = 1000*runCount/static_cast<double>(span);
+		snprintSI(freq_unit, freq, "encryptions/s");
+		snprintSI(period_unit, 1/freq, "s/encryption");
+		LIME_LOGI<<"AES256-GCM "<<int(runCount)<<" encryptions of "<<plainSize<<" bytes in "<<int(span)<<" ms : "<<period_unit<<" "<<freq_unit<<endl;
+	}
+	LIME_LOGI<<endl;
+}
+
+/**
+ * Keys, signatures and encrypted messages produced by one backend are used by another one
+ */
+template <typename Curve>
+void crossBackend_test(const CryptoBackend producer, const CryptoBackend consumer) {
+	std::string messageString{"Ni yw y byd"};
+	std::vector<uint8_t> message{messageString.cbegin(), messageString.cend()};
+
+	/* producer: signature and key exchange with the converted signature keys */
+	set_cryptoBackend(producer);
+	auto rng = make_RNG();
+	auto AliceDSA = make_Signature<Curve>();
+	auto BobDSA = make_Signature<Curve>();
+	AliceDSA->createKeyPair(rng);
+	BobDSA->createKeyPair(rng);
+	DSA<Curve, lime::DSAtype::signature> signature;
+	AliceDSA->sign(message, signature);
+	auto AliceKeyExchange = make_keyExchange<Curve>();
+	AliceKeyExchange->set_secret(AliceDSA->get_secret());
+	AliceKeyExchange->set_peerPublic(BobDSA->get_public());
+	AliceKeyExchange->computeSharedSecret();
+	auto sharedSecret = AliceKeyExchange->get_sharedSecret();
+
+	std::vector<uint8_t> key(AES256GCM::keySize()), IV(lime::settings::DRMessageIVSize), tag(AES256GCM::tagSize()), cipher(message.size()), plain(message.size());
+	rng->randomize(key.data(), key.size());
+	rng->randomize(IV.data(), IV.size());
+	AEAD_encrypt<AES256GCM>(key.data(), key.size(), IV.data(), IV.size(), message.data(), message.size(), signature.data(), signature.size(), tag.data(), tag.size(), cipher.data());
+	std::array<uint8_t, 64> producerHash, consumerHash;
+	HMAC<SHA512>(key.data(), key.size(), message.data(), message.size(), producerHash.data(), producerHash.size());
+
+	/* consumer */
+	set_cryptoBackend(consumer);
+	auto Vera = make_Signature<Curve>();
+	Vera->set_public(AliceDSA->get_public());
+	BC_ASSERT_TRUE(Vera->verify(message, signature));
+	auto BobKeyExchange = make_keyExchange<Curve>();
+	BobKeyExchange->set_secret(BobDSA->get_secret());
+	BobKeyExchange->set_peerPublic(AliceDSA->get_public());
+	BobKeyExchange->computeSharedSecret();
+	BC_ASSERT_TRUE(BobKeyExchange->get_sharedSecret()==sharedSecret);
+	BC_ASSERT_TRUE(AEAD_decrypt<AES256GCM>(key.data(), key.size(), IV.data(), IV.size(), cipher.data(), cipher.size(), signature.data(), signature.size(), tag.data(), tag.size(), plain.data()));
+	BC_ASSERT_TRUE(plain==message);
+	HMAC<SHA512>(key.data(), key.size(), message.data(), message.size(), consumerHash.data(), consumerHash.size());
+	BC_ASSERT_TRUE(producerHash==consumerHash);
+
+	/* a buffer large enough to be encrypted on several threads by one backend is decrypted by the other */
+	std::vector<uint8_t> largePlain(4*lime::settings::AESGCM_parallelThreshold+5), largeCipher(largePlain.size()), largeBack(largePlain.size());
+	rng->randomize(largePlain.data(), largePlain.size());
+	set_cryptoBackend(producer);
+	AEAD_encrypt<AES256GCM>(key.data(), key.size(), IV.data(), IV.size(), largePlain.data(), largePlain.size(), signature.data(), signature.size(), tag.data(), tag.size(), largeCipher.data());
+	set_cryptoBackend(consumer);
+	BC_ASSERT_TRUE(AEAD_decrypt<AES256GCM>(key.data(), key.size(), IV.data(), IV.size(), largeCipher.data(), largeCipher.size(), signature.data(), signature.size(), tag.data(), tag.size(), largeBack.data()));
+	BC_ASSERT_TRUE(largeBack==largePlain);
+}
+
+/**
+ * Run the crypto tests with each available backend, check they interoperate and, in bench mode, report the throughput of each
+ */
+static void cryptoBackends(void) {
+	auto initialBackend = get_cryptoBackend();
+	auto backends = available_cryptoBackends();
+	BC_ASSERT_TRUE(std::find(backends.cbegin(), backends.cend(), initialBackend) != backends.cend());
+	LIME_LOGI<<"Default crypto backend: "<<cryptoBackendName(initialBackend)<<endl;
+
+	for (auto backend : backends) {
+		BC_ASSERT_TRUE(set_cryptoBackend(backend));
+		BC_ASSERT_TRUE(get_cryptoBackend()==backend);
+#ifdef EC25519_ENABLED
+		keyExchange_test<C255>();
+		signAndVerify_test<C255>();
+#endif
+#ifdef EC448_ENABLED
+		keyExchange_test<C448>();
+		signAndVerify_test<C448>();
+#endif
+		AEAD();
+		RNG_test();
+
+		if (bench) {
+			LIME_LOGI<<"Bench for crypto backend "<<cryptoBackendName(backend)<<":"<<endl;
+#ifdef EC25519_ENABLED
+			LIME_LOGI<<"Curve 25519:"<<endl;
+			keyExchange_bench<C255>(BENCH_TIMING_MS);
+			signAndVerify_bench<C255>(BENCH_TIMING_MS);
+#endif
+#ifdef EC448_ENABLED
+			LIME_LOGI<<"Curve 448:"<<endl;
+			keyExchange_bench<C448>(BENCH_TIMING_MS);
+			signAndVerify_bench<C448>(BENCH_TIMING_MS);
+#endif
+			symmetric_bench(BENCH_TIMING_MS);
+		}
+	}
+
+	for (auto producer : backends) {
+		for (auto consumer : backends) {
+			if (producer != consumer) {
+#ifdef EC25519_ENABLED
+				crossBackend_test<C255>(producer, consumer);
+#endif
+#ifdef EC448_ENABLED
+				crossBackend_test<C448>(producer, consumer);
+#endif
+			}
+		}
+	}
+
+	BC_ASSERT_TRUE(set_cryptoBackend(initialBackend));
+}
+
 static test_t tests[] = {
 	TEST_NO_TAG("Key Exchange", exchange),
 	TEST_NO_TAG("Signature", signAndVerify),
 	TEST_NO_TAG("HKDF", hashMac_KDF),
 	TEST_NO_TAG("AEAD", AEAD),
 	TEST_NO_TAG("RNG", RNG_test),
+#ifndef _WIN32
+	TEST_NO_TAG("RNG fork", RNG_fork_test),
+#endif
+	TEST_NO_TAG("Secure arena", secureArena_test),
+	TEST_NO_TAG("Crypto backends", cryptoBackends),
 };
 
 test_suite_t lime_crypto_test_suite = {
@@ -21,6 +21,7 @@
 #include "lime-tester.hpp"
 #include "lime-tester-utils.hpp"
 #include "lime_localStorage.hpp"
+#include "lime_double_ratchet_protocol.hpp"
 
 #include <bctoolbox/tester.h>
 #include <bctoolbox/exception.hh>
@@ -28,6 +29,7 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <algorithm>
 
 #include "bctoolbox/crypto.h"
 
@@ -217,9 +219,10 @@ static void dr_skippedMessages_basic(void) {
 #endif
 }
 
-/* alice send <period> messages to bob, and bob replies with <period> messages and so on until the end of message pattern list  */
+/* alice send <period> messages to bob, and bob replies with <period> messages and so on until the end of message pattern list
+ * alice session is created using the given AEAD scheme, bob's one switches to it on the first received message */
 template <typename Curve>
-static void dr_long_exchange_test(uint8_t period=1, std::string db_filename="dr_long_exchange_tmp") {
+static void dr_long_exchange_test(uint8_t period=1, std::string db_filename="dr_long_exchange_tmp", const lime::AEADAlgorithm AEAD=lime::AEADAlgorithm::aes256gcm) {
 	std::shared_ptr<DR<Curve>> alice, bob;
 	std::shared_ptr<lime::Db> aliceLocalStorage, bobLocalStorage;
 	std::string aliceFilename(db_filename);
@@ -229,7 +232,7 @@ static void dr_long_exchange_test(uint8_t period=1, std::string db_filename="dr_
 	// create sessions
 	auto alice_db_mutex = make_shared<std::recursive_mutex>();
 	auto bob_db_mutex = make_shared<std::recursive_mutex>();
-	lime_tester::dr_sessionsInit(alice, bob, aliceLocalStorage, bobLocalStorage, aliceFilename, alice_db_mutex, bobFilename, bob_db_mutex, true, RNG_context);
+	lime_tester::dr_sessionsInit(alice, bob, aliceLocalStorage, bobLocalStorage, aliceFilename, alice_db_mutex, bobFilename, bob_db_mutex, true, RNG_context, AEAD);
 	std::vector<uint8_t> aliceCipher, bobCipher;
 
 	bool aliceSender=true;
@@ -258,6 +261,8 @@ static void dr_long_exchange_test(uint8_t period=1, std::string db_filename="dr_
 				auto bobSessionId=bob->dbSessionId();
 				bob = nullptr; // release and destroy bob DR context
 				bob = make_shared<DR<Curve>>(bobLocalStorage, bobSessionId, RNG_context);
+				// the AEAD scheme adopted from alice's messages is restored from local storage
+				BC_ASSERT_TRUE(bob->AEAD()==AEAD);
 			}
 		} else {
 			// bob replies
@@ -282,6 +287,7 @@ static void dr_long_exchange_test(uint8_t period=1, std::string db_filename="dr_
 				auto aliceSessionId=alice->dbSessionId();
 				alice = nullptr; // release and destroy alice DR context
 				alice = make_shared<DR<Curve>>(aliceLocalStorage, aliceSessionId, RNG_context);
+				BC_ASSERT_TRUE(alice->AEAD()==AEAD);
 			}
 		}
 	}
@@ -316,6 +322,14 @@ static void dr_long_exchange10(void) {
 	dr_long_exchange_test<C448>(10, "dr_long_exchange_10_X448");
 #endif
 }
+static void dr_long_exchange_chacha20poly1305(void) {
+#ifdef EC25519_ENABLED
+	dr_long_exchange_test<C255>(3, "dr_long_exchange_chacha_X25519", lime::AEADAlgorithm::chacha20poly1305);
+#endif
+#ifdef EC448_ENABLED
+	dr_long_exchange_test<C448>(3, "dr_long_exchange_chacha_X448", lime::AEADAlgorithm::chacha20poly1305);
+#endif
+}
 
 /* Basic exchange alice send a message to bob and he replies so the session is established
  *
@@ -841,17 +855,294 @@ static void dr_encryptionPolicy_error(void) {
 #endif
 }
 
+/**
+ * Alice encrypts a cipherMessage by chunks to Bob, Bob decrypts it by chunks
+ * The message spans several chunks and is given to the streams in pieces not aligned on the chunks
+ * A truncated or altered cipherMessage shall fail the decryption
+ *
+ * @param db_filename	Alice and Bob database string(file path) access
+ * @param AEAD		the AEAD used to encrypt the cipherMessage
+ */
+template <typename Curve>
+static void dr_cipherMessage_stream_test(std::string db_filename, const lime::AEADAlgorithm AEAD) {
+	std::shared_ptr<DR<Curve>> DRsessionAlice, DRsessionBob;
+	std::shared_ptr<lime::Db> localStorageAlice, localStorageBob;
+	std::string aliceFilename(db_filename);
+	std::string bobFilename(db_filename);
+	aliceFilename.append(".alice.sqlite3");
+	bobFilename.append(".bob.sqlite3");
+
+	// create sessions: alice sender, bob receiver
+	auto alice_db_mutex = make_shared<std::recursive_mutex>();
+	auto bob_db_mutex = make_shared<std::recursive_mutex>();
+	lime_tester::dr_sessionsInit(DRsessionAlice, DRsessionBob, localStorageAlice, localStorageBob, aliceFilename, alice_db_mutex, bobFilename, bob_db_mutex, true, RNG_context);
+
+	// a message of two and a half chunks
+	std::vector<uint8_t> plaintext(2*lime::settings::cipherMessageStreamChunkSize + lime::settings::cipherMessageStreamChunkSize/2);
+	RNG_context->randomize(plaintext.data(), plaintext.size());
+
+	// alice produces the DR message holding the random seed
+	EncryptionContext context("bob", "alice", AEAD);
+	std::vector<RecipientInfos<Curve>> recipients;
+	recipients.emplace_back("bob",DRsessionAlice);
+	encryptMessage(context, recipients, std::vector<uint8_t>{}, localStorageAlice, nullptr);
+
+	// then the cipherMessage, given in pieces of an odd size
+	std::vector<uint8_t> cipherMessage{};
+	auto encryptStream = std::make_shared<CipherMessageStream>(context.randomSeed, "alice", "bob", AEAD, true);
+	const size_t pieceSize = 10007;
+	for (size_t i=0; i<plaintext.size(); i+=pieceSize) {
+		BC_ASSERT_TRUE(encryptStream->update(plaintext.data()+i, std::min(pieceSize, plaintext.size()-i), cipherMessage));
+	}
+	BC_ASSERT_TRUE(encryptStream->finish(cipherMessage));
+	BC_ASSERT_EQUAL((int)cipherMessage.size(), (int)(plaintext.size()+3*lime::settings::DRMessageAuthTagSize), int, "%d");
+
+	// bob decrypts the DR message and gets the stream decrypting the cipherMessage
+	std::vector<shared_ptr<DR<Curve>>> recipientDRSessions{};
+	recipientDRSessions.push_back(DRsessionBob);
+	std::shared_ptr<CipherMessageStream> decryptStream{};
+	BC_ASSERT_TRUE(decryptMessage("alice", "bob", "bob", recipientDRSessions, recipients[0].DRmessage, decryptStream) != nullptr);
+	if (decryptStream == nullptr) {
+		return;
+	}
+	// the DR message of a stream cannot be decrypted as a regular one
+	std::vector<uint8_t> plainBuffer{};
+	BC_ASSERT_TRUE(decryptMessage("alice", "bob", "bob", recipientDRSessions, recipients[0].DRmessage, cipherMessage, plainBuffer) == nullptr);
+
+	// decrypt the cipherMessage in pieces of another size
+	const size_t decryptPieceSize = 4099;
+	for (size_t i=0; i<cipherMessage.size(); i+=decryptPieceSize) {
+		BC_ASSERT_TRUE(decryptStream->update(cipherMessage.data()+i, std::min(decryptPieceSize, cipherMessage.size()-i), plainBuffer));
+	}
+	BC_ASSERT_TRUE(decryptStream->finish(plainBuffer));
+	BC_ASSERT_TRUE(plainBuffer == plaintext);
+
+	// a cipherMessage truncated on a chunk boundary fails as its last chunk is not flagged so
+	plainBuffer.clear();
+	auto truncatedStream = std::make_shared<CipherMessageStream>(context.randomSeed, "alice", "bob", AEAD, false);
+	BC_ASSERT_TRUE(truncatedStream->update(cipherMessage.data(), 2*(lime::settings::cipherMessageStreamChunkSize+lime::settings::DRMessageAuthTagSize), plainBuffer));
+	BC_ASSERT_FALSE(truncatedStream->finish(plainBuffer));
+	BC_ASSERT_EQUAL((int)plainBuffer.size(), (int)lime::settings::cipherMessageStreamChunkSize, int, "%d"); // only the first chunk is given away
+
+	// an altered cipherMessage fails
+	plainBuffer.clear();
+	cipherMessage[lime::settings::cipherMessageStreamChunkSize/2] ^= 0x01;
+	auto alteredStream = std::make_shared<CipherMessageStream>(context.randomSeed, "alice", "bob", AEAD, false);
+	BC_ASSERT_FALSE(alteredStream->update(cipherMessage.data(), cipherMessage.size(), plainBuffer));
+	BC_ASSERT_FALSE(alteredStream->finish(plainBuffer));
+	BC_ASSERT_TRUE(plainBuffer.empty());
+
+	if (cleanDatabase) {
+		remove(aliceFilename.data());
+		remove(bobFilename.data());
+	}
+}
+
+static void dr_cipherMessage_stream(void) {
+#ifdef EC25519_ENABLED
+	dr_cipherMessage_stream_test<C255>("dr_cipherMessage_stream_C25519", lime::AEADAlgorithm::aes256gcm);
+	dr_cipherMessage_stream_test<C255>("dr_cipherMessage_stream_chacha_C25519", lime::AEADAlgorithm::chacha20poly1305);
+#endif
+#ifdef EC448_ENABLED
+	dr_cipherMessage_stream_test<C448>("dr_cipherMessage_stream_C448", lime::AEADAlgorithm::aes256gcm);
+	dr_cipherMessage_stream_test<C448>("dr_cipherMessage_stream_chacha_C448", lime::AEADAlgorithm::chacha20poly1305);
+#endif
+}
+
+/**
+ * Alice encrypts a compressible message to Bob with each available compression algorithm, in DR message and cipher message modes
+ * - the payload is not compressed until Bob advertised he can decompress it: in the message he sends after decrypting Alice's first one
+ * - once he did, the encrypted output shall be shorter than without compression and Bob shall get the original message back
+ * - Bob's capability is kept in local storage with the session
+ *
+ * @param db_filename	Alice and Bob database string(file path) access
+ * @param algorithm	the compression algorithm to use
+ * @param encryptionPolicy	DRMessage or cipherMessage
+ */
+template <typename Curve>
+static void dr_payloadCompression_test(std::string db_filename, const lime::CompressionAlgorithm algorithm, const lime::EncryptionPolicy encryptionPolicy) {
+	std::shared_ptr<DR<Curve>> DRsessionAlice, DRsessionBob;
+	std::shared_ptr<lime::Db> localStorageAlice, localStorageBob;
+	std::string aliceFilename(db_filename);
+	std::string bobFilename(db_filename);
+	aliceFilename.append(".alice.sqlite3");
+	bobFilename.append(".bob.sqlite3");
+
+	// create sessions: alice sender, bob receiver
+	auto alice_db_mutex = make_shared<std::recursive_mutex>();
+	auto bob_db_mutex = make_shared<std::recursive_mutex>();
+	lime_tester::dr_sessionsInit(DRsessionAlice, DRsessionBob, localStorageAlice, localStorageBob, aliceFilename, alice_db_mutex, bobFilename, bob_db_mutex, true, RNG_context);
+
+	// a compressible message: the same pattern repeated
+	std::vector<uint8_t> plaintext{};
+	for (size_t i=0; i<8; i++) {
+		plaintext.insert(plaintext.end(), lime_tester::messages_pattern[i%4].begin(), lime_tester::messages_pattern[i%4].end());
+	}
+
+	// bob never sent anything: alice does not know he can decompress, the payload is not compressed
+	BC_ASSERT_TRUE(lime::set_compressionAlgorithm(algorithm));
+	std::vector<uint8_t> firstCipherMessage{};
+	std::vector<RecipientInfos<Curve>> firstRecipients;
+	firstRecipients.emplace_back("bob",DRsessionAlice);
+	encryptMessage(firstRecipients, plaintext, "bob", "alice", firstCipherMessage, encryptionPolicy, localStorageAlice);
+	BC_ASSERT_FALSE(double_ratchet_protocol::DRHeader<Curve>{firstRecipients[0].DRmessage}.payloadCompressed());
+
+	std::vector<shared_ptr<DR<Curve>>> recipientDRSessions{};
+	recipientDRSessions.push_back(DRsessionBob);
+	std::vector<uint8_t> plainBuffer{};
+	BC_ASSERT_TRUE(decryptMessage("alice", "bob", "bob", recipientDRSessions, firstRecipients[0].DRmessage, firstCipherMessage, plainBuffer) != nullptr);
+	BC_ASSERT_TRUE(plainBuffer == plaintext);
+
+	// bob replies, his message advertises the algorithms he can decompress
+	std::vector<uint8_t> bobCipherMessage{};
+	std::vector<RecipientInfos<Curve>> bobRecipients;
+	bobRecipients.emplace_back("alice",DRsessionBob);
+	encryptMessage(bobRecipients, plaintext, "alice", "bob", bobCipherMessage, encryptionPolicy, localStorageBob);
+	recipientDRSessions.clear();
+	recipientDRSessions.push_back(DRsessionAlice);
+	BC_ASSERT_TRUE(decryptMessage("bob", "alice", "alice", recipientDRSessions, bobRecipients[0].DRmessage, bobCipherMessage, plainBuffer) != nullptr);
+	BC_ASSERT_TRUE(plainBuffer == plaintext);
+	BC_ASSERT_TRUE(DRsessionAlice->peerDecompresses(algorithm));
+
+	// encrypt it once without compression to get the reference size, then with compression using the session reloaded from local storage
+	std::vector<uint8_t> cipherMessage{}, uncompressedCipherMessage{};
+	std::vector<RecipientInfos<Curve>> uncompressedRecipients;
+	uncompressedRecipients.emplace_back("bob",DRsessionAlice);
+	BC_ASSERT_TRUE(lime::set_compressionAlgorithm(lime::CompressionAlgorithm::none));
+	encryptMessage(uncompressedRecipients, plaintext, "bob", "alice", uncompressedCipherMessage, encryptionPolicy, localStorageAlice);
+	BC_ASSERT_FALSE(double_ratchet_protocol::DRHeader<Curve>{uncompressedRecipients[0].DRmessage}.payloadCompressed());
+
+	std::vector<RecipientInfos<Curve>> recipients;
+	recipients.emplace_back("bob",make_shared<DR<Curve>>(localStorageAlice, DRsessionAlice->dbSessionId(), RNG_context));
+	BC_ASSERT_TRUE(lime::set_compressionAlgorithm(algorithm));
+	encryptMessage(recipients, plaintext, "bob", "alice", cipherMessage, encryptionPolicy, localStorageAlice);
+	BC_ASSERT_TRUE(lime::set_compressionAlgorithm(lime::CompressionAlgorithm::none));
+	BC_ASSERT_TRUE(double_ratchet_protocol::DRHeader<Curve>{recipients[0].DRmessage}.payloadCompressed());
+	BC_ASSERT_TRUE(recipients[0].DRmessage.size()+cipherMessage.size() < uncompressedRecipients[0].DRmessage.size()+uncompressedCipherMessage.size());
+
+	// bob decrypts both, decompression does not depend on the algorithm selected on his side
+	recipientDRSessions.clear();
+	recipientDRSessions.push_back(DRsessionBob);
+	plainBuffer.clear();
+	BC_ASSERT_TRUE(decryptMessage("alice", "bob", "bob", recipientDRSessions, uncompressedRecipients[0].DRmessage, uncompressedCipherMessage, plainBuffer) != nullptr);
+	BC_ASSERT_TRUE(plainBuffer == plaintext);
+	plainBuffer.clear();
+
+	// the decompressed size is checked before the session is saved: a too large plaintext does not consume the message
+	size_t plainSize = 0;
+	std::vector<uint8_t> callerBuffer(plaintext.size()-1, 0);
+	BC_ASSERT_TRUE(decryptMessage("alice", "bob", "bob", recipientDRSessions, recipients[0].DRmessage, cipherMessage, lime::span<uint8_t>{callerBuffer}, plainSize) == nullptr);
+	BC_ASSERT_EQUAL(plainSize, plaintext.size(), size_t, "%zu");
+	BC_ASSERT_TRUE(std::all_of(callerBuffer.cbegin(), callerBuffer.cend(), [](const uint8_t b){return b == 0;}));
+	recipientDRSessions.clear();
+	recipientDRSessions.push_back(make_shared<DR<Curve>>(localStorageBob, DRsessionBob->dbSessionId(), RNG_context)); // reload the session from local storage
+	callerBuffer.resize(plaintext.size()+1); // a larger buffer gets the plaintext in its first bytes
+	BC_ASSERT_TRUE(decryptMessage("alice", "bob", "bob", recipientDRSessions, recipients[0].DRmessage, cipherMessage, lime::span<uint8_t>{callerBuffer}, plainSize) != nullptr);
+	BC_ASSERT_EQUAL(plainSize, plaintext.size(), size_t, "%zu");
+	BC_ASSERT_TRUE(std::equal(plaintext.cbegin(), plaintext.cend(), callerBuffer.cbegin()));
+
+	if (cleanDatabase) {
+		remove(aliceFilename.data());
+		remove(bobFilename.data());
+	}
+}
+
+static void dr_payloadCompression(void) {
+	for (auto algorithm : lime::available_compressionAlgorithms()) {
+		if (algorithm == lime::CompressionAlgorithm::none) {
+			continue;
+		}
+#ifdef EC25519_ENABLED
+		dr_payloadCompression_test<C255>("dr_payloadCompression_C25519", algorithm, lime::EncryptionPolicy::DRMessage);
+		dr_payloadCompression_test<C255>("dr_payloadCompression_C25519", algorithm, lime::EncryptionPolicy::cipherMessage);
+#endif
+#ifdef EC448_ENABLED
+		dr_payloadCompression_test<C448>("dr_payloadCompression_C448", algorithm, lime::EncryptionPolicy::DRMessage);
+		dr_payloadCompression_test<C448>("dr_payloadCompression_C448", algorithm, lime::EncryptionPolicy::cipherMessage);
+#endif
+	}
+}
+
+/**
+ * Build a DR message header holding an X3DH init message and parse it back:
+ * the X3DH init message is accessed in place in the header buffer, not copied
+ */
+template <typename Curve>
+static void dr_protocol_headerParsing_test(void) {
+	DSA<Curve, lime::DSAtype::publicKey> Ik;
+	X<Curve, lime::Xtype::publicKey> Ek, DHs;
+	lime_tester::randomize(Ik.data(), Ik.size());
+	lime_tester::randomize(Ek.data(), Ek.size());
+	lime_tester::randomize(DHs.data(), DHs.size());
+
+	for (const bool OPk_flag : {true, false}) {
+		std::vector<uint8_t> X3DH_initMessage{};
+		double_ratchet_protocol::buildMessage_X3DHinit<Curve>(X3DH_initMessage, Ik, Ek, 0x01020304, 0x05060708, OPk_flag);
+		BC_ASSERT_EQUAL(X3DH_initMessage.size(), double_ratchet_protocol::X3DHinitSize<Curve>(OPk_flag), size_t, "%zu");
+
+		std::vector<uint8_t> header{};
+		double_ratchet_protocol::buildMessage_header<Curve>(header, 42, 7, DHs, X3DH_initMessage, false, lime::AEADAlgorithm::aes256gcm, lime::AEADAlgorithm::aes256gcm, false, false);
+		BC_ASSERT_EQUAL(header.size(), double_ratchet_protocol::headerSize<Curve>() + X3DH_initMessage.size(), size_t, "%zu");
+
+		// the parser returns a view on the header buffer
+		lime::span<const uint8_t> X3DH_initView{};
+		BC_ASSERT_TRUE(double_ratchet_protocol::parseMessage_get_X3DHinit<Curve>(header, X3DH_initView));
+		BC_ASSERT_TRUE(X3DH_initView.data() == header.data() + 3);
+		BC_ASSERT_TRUE(std::vector<uint8_t>(X3DH_initView.begin(), X3DH_initView.end()) == X3DH_initMessage);
+
+		DSA<Curve, lime::DSAtype::publicKey> parsedIk;
+		X<Curve, lime::Xtype::publicKey> parsedEk;
+		uint32_t SPk_id=0, OPk_id=0;
+		bool parsedOPk_flag = !OPk_flag;
+		double_ratchet_protocol::parseMessage_X3DHinit<Curve>(X3DH_initView, parsedIk, parsedEk, SPk_id, OPk_id, parsedOPk_flag);
+		BC_ASSERT_TRUE(parsedIk == Ik);
+		BC_ASSERT_TRUE(parsedEk == Ek);
+		BC_ASSERT_EQUAL(SPk_id, 0x01020304, uint32_t, "%x");
+		BC_ASSERT_TRUE(parsedOPk_flag == OPk_flag);
+		if (OPk_flag) {
+			BC_ASSERT_EQUAL(OPk_id, 0x05060708, uint32_t, "%x");
+		}
+
+		double_ratchet_protocol::DRHeader<Curve> parsedHeader{header};
+		BC_ASSERT_TRUE(parsedHeader.valid());
+		BC_ASSERT_EQUAL(parsedHeader.Ns(), 42, uint16_t, "%d");
+		BC_ASSERT_EQUAL(parsedHeader.PN(), 7, uint16_t, "%d");
+		BC_ASSERT_TRUE(parsedHeader.DHs() == DHs);
+		BC_ASSERT_EQUAL(parsedHeader.size(), header.size(), size_t, "%zu");
+
+		// every header advertises the compression algorithms this build can decompress
+		uint8_t compressionCapabilities = 0;
+		for (const auto algorithm : lime::available_compressionAlgorithms()) {
+			compressionCapabilities |= double_ratchet_protocol::compressionCapabilityFlag(algorithm);
+		}
+		BC_ASSERT_EQUAL(parsedHeader.compressionCapabilities(), compressionCapabilities, uint8_t, "%x");
+	}
+}
+
+static void dr_protocol_headerParsing(void) {
+#ifdef EC25519_ENABLED
+	dr_protocol_headerParsing_test<C255>();
+#endif
+#ifdef EC448_ENABLED
+	dr_protocol_headerParsing_test<C448>();
+#endif
+}
+
 static test_t tests[] = {
 	TEST_NO_TAG("Basic", dr_basic),
 	TEST_NO_TAG("Long Exchange 1", dr_long_exchange1),
 	TEST_NO_TAG("Long Exchange 3", dr_long_exchange3),
 	TEST_NO_TAG("Long Exchange 10", dr_long_exchange10),
+	TEST_NO_TAG("Long Exchange ChaCha20-Poly1305", dr_long_exchange_chacha20poly1305),
 	TEST_NO_TAG("Skip message", dr_skippedMessages_basic),
 	TEST_NO_TAG("Multidevices", dr_multidevice_basic),
 	TEST_NO_TAG("Skip more messages than limit", dr_skip_too_much),
 	TEST_NO_TAG("Encryption Policy basic", dr_encryptionPolicy_basic),
 	TEST_NO_TAG("Encryption Policy multidevice", dr_encryptionPolicy_multidevice),
 	TEST_NO_TAG("Wrong Encryption Policy", dr_encryptionPolicy_error),
+	TEST_NO_TAG("Cipher message stream", dr_cipherMessage_stream),
+	TEST_NO_TAG("Payload compression", dr_payloadCompression),
+	TEST_NO_TAG("Protocol header parsing", dr_protocol_headerParsing),
 };
 
 test_suite_t lime_double_ratchet_test_suite = {
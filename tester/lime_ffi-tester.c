@@ -686,9 +686,15 @@ static void ffi_basic_test(const enum lime_ffi_CurveId curve, const char *dbBase
 	 * DRmessages and Cipher Message are directly sent to bob by sharing the output buffer in the same function,
 	 * hello world test is more realistic as it simulates a network transmission
 	 */
-	/* Bob device 1 decrypts first message */
-	size_t decryptedMessageSize = (cipherMessageSize1>recipients1[0].DRmessageSize)?cipherMessageSize1:recipients1[0].DRmessageSize; /* actual ciphered message is either in cipherMessage or DRmessage, just allocated a buffer the size of the largest one of the two.*/
+	/* Bob device 1 decrypts first message, a too small buffer fails but gives the size needed and does not consume the message */
+	size_t decryptedMessageSize = message_patternSize1-1;
 	uint8_t *decryptedMessage = malloc(decryptedMessageSize);
+	BC_ASSERT_TRUE(lime_ffi_decrypt(bobManager1, bobDeviceId1, "bob", aliceDeviceId, recipients1[0].DRmessage, recipients1[0].DRmessageSize, cipherMessage1, cipherMessageSize1, decryptedMessage, &decryptedMessageSize) == lime_ffi_PeerDeviceStatus_fail);
+	BC_ASSERT_EQUAL((int)message_patternSize1, (int)decryptedMessageSize, int, "%d");
+	free(decryptedMessage);
+
+	decryptedMessageSize = (cipherMessageSize1>recipients1[0].DRmessageSize)?cipherMessageSize1:recipients1[0].DRmessageSize; /* actual ciphered message is either in cipherMessage or DRmessage, just allocated a buffer the size of the largest one of the two.*/
+	decryptedMessage = malloc(decryptedMessageSize);
 	BC_ASSERT_TRUE(lime_ffi_decrypt(bobManager1, bobDeviceId1, "bob", aliceDeviceId, recipients1[0].DRmessage, recipients1[0].DRmessageSize, cipherMessage1, cipherMessageSize1, decryptedMessage, &decryptedMessageSize) == lime_ffi_PeerDeviceStatus_unknown);
 	/* check we got the original message back */
 	BC_ASSERT_EQUAL((int)message_patternSize1, (int)decryptedMessageSize, int, "%d");
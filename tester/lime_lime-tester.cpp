@@ -50,7 +50,8 @@ static belle_http_provider_t *prov=NULL;
 enum class HttpLinkStatus : uint8_t {
 	ok,
 	sending_fail,
-	reception_fail
+	reception_fail,
+	server_error
 };
 
 static HttpLinkStatus httpLink = HttpLinkStatus::ok;
@@ -166,6 +167,10 @@ static limeX3DHServerPostData X3DHServerPost_Failing_Simulation([](const std::st
 		case HttpLinkStatus::sending_fail :
 			// Just do nothing, swallow the packet and do not give any answer.
 		break;
+		case HttpLinkStatus::server_error :
+			// Do not send the packet, answer with a server error
+			responseProcess(500, std::vector<uint8_t>{});
+		break;
 		case HttpLinkStatus::ok :
 		default:
 			X3DHServerPost(url, from, message, responseProcess);
@@ -1469,10 +1474,21 @@ static void lime_db_migration() {
 		sql.open("sqlite3", dbFilename);
 		int userVersion=-1;
 		sql<<"SELECT version FROM db_module_version WHERE name='lime'", soci::into(userVersion);
-		BC_ASSERT_EQUAL(userVersion, 0x100, int, "%d");
+		BC_ASSERT_EQUAL(userVersion, 0x103, int, "%d");
 		int haveTs=0;
 		sql<<"SELECT COUNT(*) FROM pragma_table_info('lime_LocalUsers') WHERE name='updateTs'", soci::into(haveTs);
 		BC_ASSERT_EQUAL(haveTs, 1, int, "%d");
+		// Version 0.1.1 added the peer devices without key bundle table
+		int haveNoBundleTable=0;
+		sql<<"SELECT COUNT(*) FROM sqlite_master WHERE type='table' AND name='lime_NoBundlePeerDevices'", soci::into(haveNoBundleTable);
+		BC_ASSERT_EQUAL(haveNoBundleTable, 1, int, "%d");
+		// Version 0.1.2 added the sessions AEAD scheme, version 0.1.3 the peer compression capabilities
+		int haveAEAD=0;
+		sql<<"SELECT COUNT(*) FROM pragma_table_info('DR_sessions') WHERE name='AEAD'", soci::into(haveAEAD);
+		BC_ASSERT_EQUAL(haveAEAD, 1, int, "%d");
+		int haveCompression=0;
+		sql<<"SELECT COUNT(*) FROM pragma_table_info('DR_sessions') WHERE name='Compression'", soci::into(haveCompression);
+		BC_ASSERT_EQUAL(haveCompression, 1, int, "%d");
 	} catch (BctbxException &e) {
 		LIME_LOGE << e;
 		BC_FAIL("Can't check DB migration done");
@@ -1622,6 +1638,115 @@ static void lime_update_OPk() {
 #endif
 }
 
+/**
+ * Scenario:
+ * - Create a user alice, update it with a server low limit under its initial batch: nothing is uploaded
+ * - Create bob devices fetching alice key bundles: they consume more OPks than the server low limit
+ * - Update alice again: the batch uploaded is sized on the observed consumption, not on the given low limit and batch size
+ * - alice decrypts bob's messages
+ */
+static void lime_update_OPk_adaptive_test(const lime::CurveId curve, const std::string &dbBaseFilename, const std::string &x3dh_server_url) {
+	// create DB
+	std::string dbFilenameAlice{dbBaseFilename};
+	std::string dbFilenameBob{dbBaseFilename};
+	dbFilenameAlice.append(".alice.").append((curve==CurveId::c25519)?"C25519":"C448").append(".sqlite3");
+	dbFilenameBob.append(".bob.").append((curve==CurveId::c25519)?"C25519":"C448").append(".sqlite3");
+
+	remove(dbFilenameAlice.data()); // delete the database file if already exists
+	remove(dbFilenameBob.data()); // delete the database file if already exists
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+
+	limeCallback callback([&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				});
+	try {
+		// server low limit is under the initial batch, the batch is one key
+		const uint16_t OPkServerLowLimit = lime_tester::OPkInitialBatchSize - 1;
+		const uint16_t OPkBatchSize = 1;
+
+		// create Manager and device for alice
+		auto aliceManager = std::unique_ptr<LimeManager>(new LimeManager(dbFilenameAlice, X3DHServerPost));
+		auto aliceDeviceId = lime_tester::makeRandomDeviceName("alice.d1.");
+		aliceManager->create_user(*aliceDeviceId, x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+
+		// first update: all the keys are still on server, nothing to upload
+		// alice's manager is kept alive as the consumption rate is observed in memory, only the update timestamp is forwarded
+		lime_tester::forwardTime(dbFilenameAlice, 2);
+		aliceManager->update(*aliceDeviceId, callback, OPkServerLowLimit, OPkBatchSize);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+		BC_ASSERT_EQUAL((int)lime_tester::get_OPks(dbFilenameAlice, *aliceDeviceId), lime_tester::OPkInitialBatchSize, int, "%d");
+
+		// bob devices fetch all alice's OPks
+		auto bobManager = std::unique_ptr<LimeManager>(new LimeManager(dbFilenameBob, X3DHServerPost));
+		std::vector<std::shared_ptr<std::string>> bobDeviceIds{};
+		std::vector<std::shared_ptr<std::vector<RecipientData>>> bobRecipients{};
+		std::vector<std::shared_ptr<std::vector<uint8_t>>> bobCipherMessages{};
+		for (auto i=0; i<lime_tester::OPkInitialBatchSize; i++) {
+			bobDeviceIds.push_back(lime_tester::makeRandomDeviceName("bob.d"));
+			bobManager->create_user(*(bobDeviceIds.back()), x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+
+			bobRecipients.push_back(make_shared<std::vector<RecipientData>>());
+			bobRecipients.back()->emplace_back(*aliceDeviceId);
+			auto plainMessage = make_shared<const std::vector<uint8_t>>(lime_tester::messages_pattern[i].begin(), lime_tester::messages_pattern[i].end());
+			bobCipherMessages.push_back(make_shared<std::vector<uint8_t>>());
+			bobManager->encrypt(*(bobDeviceIds.back()), make_shared<const std::string>("alice"), bobRecipients.back(), plainMessage, bobCipherMessages.back(), callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+		}
+
+		// second update: the server holds no more OPks, the fixed policy would upload OPkServerLowLimit keys
+		// but the observed consumption exceeds it, so we upload enough to cover it on top of the low limit
+		lime_tester::forwardTime(dbFilenameAlice, 2);
+		aliceManager->update(*aliceDeviceId, callback, OPkServerLowLimit, OPkBatchSize);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+		// dispatched keys are still in local storage
+		BC_ASSERT_EQUAL((int)lime_tester::get_OPks(dbFilenameAlice, *aliceDeviceId), lime_tester::OPkInitialBatchSize + lime_tester::OPkInitialBatchSize + OPkServerLowLimit, int, "%d");
+
+		// alice decrypts all bob's messages, the OPks are not counted twice: an other update does not upload anything
+		for (size_t i=0; i<bobDeviceIds.size(); i++) {
+			std::vector<uint8_t> receivedMessage{};
+			BC_ASSERT_TRUE(aliceManager->decrypt(*aliceDeviceId, "alice", *(bobDeviceIds[i]), (*bobRecipients[i])[0].DRmessage, *(bobCipherMessages[i]), receivedMessage) == lime::PeerDeviceStatus::unknown);
+			auto receivedMessageString = std::string{receivedMessage.begin(), receivedMessage.end()};
+			BC_ASSERT_TRUE(receivedMessageString == lime_tester::messages_pattern[i]);
+		}
+		lime_tester::forwardTime(dbFilenameAlice, 2);
+		aliceManager->update(*aliceDeviceId, callback, OPkServerLowLimit, OPkBatchSize);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+		BC_ASSERT_EQUAL((int)lime_tester::get_OPks(dbFilenameAlice, *aliceDeviceId), lime_tester::OPkInitialBatchSize + OPkServerLowLimit, int, "%d");
+
+		if (cleanDatabase) {
+			for (const auto &bobDeviceId : bobDeviceIds) {
+				bobManager->delete_user(*bobDeviceId, callback);
+			}
+			aliceManager->delete_user(*aliceDeviceId, callback);
+			expected_success += 1+(int)bobDeviceIds.size();
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success,lime_tester::wait_for_timeout));
+			remove(dbFilenameAlice.data());
+			remove(dbFilenameBob.data());
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void lime_update_OPk_adaptive() {
+#ifdef EC25519_ENABLED
+	lime_update_OPk_adaptive_test(lime::CurveId::c25519, "lime_update_OPk_adaptive", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c25519_server_port).data());
+#endif
+#ifdef EC448_ENABLED
+	lime_update_OPk_adaptive_test(lime::CurveId::c448, "lime_update_OPk_adaptive", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c448_server_port).data());
+#endif
+}
+
 /**
  * Scenario:
  * - Create a user alice
@@ -3620,8 +3745,9 @@ static void user_registration_failure_test(const lime::CurveId curve, const std:
 		auto localStorage = std::unique_ptr<lime::Db>(new lime::Db(dbFilenameAlice, alice_db_mutex));
 		auto curve = CurveId::unset;
 		std::string x3dh_server_url;
+		auto AEAD = lime::AEADAlgorithm::aes256gcm;
 
-		localStorage->load_LimeUser(*aliceDeviceId, Uid, curve, x3dh_server_url); // this one will throw an exception if user is not found, just let it rise
+		localStorage->load_LimeUser(*aliceDeviceId, Uid, curve, x3dh_server_url, AEAD); // this one will throw an exception if user is not found, just let it rise
 	} catch (BctbxException &) {
 		gotExpectedException = true;
 	}
@@ -4229,6 +4355,819 @@ static void lime_session_cancel(void) {
 #endif
 }
 
+/*
+ * Scenario
+ * - Create alice.d1 and bob.d1, bob.d2, bob.d3
+ * - Alice encrypts to bob.d1, bob.d2, bob.d3 and a device not registered on the X3DH server using the streaming encrypt
+ * - Check the recipient callback is called once for each bob device, before the final callback, and never for the unknown device
+ * - Check the streamed DR messages match the one in the recipients list after completion
+ * - Bob's devices decrypt the streamed DR messages
+ * - Do it twice to stream also when all sessions are already established
+ */
+static void lime_encrypt_streaming_test(const lime::CurveId curve, const std::string &dbBaseFilename, const std::string &x3dh_server_url) {
+	// create DB
+	std::string dbFilenameAlice{dbBaseFilename};
+	dbFilenameAlice.append(".alice.").append((curve==CurveId::c25519)?"C25519":"C448").append(".sqlite3");
+	std::string dbFilenameBob{dbBaseFilename};
+	dbFilenameBob.append(".bob.").append((curve==CurveId::c25519)?"C25519":"C448").append(".sqlite3");
+
+	remove(dbFilenameAlice.data()); // delete the database file if already exists
+	remove(dbFilenameBob.data()); // delete the database file if already exists
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+
+	limeCallback callback([&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				});
+
+	// store the streamed output: device Id and DR message
+	std::vector<std::pair<std::string, std::vector<uint8_t>>> streamed{};
+	size_t streamedBeforeCompletion = 0;
+	limeRecipientCallback recipientCallback([&streamed](const lime::RecipientData &recipient) {
+					streamed.emplace_back(recipient.deviceId, recipient.DRmessage);
+				});
+	// final callback: check we already got the streamed output when it is called
+	limeCallback streamingCallback([&counters, &streamed, &streamedBeforeCompletion](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					streamedBeforeCompletion = streamed.size();
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				});
+
+	try {
+		// create Manager and devices
+		auto aliceManager = std::unique_ptr<LimeManager>(new LimeManager(dbFilenameAlice, X3DHServerPost));
+		auto bobManager = std::unique_ptr<LimeManager>(new LimeManager(dbFilenameBob, X3DHServerPost));
+
+		auto aliceDevice1 = lime_tester::makeRandomDeviceName("alice.d1.");
+		std::vector<std::shared_ptr<std::string>> bobDevices{};
+		bobDevices.push_back(lime_tester::makeRandomDeviceName("bob.d1."));
+		bobDevices.push_back(lime_tester::makeRandomDeviceName("bob.d2."));
+		bobDevices.push_back(lime_tester::makeRandomDeviceName("bob.d3."));
+		auto unknownDevice = lime_tester::makeRandomDeviceName("unknown.");
+
+		aliceManager->create_user(*aliceDevice1, x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+		for (const auto &bobDevice : bobDevices) {
+			bobManager->create_user(*bobDevice, x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+		}
+		expected_success += 4;
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, expected_success,lime_tester::wait_for_timeout));
+		if (counters.operation_failed != 0) return; // skip the end of the test if we can't do this
+
+		for (size_t messageIndex=0; messageIndex<2; messageIndex++) {
+			streamed.clear();
+			streamedBeforeCompletion = 0;
+
+			auto aliceRecipients = make_shared<std::vector<RecipientData>>();
+			for (const auto &bobDevice : bobDevices) {
+				aliceRecipients->emplace_back(*bobDevice);
+			}
+			aliceRecipients->emplace_back(*unknownDevice);
+			auto aliceMessage = make_shared<const std::vector<uint8_t>>(lime_tester::messages_pattern[messageIndex].begin(), lime_tester::messages_pattern[messageIndex].end());
+			auto aliceCipherMessage = make_shared<std::vector<uint8_t>>();
+
+			aliceManager->encrypt(*aliceDevice1, make_shared<const std::string>("bob"), aliceRecipients, aliceMessage, aliceCipherMessage, recipientCallback, streamingCallback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+
+			// all bob's devices were streamed before completion, not the unknown one
+			BC_ASSERT_EQUAL((int)streamed.size(), (int)bobDevices.size(), int, "%d");
+			BC_ASSERT_EQUAL((int)streamedBeforeCompletion, (int)bobDevices.size(), int, "%d");
+			BC_ASSERT_TRUE((*aliceRecipients)[bobDevices.size()].peerStatus == lime::PeerDeviceStatus::fail);
+
+			// streamed output matches the final one and decrypts
+			for (const auto &streamedRecipient : streamed) {
+				bool found = false;
+				for (const auto &recipient : *aliceRecipients) {
+					if (recipient.deviceId == streamedRecipient.first) {
+						found = true;
+						BC_ASSERT_TRUE(recipient.DRmessage == streamedRecipient.second);
+					}
+				}
+				BC_ASSERT_TRUE(found);
+				BC_ASSERT_TRUE(streamedRecipient.first != *unknownDevice);
+
+				std::vector<uint8_t> receivedMessage{};
+				BC_ASSERT_TRUE(bobManager->decrypt(streamedRecipient.first, "bob", *aliceDevice1, streamedRecipient.second, *aliceCipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+				auto receivedMessageString = std::string{receivedMessage.begin(), receivedMessage.end()};
+				BC_ASSERT_TRUE(receivedMessageString == lime_tester::messages_pattern[messageIndex]);
+			}
+		}
+
+		// cleaning
+		if (cleanDatabase) {
+			aliceManager->delete_user(*aliceDevice1, callback);
+			for (const auto &bobDevice : bobDevices) {
+				bobManager->delete_user(*bobDevice, callback);
+			}
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success+4,lime_tester::wait_for_timeout));
+			remove(dbFilenameAlice.data());
+			remove(dbFilenameBob.data());
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void lime_encrypt_streaming(void) {
+#ifdef EC25519_ENABLED
+	lime_encrypt_streaming_test(lime::CurveId::c25519, "lime_encrypt_streaming", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c25519_server_port).data());
+#endif
+#ifdef EC448_ENABLED
+	lime_encrypt_streaming_test(lime::CurveId::c448, "lime_encrypt_streaming", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c448_server_port).data());
+#endif
+}
+
+/**
+ * Scenario: alice.d1 encrypts to bob.d1, with whom she already has a session, and bob.d2 which requires a key bundle
+ * - bob.d1 DR message is streamed right away, before the X3DH server responds
+ * - bob.d2 DR message is streamed when its key bundle arrives
+ * - both use the cipherMessage produced in the first phase
+ */
+static void lime_encrypt_partial_test(const lime::CurveId curve, const std::string &dbBaseFilename, const std::string &x3dh_server_url) {
+	// create DB
+	std::string dbFilenameAlice{dbBaseFilename};
+	dbFilenameAlice.append(".alice.").append((curve==CurveId::c25519)?"C25519":"C448").append(".sqlite3");
+	std::string dbFilenameBob{dbBaseFilename};
+	dbFilenameBob.append(".bob.").append((curve==CurveId::c25519)?"C25519":"C448").append(".sqlite3");
+
+	remove(dbFilenameAlice.data()); // delete the database file if already exists
+	remove(dbFilenameBob.data()); // delete the database file if already exists
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+
+	limeCallback callback([&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				});
+
+	// store the streamed output: device Id and DR message
+	std::vector<std::pair<std::string, std::vector<uint8_t>>> streamed{};
+	limeRecipientCallback recipientCallback([&streamed](const lime::RecipientData &recipient) {
+					streamed.emplace_back(recipient.deviceId, recipient.DRmessage);
+				});
+
+	try {
+		// create Manager and devices
+		auto aliceManager = std::unique_ptr<LimeManager>(new LimeManager(dbFilenameAlice, X3DHServerPost));
+		auto bobManager = std::unique_ptr<LimeManager>(new LimeManager(dbFilenameBob, X3DHServerPost));
+
+		auto aliceDevice1 = lime_tester::makeRandomDeviceName("alice.d1.");
+		auto bobDevice1 = lime_tester::makeRandomDeviceName("bob.d1.");
+		auto bobDevice2 = lime_tester::makeRandomDeviceName("bob.d2.");
+
+		aliceManager->create_user(*aliceDevice1, x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+		bobManager->create_user(*bobDevice1, x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+		bobManager->create_user(*bobDevice2, x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+		expected_success += 3;
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, expected_success,lime_tester::wait_for_timeout));
+		if (counters.operation_failed != 0) return; // skip the end of the test if we can't do this
+
+		// alice encrypts a first message to bob.d1 only: open the session
+		auto aliceRecipients = make_shared<std::vector<RecipientData>>();
+		aliceRecipients->emplace_back(*bobDevice1);
+		auto aliceMessage = make_shared<const std::vector<uint8_t>>(lime_tester::messages_pattern[0].begin(), lime_tester::messages_pattern[0].end());
+		auto aliceCipherMessage = make_shared<std::vector<uint8_t>>();
+		aliceManager->encrypt(*aliceDevice1, make_shared<const std::string>("bob"), aliceRecipients, aliceMessage, aliceCipherMessage, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+		std::vector<uint8_t> receivedMessage{};
+		BC_ASSERT_TRUE(bobManager->decrypt(*bobDevice1, "bob", *aliceDevice1, (*aliceRecipients)[0].DRmessage, *aliceCipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+
+		// alice encrypts a second message to both bob's devices, forcing the cipher message policy so both phases must share it
+		aliceRecipients = make_shared<std::vector<RecipientData>>();
+		aliceRecipients->emplace_back(*bobDevice1);
+		aliceRecipients->emplace_back(*bobDevice2);
+		aliceMessage = make_shared<const std::vector<uint8_t>>(lime_tester::messages_pattern[1].begin(), lime_tester::messages_pattern[1].end());
+		aliceCipherMessage = make_shared<std::vector<uint8_t>>();
+		aliceManager->encrypt(*aliceDevice1, make_shared<const std::string>("bob"), aliceRecipients, aliceMessage, aliceCipherMessage, recipientCallback, callback, lime::EncryptionPolicy::cipherMessage);
+
+		// bob.d1 was given away before the X3DH server responded with bob.d2 key bundle, the cipherMessage is ready
+		BC_ASSERT_EQUAL((int)streamed.size(), 1, int, "%d");
+		if (streamed.size() != 1) return;
+		BC_ASSERT_TRUE(streamed[0].first == *bobDevice1);
+		BC_ASSERT_EQUAL((int)counters.operation_success, expected_success, int, "%d");
+		BC_ASSERT_FALSE(aliceCipherMessage->empty());
+		auto firstPhaseCipherMessage = *aliceCipherMessage;
+
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+
+		// now bob.d2 is done too, the cipherMessage did not change and both decrypt
+		BC_ASSERT_EQUAL((int)streamed.size(), 2, int, "%d");
+		BC_ASSERT_TRUE(*aliceCipherMessage == firstPhaseCipherMessage);
+		for (const auto &streamedRecipient : streamed) {
+			receivedMessage.clear();
+			BC_ASSERT_TRUE(bobManager->decrypt(streamedRecipient.first, "bob", *aliceDevice1, streamedRecipient.second, *aliceCipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+			auto receivedMessageString = std::string{receivedMessage.begin(), receivedMessage.end()};
+			BC_ASSERT_TRUE(receivedMessageString == lime_tester::messages_pattern[1]);
+		}
+		for (const auto &recipient : *aliceRecipients) {
+			BC_ASSERT_FALSE(recipient.DRmessage.empty());
+		}
+
+		// cleaning
+		if (cleanDatabase) {
+			aliceManager->delete_user(*aliceDevice1, callback);
+			bobManager->delete_user(*bobDevice1, callback);
+			bobManager->delete_user(*bobDevice2, callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success+3,lime_tester::wait_for_timeout));
+			remove(dbFilenameAlice.data());
+			remove(dbFilenameBob.data());
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void lime_encrypt_partial(void) {
+#ifdef EC25519_ENABLED
+	lime_encrypt_partial_test(lime::CurveId::c25519, "lime_encrypt_partial", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c25519_server_port).data());
+#endif
+#ifdef EC448_ENABLED
+	lime_encrypt_partial_test(lime::CurveId::c448, "lime_encrypt_partial", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c448_server_port).data());
+#endif
+}
+
+/**
+ * Scenario: negative cache of peer devices without key bundle
+ * - alice encrypts to bob.d1 and bob.d2, bob.d2 is not registered on the X3DH server: it fails
+ * - alice encrypts to bob.d2 again, it fails right away without asking the X3DH server
+ * - bob.d2 registers and sends a message to alice, alice decrypts it
+ * - alice can now encrypt to bob.d2
+ */
+static void lime_noBundle_cache_test(const lime::CurveId curve, const std::string &dbBaseFilename, const std::string &x3dh_server_url, bool continuousSession=true) {
+	// create DB
+	std::string dbFilenameAlice{dbBaseFilename};
+	dbFilenameAlice.append(".alice.").append((curve==CurveId::c25519)?"C25519":"C448").append(".sqlite3");
+	std::string dbFilenameBob{dbBaseFilename};
+	dbFilenameBob.append(".bob.").append((curve==CurveId::c25519)?"C25519":"C448").append(".sqlite3");
+
+	remove(dbFilenameAlice.data()); // delete the database file if already exists
+	remove(dbFilenameBob.data()); // delete the database file if already exists
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+	int expected_fail=0;
+
+	limeCallback callback([&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				});
+
+	try {
+		// create Manager and devices
+		auto aliceManager = std::unique_ptr<LimeManager>(new LimeManager(dbFilenameAlice, X3DHServerPost));
+		auto bobManager = std::unique_ptr<LimeManager>(new LimeManager(dbFilenameBob, X3DHServerPost));
+
+		auto aliceDevice1 = lime_tester::makeRandomDeviceName("alice.d1.");
+		auto bobDevice1 = lime_tester::makeRandomDeviceName("bob.d1.");
+		auto bobDevice2 = lime_tester::makeRandomDeviceName("bob.d2."); // not registered on the X3DH server yet
+
+		aliceManager->create_user(*aliceDevice1, x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+		bobManager->create_user(*bobDevice1, x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+		expected_success += 2;
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, expected_success,lime_tester::wait_for_timeout));
+		if (counters.operation_failed != 0) return; // skip the end of the test if we can't do this
+
+		// alice encrypts to bob.d1 and bob.d2: the X3DH server has no key bundle for bob.d2
+		auto aliceRecipients = make_shared<std::vector<RecipientData>>();
+		aliceRecipients->emplace_back(*bobDevice1);
+		aliceRecipients->emplace_back(*bobDevice2);
+		auto aliceMessage = make_shared<const std::vector<uint8_t>>(lime_tester::messages_pattern[0].begin(), lime_tester::messages_pattern[0].end());
+		auto aliceCipherMessage = make_shared<std::vector<uint8_t>>();
+		aliceManager->encrypt(*aliceDevice1, make_shared<const std::string>("bob"), aliceRecipients, aliceMessage, aliceCipherMessage, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+		BC_ASSERT_TRUE((*aliceRecipients)[0].peerStatus != lime::PeerDeviceStatus::fail);
+		BC_ASSERT_TRUE((*aliceRecipients)[1].peerStatus == lime::PeerDeviceStatus::fail);
+
+		/* destroy and reload the Managers(tests the negative cache is correctly saved/load from local Storage) */
+		if (!continuousSession) { managersClean (aliceManager, bobManager, dbFilenameAlice, dbFilenameBob);}
+
+		// encrypt again to bob.d2 only: the callback is called before returning as the X3DH server is not contacted
+		aliceRecipients = make_shared<std::vector<RecipientData>>();
+		aliceRecipients->emplace_back(*bobDevice2);
+		aliceCipherMessage = make_shared<std::vector<uint8_t>>();
+		aliceManager->encrypt(*aliceDevice1, make_shared<const std::string>("bob"), aliceRecipients, aliceMessage, aliceCipherMessage, callback);
+		BC_ASSERT_EQUAL(counters.operation_failed, ++expected_fail, int, "%d");
+		BC_ASSERT_TRUE((*aliceRecipients)[0].peerStatus == lime::PeerDeviceStatus::fail);
+
+		// bob.d2 registers and sends a message to alice
+		bobManager->create_user(*bobDevice2, x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+		auto bobRecipients = make_shared<std::vector<RecipientData>>();
+		bobRecipients->emplace_back(*aliceDevice1);
+		auto bobCipherMessage = make_shared<std::vector<uint8_t>>();
+		bobManager->encrypt(*bobDevice2, make_shared<const std::string>("alice"), bobRecipients, aliceMessage, bobCipherMessage, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+		std::vector<uint8_t> receivedMessage{};
+		BC_ASSERT_TRUE(aliceManager->decrypt(*aliceDevice1, "alice", *bobDevice2, (*bobRecipients)[0].DRmessage, *bobCipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+
+		if (!continuousSession) { managersClean (aliceManager, bobManager, dbFilenameAlice, dbFilenameBob);}
+
+		// alice can now reach bob.d2
+		aliceRecipients = make_shared<std::vector<RecipientData>>();
+		aliceRecipients->emplace_back(*bobDevice2);
+		aliceCipherMessage = make_shared<std::vector<uint8_t>>();
+		aliceManager->encrypt(*aliceDevice1, make_shared<const std::string>("bob"), aliceRecipients, aliceMessage, aliceCipherMessage, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+		receivedMessage.clear();
+		BC_ASSERT_TRUE(bobManager->decrypt(*bobDevice2, "bob", *aliceDevice1, (*aliceRecipients)[0].DRmessage, *aliceCipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+
+		// cleaning
+		if (cleanDatabase) {
+			aliceManager->delete_user(*aliceDevice1, callback);
+			bobManager->delete_user(*bobDevice1, callback);
+			bobManager->delete_user(*bobDevice2, callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success+3,lime_tester::wait_for_timeout));
+			remove(dbFilenameAlice.data());
+			remove(dbFilenameBob.data());
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void lime_noBundle_cache(void) {
+#ifdef EC25519_ENABLED
+	lime_noBundle_cache_test(lime::CurveId::c25519, "lime_noBundle_cache", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c25519_server_port).data());
+	lime_noBundle_cache_test(lime::CurveId::c25519, "lime_noBundle_cache", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c25519_server_port).data(), false);
+#endif
+#ifdef EC448_ENABLED
+	lime_noBundle_cache_test(lime::CurveId::c448, "lime_noBundle_cache", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c448_server_port).data());
+	lime_noBundle_cache_test(lime::CurveId::c448, "lime_noBundle_cache", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c448_server_port).data(), false);
+#endif
+}
+
+/* Alice encrypt to bob, bob replies so session is fully established, then alice encrypt until the session is renewed
+ * - alice encrypt sendingChainRenewal messages, bob never reply, none of them hold the X3DH init message
+ * - alice keeps encrypting: the session renewal is performed in background and a message holds the X3DH init before maxSendingChain is reached
+ * - bob decrypts it
+ */
+static void lime_session_renewal_test(const lime::CurveId curve, const std::string &dbBaseFilename, const std::string &x3dh_server_url) {
+	// create DB
+	std::string dbFilenameAlice{dbBaseFilename};
+	dbFilenameAlice.append(".alice.").append((curve==CurveId::c25519)?"C25519":"C448").append(".sqlite3");
+	std::string dbFilenameBob{dbBaseFilename};
+	dbFilenameBob.append(".bob.").append((curve==CurveId::c25519)?"C25519":"C448").append(".sqlite3");
+
+	remove(dbFilenameAlice.data()); // delete the database file if already exists
+	remove(dbFilenameBob.data()); // delete the database file if already exists
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+
+	limeCallback callback([&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				});
+	try {
+		// create Manager
+		auto aliceManager = std::unique_ptr<LimeManager>(new LimeManager(dbFilenameAlice, X3DHServerPost));
+		auto bobManager = std::unique_ptr<LimeManager>(new LimeManager(dbFilenameBob, X3DHServerPost));
+
+		// create Random devices names
+		auto aliceDevice1 = lime_tester::makeRandomDeviceName("alice.d1.");
+		auto bobDevice1 = lime_tester::makeRandomDeviceName("bob.d1.");
+
+		// create users alice.d1 and bob.d1
+		aliceManager->create_user(*aliceDevice1, x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+		bobManager->create_user(*bobDevice1, x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+		expected_success +=2; // we have two asynchronous operation on going
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, expected_success,lime_tester::wait_for_timeout));
+		if (counters.operation_failed == 1) return; // skip the end of the test if we can't do this
+
+		// alice.d1 encrypts a message for bob.d1, bob replies
+		auto aliceRecipients = make_shared<std::vector<RecipientData>>();
+		aliceRecipients->emplace_back(*bobDevice1);
+		auto aliceMessage = make_shared<std::vector<uint8_t>>(lime_tester::messages_pattern[0].begin(), lime_tester::messages_pattern[0].end());
+		auto aliceCipherMessage = make_shared<std::vector<uint8_t>>();
+		aliceManager->encrypt(*aliceDevice1, make_shared<const std::string>("bob"), aliceRecipients, aliceMessage, aliceCipherMessage, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+		std::vector<uint8_t> receivedMessage{};
+		BC_ASSERT_TRUE(bobManager->decrypt(*bobDevice1, "bob", *aliceDevice1, (*aliceRecipients)[0].DRmessage, *aliceCipherMessage, receivedMessage) == lime::PeerDeviceStatus::unknown);
+
+		auto bobRecipients = make_shared<std::vector<RecipientData>>();
+		bobRecipients->emplace_back(*aliceDevice1);
+		auto bobMessage = make_shared<const std::vector<uint8_t>>(lime_tester::messages_pattern[1].begin(), lime_tester::messages_pattern[1].end());
+		auto bobCipherMessage = make_shared<std::vector<uint8_t>>();
+		bobManager->encrypt(*bobDevice1, make_shared<const std::string>("alice"), bobRecipients, bobMessage, bobCipherMessage, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+		BC_ASSERT_TRUE(aliceManager->decrypt(*aliceDevice1, "alice", *bobDevice1, (*bobRecipients)[0].DRmessage, *bobCipherMessage, receivedMessage) == lime::PeerDeviceStatus::untrusted);
+
+		// Alice encrypt sendingChainRenewal messages to bob, none shall have the X3DH init
+		for (auto i=0; i<lime::settings::sendingChainRenewal; i++) {
+			aliceMessage->assign(lime_tester::messages_pattern[i%lime_tester::messages_pattern.size()].begin(), lime_tester::messages_pattern[i%lime_tester::messages_pattern.size()].end());
+			aliceCipherMessage->clear();
+			aliceManager->encrypt(*aliceDevice1, make_shared<const std::string>("bob"), aliceRecipients, aliceMessage, aliceCipherMessage, callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+			BC_ASSERT_FALSE(lime_tester::DR_message_holdsX3DHInit((*aliceRecipients)[0].DRmessage)); // it's an ongoing session, no X3DH init
+		}
+
+		// keep encrypting while processing the X3DH server response: the session shall be renewed before the sending chain reaches its maximum
+		bool renewed = false;
+		for (auto i=lime::settings::sendingChainRenewal; i<lime::settings::maxSendingChain && !renewed; i++) {
+			belle_sip_stack_sleep(bc_stack, 10);
+			aliceMessage->assign(lime_tester::messages_pattern[0].begin(), lime_tester::messages_pattern[0].end());
+			aliceCipherMessage->clear();
+			aliceManager->encrypt(*aliceDevice1, make_shared<const std::string>("bob"), aliceRecipients, aliceMessage, aliceCipherMessage, callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+			renewed = lime_tester::DR_message_holdsX3DHInit((*aliceRecipients)[0].DRmessage);
+		}
+		BC_ASSERT_TRUE(renewed);
+
+		// bob decrypts the first message of the new session
+		receivedMessage.clear();
+		BC_ASSERT_TRUE(bobManager->decrypt(*bobDevice1, "bob", *aliceDevice1, (*aliceRecipients)[0].DRmessage, *aliceCipherMessage, receivedMessage) == lime::PeerDeviceStatus::untrusted);
+		std::string receivedMessageString{receivedMessage.begin(), receivedMessage.end()};
+		BC_ASSERT_TRUE(receivedMessageString == lime_tester::messages_pattern[0]);
+
+		// delete the users so the remote DB will be clean too
+		if (cleanDatabase) {
+			aliceManager->delete_user(*aliceDevice1, callback);
+			bobManager->delete_user(*bobDevice1, callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success+2,lime_tester::wait_for_timeout));
+			remove(dbFilenameAlice.data());
+			remove(dbFilenameBob.data());
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void lime_session_renewal(void) {
+	if (lime::settings::sendingChainRenewal == lime::settings::maxSendingChain) return; // proactive renewal is disabled
+#ifdef EC25519_ENABLED
+	lime_session_renewal_test(lime::CurveId::c25519, "lime_session_renewal", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c25519_server_port).data());
+#endif
+#ifdef EC448_ENABLED
+	lime_session_renewal_test(lime::CurveId::c448, "lime_session_renewal", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c448_server_port).data());
+#endif
+}
+
+/*
+ * Scenario: the background session renewal fails, the renewal is requested again and succeeds once the X3DH server answers
+ * - alice.d1 and bob.d1 establish a session
+ * - alice encrypts to bob until the session needs a renewal while the X3DH server answers with an error
+ * - the X3DH server is back: the renewal is requested again and the session is renewed before its sending chain reaches its maximum
+ */
+static void lime_session_renewal_failure_test(const lime::CurveId curve, const std::string &dbBaseFilename, const std::string &x3dh_server_url) {
+	// create DB
+	std::string dbFilenameAlice{dbBaseFilename};
+	dbFilenameAlice.append(".alice.").append((curve==CurveId::c25519)?"C25519":"C448").append(".sqlite3");
+	std::string dbFilenameBob{dbBaseFilename};
+	dbFilenameBob.append(".bob.").append((curve==CurveId::c25519)?"C25519":"C448").append(".sqlite3");
+
+	remove(dbFilenameAlice.data()); // delete the database file if already exists
+	remove(dbFilenameBob.data()); // delete the database file if already exists
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+	// reset the global setting for Http Link
+	httpLink = HttpLinkStatus::ok;
+
+	limeCallback callback([&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				});
+	try {
+		// create Manager, alice's one can simulate X3DH server failures
+		auto aliceManager = std::unique_ptr<LimeManager>(new LimeManager(dbFilenameAlice, X3DHServerPost_Failing_Simulation));
+		auto bobManager = std::unique_ptr<LimeManager>(new LimeManager(dbFilenameBob, X3DHServerPost));
+
+		// create Random devices names
+		auto aliceDevice1 = lime_tester::makeRandomDeviceName("alice.d1.");
+		auto bobDevice1 = lime_tester::makeRandomDeviceName("bob.d1.");
+
+		// create users alice.d1 and bob.d1
+		aliceManager->create_user(*aliceDevice1, x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+		bobManager->create_user(*bobDevice1, x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+		expected_success +=2; // we have two asynchronous operation on going
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, expected_success,lime_tester::wait_for_timeout));
+		if (counters.operation_failed != 0) return; // skip the end of the test if we can't do this
+
+		// alice.d1 encrypts a message for bob.d1, bob replies
+		auto aliceRecipients = make_shared<std::vector<RecipientData>>();
+		aliceRecipients->emplace_back(*bobDevice1);
+		auto aliceMessage = make_shared<std::vector<uint8_t>>(lime_tester::messages_pattern[0].begin(), lime_tester::messages_pattern[0].end());
+		auto aliceCipherMessage = make_shared<std::vector<uint8_t>>();
+		aliceManager->encrypt(*aliceDevice1, make_shared<const std::string>("bob"), aliceRecipients, aliceMessage, aliceCipherMessage, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+		std::vector<uint8_t> receivedMessage{};
+		BC_ASSERT_TRUE(bobManager->decrypt(*bobDevice1, "bob", *aliceDevice1, (*aliceRecipients)[0].DRmessage, *aliceCipherMessage, receivedMessage) == lime::PeerDeviceStatus::unknown);
+
+		auto bobRecipients = make_shared<std::vector<RecipientData>>();
+		bobRecipients->emplace_back(*aliceDevice1);
+		auto bobMessage = make_shared<const std::vector<uint8_t>>(lime_tester::messages_pattern[1].begin(), lime_tester::messages_pattern[1].end());
+		auto bobCipherMessage = make_shared<std::vector<uint8_t>>();
+		bobManager->encrypt(*bobDevice1, make_shared<const std::string>("alice"), bobRecipients, bobMessage, bobCipherMessage, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+		BC_ASSERT_TRUE(aliceManager->decrypt(*aliceDevice1, "alice", *bobDevice1, (*bobRecipients)[0].DRmessage, *bobCipherMessage, receivedMessage) == lime::PeerDeviceStatus::untrusted);
+
+		// the X3DH server fails: alice encrypts past sendingChainRenewal, each renewal request fails, the session is not renewed
+		httpLink = HttpLinkStatus::server_error;
+		for (auto i=0; i<lime::settings::sendingChainRenewal+2; i++) {
+			aliceCipherMessage->clear();
+			aliceManager->encrypt(*aliceDevice1, make_shared<const std::string>("bob"), aliceRecipients, aliceMessage, aliceCipherMessage, callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+			BC_ASSERT_FALSE(lime_tester::DR_message_holdsX3DHInit((*aliceRecipients)[0].DRmessage)); // it's an ongoing session, no X3DH init
+		}
+		BC_ASSERT_EQUAL(counters.operation_failed, 0, int, "%d"); // renewal requests have no callback, their failure is not reported
+
+		// the X3DH server is back: a failed renewal does not leave the device flagged, it is requested again and the session renewed
+		httpLink = HttpLinkStatus::ok;
+		bool renewed = false;
+		for (auto i=lime::settings::sendingChainRenewal+2; i<lime::settings::maxSendingChain && !renewed; i++) {
+			belle_sip_stack_sleep(bc_stack, 10);
+			aliceCipherMessage->clear();
+			aliceManager->encrypt(*aliceDevice1, make_shared<const std::string>("bob"), aliceRecipients, aliceMessage, aliceCipherMessage, callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+			renewed = lime_tester::DR_message_holdsX3DHInit((*aliceRecipients)[0].DRmessage);
+		}
+		BC_ASSERT_TRUE(renewed);
+
+		// bob decrypts the first message of the new session
+		receivedMessage.clear();
+		BC_ASSERT_TRUE(bobManager->decrypt(*bobDevice1, "bob", *aliceDevice1, (*aliceRecipients)[0].DRmessage, *aliceCipherMessage, receivedMessage) == lime::PeerDeviceStatus::untrusted);
+		std::string receivedMessageString{receivedMessage.begin(), receivedMessage.end()};
+		BC_ASSERT_TRUE(receivedMessageString == lime_tester::messages_pattern[0]);
+
+		// delete the users so the remote DB will be clean too
+		if (cleanDatabase) {
+			aliceManager->delete_user(*aliceDevice1, callback);
+			bobManager->delete_user(*bobDevice1, callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success+2,lime_tester::wait_for_timeout));
+			remove(dbFilenameAlice.data());
+			remove(dbFilenameBob.data());
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+	httpLink = HttpLinkStatus::ok;
+}
+
+static void lime_session_renewal_failure(void) {
+	if (lime::settings::sendingChainRenewal == lime::settings::maxSendingChain) return; // proactive renewal is disabled
+#ifdef EC25519_ENABLED
+	lime_session_renewal_failure_test(lime::CurveId::c25519, "lime_session_renewal_failure", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c25519_server_port).data());
+#endif
+#ifdef EC448_ENABLED
+	lime_session_renewal_failure_test(lime::CurveId::c448, "lime_session_renewal_failure", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c448_server_port).data());
+#endif
+}
+
+/*
+ * Scenario
+ * - Create alice.d1 and enough bob devices for the X3DH sessions initialisation to be spread over several threads
+ * - Alice encrypts to all bob devices, all the key bundles are fetched in one request
+ * - Each bob device decrypts its message
+ */
+static void lime_encrypt_many_devices_test(const lime::CurveId curve, const std::string &dbBaseFilename, const std::string &x3dh_server_url) {
+	// create DB
+	std::string dbFilenameAlice{dbBaseFilename};
+	dbFilenameAlice.append(".alice.").append((curve==CurveId::c25519)?"C25519":"C448").append(".sqlite3");
+	std::string dbFilenameBob{dbBaseFilename};
+	dbFilenameBob.append(".bob.").append((curve==CurveId::c25519)?"C25519":"C448").append(".sqlite3");
+
+	remove(dbFilenameAlice.data()); // delete the database file if already exists
+	remove(dbFilenameBob.data()); // delete the database file if already exists
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+
+	limeCallback callback([&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				});
+
+	try {
+		// create Manager and devices: two workers at least, and an uneven repartition
+		auto aliceManager = std::unique_ptr<LimeManager>(new LimeManager(dbFilenameAlice, X3DHServerPost));
+		auto bobManager = std::unique_ptr<LimeManager>(new LimeManager(dbFilenameBob, X3DHServerPost));
+
+		auto aliceDevice1 = lime_tester::makeRandomDeviceName("alice.d1.");
+		std::vector<std::shared_ptr<std::string>> bobDevices{};
+		const size_t bobDevicesCount = 2*std::max(lime::settings::X3DH_parallelInitThreshold, static_cast<size_t>(2)) + 1;
+
+		aliceManager->create_user(*aliceDevice1, x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+		for (size_t i=0; i<bobDevicesCount; i++) {
+			bobDevices.push_back(lime_tester::makeRandomDeviceName("bob.d"));
+			bobManager->create_user(*(bobDevices.back()), x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+		}
+		expected_success += 1 + (int)bobDevicesCount;
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, expected_success,lime_tester::wait_for_timeout));
+		if (counters.operation_failed != 0) return; // skip the end of the test if we can't do this
+
+		auto aliceRecipients = make_shared<std::vector<RecipientData>>();
+		for (const auto &bobDevice : bobDevices) {
+			aliceRecipients->emplace_back(*bobDevice);
+		}
+		auto aliceMessage = make_shared<const std::vector<uint8_t>>(lime_tester::messages_pattern[0].begin(), lime_tester::messages_pattern[0].end());
+		auto aliceCipherMessage = make_shared<std::vector<uint8_t>>();
+
+		aliceManager->encrypt(*aliceDevice1, make_shared<const std::string>("bob"), aliceRecipients, aliceMessage, aliceCipherMessage, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+
+		// every bob device got a message holding a X3DH init and decrypts it
+		for (auto &recipient : *aliceRecipients) {
+			BC_ASSERT_TRUE(recipient.peerStatus == lime::PeerDeviceStatus::unknown);
+			BC_ASSERT_TRUE(lime_tester::DR_message_holdsX3DHInit(recipient.DRmessage));
+			std::vector<uint8_t> receivedMessage{};
+			BC_ASSERT_TRUE(bobManager->decrypt(recipient.deviceId, "bob", *aliceDevice1, recipient.DRmessage, *aliceCipherMessage, receivedMessage) == lime::PeerDeviceStatus::unknown);
+			auto receivedMessageString = std::string{receivedMessage.begin(), receivedMessage.end()};
+			BC_ASSERT_TRUE(receivedMessageString == lime_tester::messages_pattern[0]);
+		}
+
+		// cleaning
+		if (cleanDatabase) {
+			aliceManager->delete_user(*aliceDevice1, callback);
+			for (const auto &bobDevice : bobDevices) {
+				bobManager->delete_user(*bobDevice, callback);
+			}
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success+1+(int)bobDevicesCount,lime_tester::wait_for_timeout));
+			remove(dbFilenameAlice.data());
+			remove(dbFilenameBob.data());
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void lime_encrypt_many_devices(void) {
+#ifdef EC25519_ENABLED
+	lime_encrypt_many_devices_test(lime::CurveId::c25519, "lime_encrypt_many_devices", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c25519_server_port).data());
+#endif
+#ifdef EC448_ENABLED
+	lime_encrypt_many_devices_test(lime::CurveId::c448, "lime_encrypt_many_devices", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c448_server_port).data());
+#endif
+}
+
+/**
+ * Scenario: encrypt and decrypt using the span forms of LimeManager encrypt and decrypt
+ * - alice encrypts to bob from buffers she owns, a too small cipherMessage buffer is rejected giving the size needed
+ * - bob decrypts in a buffer he provides, a too small output buffer is rejected without consuming the message
+ * - bob answers with the payload in the DR message, streaming the recipients, alice decrypts it with the span and the vector forms of decrypt
+ */
+static void lime_span_api_test(const lime::CurveId curve, const std::string &dbBaseFilename, const std::string &x3dh_server_url) {
+	// create DB
+	std::string dbFilenameAlice{dbBaseFilename};
+	dbFilenameAlice.append(".alice.").append((curve==CurveId::c25519)?"C25519":"C448").append(".sqlite3");
+	std::string dbFilenameBob{dbBaseFilename};
+	dbFilenameBob.append(".bob.").append((curve==CurveId::c25519)?"C25519":"C448").append(".sqlite3");
+
+	remove(dbFilenameAlice.data()); // delete the database file if already exists
+	remove(dbFilenameBob.data()); // delete the database file if already exists
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+
+	limeCallback callback([&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				});
+
+	try {
+		// create Manager and devices
+		auto aliceManager = std::unique_ptr<LimeManager>(new LimeManager(dbFilenameAlice, X3DHServerPost));
+		auto bobManager = std::unique_ptr<LimeManager>(new LimeManager(dbFilenameBob, X3DHServerPost));
+		auto aliceDevice1 = lime_tester::makeRandomDeviceName("alice.d1.");
+		auto bobDevice1 = lime_tester::makeRandomDeviceName("bob.d1.");
+
+		aliceManager->create_user(*aliceDevice1, x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+		bobManager->create_user(*bobDevice1, x3dh_server_url, curve, lime_tester::OPkInitialBatchSize, callback);
+		expected_success += 2;
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, expected_success,lime_tester::wait_for_timeout));
+		if (counters.operation_failed != 0) return; // skip the end of the test if we can't do this
+
+		// alice encrypts from her own buffers, they stay alive until the callback is called
+		const std::string bobUserId{"bob"};
+		std::vector<RecipientData> aliceRecipients{};
+		aliceRecipients.emplace_back(*bobDevice1);
+		const std::vector<uint8_t> aliceMessage{lime_tester::messages_pattern[0].begin(), lime_tester::messages_pattern[0].end()};
+		std::vector<uint8_t> aliceCipherMessage(aliceMessage.size());
+		size_t aliceCipherMessageSize = 0;
+
+		// a too small cipherMessage buffer fails right away, giving the size needed
+		aliceManager->encrypt(*aliceDevice1, bobUserId, aliceRecipients, aliceMessage, aliceCipherMessage, aliceCipherMessageSize, callback, lime::EncryptionPolicy::cipherMessage);
+		BC_ASSERT_EQUAL(counters.operation_failed, 1, int, "%d");
+		BC_ASSERT_EQUAL(aliceCipherMessageSize, LimeManager::cipherMessageMaximumSize(aliceMessage.size()), size_t, "%zu");
+		BC_ASSERT_TRUE(aliceRecipients[0].DRmessage.empty());
+		counters.operation_failed = 0;
+
+		aliceCipherMessage.resize(aliceCipherMessageSize);
+		aliceManager->encrypt(*aliceDevice1, bobUserId, aliceRecipients, aliceMessage, aliceCipherMessage, aliceCipherMessageSize, callback, lime::EncryptionPolicy::cipherMessage);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+		BC_ASSERT_TRUE(aliceRecipients[0].peerStatus == lime::PeerDeviceStatus::unknown);
+		BC_ASSERT_TRUE(lime_tester::DR_message_holdsX3DHInit(aliceRecipients[0].DRmessage));
+		BC_ASSERT_EQUAL(aliceCipherMessageSize, aliceCipherMessage.size(), size_t, "%zu"); // no compression: the cipherMessage uses the whole buffer
+
+		// a too small output buffer is rejected before the message key is consumed, giving the size needed
+		std::vector<uint8_t> receivedBuffer(aliceMessage.size()-1);
+		size_t receivedSize = 0;
+		BC_ASSERT_TRUE(bobManager->decrypt(*bobDevice1, bobUserId, *aliceDevice1, aliceRecipients[0].DRmessage, aliceCipherMessage, receivedBuffer, receivedSize) == lime::PeerDeviceStatus::fail);
+		BC_ASSERT_EQUAL(receivedSize, aliceMessage.size(), size_t, "%zu");
+
+		// so the message can still be decrypted, in a buffer of the exact size
+		receivedBuffer.resize(receivedSize);
+		BC_ASSERT_TRUE(bobManager->decrypt(*bobDevice1, bobUserId, *aliceDevice1, aliceRecipients[0].DRmessage, aliceCipherMessage, receivedBuffer, receivedSize) == lime::PeerDeviceStatus::unknown);
+		BC_ASSERT_TRUE(std::string(receivedBuffer.begin(), receivedBuffer.begin()+receivedSize) == lime_tester::messages_pattern[0]);
+
+		// bob answers with the payload in the DR message
+		const std::string aliceUserId{"alice"};
+		std::vector<RecipientData> bobRecipients{};
+		bobRecipients.emplace_back(*aliceDevice1);
+		const std::vector<uint8_t> bobMessage{lime_tester::messages_pattern[1].begin(), lime_tester::messages_pattern[1].end()};
+		std::vector<uint8_t> bobCipherMessage(LimeManager::cipherMessageMaximumSize(bobMessage.size()));
+		size_t bobCipherMessageSize = bobCipherMessage.size();
+		size_t streamedRecipients = 0;
+		limeRecipientCallback recipientCallback([&streamedRecipients, &aliceDevice1](const lime::RecipientData &recipient) {
+					BC_ASSERT_TRUE(recipient.deviceId == *aliceDevice1);
+					BC_ASSERT_FALSE(recipient.DRmessage.empty());
+					streamedRecipients++;
+				});
+
+		bobManager->encrypt(*bobDevice1, aliceUserId, bobRecipients, bobMessage, bobCipherMessage, bobCipherMessageSize, recipientCallback, callback, lime::EncryptionPolicy::DRMessage);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+		BC_ASSERT_EQUAL(streamedRecipients, 1, size_t, "%zu");
+		BC_ASSERT_TRUE(bobRecipients[0].peerStatus == lime::PeerDeviceStatus::untrusted);
+		BC_ASSERT_FALSE(lime_tester::DR_message_holdsX3DHInit(bobRecipients[0].DRmessage));
+		BC_ASSERT_EQUAL(bobCipherMessageSize, 0, size_t, "%zu");
+
+		// alice decrypts it in a buffer sized on the DR message, no cipherMessage
+		receivedBuffer.resize(bobRecipients[0].DRmessage.size());
+		BC_ASSERT_TRUE(aliceManager->decrypt(*aliceDevice1, aliceUserId, *bobDevice1, bobRecipients[0].DRmessage, lime::span<const uint8_t>{}, receivedBuffer, receivedSize) == lime::PeerDeviceStatus::untrusted);
+		BC_ASSERT_TRUE(std::string(receivedBuffer.begin(), receivedBuffer.begin()+receivedSize) == lime_tester::messages_pattern[1]);
+
+		// messages encrypted from borrowed buffers are decrypted by the vector form of decrypt too
+		bobRecipients[0].DRmessage.clear();
+		bobRecipients[0].peerStatus = lime::PeerDeviceStatus::unknown;
+		bobManager->encrypt(*bobDevice1, aliceUserId, bobRecipients, bobMessage, bobCipherMessage, bobCipherMessageSize, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+		bobCipherMessage.resize(bobCipherMessageSize);
+		std::vector<uint8_t> receivedMessage{};
+		BC_ASSERT_TRUE(aliceManager->decrypt(*aliceDevice1, aliceUserId, *bobDevice1, bobRecipients[0].DRmessage, bobCipherMessage, receivedMessage) == lime::PeerDeviceStatus::untrusted);
+		BC_ASSERT_TRUE(std::string(receivedMessage.begin(), receivedMessage.end()) == lime_tester::messages_pattern[1]);
+
+		// cleaning
+		if (cleanDatabase) {
+			aliceManager->delete_user(*aliceDevice1, callback);
+			bobManager->delete_user(*bobDevice1, callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success+2,lime_tester::wait_for_timeout));
+			remove(dbFilenameAlice.data());
+			remove(dbFilenameBob.data());
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void lime_span_api(void) {
+#ifdef EC25519_ENABLED
+	lime_span_api_test(lime::CurveId::c25519, "lime_span_api", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c25519_server_port).data());
+#endif
+#ifdef EC448_ENABLED
+	lime_span_api_test(lime::CurveId::c448, "lime_span_api", std::string("https://").append(lime_tester::test_x3dh_server_url).append(":").append(lime_tester::test_x3dh_c448_server_port).data());
+#endif
+}
+
 static test_t tests[] = {
 	TEST_NO_TAG("Basic", x3dh_basic),
 	TEST_NO_TAG("User Management", user_management),
@@ -4238,10 +5177,13 @@ static test_t tests[] = {
 	TEST_NO_TAG("Multi devices queued encryption", x3dh_multidev_operation_queue),
 	TEST_NO_TAG("Multiple sessions", x3dh_multiple_DRsessions),
 	TEST_NO_TAG("Sending chain limit", x3dh_sending_chain_limit),
+	TEST_NO_TAG("Session renewal", lime_session_renewal),
+	TEST_NO_TAG("Session renewal failure", lime_session_renewal_failure),
 	TEST_NO_TAG("Without OPk", x3dh_without_OPk),
 	TEST_NO_TAG("Update - clean MK", lime_update_clean_MK),
 	TEST_NO_TAG("Update - SPk", lime_update_SPk),
 	TEST_NO_TAG("Update - OPk", lime_update_OPk),
+	TEST_NO_TAG("Update - OPk adaptive", lime_update_OPk_adaptive),
 	TEST_NO_TAG("Update - Republish", lime_update_republish),
 	TEST_NO_TAG("get self Identity Key", lime_getSelfIk),
 	TEST_NO_TAG("Verified Status", lime_identityVerifiedStatus),
@@ -4252,6 +5194,11 @@ static test_t tests[] = {
 	TEST_NO_TAG("Identity theft", lime_identity_theft),
 	TEST_NO_TAG("Multithread", lime_multithread),
 	TEST_NO_TAG("Session cancel", lime_session_cancel),
+	TEST_NO_TAG("Encrypt streaming", lime_encrypt_streaming),
+	TEST_NO_TAG("Encrypt partial progress", lime_encrypt_partial),
+	TEST_NO_TAG("Encrypt to many devices", lime_encrypt_many_devices),
+	TEST_NO_TAG("Span API", lime_span_api),
+	TEST_NO_TAG("No key bundle cache", lime_noBundle_cache),
 	TEST_NO_TAG("DB Migration", lime_db_migration)
 };
 